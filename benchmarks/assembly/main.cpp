@@ -0,0 +1,198 @@
+#include <iostream>
+#include <stdexcept>
+
+#include "matrix.h"
+#include "common_time_period.h"
+
+// Assembles the stiffness matrix of a 3D Poisson problem (trilinear hexahedral
+// elements on an n x n x n grid) into a CooMatrix, once with the map storage
+// and once with the triplet storage, and converts both to CSR. Then it
+// assembles the matrix by OpenMP threads with CooAssembler, and reassembles
+// the CSR matrix in place, with and without scatter maps.
+//
+// usage: bench-assembly [n]
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                              -1
+
+// element stiffness matrix of the Laplace operator on the unit cube
+void element_matrix(double **mat)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        for (int j = 0; j < 8; j++)
+        {
+            // number of coordinates in which the vertices i and j differ
+            int d = ((i ^ j) & 1) + (((i ^ j) >> 1) & 1) + (((i ^ j) >> 2) & 1);
+            static const double values[4] = {1./3., 0., -1./12., -1./12.};
+            mat[i][j] = values[d];
+        }
+    }
+}
+
+// global indices of the vertices of the element (ex, ey, ez)
+void element_dofs(int n, int ex, int ey, int ez, int *idx)
+{
+    int m = n + 1;
+    for (int v = 0; v < 8; v++)
+        idx[v] = (ex + (v & 1)) + m*((ey + ((v >> 1) & 1)) + m*(ez + ((v >> 2) & 1)));
+}
+
+void assemble(Matrix *A, int n)
+{
+    double **mat = _new_matrix<double>(8, 8);
+    element_matrix(mat);
+
+    int idx[8];
+    for (int ez = 0; ez < n; ez++)
+        for (int ey = 0; ey < n; ey++)
+            for (int ex = 0; ex < n; ex++)
+            {
+                element_dofs(n, ex, ey, ez, idx);
+                A->add_block(idx, 8, idx, 8, mat);
+            }
+
+    delete[] mat;
+}
+
+// reassembly into the existing pattern with cached scatter maps
+void assemble(CSRMatrix *A, int n, ScatterMap *maps)
+{
+    double **mat = _new_matrix<double>(8, 8);
+    element_matrix(mat);
+
+    int idx[8];
+    int e = 0;
+    for (int ez = 0; ez < n; ez++)
+        for (int ey = 0; ey < n; ey++)
+            for (int ex = 0; ex < n; ex++, e++)
+            {
+                element_dofs(n, ex, ey, ez, idx);
+                A->add_block(idx, 8, idx, 8, mat, &maps[e]);
+            }
+
+    delete[] mat;
+}
+
+void bench(const char *label, CooMatrix::CooMatrixStorage storage, int n)
+{
+    int ndof = (n+1)*(n+1)*(n+1);
+    TimePeriod timer;
+
+    CooMatrix A(ndof, false, storage);
+    if (storage == CooMatrix::CooMatrixStorage_Triplets)
+        A.reserve(64*n*n*n);
+    timer.tick_reset();
+    assemble(&A, n);
+    timer.tick();
+    double t_assemble = timer.last();
+
+    CSRMatrix B(&A);
+    timer.tick();
+    double t_convert = timer.last();
+
+    printf("%-10s ndof: %9i  nnz: %10i  assemble: %8.3f s  to CSR: %8.3f s  total: %8.3f s\n",
+           label, ndof, B.get_nnz(), t_assemble, t_convert, t_assemble + t_convert);
+}
+
+// the elements are split among the threads, each one adds into its buffer
+void assemble_parallel(CooAssembler *assembler, int n, int threads)
+{
+#pragma omp parallel num_threads(threads)
+    {
+        double **mat = _new_matrix<double>(8, 8);
+        element_matrix(mat);
+
+        int idx[8];
+#pragma omp for schedule(static)
+        for (int e = 0; e < n*n*n; e++)
+        {
+            element_dofs(n, e % n, (e / n) % n, e / (n*n), idx);
+            assembler->add_block(idx, 8, idx, 8, mat);
+        }
+
+        delete[] mat;
+    }
+}
+
+void bench_parallel(int n, int threads)
+{
+    int ndof = (n+1)*(n+1)*(n+1);
+    TimePeriod timer;
+
+    CooMatrix A(ndof);
+    CooAssembler assembler(&A, threads);
+    timer.tick_reset();
+    assemble_parallel(&assembler, n, threads);
+    timer.tick();
+    double t_assemble = timer.last();
+    assembler.merge();
+    timer.tick();
+    double t_merge = timer.last();
+
+    CSRMatrix B(&A);
+    timer.tick();
+    double t_convert = timer.last();
+
+    char label[32];
+    sprintf(label, "%i threads", threads);
+    printf("%-10s ndof: %9i  nnz: %10i  assemble: %8.3f s  merge: %8.3f s  to CSR: %8.3f s  total: %8.3f s\n",
+           label, ndof, B.get_nnz(), t_assemble, t_merge, t_convert, t_assemble + t_merge + t_convert);
+}
+
+void bench_refill(int n)
+{
+    int ndof = (n+1)*(n+1)*(n+1);
+    TimePeriod timer;
+
+    CooMatrix A(ndof, false, CooMatrix::CooMatrixStorage_Triplets);
+    assemble(&A, n);
+    CSRMatrix B(&A);
+
+    // binary search for every entry
+    timer.tick_reset();
+    B.set_zero();
+    assemble((Matrix *) &B, n);
+    timer.tick();
+    double t_search = timer.last();
+
+    // the first pass records the scatter maps, the second one uses them
+    ScatterMap *maps = new ScatterMap[n*n*n];
+    B.set_zero();
+    timer.tick();
+    assemble(&B, n, maps);
+    timer.tick();
+    double t_record = timer.last();
+    B.set_zero();
+    timer.tick();
+    assemble(&B, n, maps);
+    timer.tick();
+    double t_scatter = timer.last();
+    delete[] maps;
+
+    printf("CSR refill ndof: %9i  nnz: %10i  search: %8.3f s  record maps: %8.3f s  scatter: %8.3f s\n",
+           ndof, B.get_nnz(), t_search, t_record, t_scatter);
+}
+
+int main(int argc, char* argv[])
+{
+    int n = 40;
+    if (argc > 1)
+        n = atoi(argv[1]);
+
+    try {
+        bench("map", CooMatrix::CooMatrixStorage_Map, n);
+        bench("triplets", CooMatrix::CooMatrixStorage_Triplets, n);
+        for (int threads = 1; threads <= get_num_threads(); threads *= 2)
+            bench_parallel(n, threads);
+        bench_refill(n);
+
+        return ERROR_SUCCESS;
+    } catch(std::exception const &ex) {
+        std::cout << "Exception raised: " << ex.what() << "\n";
+        return ERROR_FAILURE;
+    } catch(...) {
+        std::cout << "Exception raised." << "\n";
+        return ERROR_FAILURE;
+    }
+}
@@ -0,0 +1,161 @@
+#include <iostream>
+#include <stdexcept>
+
+#include "matrix.h"
+#include "solvers.h"
+#include "common_time_period.h"
+
+// Compares the preconditioners of CommonSolverCG on the 7-point Laplacian on
+// an n^3 grid and the 5-point Laplacian on a grid with about as many nodes.
+// For each preconditioner it reports the iterations, the time of the solve
+// and the time per iteration, and the same for a plain CG loop that
+// allocates its vectors and calls mat_dot() and vec_dot() (the CG of
+// hermes_common before the preconditioners), so that the effect of the fused
+// kernels can be seen. The rhs is A 1, the tolerance 1e-8 ||b||.
+//
+// usage: bench-cg [n]
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                              -1
+
+// plain CG, returns the number of iterations
+int plain_cg(Matrix *A, double *x, double tol, int maxiter)
+{
+    int n_dof = A->get_size();
+    double *r = new double[n_dof];
+    double *p = new double[n_dof];
+    double *help_vec = new double[n_dof];
+    for (int i=0; i < n_dof; i++) r[i] = x[i];
+    for (int i=0; i < n_dof; i++) p[i] = r[i];
+    for (int i=0; i < n_dof; i++) x[i] = 0;
+
+    int iter_current = 0;
+    while (1)
+    {
+        mat_dot(A, p, help_vec, n_dof);
+        double r_times_r = vec_dot(r, r, n_dof);
+        double alpha = r_times_r / vec_dot(p, help_vec, n_dof);
+        for (int i=0; i < n_dof; i++) {
+            x[i] += alpha*p[i];
+            r[i] -= alpha*help_vec[i];
+        }
+        double r_times_r_new = vec_dot(r, r, n_dof);
+        iter_current++;
+        if (sqrt(r_times_r_new) < tol || iter_current >= maxiter) break;
+        double beta = r_times_r_new/r_times_r;
+        for (int i=0; i < n_dof; i++) p[i] = r[i] + beta*p[i];
+    }
+
+    delete[] r;
+    delete[] p;
+    delete[] help_vec;
+    return iter_current;
+}
+
+// max norm of x - 1
+double error(double *x, int size)
+{
+    double err = 0;
+    for (int i = 0; i < size; i++)
+        err = std::max(err, fabs(x[i] - 1.));
+    return err;
+}
+
+void report(const char *label, int iters, double time, double err)
+{
+    printf("  %-20s %6d iterations %9.4f s %9.4f ms/iteration   error %.2e\n", label, iters, time,
+           1000 * time / std::max(iters, 1), err);
+}
+
+void run(const char *name, CSRMatrix *A)
+{
+    int size = A->get_size();
+    double *ones = new double[size];
+    double *b = new double[size];
+    double *x = new double[size];
+    for (int i = 0; i < size; i++)
+        ones[i] = 1.;
+    A->times_vector(ones, b, size);
+    double tol = 1e-8 * sqrt(vec_dot(b, b, size));
+
+    printf("\n%s: size %i, nnz %i, %i threads\n", name, size, A->get_nnz(), get_num_threads());
+
+    std::copy(b, b + size, x);
+    TimePeriod timer;
+    int iters = plain_cg(A, x, tol, 10000);
+    timer.tick();
+    report("plain CG", iters, timer.last(), error(x, size));
+
+    const char *labels[4] = {"PCG, none", "PCG, Jacobi", "PCG, SSOR", "PCG, ILU(0)"};
+    CommonSolverPreconditioner types[4] = {CommonSolverPreconditioner_None, CommonSolverPreconditioner_Jacobi,
+                                           CommonSolverPreconditioner_SSOR, CommonSolverPreconditioner_ILU};
+    CommonSolverCG cg;
+    for (int t = 0; t < 4; t++)
+    {
+        cg.set_preconditioner(types[t]);
+        // the first solve allocates the work vectors
+        std::copy(b, b + size, x);
+        cg.solve(A, x, tol, 10000);
+        std::copy(b, b + size, x);
+        timer.tick(H2D_SKIP);
+        cg.solve(A, x, tol, 10000);
+        timer.tick();
+        report(labels[t], cg.get_num_iters(), timer.last(), error(x, size));
+    }
+
+    delete[] ones;
+    delete[] b;
+    delete[] x;
+}
+
+int main(int argc, char* argv[])
+{
+    int n = 40;
+    if (argc > 1)
+        n = atoi(argv[1]);
+
+    try {
+        int size = n*n*n;
+        CooMatrix L3(size, false, CooMatrix::CooMatrixStorage_Triplets);
+        for (int z = 0; z < n; z++)
+            for (int y = 0; y < n; y++)
+                for (int x = 0; x < n; x++)
+                {
+                    int i = x + n*(y + n*z);
+                    L3.add(i, i, 6.);
+                    if (x > 0) L3.add(i, i - 1, -1.);
+                    if (x + 1 < n) L3.add(i, i + 1, -1.);
+                    if (y > 0) L3.add(i, i - n, -1.);
+                    if (y + 1 < n) L3.add(i, i + n, -1.);
+                    if (z > 0) L3.add(i, i - n*n, -1.);
+                    if (z + 1 < n) L3.add(i, i + n*n, -1.);
+                }
+        CSRMatrix A3(&L3);
+        L3.free_data();
+        run("3D Laplacian", &A3);
+
+        int m = (int) sqrt((double) size);
+        CooMatrix L2(m*m, false, CooMatrix::CooMatrixStorage_Triplets);
+        for (int y = 0; y < m; y++)
+            for (int x = 0; x < m; x++)
+            {
+                int i = x + m*y;
+                L2.add(i, i, 4.);
+                if (x > 0) L2.add(i, i - 1, -1.);
+                if (x + 1 < m) L2.add(i, i + 1, -1.);
+                if (y > 0) L2.add(i, i - m, -1.);
+                if (y + 1 < m) L2.add(i, i + m, -1.);
+            }
+        CSRMatrix A2(&L2);
+        L2.free_data();
+        run("2D Laplacian", &A2);
+
+        return ERROR_SUCCESS;
+    } catch(std::exception const &ex) {
+        std::cout << "Exception raised: " << ex.what() << "\n";
+        return ERROR_FAILURE;
+    } catch(...) {
+        std::cout << "Exception raised." << "\n";
+        return ERROR_FAILURE;
+    }
+}
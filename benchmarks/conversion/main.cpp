@@ -0,0 +1,111 @@
+#include <iostream>
+#include <stdexcept>
+
+#include "matrix.h"
+#include "common_time_period.h"
+
+// Measures the scaling of the conversion kernels (coo_to_csr, csr_to_csc,
+// csc_to_csr, csr_sum_duplicates) with the number of threads. The triplets
+// come from the assembly of trilinear hexahedral elements on an n x n x n
+// grid, i.e. 64 n^3 triplets with duplicates (16.8M for the default n = 64).
+//
+// usage: bench-conversion [n] [max_threads]
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                              -1
+
+void run(int size, int nnz, int *row, int *col, double *data, int num_threads)
+{
+    int *Ap = new int[size + 1];
+    int *Ai = new int[nnz];
+    double *Ax = new double[nnz];
+    int *Bp = new int[size + 1];
+    int *Bi = new int[nnz];
+    double *Bx = new double[nnz];
+
+    if (num_threads == 1)
+        set_parallel_mode(ParallelMode_Serial);
+    else
+    {
+        set_parallel_mode(ParallelMode_Parallel);
+        set_num_threads(num_threads);
+    }
+
+    TimePeriod timer;
+    timer.tick_reset();
+    coo_to_csr(size, nnz, row, col, data, Ap, Ai, Ax);
+    timer.tick();
+    double t_coo_csr = timer.last();
+    csr_to_csc(size, nnz, Ap, Ai, Ax, Bp, Bi, Bx);
+    timer.tick();
+    double t_csr_csc = timer.last();
+    csc_to_csr(size, nnz, Bp, Bi, Bx, Ap, Ai, Ax);
+    timer.tick();
+    double t_csc_csr = timer.last();
+    int unique = csr_sum_duplicates(size, Ap, Ai, Ax, Bp, Bi, Bx);
+    timer.tick();
+    double t_sum = timer.last();
+
+    printf("threads: %3i  coo->csr: %7.3f s  csr->csc: %7.3f s  csc->csr: %7.3f s  sum duplicates: %7.3f s (%i entries)\n",
+           get_num_threads(), t_coo_csr, t_csr_csc, t_csc_csr, t_sum, unique);
+
+    delete[] Ap;
+    delete[] Ai;
+    delete[] Ax;
+    delete[] Bp;
+    delete[] Bi;
+    delete[] Bx;
+}
+
+int main(int argc, char* argv[])
+{
+    int n = 64;
+    if (argc > 1)
+        n = atoi(argv[1]);
+    int max_threads = get_num_threads();
+    if (argc > 2)
+        max_threads = atoi(argv[2]);
+
+    try {
+        int m = n + 1;
+        int size = m*m*m;
+        int nnz = 64*n*n*n;
+        int *row = new int[nnz];
+        int *col = new int[nnz];
+        double *data = new double[nnz];
+
+        int count = 0;
+        int idx[8];
+        for (int ez = 0; ez < n; ez++)
+            for (int ey = 0; ey < n; ey++)
+                for (int ex = 0; ex < n; ex++)
+                {
+                    for (int v = 0; v < 8; v++)
+                        idx[v] = (ex + (v & 1)) + m*((ey + ((v >> 1) & 1)) + m*(ez + ((v >> 2) & 1)));
+                    for (int i = 0; i < 8; i++)
+                        for (int j = 0; j < 8; j++)
+                        {
+                            row[count] = idx[i];
+                            col[count] = idx[j];
+                            data[count] = (i == j) ? 1. : -1./7.;
+                            count++;
+                        }
+                }
+
+        printf("size: %i  nnz (with duplicates): %i\n", size, nnz);
+        for (int t = 1; t <= max_threads; t *= 2)
+            run(size, nnz, row, col, data, t);
+
+        delete[] row;
+        delete[] col;
+        delete[] data;
+
+        return ERROR_SUCCESS;
+    } catch(std::exception const &ex) {
+        std::cout << "Exception raised: " << ex.what() << "\n";
+        return ERROR_FAILURE;
+    } catch(...) {
+        std::cout << "Exception raised." << "\n";
+        return ERROR_FAILURE;
+    }
+}
@@ -0,0 +1,115 @@
+#include <iostream>
+#include <stdexcept>
+
+#include "matrix.h"
+#include "solvers.h"
+#include "common_time_period.h"
+
+// Compares the preconditioners and restart lengths of CommonSolverGMRES on
+// the upwind convection-diffusion operator on an n x n grid (nonsymmetric,
+// the convection c is given relative to the diffusion). For each solve it
+// reports the iterations, the time of the solve and the time per iteration,
+// and the same for the GMRES of IML++ (CommonSolverSparseLib) with ILU(0).
+// The rhs is A 1, the tolerance 1e-8 ||b||.
+//
+// usage: bench-gmres [n] [c]
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                              -1
+
+// max norm of x - 1
+double error(double *x, int size)
+{
+    double err = 0;
+    for (int i = 0; i < size; i++)
+        err = std::max(err, fabs(x[i] - 1.));
+    return err;
+}
+
+void report(const char *label, int iters, double time, double err)
+{
+    printf("  %-24s %6d iterations %9.4f s %9.4f ms/iteration   error %.2e\n", label, iters, time,
+           1000 * time / std::max(iters, 1), err);
+}
+
+int main(int argc, char* argv[])
+{
+    int n = 200;
+    double c = 2.;
+    if (argc > 1)
+        n = atoi(argv[1]);
+    if (argc > 2)
+        c = atof(argv[2]);
+
+    try {
+        int size = n*n;
+        CooMatrix L(size, false, CooMatrix::CooMatrixStorage_Triplets);
+        for (int y = 0; y < n; y++)
+            for (int x = 0; x < n; x++)
+            {
+                int i = x + n*y;
+                L.add(i, i, 4. + 2.*c);
+                if (x > 0) L.add(i, i - 1, -1. - c);
+                if (x + 1 < n) L.add(i, i + 1, -1.);
+                if (y > 0) L.add(i, i - n, -1. - c);
+                if (y + 1 < n) L.add(i, i + n, -1.);
+            }
+        CSRMatrix A(&L);
+        L.free_data();
+
+        double *ones = new double[size];
+        double *b = new double[size];
+        double *x = new double[size];
+        for (int i = 0; i < size; i++)
+            ones[i] = 1.;
+        A.times_vector(ones, b, size);
+
+        printf("convection-diffusion, c = %g: size %i, nnz %i, %i threads\n", c, size, A.get_nnz(), get_num_threads());
+
+        const char *labels[4] = {"none", "Jacobi", "SSOR", "ILU(0)"};
+        CommonSolverPreconditioner types[4] = {CommonSolverPreconditioner_None, CommonSolverPreconditioner_Jacobi,
+                                               CommonSolverPreconditioner_SSOR, CommonSolverPreconditioner_ILU};
+        int restarts[2] = {20, 50};
+        CommonSolverGMRES gmres;
+        TimePeriod timer;
+        char label[64];
+        for (int r = 0; r < 2; r++)
+            for (int t = 0; t < 4; t++)
+            {
+                gmres.set_restart(restarts[r]);
+                gmres.set_preconditioner(types[t]);
+                // the first solve allocates the work arrays
+                std::copy(b, b + size, x);
+                gmres.solve(&A, x, 1e-8, 10000);
+                std::copy(b, b + size, x);
+                timer.tick(H2D_SKIP);
+                gmres.solve(&A, x, 1e-8, 10000);
+                timer.tick();
+                sprintf(label, "GMRES(%i), %s", restarts[r], labels[t]);
+                report(label, gmres.get_num_iters(), timer.last(), error(x, size));
+            }
+
+        CommonSolverSparseLib iml;
+        iml.set_method(CommonSolverSparseLib::CommonSolverSparseLibSolver_GeneralizedMinimumResidual);
+        iml.set_restart(20);
+        iml.set_tolerance(1e-8);
+        iml.set_maxiter(10000);
+        std::copy(b, b + size, x);
+        timer.tick(H2D_SKIP);
+        iml.solve(&A, x);
+        timer.tick();
+        report("IML++ GMRES(20), ILU(0)", iml.get_num_iters(), timer.last(), error(x, size));
+
+        delete[] ones;
+        delete[] b;
+        delete[] x;
+
+        return ERROR_SUCCESS;
+    } catch(std::exception const &ex) {
+        std::cout << "Exception raised: " << ex.what() << "\n";
+        return ERROR_FAILURE;
+    } catch(...) {
+        std::cout << "Exception raised." << "\n";
+        return ERROR_FAILURE;
+    }
+}
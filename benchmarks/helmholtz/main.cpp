@@ -0,0 +1,133 @@
+#include <iostream>
+#include <stdexcept>
+
+#include "matrix.h"
+#include "solvers.h"
+#include "common_time_period.h"
+
+// Compares the complex iterative solvers (COCG of CommonSolverCG,
+// CommonSolverBiCGSTAB and CommonSolverGMRES) with and without ILU(0) on
+// the Helmholtz operator with absorption on an n x n grid, -Laplace u - k^2 u
+// + i s u with k^2 and s given relative to the diagonal of the 5-point
+// Laplacian (complex symmetric, indefinite for large k). For each solve it
+// reports the iterations, the time of the solve and the time per iteration.
+// The rhs is A x with x = 1 + i, the tolerance 1e-8 ||b||.
+//
+// usage: bench-helmholtz [n] [k^2] [s]
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                              -1
+
+// max norm of x - (1 + i)
+double error(cplx *x, int size)
+{
+    double err = 0;
+    for (int i = 0; i < size; i++)
+        err = std::max(err, std::abs(x[i] - cplx(1., 1.)));
+    return err;
+}
+
+void report(const char *label, int iters, double time, double err)
+{
+    printf("  %-24s %6d iterations %9.4f s %9.4f ms/iteration   error %.2e\n", label, iters, time,
+           1000 * time / std::max(iters, 1), err);
+}
+
+int main(int argc, char* argv[])
+{
+    int n = 200;
+    double k2 = 0.5;
+    double s = 0.5;
+    if (argc > 1)
+        n = atoi(argv[1]);
+    if (argc > 2)
+        k2 = atof(argv[2]);
+    if (argc > 3)
+        s = atof(argv[3]);
+
+    try {
+        int size = n*n;
+        CooMatrix L(size, true, CooMatrix::CooMatrixStorage_Triplets);
+        for (int y = 0; y < n; y++)
+            for (int x = 0; x < n; x++)
+            {
+                int i = x + n*y;
+                L.add(i, i, cplx(4. - k2, s));
+                if (x > 0) L.add(i, i - 1, cplx(-1.));
+                if (x + 1 < n) L.add(i, i + 1, cplx(-1.));
+                if (y > 0) L.add(i, i - n, cplx(-1.));
+                if (y + 1 < n) L.add(i, i + n, cplx(-1.));
+            }
+        CSRMatrix A(&L);
+        L.free_data();
+
+        cplx *exact = new cplx[size];
+        cplx *b = new cplx[size];
+        cplx *x = new cplx[size];
+        for (int i = 0; i < size; i++)
+            exact[i] = cplx(1., 1.);
+        A.times_vector(exact, b, size);
+        // the tolerance of CommonSolverCG is absolute
+        double norm_b = 0;
+        for (int i = 0; i < size; i++)
+            norm_b += std::norm(b[i]);
+        norm_b = sqrt(norm_b);
+
+        printf("Helmholtz, k^2 = %g, s = %g: size %i, nnz %i, %i threads\n", k2, s, size, A.get_nnz(),
+               get_num_threads());
+
+        const char *labels[2] = {"none", "ILU(0)"};
+        CommonSolverPreconditioner types[2] = {CommonSolverPreconditioner_None, CommonSolverPreconditioner_ILU};
+        CommonSolverCG cocg;
+        CommonSolverBiCGSTAB bicgstab;
+        CommonSolverGMRES gmres;
+        TimePeriod timer;
+        char label[64];
+        for (int t = 0; t < 2; t++)
+        {
+            cocg.set_preconditioner(types[t]);
+            bicgstab.set_preconditioner(types[t]);
+            gmres.set_preconditioner(types[t]);
+
+            // the first solves allocate the work arrays
+            std::copy(b, b + size, x);
+            cocg.solve(&A, x, 1e-8 * norm_b, 10000);
+            std::copy(b, b + size, x);
+            timer.tick(H2D_SKIP);
+            cocg.solve(&A, x, 1e-8 * norm_b, 10000);
+            timer.tick();
+            sprintf(label, "COCG, %s", labels[t]);
+            report(label, cocg.get_num_iters(), timer.last(), error(x, size));
+
+            std::copy(b, b + size, x);
+            bicgstab.solve(&A, x, 1e-8, 10000);
+            std::copy(b, b + size, x);
+            timer.tick(H2D_SKIP);
+            bicgstab.solve(&A, x, 1e-8, 10000);
+            timer.tick();
+            sprintf(label, "BiCGSTAB, %s", labels[t]);
+            report(label, bicgstab.get_num_iters(), timer.last(), error(x, size));
+
+            std::copy(b, b + size, x);
+            gmres.solve(&A, x, 1e-8, 10000);
+            std::copy(b, b + size, x);
+            timer.tick(H2D_SKIP);
+            gmres.solve(&A, x, 1e-8, 10000);
+            timer.tick();
+            sprintf(label, "GMRES(20), %s", labels[t]);
+            report(label, gmres.get_num_iters(), timer.last(), error(x, size));
+        }
+
+        delete[] exact;
+        delete[] b;
+        delete[] x;
+
+        return ERROR_SUCCESS;
+    } catch(std::exception const &ex) {
+        std::cout << "Exception raised: " << ex.what() << "\n";
+        return ERROR_FAILURE;
+    } catch(...) {
+        std::cout << "Exception raised." << "\n";
+        return ERROR_FAILURE;
+    }
+}
@@ -0,0 +1,163 @@
+#include <iostream>
+#include <stdexcept>
+
+#include "matrix.h"
+#include "matrixio.h"
+#include "solvers.h"
+#include "common_time_period.h"
+
+// Compares double and float storage of the matrix values. For each matrix it
+// reports the time of one product with CSRMatrix, CSRMatrixFloat and
+// CSCMatrixFloat and the relative error of the float products, then solves
+// A x = A 1 by SparseLib++ CGS with the ILU factors in double and in float
+// and reports the times and the errors of x. The matrices are the fidap001
+// and fidap029 matrices from tests/matrix-io (or the Harwell-Boeing files
+// given on the command line) and trilinear hexahedral elements on a uniform
+// grid of n^3 nodes.
+//
+// usage: bench-mixed-precision [n] [file.rua ...]
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                              -1
+
+#ifndef FIDAP_DIR
+#define FIDAP_DIR "tests/matrix-io"
+#endif
+
+// time of one product in ms
+double time_product(Matrix *A, double *x, double *y, int reps)
+{
+    int size = A->get_size();
+    A->times_vector(x, y, size);
+    TimePeriod timer;
+    timer.tick_reset();
+    for (int r = 0; r < reps; r++)
+        A->times_vector(x, y, size);
+    timer.tick();
+    return 1000 * timer.last() / reps;
+}
+
+// relative error of y in the max norm
+double rel_error(double *y, double *z, int size)
+{
+    double err = 0, norm = 0;
+    for (int i = 0; i < size; i++)
+    {
+        err = std::max(err, fabs(y[i] - z[i]));
+        norm = std::max(norm, fabs(z[i]));
+    }
+    return err / norm;
+}
+
+void run_solve(const char *label, CSRMatrix *A,
+               CommonSolverSparseLib::CommonSolverSparseLibPreconditioner preconditioner)
+{
+    int size = A->get_size();
+    double *x = new double[size];
+    double *ones = new double[size];
+    for (int i = 0; i < size; i++)
+        ones[i] = 1.;
+    A->times_vector(ones, x, size);
+
+    CommonSolverSparseLib solver;
+    solver.set_preconditioner(preconditioner);
+    solver.set_tolerance(1e-10);
+    TimePeriod timer;
+    try {
+        solver.solve(A, x);
+        timer.tick();
+        printf("  %-20s %5d iterations %9.4f s   error %.2e\n", label, solver.get_num_iters(), timer.last(),
+               rel_error(x, ones, size));
+    } catch(std::exception const &ex) {
+        printf("  %-20s %s\n", label, ex.what());
+    }
+
+    delete[] x;
+    delete[] ones;
+}
+
+void run(const char *name, CSRMatrix *A)
+{
+    int size = A->get_size();
+    int nnz = A->get_nnz();
+    int reps = std::max(10, 100000000 / (nnz + 1));
+
+    double *x = new double[size];
+    double *y = new double[size];
+    double *z = new double[size];
+    for (int i = 0; i < size; i++)
+        x[i] = 1. + (i % 7);
+
+    printf("\n%s: size %i, nnz %i, %i products\n", name, size, nnz, reps);
+    double t_csr = time_product(A, x, z, reps);
+    printf("  CSR double           %9.4f ms\n", t_csr);
+
+    CSRMatrixFloat F(A);
+    double t = time_product(&F, x, y, reps);
+    printf("  CSR float            %9.4f ms  (%.2fx CSR, error %.2e)\n", t, t_csr / t, rel_error(y, z, size));
+
+    CSCMatrixFloat G(A);
+    t = time_product(&G, x, y, reps);
+    printf("  CSC float            %9.4f ms  (%.2fx CSR, error %.2e)\n", t, t_csr / t, rel_error(y, z, size));
+
+    run_solve("CGS, ILU double", A, CommonSolverSparseLib::CommonSolverSparseLibPreconditioner_ILU);
+    run_solve("CGS, ILU float", A, CommonSolverSparseLib::CommonSolverSparseLibPreconditioner_ILUFloat);
+
+    delete[] x;
+    delete[] y;
+    delete[] z;
+}
+
+int main(int argc, char* argv[])
+{
+    int n = 40;
+    if (argc > 1)
+        n = atoi(argv[1]);
+
+    try {
+        if (argc > 2)
+            for (int i = 2; i < argc; i++)
+            {
+                CSRMatrix *A = read_hb_csr(argv[i]);
+                run(argv[i], A);
+                delete A;
+            }
+        else
+        {
+            const char *files[2] = {FIDAP_DIR "/fidap001.rua", FIDAP_DIR "/fidap029.rua"};
+            for (int i = 0; i < 2; i++)
+            {
+                CSRMatrix *A = read_hb_csr(files[i]);
+                run(files[i], A);
+                delete A;
+            }
+        }
+
+        // trilinear elements on an n x n x n grid of nodes, with a dominant
+        // diagonal so that the solves converge
+        int size = n*n*n;
+        CooMatrix Q1(size, false, CooMatrix::CooMatrixStorage_Triplets);
+        for (int z = 0; z < n; z++)
+            for (int y = 0; y < n; y++)
+                for (int x = 0; x < n; x++)
+                    for (int dz = -1; dz <= 1; dz++)
+                        for (int dy = -1; dy <= 1; dy++)
+                            for (int dx = -1; dx <= 1; dx++)
+                            {
+                                if (x + dx < 0 || x + dx >= n || y + dy < 0 || y + dy >= n || z + dz < 0 || z + dz >= n)
+                                    continue;
+                                Q1.add(x + n*(y + n*z), (x + dx) + n*((y + dy) + n*(z + dz)), (dx || dy || dz) ? -1. : 27.);
+                            }
+        CSRMatrix A(&Q1);
+        Q1.free_data();
+        run("hexahedra", &A);
+
+        return ERROR_SUCCESS;
+    } catch(std::exception const &ex) {
+        std::cout << "Exception raised: " << ex.what() << "\n";
+        return ERROR_FAILURE;
+    } catch(...) {
+        std::cout << "Exception raised." << "\n";
+        return ERROR_FAILURE;
+    }
+}
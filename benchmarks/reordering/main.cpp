@@ -0,0 +1,168 @@
+#include <iostream>
+#include <stdexcept>
+
+#include "matrix.h"
+#include "matrixio.h"
+#include "solvers.h"
+#include "common_time_period.h"
+
+// Reverse Cuthill-McKee reordering. For each matrix it reports the bandwidth
+// and the time of one product before and after the reordering, and the time
+// of the SparseLib++ CGS solve with ILU without and with the reordering.
+// The matrices are the fidap001 and fidap029 matrices from tests/matrix-io
+// (or the Harwell-Boeing files given on the command line) and trilinear
+// hexahedral elements on a grid of n^3 nodes, once numbered along the grid
+// and once with a random numbering like on an unstructured mesh.
+//
+// usage: bench-reordering [n] [file.rua ...]
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                              -1
+
+#ifndef FIDAP_DIR
+#define FIDAP_DIR "tests/matrix-io"
+#endif
+
+// time of one product in ms
+double time_product(Matrix *A, double *x, double *y, int reps)
+{
+    int size = A->get_size();
+    A->times_vector(x, y, size);
+    TimePeriod timer;
+    timer.tick_reset();
+    for (int r = 0; r < reps; r++)
+        A->times_vector(x, y, size);
+    timer.tick();
+    return 1000 * timer.last() / reps;
+}
+
+void run_solve(const char *label, CSRMatrix *A, CommonSolverReordering reordering)
+{
+    int size = A->get_size();
+    double *x = new double[size];
+    double *ones = new double[size];
+    for (int i = 0; i < size; i++)
+        ones[i] = 1.;
+    A->times_vector(ones, x, size);
+
+    CommonSolverSparseLib solver;
+    solver.set_reordering(reordering);
+    solver.set_tolerance(1e-10);
+    TimePeriod timer;
+    try {
+        solver.solve(A, x);
+        timer.tick();
+        double err = 0;
+        for (int i = 0; i < size; i++)
+            err = std::max(err, fabs(x[i] - 1.));
+        printf("  %-20s %5d iterations %9.4f s   error %.2e\n", label, solver.get_num_iters(), timer.last(), err);
+    } catch(std::exception const &ex) {
+        printf("  %-20s %s\n", label, ex.what());
+    }
+
+    delete[] x;
+    delete[] ones;
+}
+
+void run(const char *name, CSRMatrix *A)
+{
+    int size = A->get_size();
+    int nnz = A->get_nnz();
+    int reps = std::max(10, 100000000 / (nnz + 1));
+
+    double *x = new double[size];
+    double *y = new double[size];
+    for (int i = 0; i < size; i++)
+        x[i] = 1. + (i % 7);
+
+    printf("\n%s: size %i, nnz %i, %i products\n", name, size, nnz, reps);
+    double t = time_product(A, x, y, reps);
+    printf("  original             %9.4f ms  bandwidth %i\n", t, csr_bandwidth(size, A->get_Ap(), A->get_Ai()));
+
+    TimePeriod timer;
+    int *perm = new int[size];
+    A->get_rcm_ordering(perm);
+    timer.tick();
+    double t_rcm = timer.last();
+    CSRMatrix B(A->get_size(), A->get_nnz(), A->get_Ap(), A->get_Ai(), A->get_Ax(), false);
+    B.permute(perm);
+    timer.tick();
+    double t_rcm_permute = timer.last();
+    double t_b = time_product(&B, x, y, reps);
+    printf("  RCM                  %9.4f ms  bandwidth %i (%.2fx original, ordering %.3f s, permutation %.3f s)\n",
+           t_b, csr_bandwidth(size, B.get_Ap(), B.get_Ai()), t / t_b, t_rcm, t_rcm_permute);
+    delete[] perm;
+
+    run_solve("CGS, ILU", A, CommonSolverReordering_None);
+    run_solve("CGS, ILU, RCM", A, CommonSolverReordering_RCM);
+
+    delete[] x;
+    delete[] y;
+}
+
+int main(int argc, char* argv[])
+{
+    int n = 30;
+    if (argc > 1)
+        n = atoi(argv[1]);
+
+    try {
+        if (argc > 2)
+            for (int i = 2; i < argc; i++)
+            {
+                CSRMatrix *A = read_hb_csr(argv[i]);
+                run(argv[i], A);
+                delete A;
+            }
+        else
+        {
+            const char *files[2] = {FIDAP_DIR "/fidap001.rua", FIDAP_DIR "/fidap029.rua"};
+            for (int i = 0; i < 2; i++)
+            {
+                CSRMatrix *A = read_hb_csr(files[i]);
+                run(files[i], A);
+                delete A;
+            }
+        }
+
+        // trilinear elements on an n x n x n grid of nodes, with a dominant
+        // diagonal so that the solves converge
+        int size = n*n*n;
+        int *num = new int[size];
+        for (int i = 0; i < size; i++)
+            num[i] = i;
+        for (int shuffle = 0; shuffle < 2; shuffle++)
+        {
+            if (shuffle)
+            {
+                srand(1);
+                for (int i = size - 1; i > 0; i--)
+                    std::swap(num[i], num[rand() % (i + 1)]);
+            }
+            CooMatrix Q1(size, false, CooMatrix::CooMatrixStorage_Triplets);
+            for (int z = 0; z < n; z++)
+                for (int y = 0; y < n; y++)
+                    for (int x = 0; x < n; x++)
+                        for (int dz = -1; dz <= 1; dz++)
+                            for (int dy = -1; dy <= 1; dy++)
+                                for (int dx = -1; dx <= 1; dx++)
+                                {
+                                    if (x + dx < 0 || x + dx >= n || y + dy < 0 || y + dy >= n || z + dz < 0 || z + dz >= n)
+                                        continue;
+                                    Q1.add(num[x + n*(y + n*z)], num[(x + dx) + n*((y + dy) + n*(z + dz))], (dx || dy || dz) ? -1. : 27.);
+                                }
+            CSRMatrix A(&Q1);
+            Q1.free_data();
+            run(shuffle ? "hexahedra, random numbering" : "hexahedra", &A);
+        }
+        delete[] num;
+
+        return ERROR_SUCCESS;
+    } catch(std::exception const &ex) {
+        std::cout << "Exception raised: " << ex.what() << "\n";
+        return ERROR_FAILURE;
+    } catch(...) {
+        std::cout << "Exception raised." << "\n";
+        return ERROR_FAILURE;
+    }
+}
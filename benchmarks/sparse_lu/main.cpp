@@ -0,0 +1,154 @@
+#include <iostream>
+#include <stdexcept>
+
+#include "matrix.h"
+#include "solvers.h"
+#include "common_time_period.h"
+
+// Compares the orderings of CommonSolverSparseLU on the upwind
+// convection-diffusion operator on an n x n grid (nonsymmetric pattern with
+// a symmetric structure, the convection c is given relative to the
+// diffusion) and on the 7-point Laplacian on a grid with about as many
+// nodes. For each ordering it reports the entries of L and U and the times of
+// the symbolic analysis, the numeric factorization, the refactorization with
+// the kept pivots and one solve. CommonSolverDenseLU is timed for the
+// smaller grids and CommonSolverUmfpack if it is compiled in. The rhs is A 1.
+//
+// usage: bench-sparse-lu [n] [c]
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                              -1
+
+// max norm of x - 1
+double error(double *x, int size)
+{
+    double err = 0;
+    for (int i = 0; i < size; i++)
+        err = std::max(err, fabs(x[i] - 1.));
+    return err;
+}
+
+void run(const char *name, CooMatrix *L)
+{
+    CSRMatrix A(L);
+    int size = A.get_size();
+    double *ones = new double[size];
+    double *b = new double[size];
+    double *x = new double[size];
+    for (int i = 0; i < size; i++)
+        ones[i] = 1.;
+    A.times_vector(ones, b, size);
+
+    printf("\n%s: size %i, nnz %i\n", name, size, A.get_nnz());
+    printf("  %-10s %10s %10s %10s %10s %10s   %s\n", "ordering", "nnz(L+U)", "analyze", "factorize",
+           "refactor", "solve", "error");
+
+    const char *labels[3] = {"natural", "AMD", "COLAMD"};
+    CommonSolverSparseLU::CommonSolverSparseLUOrdering orderings[3] = {
+        CommonSolverSparseLU::CommonSolverSparseLUOrdering_Natural, CommonSolverSparseLU::CommonSolverSparseLUOrdering_AMD,
+        CommonSolverSparseLU::CommonSolverSparseLUOrdering_COLAMD};
+    CommonSolverSparseLU lu;
+    TimePeriod timer;
+    for (int o = 0; o < 3; o++)
+    {
+        lu.set_ordering(orderings[o]);
+        timer.tick(H2D_SKIP);
+        lu.analyze(&A);
+        timer.tick();
+        double t_analyze = timer.last();
+        lu.factorize_numeric(&A);
+        timer.tick();
+        double t_factorize = timer.last();
+        lu.refactor(&A);
+        timer.tick();
+        double t_refactor = timer.last();
+        std::copy(b, b + size, x);
+        timer.tick(H2D_SKIP);
+        lu.solve(x);
+        timer.tick();
+        printf("  %-10s %10i %9.4fs %9.4fs %9.4fs %9.4fs   %.2e\n", labels[o], lu.get_nnz_L() + lu.get_nnz_U(),
+               t_analyze, t_factorize, t_refactor, timer.last(), error(x, size));
+    }
+
+    if (size <= 5000)
+    {
+        CommonSolverDenseLU dense;
+        std::copy(b, b + size, x);
+        timer.tick(H2D_SKIP);
+        dense.solve(L, x);
+        timer.tick();
+        printf("  %-10s %10i %31.4fs   %.2e\n", "dense LU", size * size, timer.last(), error(x, size));
+    }
+
+#ifdef COMMON_WITH_UMFPACK
+    CommonSolverUmfpack umfpack;
+    timer.tick(H2D_SKIP);
+    umfpack.factorize(&A);
+    timer.tick();
+    double t_factorize = timer.last();
+    umfpack.refactor(&A);
+    timer.tick();
+    double t_refactor = timer.last();
+    std::copy(b, b + size, x);
+    timer.tick(H2D_SKIP);
+    umfpack.solve(x);
+    timer.tick();
+    printf("  %-10s %10s %20.4fs %9.4fs %9.4fs   %.2e\n", "UMFPACK", "", t_factorize, t_refactor, timer.last(),
+           error(x, size));
+#endif
+
+    delete[] ones;
+    delete[] b;
+    delete[] x;
+}
+
+int main(int argc, char* argv[])
+{
+    int n = 100;
+    double c = 2.;
+    if (argc > 1)
+        n = atoi(argv[1]);
+    if (argc > 2)
+        c = atof(argv[2]);
+
+    try {
+        int size = n*n;
+        CooMatrix L2(size, false, CooMatrix::CooMatrixStorage_Triplets);
+        for (int y = 0; y < n; y++)
+            for (int x = 0; x < n; x++)
+            {
+                int i = x + n*y;
+                L2.add(i, i, 4. + 2.*c);
+                if (x > 0) L2.add(i, i - 1, -1. - c);
+                if (x + 1 < n) L2.add(i, i + 1, -1.);
+                if (y > 0) L2.add(i, i - n, -1. - c);
+                if (y + 1 < n) L2.add(i, i + n, -1.);
+            }
+        run("convection-diffusion", &L2);
+
+        int m = (int) pow((double) size, 1. / 3.);
+        CooMatrix L3(m*m*m, false, CooMatrix::CooMatrixStorage_Triplets);
+        for (int z = 0; z < m; z++)
+            for (int y = 0; y < m; y++)
+                for (int x = 0; x < m; x++)
+                {
+                    int i = x + m*(y + m*z);
+                    L3.add(i, i, 6.);
+                    if (x > 0) L3.add(i, i - 1, -1.);
+                    if (x + 1 < m) L3.add(i, i + 1, -1.);
+                    if (y > 0) L3.add(i, i - m, -1.);
+                    if (y + 1 < m) L3.add(i, i + m, -1.);
+                    if (z > 0) L3.add(i, i - m*m, -1.);
+                    if (z + 1 < m) L3.add(i, i + m*m, -1.);
+                }
+        run("3D Laplacian", &L3);
+
+        return ERROR_SUCCESS;
+    } catch(std::exception const &ex) {
+        std::cout << "Exception raised: " << ex.what() << "\n";
+        return ERROR_FAILURE;
+    } catch(...) {
+        std::cout << "Exception raised." << "\n";
+        return ERROR_FAILURE;
+    }
+}
@@ -0,0 +1,135 @@
+#include <iostream>
+#include <stdexcept>
+
+#include "matrix.h"
+#include "matrixio.h"
+#include "common_time_period.h"
+
+// Compares the matrix-vector products of CSRMatrix and SELLMatrix for
+// several chunk heights C and sorting windows sigma. The matrices are the
+// fidap001 and fidap029 matrices from tests/matrix-io (or the Harwell-Boeing
+// files given on the command line) and two generated matrices of size n^3:
+// trilinear hexahedral elements on a uniform grid (27 entries per row) and
+// a matrix with irregular row lengths like near refined regions (mostly 5 to
+// 30 entries, every 40th row 250).
+//
+// usage: bench-spmv [n] [file.rua ...]
+
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                              -1
+
+#ifndef FIDAP_DIR
+#define FIDAP_DIR "tests/matrix-io"
+#endif
+
+// time of one product in ms
+double time_product(Matrix *A, double *x, double *y, int reps)
+{
+    int size = A->get_size();
+    A->times_vector(x, y, size);
+    TimePeriod timer;
+    timer.tick_reset();
+    for (int r = 0; r < reps; r++)
+        A->times_vector(x, y, size);
+    timer.tick();
+    return 1000 * timer.last() / reps;
+}
+
+void run(const char *name, CSRMatrix *A)
+{
+    int size = A->get_size();
+    int nnz = A->get_nnz();
+    int reps = std::max(10, 100000000 / (nnz + 1));
+
+    double *x = new double[size];
+    double *y = new double[size];
+    for (int i = 0; i < size; i++)
+        x[i] = 1. + (i % 7);
+
+    printf("\n%s: size %i, nnz %i, %i products\n", name, size, nnz, reps);
+    double t_csr = time_product(A, x, y, reps);
+    printf("  CSR                  %9.4f ms\n", t_csr);
+
+    int chunks[3] = {4, 8, 16};
+    int sigmas[3] = {1, 64, 1024};
+    for (int ic = 0; ic < 3; ic++)
+        for (int is = 0; is < 3; is++)
+        {
+            SELLMatrix S(A, chunks[ic], sigmas[is]);
+            double t = time_product(&S, x, y, reps);
+            char label[32];
+            sprintf(label, "SELL-%i-%i", chunks[ic], sigmas[is]);
+            printf("  %-20s %9.4f ms  (%.2fx CSR, padding %.1f %%)\n",
+                   label, t, t_csr / t, 100. * (S.get_padded_nnz() - nnz) / nnz);
+        }
+
+    delete[] x;
+    delete[] y;
+}
+
+int main(int argc, char* argv[])
+{
+    int n = 50;
+    if (argc > 1)
+        n = atoi(argv[1]);
+
+    try {
+        if (argc > 2)
+            for (int i = 2; i < argc; i++)
+            {
+                CSRMatrix *A = read_hb_csr(argv[i]);
+                run(argv[i], A);
+                delete A;
+            }
+        else
+        {
+            const char *files[2] = {FIDAP_DIR "/fidap001.rua", FIDAP_DIR "/fidap029.rua"};
+            for (int i = 0; i < 2; i++)
+            {
+                CSRMatrix *A = read_hb_csr(files[i]);
+                run(files[i], A);
+                delete A;
+            }
+        }
+
+        // trilinear elements on an n x n x n grid of nodes
+        int size = n*n*n;
+        CooMatrix Q1(size, false, CooMatrix::CooMatrixStorage_Triplets);
+        for (int z = 0; z < n; z++)
+            for (int y = 0; y < n; y++)
+                for (int x = 0; x < n; x++)
+                    for (int dz = -1; dz <= 1; dz++)
+                        for (int dy = -1; dy <= 1; dy++)
+                            for (int dx = -1; dx <= 1; dx++)
+                            {
+                                if (x + dx < 0 || x + dx >= n || y + dy < 0 || y + dy >= n || z + dz < 0 || z + dz >= n)
+                                    continue;
+                                Q1.add(x + n*(y + n*z), (x + dx) + n*((y + dy) + n*(z + dz)), (dx || dy || dz) ? -1. : 26.);
+                            }
+        CSRMatrix A(&Q1);
+        Q1.free_data();
+        run("hexahedra", &A);
+        A.free_data();
+
+        // irregular row lengths
+        CooMatrix R(size, false, CooMatrix::CooMatrixStorage_Triplets);
+        srand(1);
+        for (int i = 0; i < size; i++)
+        {
+            int len = (i % 40 == 0) ? 250 : 5 + rand() % 26;
+            for (int k = 0; k < len; k++)
+                R.add(i, (i + rand() % (2*n*n)) % size, 1.);
+        }
+        CSRMatrix B(&R);
+        R.free_data();
+        run("irregular", &B);
+
+        return ERROR_SUCCESS;
+    } catch(std::exception const &ex) {
+        std::cout << "Exception raised: " << ex.what() << "\n";
+        return ERROR_FAILURE;
+    } catch(...) {
+        std::cout << "Exception raised." << "\n";
+        return ERROR_FAILURE;
+    }
+}
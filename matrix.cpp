@@ -5,6 +5,10 @@
 
 #include "matrix.h"
 
+#ifdef COMMON_WITH_OPENMP
+#include <omp.h>
+#endif
+
 // print vector - int
 void print_vector(const char *label, int *value, int size) {
     printf("%s [", label);
@@ -17,6 +21,18 @@ void print_vector(const char *label, int *value, int size) {
     printf("]\n");
 }
 
+// print vector - long long
+void print_vector(const char *label, long long *value, int size) {
+    printf("%s [", label);
+    for (int i = 0; i < size; i++) {
+        if (i < size-1)
+            printf("%lld, ", value[i]);
+        else
+            printf("%lld", value[i]);
+    }
+    printf("]\n");
+}
+
 // print vector - double
 void print_vector(const char *label, double *value, int size) {
     printf("%s [", label);
@@ -143,7 +159,11 @@ void DenseMatrix::add_from_coo(CooMatrix *m)
         m->get_row_col_data(row, col, data);
 
         for (int i = 0; i < nnz; i++)
+        {
             A_cplx[row[i]][col[i]] = data[i];
+            if (m->is_symmetric())
+                A_cplx[col[i]][row[i]] = data[i];
+        }
 
         if (data) delete[] data;
     }
@@ -153,7 +173,11 @@ void DenseMatrix::add_from_coo(CooMatrix *m)
         m->get_row_col_data(row, col, data);
 
         for (int i = 0; i < nnz; i++)
+        {
             A[row[i]][col[i]] = data[i];
+            if (m->is_symmetric())
+                A[col[i]][row[i]] = data[i];
+        }
 
         if (data) delete[] data;
     }
@@ -211,6 +235,93 @@ void DenseMatrix::print()
 
 // *********************************************************************************************************************
 
+/// Sorts the triplets (row, col, data) by rows and columns and sums the
+/// duplicates in place. Both sorting passes are stable counting sorts, so that
+/// the duplicates are always summed in the order in which they were added.
+/// Returns the number of unique entries.
+template<typename T>
+static int sort_sum_triplets(int size, int nnz, int *row, int *col, T *data)
+{
+    int *Cp = new int[size + 1];
+    int *Ci = new int[nnz];
+    T *Cx = new T[nnz];
+
+    // sort by columns...
+    coo_to_csc(size, nnz, row, col, data, Cp, Ci, Cx);
+
+    // ...then by rows, the column indices and the data go back into col, data
+    int *Rp = new int[size + 1];
+    csc_to_csr(size, nnz, Cp, Ci, Cx, Rp, col, data);
+
+    // sum duplicates into Cp, Ci, Cx and go back to the triplets
+    nnz = csr_sum_duplicates(size, Rp, col, data, Cp, Ci, Cx);
+    csr_to_coo(size, nnz, Cp, Ci, Cx, row, col, data);
+
+    delete[] Cp;
+    delete[] Ci;
+    delete[] Cx;
+    delete[] Rp;
+
+    return nnz;
+}
+
+/// Writes the map storage of CooMatrix directly into the CSR arrays.
+template<typename T, typename I>
+static void coo_map_to_csr(int size, std::map<size_t, std::map<size_t, T> > &A, I *Ap, I *Ai, T *Ax)
+{
+    std::fill(Ap, Ap + size + 1, 0);
+    for(typename std::map<size_t, std::map<size_t, T> >::const_iterator it_row = A.begin(); it_row != A.end(); ++it_row)
+        Ap[it_row->first + 1] = it_row->second.size();
+    for (int i = 0; i < size; i++)
+        Ap[i+1] += Ap[i];
+
+    I index = 0;
+    for(typename std::map<size_t, std::map<size_t, T> >::const_iterator it_row = A.begin(); it_row != A.end(); ++it_row)
+    {
+        for(typename std::map<size_t, T>::const_iterator it_col = it_row->second.begin(); it_col != it_row->second.end(); ++it_col)
+        {
+            Ai[index] = it_col->first;
+            Ax[index] = it_col->second;
+            index++;
+        }
+    }
+}
+
+/// Writes the map storage of CooMatrix directly into the CSC arrays. The rows
+/// are visited in order, so that the row indices in each column are sorted.
+template<typename T>
+static void coo_map_to_csc(int size, std::map<size_t, std::map<size_t, T> > &A, int *Ap, int *Ai, T *Ax)
+{
+    // count the entries in each column
+    std::fill(Ap, Ap + size + 1, 0);
+    for(typename std::map<size_t, std::map<size_t, T> >::const_iterator it_row = A.begin(); it_row != A.end(); ++it_row)
+        for(typename std::map<size_t, T>::const_iterator it_col = it_row->second.begin(); it_col != it_row->second.end(); ++it_col)
+            Ap[it_col->first]++;
+
+    // Ap[j] is the next free position in the column j
+    for (int j = 0, cumsum = 0; j <= size; j++)
+    {
+        int temp = Ap[j];
+        Ap[j] = cumsum;
+        cumsum += temp;
+    }
+
+    for(typename std::map<size_t, std::map<size_t, T> >::const_iterator it_row = A.begin(); it_row != A.end(); ++it_row)
+    {
+        for(typename std::map<size_t, T>::const_iterator it_col = it_row->second.begin(); it_col != it_row->second.end(); ++it_col)
+        {
+            int dest = Ap[it_col->first]++;
+            Ai[dest] = it_row->first;
+            Ax[dest] = it_col->second;
+        }
+    }
+
+    // shift back
+    for (int j = size; j > 0; j--)
+        Ap[j] = Ap[j-1];
+    Ap[0] = 0;
+}
+
 CooMatrix::CooMatrix(bool complex) : Matrix()
 {
     init();
@@ -219,12 +330,13 @@ CooMatrix::CooMatrix(bool complex) : Matrix()
     this->size = 0;
 }
 
-CooMatrix::CooMatrix(int size, bool complex) : Matrix()
+CooMatrix::CooMatrix(int size, bool complex, CooMatrixStorage storage) : Matrix()
 {
     init();
 
     this->complex = complex;
     this->size = size;
+    this->storage = storage;
 }
 
 CooMatrix::CooMatrix(Matrix *m)
@@ -260,14 +372,124 @@ void CooMatrix::free_data()
 {
     A_cplx.clear();
     A.clear();
+
+    // release the memory, clear() keeps the capacity
+    std::vector<int>().swap(t_row);
+    std::vector<int>().swap(t_col);
+    std::vector<double>().swap(t_data);
+    std::vector<cplx>().swap(t_data_cplx);
+    this->compressed = true;
+
     this->size = 0;
 }
 
+void CooMatrix::set_storage(CooMatrixStorage storage)
+{
+    if (storage == this->storage)
+        return;
+
+    if (storage == CooMatrixStorage_Triplets)
+    {
+        // the map is sorted and contains no duplicates
+        int nnz = get_nnz();
+        reserve(nnz);
+        if (this->complex)
+        {
+            for(std::map<size_t, std::map<size_t, cplx> >::const_iterator it_row = A_cplx.begin(); it_row != A_cplx.end(); ++it_row)
+            {
+                for(std::map<size_t, cplx>::const_iterator it_col = it_row->second.begin(); it_col != it_row->second.end(); ++it_col)
+                {
+                    t_row.push_back(it_row->first);
+                    t_col.push_back(it_col->first);
+                    t_data_cplx.push_back(it_col->second);
+                }
+            }
+        }
+        else
+        {
+            for(std::map<size_t, std::map<size_t, double> >::const_iterator it_row = A.begin(); it_row != A.end(); ++it_row)
+            {
+                for(std::map<size_t, double>::const_iterator it_col = it_row->second.begin(); it_col != it_row->second.end(); ++it_col)
+                {
+                    t_row.push_back(it_row->first);
+                    t_col.push_back(it_col->first);
+                    t_data.push_back(it_col->second);
+                }
+            }
+        }
+        A.clear();
+        A_cplx.clear();
+        this->compressed = true;
+    }
+    else
+    {
+        compress();
+        for (int i = 0; i < (int) t_row.size(); i++)
+        {
+            if (this->complex)
+                A_cplx[t_row[i]][t_col[i]] = t_data_cplx[i];
+            else
+                A[t_row[i]][t_col[i]] = t_data[i];
+        }
+        std::vector<int>().swap(t_row);
+        std::vector<int>().swap(t_col);
+        std::vector<double>().swap(t_data);
+        std::vector<cplx>().swap(t_data_cplx);
+    }
+
+    this->storage = storage;
+}
+
+void CooMatrix::reserve(int nnz)
+{
+    if (this->storage != CooMatrixStorage_Triplets)
+        return;
+
+    t_row.reserve(nnz);
+    t_col.reserve(nnz);
+    if (this->complex)
+        t_data_cplx.reserve(nnz);
+    else
+        t_data.reserve(nnz);
+}
+
+void CooMatrix::compress()
+{
+    if (this->storage != CooMatrixStorage_Triplets || this->compressed)
+        return;
+
+    int nnz = t_row.size();
+    if (nnz > 0)
+    {
+        if (this->complex)
+            nnz = sort_sum_triplets(this->size, nnz, &t_row[0], &t_col[0], &t_data_cplx[0]);
+        else
+            nnz = sort_sum_triplets(this->size, nnz, &t_row[0], &t_col[0], &t_data[0]);
+    }
+
+    t_row.resize(nnz);
+    t_col.resize(nnz);
+    if (this->complex)
+        t_data_cplx.resize(nnz);
+    else
+        t_data.resize(nnz);
+
+    this->compressed = true;
+}
+
+void CooMatrix::set_symmetric(bool symmetric)
+{
+    if (!(A.empty() && A_cplx.empty() && t_row.empty()))
+        _error("CooMatrix::set_symmetric(): the matrix is not empty.");
+    this->symmetric = symmetric;
+}
+
 void CooMatrix::add_from_csr(CSRMatrix *m)
 {
     free_data();
 
     this->complex = m->is_complex();
+    this->symmetric = m->is_symmetric();
 
     int *Ap = m->get_Ap();
     int *Ai = m->get_Ai();
@@ -294,6 +516,7 @@ void CooMatrix::add_from_csc(CSCMatrix *m)
     free_data();
 
     this->complex = m->is_complex();
+    this->symmetric = false;
 
     int *Ap = m->get_Ap();
     int *Ai = m->get_Ai();
@@ -320,12 +543,24 @@ void CooMatrix::add(int m, int n, double v)
     if (this->complex)
         _error("can't use add(int, int, double) for complex matrix");
 
+    // the lower triangle is folded into the upper one
+    if (this->symmetric && m > n)
+        std::swap(m, n);
+
     // adjusting size if necessary
     if (m+1 > this->size) this->size = m+1;
     if (n+1 > this->size) this->size = n+1;
 
     // add new
-    A[m][n] += v;
+    if (this->storage == CooMatrixStorage_Triplets)
+    {
+        t_row.push_back(m);
+        t_col.push_back(n);
+        t_data.push_back(v);
+        this->compressed = false;
+    }
+    else
+        A[m][n] += v;
 }
 
 void CooMatrix::add(int m, int n, cplx v)
@@ -333,17 +568,104 @@ void CooMatrix::add(int m, int n, cplx v)
     if (!(this->complex))
         _error("can't use add(int, int, cplx) for real matrix");
 
+    if (this->symmetric && m > n)
+        std::swap(m, n);
+
     // adjusting size if necessary
     if (m+1 > this->size) this->size = m+1;
     if (n+1 > this->size) this->size = n+1;
 
-    A_cplx[m][n] += v;
+    if (this->storage == CooMatrixStorage_Triplets)
+    {
+        t_row.push_back(m);
+        t_col.push_back(n);
+        t_data_cplx.push_back(v);
+        this->compressed = false;
+    }
+    else
+        A_cplx[m][n] += v;
+}
+
+// position of the entry (m, n) in the compressed triplets, -1 if missing
+int CooMatrix::find_triplet(int m, int n)
+{
+    compress();
+
+    // the triplets are sorted by rows and columns
+    int first = std::lower_bound(t_row.begin(), t_row.end(), m) - t_row.begin();
+    int last = std::upper_bound(t_row.begin() + first, t_row.end(), m) - t_row.begin();
+    int index = std::lower_bound(t_col.begin() + first, t_col.begin() + last, n) - t_col.begin();
+    return (index < last && t_col[index] == n) ? index : -1;
+}
+
+double CooMatrix::get(int m, int n)
+{
+    if (this->complex) _error("CooMatrix::get(): the matrix is complex, use get_cplx().");
+    if (this->symmetric && m > n)
+        std::swap(m, n);
+
+    if (this->storage == CooMatrixStorage_Triplets)
+    {
+        int index = find_triplet(m, n);
+        return (index < 0) ? 0.0 : t_data[index];
+    }
+
+    // do not insert the missing entries into the map
+    std::map<size_t, std::map<size_t, double> >::const_iterator it_row = A.find(m);
+    if (it_row == A.end())
+        return 0.0;
+    std::map<size_t, double>::const_iterator it_col = it_row->second.find(n);
+    if (it_col == it_row->second.end())
+        return 0.0;
+    return it_col->second;
+}
+
+cplx CooMatrix::get_cplx(int m, int n)
+{
+    if (!this->complex) _error("CooMatrix::get_cplx(): the matrix is real, use get().");
+    if (this->symmetric && m > n)
+        std::swap(m, n);
+
+    if (this->storage == CooMatrixStorage_Triplets)
+    {
+        int index = find_triplet(m, n);
+        return (index < 0) ? cplx(0) : t_data_cplx[index];
+    }
+
+    std::map<size_t, std::map<size_t, cplx> >::const_iterator it_row = A_cplx.find(m);
+    if (it_row == A_cplx.end())
+        return cplx(0);
+    std::map<size_t, cplx>::const_iterator it_col = it_row->second.find(n);
+    if (it_col == it_row->second.end())
+        return cplx(0);
+    return it_col->second;
 }
 
 void CooMatrix::copy_into(Matrix *m)
 {
     m->free_data();
 
+    if (this->storage == CooMatrixStorage_Triplets)
+    {
+        compress();
+        for (int i = 0; i < (int) t_row.size(); i++)
+        {
+            if (this->complex)
+                m->add(t_row[i], t_col[i], t_data_cplx[i]);
+            else
+                m->add(t_row[i], t_col[i], t_data[i]);
+            // the lower triangle of a symmetric matrix
+            if (this->symmetric && !m->is_symmetric() && t_row[i] != t_col[i])
+            {
+                if (this->complex)
+                    m->add(t_col[i], t_row[i], t_data_cplx[i]);
+                else
+                    m->add(t_col[i], t_row[i], t_data[i]);
+            }
+        }
+        return;
+    }
+
     int index = 0;
     if (this->complex)
     {
@@ -354,6 +676,8 @@ void CooMatrix::copy_into(Matrix *m)
                 m->add(it_row->first,
                        it_col->first,
                        cplx(it_col->second.real(), it_col->second.imag()));
+                if (this->symmetric && !m->is_symmetric() && it_row->first != it_col->first)
+                    m->add(it_col->first, it_row->first, it_col->second);
 
                 index++;
             }
@@ -368,6 +692,8 @@ void CooMatrix::copy_into(Matrix *m)
                 m->add(it_row->first,
                        it_col->first,
                        it_col->second);
+                if (this->symmetric && !m->is_symmetric() && it_row->first != it_col->first)
+                    m->add(it_col->first, it_row->first, it_col->second);
 
                 index++;
             }
@@ -377,6 +703,15 @@ void CooMatrix::copy_into(Matrix *m)
 
 void CooMatrix::get_row_col_data(int *row, int *col, double *data)
 {
+    if (this->storage == CooMatrixStorage_Triplets)
+    {
+        compress();
+        std::copy(t_row.begin(), t_row.end(), row);
+        std::copy(t_col.begin(), t_col.end(), col);
+        std::copy(t_data.begin(), t_data.end(), data);
+        return;
+    }
+
     int index = 0;
     for(std::map<size_t, std::map<size_t, double> >::const_iterator it_row = A.begin(); it_row != A.end(); ++it_row)
     {
@@ -393,6 +728,15 @@ void CooMatrix::get_row_col_data(int *row, int *col, double *data)
 
 void CooMatrix::get_row_col_data(int *row, int *col, cplx *data)
 {
+    if (this->storage == CooMatrixStorage_Triplets)
+    {
+        compress();
+        std::copy(t_row.begin(), t_row.end(), row);
+        std::copy(t_col.begin(), t_col.end(), col);
+        std::copy(t_data_cplx.begin(), t_data_cplx.end(), data);
+        return;
+    }
+
     int index = 0;
     for(std::map<size_t, std::map<size_t, cplx> >::const_iterator it_row = A_cplx.begin(); it_row != A_cplx.end(); ++it_row)
     {
@@ -409,6 +753,19 @@ void CooMatrix::get_row_col_data(int *row, int *col, cplx *data)
 
 void CooMatrix::get_row_col_data(int *row, int *col, double *data_real, double *data_imag)
 {
+    if (this->storage == CooMatrixStorage_Triplets)
+    {
+        compress();
+        for (int i = 0; i < (int) t_row.size(); i++)
+        {
+            row[i] = t_row[i];
+            col[i] = t_col[i];
+            data_real[i] = t_data_cplx[i].real();
+            data_imag[i] = t_data_cplx[i].imag();
+        }
+        return;
+    }
+
     int index = 0;
     for(std::map<size_t, std::map<size_t, cplx> >::const_iterator it_row = A_cplx.begin(); it_row != A_cplx.end(); ++it_row)
     {
@@ -424,9 +781,123 @@ void CooMatrix::get_row_col_data(int *row, int *col, double *data_real, double *
     }
 }
 
+void CooMatrix::get_csr(int *Ap, int *Ai, double *Ax)
+{
+    if (this->storage == CooMatrixStorage_Triplets)
+    {
+        compress();
+        int nnz = t_row.size();
+        if (nnz > 0)
+            coo_to_csr(this->size, nnz, &t_row[0], &t_col[0], &t_data[0], Ap, Ai, Ax);
+        else
+            std::fill(Ap, Ap + this->size + 1, 0);
+    }
+    else
+        coo_map_to_csr(this->size, A, Ap, Ai, Ax);
+}
+
+void CooMatrix::get_csr(int *Ap, int *Ai, cplx *Ax)
+{
+    if (this->storage == CooMatrixStorage_Triplets)
+    {
+        compress();
+        int nnz = t_row.size();
+        if (nnz > 0)
+            coo_to_csr(this->size, nnz, &t_row[0], &t_col[0], &t_data_cplx[0], Ap, Ai, Ax);
+        else
+            std::fill(Ap, Ap + this->size + 1, 0);
+    }
+    else
+        coo_map_to_csr(this->size, A_cplx, Ap, Ai, Ax);
+}
+
+/// Writes the compressed triplets, which are sorted by rows and columns,
+/// into the CSR arrays with 64-bit indices.
+template<typename T>
+static void coo_triplets_to_csr(int size, std::vector<int> &row, std::vector<int> &col, std::vector<T> &data,
+                                long long *Ap, long long *Ai, T *Ax)
+{
+    long long nnz = row.size();
+    std::fill(Ap, Ap + size + 1, 0);
+    for (long long k = 0; k < nnz; k++)
+    {
+        Ap[row[k] + 1]++;
+        Ai[k] = col[k];
+        Ax[k] = data[k];
+    }
+    for (int i = 0; i < size; i++)
+        Ap[i+1] += Ap[i];
+}
+
+void CooMatrix::get_csr(long long *Ap, long long *Ai, double *Ax)
+{
+    if (this->storage == CooMatrixStorage_Triplets)
+    {
+        compress();
+        coo_triplets_to_csr(this->size, t_row, t_col, t_data, Ap, Ai, Ax);
+    }
+    else
+        coo_map_to_csr(this->size, A, Ap, Ai, Ax);
+}
+
+void CooMatrix::get_csr(long long *Ap, long long *Ai, cplx *Ax)
+{
+    if (this->storage == CooMatrixStorage_Triplets)
+    {
+        compress();
+        coo_triplets_to_csr(this->size, t_row, t_col, t_data_cplx, Ap, Ai, Ax);
+    }
+    else
+        coo_map_to_csr(this->size, A_cplx, Ap, Ai, Ax);
+}
+
+void CooMatrix::get_csc(int *Ap, int *Ai, double *Ax)
+{
+    if (this->storage == CooMatrixStorage_Triplets)
+    {
+        compress();
+        int nnz = t_row.size();
+        if (nnz > 0)
+            coo_to_csc(this->size, nnz, &t_row[0], &t_col[0], &t_data[0], Ap, Ai, Ax);
+        else
+            std::fill(Ap, Ap + this->size + 1, 0);
+    }
+    else
+        coo_map_to_csc(this->size, A, Ap, Ai, Ax);
+}
+
+void CooMatrix::get_csc(int *Ap, int *Ai, cplx *Ax)
+{
+    if (this->storage == CooMatrixStorage_Triplets)
+    {
+        compress();
+        int nnz = t_row.size();
+        if (nnz > 0)
+            coo_to_csc(this->size, nnz, &t_row[0], &t_col[0], &t_data_cplx[0], Ap, Ai, Ax);
+        else
+            std::fill(Ap, Ap + this->size + 1, 0);
+    }
+    else
+        coo_map_to_csc(this->size, A_cplx, Ap, Ai, Ax);
+}
+
 int CooMatrix::get_nnz()
 {
-    int nnz = 0;
+    long long nnz = get_nnz64();
+    if (nnz > INT_MAX)
+        _error("CooMatrix::get_nnz(): the matrix has more than 2^31 - 1 entries, use CSRMatrix64.");
+    return (int) nnz;
+}
+
+long long CooMatrix::get_nnz64()
+{
+    if (this->storage == CooMatrixStorage_Triplets)
+    {
+        compress();
+        return t_row.size();
+    }
+
+    long long nnz = 0;
     if (complex)
         for(std::map<size_t, std::map<size_t, cplx> >::const_iterator it_row = A_cplx.begin(); it_row != A_cplx.end(); ++it_row)
             nnz += it_row->second.size();
@@ -441,11 +912,51 @@ void CooMatrix::times_vector(double* vec, double* result, int rank)
 {
     for (int i=0; i < rank; i++) result[i] = 0;
 
+    if (this->storage == CooMatrixStorage_Triplets)
+    {
+        // duplicates don't matter here, no need to compress
+        for (int i = 0; i < (int) t_row.size(); i++)
+        {
+            result[t_row[i]] += t_data[i] * vec[t_col[i]];
+            if (this->symmetric && t_row[i] != t_col[i])
+                result[t_col[i]] += t_data[i] * vec[t_row[i]];
+        }
+        return;
+    }
+
     for(std::map<size_t, std::map<size_t, double> >::const_iterator it_row = A.begin(); it_row != A.end(); ++it_row)
     {
         for(std::map<size_t, double>::const_iterator it_col = it_row->second.begin(); it_col != it_row->second.end(); ++it_col)
         {
             result[it_row->first] += it_col->second * vec[it_col->first];
+            if (this->symmetric && it_row->first != it_col->first)
+                result[it_col->first] += it_col->second * vec[it_row->first];
+        }
+    }
+}
+
+void CooMatrix::times_vector(cplx* vec, cplx* result, int rank)
+{
+    for (int i=0; i < rank; i++) result[i] = 0;
+
+    if (this->storage == CooMatrixStorage_Triplets)
+    {
+        for (int i = 0; i < (int) t_row.size(); i++)
+        {
+            result[t_row[i]] += t_data_cplx[i] * vec[t_col[i]];
+            if (this->symmetric && t_row[i] != t_col[i])
+                result[t_col[i]] += t_data_cplx[i] * vec[t_row[i]];
+        }
+        return;
+    }
+
+    for(std::map<size_t, std::map<size_t, cplx> >::const_iterator it_row = A_cplx.begin(); it_row != A_cplx.end(); ++it_row)
+    {
+        for(std::map<size_t, cplx>::const_iterator it_col = it_row->second.begin(); it_col != it_row->second.end(); ++it_col)
+        {
+            result[it_row->first] += it_col->second * vec[it_col->first];
+            if (this->symmetric && it_row->first != it_col->first)
+                result[it_col->first] += it_col->second * vec[it_row->first];
         }
     }
 }
@@ -454,6 +965,21 @@ void CooMatrix::print()
 {
     printf("\nCoo Matrix:\n");
 
+    if (this->storage == CooMatrixStorage_Triplets)
+    {
+        compress();
+        for (int i = 0; i < (int) t_row.size(); i++)
+        {
+            if (is_complex())
+                printf("(%i, %i): (%f, %f)\n",
+                       t_row[i], t_col[i], t_data_cplx[i].real(), t_data_cplx[i].imag());
+            else
+                printf("(%i, %i): %f\n",
+                       t_row[i], t_col[i], t_data[i]);
+        }
+        return;
+    }
+
     if (is_complex())
     {
         for(std::map<size_t, std::map<size_t, cplx> >::const_iterator it_row = A_cplx.begin(); it_row != A_cplx.end(); ++it_row)
@@ -484,54 +1010,478 @@ void CooMatrix::print()
 }
 
 // *********************************************************************************************************************
-CSRMatrix::CSRMatrix(int size) : Matrix()
+
+/// Entry of a row in CooAssembler::merge(), ordered by the column and then by
+/// the value, so that the duplicates are summed in the same order whatever
+/// the order in which they were added.
+template<typename T>
+struct AssemblyEntry
 {
-    init();
-    this->size = size;
-}
+    int col;
+    T value;
+};
 
-CSRMatrix::CSRMatrix(CooMatrix *m) : Matrix()
+static inline bool value_less(double a, double b) { return a < b; }
+static inline bool value_less(cplx a, cplx b)
 {
-    init();
-    this->add_from_coo(m);
+    return a.real() < b.real() || (a.real() == b.real() && a.imag() < b.imag());
 }
 
-CSRMatrix::CSRMatrix(CSCMatrix *m) : Matrix()
+template<typename T>
+struct AssemblyEntryLess
 {
-    init();
-    this->add_from_csc(m);
-}
+    inline bool operator()(const AssemblyEntry<T> &a, const AssemblyEntry<T> &b) const
+    {
+        return a.col < b.col || (a.col == b.col && value_less(a.value, b.value));
+    }
+};
 
-CSRMatrix::CSRMatrix(DenseMatrix *m) : Matrix()
+CooAssembler::CooAssembler(CooMatrix *mat, int num_threads)
 {
-    init();
-    this->add_from_dense(m);
+    this->mat = mat;
+#ifdef COMMON_WITH_OPENMP
+    this->num_buffers = (num_threads > 0) ? num_threads : omp_get_max_threads();
+#else
+    this->num_buffers = 1;
+#endif
+    this->buffers = new Buffer[this->num_buffers];
+    for (int t = 0; t < this->num_buffers; t++)
+        this->buffers[t].size = 0;
 }
 
-CSRMatrix::CSRMatrix(Matrix *m) : Matrix()
+CooAssembler::~CooAssembler()
 {
-    init();
-
-    if (dynamic_cast<CooMatrix*>(m))
-        this->add_from_coo((CooMatrix*)m);
-    else if (dynamic_cast<CSCMatrix*>(m))
-        this->add_from_csc((CSCMatrix*)m);
-    else if (dynamic_cast<DenseMatrix*>(m))
-        this->add_from_dense((DenseMatrix*)m);
-    else
-        _error("Matrix type not supported.");
+    delete[] this->buffers;
 }
 
-CSRMatrix::~CSRMatrix()
+CooAssembler::Buffer *CooAssembler::get_buffer()
 {
-    free_data();
+#ifdef COMMON_WITH_OPENMP
+    int t = omp_get_thread_num();
+    if (t >= this->num_buffers)
+        _error("CooAssembler: more threads than buffers.");
+    return &this->buffers[t];
+#else
+    return &this->buffers[0];
+#endif
 }
 
-void CSRMatrix::init()
+void CooAssembler::add(int m, int n, double v)
 {
-    this->complex = false;
-    this->size = 0;
-    this->nnz = 0;
+    if (this->mat->is_complex())
+        _error("can't use add(int, int, double) for complex matrix");
+
+    // the lower triangle is folded into the upper one
+    if (this->mat->is_symmetric() && m > n)
+        std::swap(m, n);
+
+    Buffer *b = get_buffer();
+    b->row.push_back(m);
+    b->col.push_back(n);
+    b->data.push_back(v);
+    b->size = std::max(b->size, std::max(m, n) + 1);
+}
+
+void CooAssembler::add(int m, int n, cplx v)
+{
+    if (!this->mat->is_complex())
+        _error("can't use add(int, int, cplx) for real matrix");
+
+    if (this->mat->is_symmetric() && m > n)
+        std::swap(m, n);
+
+    Buffer *b = get_buffer();
+    b->row.push_back(m);
+    b->col.push_back(n);
+    b->data_cplx.push_back(v);
+    b->size = std::max(b->size, std::max(m, n) + 1);
+}
+
+void CooAssembler::add_block(int *iidx, int ilen, int *jidx, int jlen, double** mat)
+{
+    bool symmetric = this->mat->is_symmetric();
+    for (int i = 0; i < ilen; i++)
+        for (int j = 0; j < jlen; j++)
+            if (iidx[i] >= 0 && jidx[j] >= 0 && (!symmetric || iidx[i] <= jidx[j]))
+                this->add(iidx[i], jidx[j], mat[i][j]);
+}
+
+void CooAssembler::add_block(int *iidx, int ilen, int *jidx, int jlen, cplx** mat)
+{
+    bool symmetric = this->mat->is_symmetric();
+    for (int i = 0; i < ilen; i++)
+        for (int j = 0; j < jlen; j++)
+            if (iidx[i] >= 0 && jidx[j] >= 0 && (!symmetric || iidx[i] <= jidx[j]))
+                this->add(iidx[i], jidx[j], mat[i][j]);
+}
+
+long long CooAssembler::get_buffered_nnz()
+{
+    long long nnz = 0;
+    for (int t = 0; t < this->num_buffers; t++)
+        nnz += this->buffers[t].row.size();
+    return nnz;
+}
+
+void CooAssembler::merge()
+{
+    this->mat->set_storage(CooMatrix::CooMatrixStorage_Triplets);
+    for (int t = 0; t < this->num_buffers; t++)
+        this->mat->size = std::max(this->mat->size, this->buffers[t].size);
+
+    if (this->mat->is_complex())
+        merge_buffers(this->mat->t_data_cplx, &Buffer::data_cplx);
+    else
+        merge_buffers(this->mat->t_data, &Buffer::data);
+}
+
+/// Appends the buffers to the triplets of the matrix, sorts the rows by a
+/// stable counting sort and each row by the columns and values, and sums
+/// the duplicates. The rows are processed in parallel.
+template<typename T>
+void CooAssembler::merge_buffers(std::vector<T> &t_data, std::vector<T> Buffer::*data)
+{
+    std::vector<int> &t_row = this->mat->t_row;
+    std::vector<int> &t_col = this->mat->t_col;
+
+    // gather the matrix and all buffers
+    size_t total = t_row.size();
+    for (int t = 0; t < this->num_buffers; t++)
+        total += this->buffers[t].row.size();
+    if (total > INT_MAX)
+        _error("CooAssembler::merge(): more than 2^31 - 1 entries.");
+    int nnz = (int) total;
+    t_row.reserve(nnz);
+    t_col.reserve(nnz);
+    t_data.reserve(nnz);
+    for (int t = 0; t < this->num_buffers; t++)
+    {
+        Buffer &b = this->buffers[t];
+        t_row.insert(t_row.end(), b.row.begin(), b.row.end());
+        t_col.insert(t_col.end(), b.col.begin(), b.col.end());
+        t_data.insert(t_data.end(), (b.*data).begin(), (b.*data).end());
+        std::vector<int>().swap(b.row);
+        std::vector<int>().swap(b.col);
+        std::vector<T>().swap(b.*data);
+        b.size = 0;
+    }
+    if (nnz == 0)
+    {
+        this->mat->compressed = true;
+        return;
+    }
+
+    // sort by rows
+    int size = this->mat->size;
+    int *Ap = new int[size + 1];
+    int *Ai = new int[nnz];
+    T *Ax = new T[nnz];
+    coo_to_csr(size, nnz, &t_row[0], &t_col[0], &t_data[0], Ap, Ai, Ax);
+
+    // sort each row by columns and values and sum the duplicates in place,
+    // count[i] is the number of unique entries of the row i
+    AssemblyEntry<T> *entries = new AssemblyEntry<T>[nnz];
+    int *count = new int[size + 1];
+    count[0] = 0;
+    int threads = get_num_threads();
+#ifdef COMMON_WITH_OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 256)
+#endif
+    for (int i = 0; i < size; i++)
+    {
+        int begin = Ap[i], end = Ap[i+1];
+        for (int k = begin; k < end; k++)
+        {
+            entries[k].col = Ai[k];
+            entries[k].value = Ax[k];
+        }
+        std::sort(entries + begin, entries + end, AssemblyEntryLess<T>());
+
+        int last = begin - 1;
+        for (int k = begin; k < end; k++)
+        {
+            if (last >= begin && Ai[last] == entries[k].col)
+                Ax[last] += entries[k].value;
+            else
+            {
+                last++;
+                Ai[last] = entries[k].col;
+                Ax[last] = entries[k].value;
+            }
+        }
+        count[i+1] = last + 1 - begin;
+    }
+    delete[] entries;
+
+    // compact the rows back into the triplets
+    for (int i = 0; i < size; i++)
+        count[i+1] += count[i];
+    nnz = count[size];
+    t_row.resize(nnz);
+    t_col.resize(nnz);
+    t_data.resize(nnz);
+#ifdef COMMON_WITH_OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static)
+#endif
+    for (int i = 0; i < size; i++)
+        for (int k = 0; k < count[i+1] - count[i]; k++)
+        {
+            t_row[count[i] + k] = i;
+            t_col[count[i] + k] = Ai[Ap[i] + k];
+            t_data[count[i] + k] = Ax[Ap[i] + k];
+        }
+
+    delete[] Ap;
+    delete[] Ai;
+    delete[] Ax;
+    delete[] count;
+
+    this->mat->compressed = true;
+}
+
+// *********************************************************************************************************************
+
+/// Returns the position of the index i in the sorted part Ai[start...end) of
+/// the array Ai, or -1 if it is not there.
+template<typename I>
+static inline I find_sorted_index(I *Ai, I start, I end, int i)
+{
+    I *pos = std::lower_bound(Ai + start, Ai + end, (I) i);
+    if (pos != Ai + end && *pos == i)
+        return pos - Ai;
+    return -1;
+}
+
+/// Adds the block mat[ilen][jlen] into the existing entries of the CSR
+/// matrix (Ap, Ai, Ax). Negative indices are skipped, and so are the entries
+/// below the diagonal if 'upper' is set (symmetric storage). Returns false if
+/// an entry is not in the sparsity pattern.
+template<typename T>
+static bool csr_add_block(int *Ap, int *Ai, T *Ax, int *iidx, int ilen, int *jidx, int jlen, T **mat,
+                          bool upper = false)
+{
+    for (int i = 0; i < ilen; i++)
+    {
+        if (iidx[i] < 0) continue;
+        int start = Ap[iidx[i]];
+        int end = Ap[iidx[i]+1];
+        for (int j = 0; j < jlen; j++)
+        {
+            if (jidx[j] < 0 || (upper && jidx[j] < iidx[i])) continue;
+            int index = find_sorted_index(Ai, start, end, jidx[j]);
+            if (index < 0) return false;
+            Ax[index] += mat[i][j];
+        }
+    }
+    return true;
+}
+
+/// Same as csr_add_block() for the CSC matrix (Ap, Ai, Ax).
+template<typename T>
+static bool csc_add_block(int *Ap, int *Ai, T *Ax, int *iidx, int ilen, int *jidx, int jlen, T **mat)
+{
+    for (int j = 0; j < jlen; j++)
+    {
+        if (jidx[j] < 0) continue;
+        int start = Ap[jidx[j]];
+        int end = Ap[jidx[j]+1];
+        for (int i = 0; i < ilen; i++)
+        {
+            if (iidx[i] < 0) continue;
+            int index = find_sorted_index(Ai, start, end, iidx[i]);
+            if (index < 0) return false;
+            Ax[index] += mat[i][j];
+        }
+    }
+    return true;
+}
+
+/// Finds the positions of the entries of the block (iidx x jidx) in the CSR
+/// matrix (Ap, Ai) and stores them in offsets[ilen*jlen], -1 for negative
+/// indices (and for the entries below the diagonal if 'upper' is set).
+/// Returns false if an entry is not in the sparsity pattern.
+static bool csr_find_block(int *Ap, int *Ai, int *iidx, int ilen, int *jidx, int jlen, int *offsets,
+                           bool upper = false)
+{
+    for (int i = 0; i < ilen; i++)
+    {
+        for (int j = 0; j < jlen; j++)
+        {
+            int index = -1;
+            if (iidx[i] >= 0 && jidx[j] >= 0 && !(upper && jidx[j] < iidx[i]))
+            {
+                index = find_sorted_index(Ai, Ap[iidx[i]], Ap[iidx[i]+1], jidx[j]);
+                if (index < 0) return false;
+            }
+            offsets[i*jlen + j] = index;
+        }
+    }
+    return true;
+}
+
+/// Same as csr_find_block() for the CSC matrix (Ap, Ai).
+static bool csc_find_block(int *Ap, int *Ai, int *iidx, int ilen, int *jidx, int jlen, int *offsets)
+{
+    for (int i = 0; i < ilen; i++)
+    {
+        for (int j = 0; j < jlen; j++)
+        {
+            int index = -1;
+            if (iidx[i] >= 0 && jidx[j] >= 0)
+            {
+                index = find_sorted_index(Ai, Ap[jidx[j]], Ap[jidx[j]+1], iidx[i]);
+                if (index < 0) return false;
+            }
+            offsets[i*jlen + j] = index;
+        }
+    }
+    return true;
+}
+
+/// Adds the block mat[ilen][jlen] to Ax at the positions found by
+/// csr_find_block() or csc_find_block().
+template<typename T>
+static inline void scatter_block(int *offsets, int ilen, int jlen, T **mat, T *Ax)
+{
+    for (int i = 0; i < ilen; i++)
+    {
+        int *off = offsets + i*jlen;
+        T *row = mat[i];
+        for (int j = 0; j < jlen; j++)
+            if (off[j] >= 0)
+                Ax[off[j]] += row[j];
+    }
+}
+
+// copies the values of a typed matrix (CSRMatrixT, CSCMatrixT) into a new
+// array of CSRMatrix or CSCMatrix, the float values are widened to double
+static void widen_typed_values(int nnz, double *Ax, double *&Bx, cplx *&Bx_cplx)
+{
+    Bx = new double[nnz];
+    std::copy(Ax, Ax + nnz, Bx);
+}
+
+static void widen_typed_values(int nnz, cplx *Ax, double *&Bx, cplx *&Bx_cplx)
+{
+    Bx_cplx = new cplx[nnz];
+    std::copy(Ax, Ax + nnz, Bx_cplx);
+}
+
+static void widen_typed_values(int nnz, float *Ax, double *&Bx, cplx *&Bx_cplx)
+{
+    Bx = new double[nnz];
+    std::copy(Ax, Ax + nnz, Bx);
+}
+
+// converts m if it is one of the typed matrices, the only place that lists
+// their scalar types (M is CSRMatrix or CSCMatrix)
+template<typename M>
+static bool add_from_typed_matrix(M *dst, Matrix *m)
+{
+    return dst->template add_from_typed<double>(m) || dst->template add_from_typed<cplx>(m)
+        || dst->template add_from_typed<float>(m);
+}
+
+// *********************************************************************************************************************
+CSRMatrix::CSRMatrix(int size) : Matrix()
+{
+    init();
+    this->size = size;
+}
+
+CSRMatrix::CSRMatrix(int size, int nnz, int *Ap, int *Ai, double *Ax, bool owner) : Matrix()
+{
+    init();
+    this->size = size;
+    this->nnz = nnz;
+    this->owner = owner;
+
+    this->Ap = Ap;
+    this->Ai = Ai;
+    this->Ax = Ax;
+}
+
+CSRMatrix::CSRMatrix(int size, int nnz, int *Ap, int *Ai, cplx *Ax_cplx, bool owner) : Matrix()
+{
+    init();
+    this->size = size;
+    this->nnz = nnz;
+    this->complex = true;
+    this->owner = owner;
+
+    this->Ap = Ap;
+    this->Ai = Ai;
+    this->Ax_cplx = Ax_cplx;
+}
+
+CSRMatrix::CSRMatrix(CooMatrix *m) : Matrix()
+{
+    init();
+    this->add_from_coo(m);
+}
+
+CSRMatrix::CSRMatrix(CSCMatrix *m) : Matrix()
+{
+    init();
+    this->add_from_csc(m);
+}
+
+CSRMatrix::CSRMatrix(DenseMatrix *m) : Matrix()
+{
+    init();
+    this->add_from_dense(m);
+}
+
+CSRMatrix::CSRMatrix(BSRMatrix *m) : Matrix()
+{
+    init();
+    this->add_from_bsr(m);
+}
+
+CSRMatrix::CSRMatrix(SELLMatrix *m) : Matrix()
+{
+    init();
+    this->add_from_sell(m);
+}
+
+CSRMatrix::CSRMatrix(CSRMatrix64 *m) : Matrix()
+{
+    init();
+    this->add_from_csr64(m);
+}
+
+CSRMatrix::CSRMatrix(Matrix *m) : Matrix()
+{
+    init();
+
+    if (dynamic_cast<CooMatrix*>(m))
+        this->add_from_coo((CooMatrix*)m);
+    else if (dynamic_cast<CSCMatrix*>(m))
+        this->add_from_csc((CSCMatrix*)m);
+    else if (dynamic_cast<DenseMatrix*>(m))
+        this->add_from_dense((DenseMatrix*)m);
+    else if (dynamic_cast<BSRMatrix*>(m))
+        this->add_from_bsr((BSRMatrix*)m);
+    else if (dynamic_cast<SELLMatrix*>(m))
+        this->add_from_sell((SELLMatrix*)m);
+    else if (dynamic_cast<CSRMatrix64*>(m))
+        this->add_from_csr64((CSRMatrix64*)m);
+    else if (!add_from_typed_matrix(this, m))
+        _error("Matrix type not supported.");
+}
+
+CSRMatrix::~CSRMatrix()
+{
+    free_data();
+}
+
+void CSRMatrix::init()
+{
+    this->complex = false;
+    this->symmetric = false;
+    this->size = 0;
+    this->nnz = 0;
+    this->owner = true;
 
     this->Ax = NULL;
     this->Ax_cplx = NULL;
@@ -541,13 +1491,22 @@ void CSRMatrix::init()
 
 void CSRMatrix::free_data()
 {
-    if (this->Ap) { delete[] this->Ap; this->Ap = NULL; }
-    if (this->Ai) { delete[] this->Ai; this->Ai = NULL; }
-    if (this->Ax) { delete[] this->Ax; this->Ax = NULL; }
-    if (this->Ax_cplx) { delete[] this->Ax_cplx; this->Ax_cplx = NULL; }
+    if (this->owner)
+    {
+        if (this->Ap) delete[] this->Ap;
+        if (this->Ai) delete[] this->Ai;
+        if (this->Ax) delete[] this->Ax;
+        if (this->Ax_cplx) delete[] this->Ax_cplx;
+    }
+    this->Ap = NULL;
+    this->Ai = NULL;
+    this->Ax = NULL;
+    this->Ax_cplx = NULL;
+    this->owner = true;
 
     this->size = 0;
     this->nnz = 0;
+    this->symmetric = false;
 }
 
 void CSRMatrix::add_from_dense(DenseMatrix *m)
@@ -596,6 +1555,7 @@ void CSRMatrix::add_from_coo(CooMatrix *m)
     this->size = m->get_size();
     this->nnz = m->get_nnz();
     this->complex = m->is_complex();
+    this->symmetric = m->is_symmetric();
 
     // allocate data
     this->Ap = new int[this->size + 1];
@@ -605,27 +1565,11 @@ void CSRMatrix::add_from_coo(CooMatrix *m)
     else
         this->Ax = new double[this->nnz];
 
-    // get data
-    int *row = new int[this->nnz];
-    int *col = new int[this->nnz];
+    // no temporary triplets
     if (is_complex())
-    {
-        cplx *data = new cplx[this->nnz];
-        m->get_row_col_data(row, col, data);
-        coo_to_csr(this->size, this->nnz, row, col, data, Ap, Ai, Ax_cplx);
-        if (data) delete[] data;
-    }
+        m->get_csr(Ap, Ai, Ax_cplx);
     else
-    {
-        double *data = new double[this->nnz];
-        m->get_row_col_data(row, col, data);
-        coo_to_csr(this->size, this->nnz, row, col, data, Ap, Ai, Ax);
-        if (data) delete[] data;
-    }
-
-    // free data
-    if (row) delete[] row;
-    if (col) delete[] col;
+        m->get_csr(Ap, Ai, Ax);
 }
 
 void CSRMatrix::add_from_csc(CSCMatrix *m)
@@ -654,46 +1598,491 @@ void CSRMatrix::add_from_csc(CSCMatrix *m)
     }
 }
 
-void CSRMatrix::print()
+void CSRMatrix::add_from_bsr(BSRMatrix *m)
 {
-    printf("\nCSR Matrix:\n");
-    printf("size: %i\n", this->size);
-    printf("nzz: %i\n", this->nnz);
+    free_data();
 
-    print_vector("row_ptr", this->Ap, this->size+1);
-    print_vector("col_ind", this->Ai, this->nnz);
+    this->size = m->get_size();
+    this->nnz = m->get_nnz();
+    this->complex = m->is_complex();
+
+    // allocate data
+    this->Ap = new int[this->size + 1];
+    this->Ai = new int[this->nnz];
     if (is_complex())
-        print_vector("data", this->Ax_cplx, this->nnz);
+        this->Ax_cplx = new cplx[this->nnz];
     else
-        print_vector("data", this->Ax, this->nnz);
-}
-
-// *********************************************************************************************************************
+        this->Ax = new double[this->nnz];
 
-CSCMatrix::CSCMatrix(int size) : Matrix()
-{
-    init();
-    this->size = size;
+    if (is_complex())
+        m->get_csr(Ap, Ai, Ax_cplx);
+    else
+        m->get_csr(Ap, Ai, Ax);
 }
 
-CSCMatrix::CSCMatrix(CooMatrix *m) : Matrix()
+void CSRMatrix::add_from_sell(SELLMatrix *m)
 {
-    init();
-    this->add_from_coo(m);
-}
+    free_data();
 
-CSCMatrix::CSCMatrix(DenseMatrix *m) : Matrix()
-{
-    init();
-    this->add_from_dense(m);
-}
+    this->size = m->get_size();
+    this->nnz = m->get_nnz();
+    this->complex = m->is_complex();
 
-CSCMatrix::CSCMatrix(CSRMatrix *m) : Matrix()
-{
+    // allocate data
+    this->Ap = new int[this->size + 1];
+    this->Ai = new int[this->nnz];
+    if (is_complex())
+        this->Ax_cplx = new cplx[this->nnz];
+    else
+        this->Ax = new double[this->nnz];
+
+    if (is_complex())
+        m->get_csr(Ap, Ai, Ax_cplx);
+    else
+        m->get_csr(Ap, Ai, Ax);
+}
+
+void CSRMatrix::add_from_csr64(CSRMatrix64 *m)
+{
+    if (!m->fits_int())
+        _error("CSR matrix: the matrix has too many entries for 32-bit indices.");
+
+    free_data();
+
+    this->size = m->get_size();
+    this->nnz = (int) m->get_nnz();
+    this->complex = m->is_complex();
+    this->symmetric = m->is_symmetric();
+
+    // narrow the indices
+    this->Ap = new int[this->size + 1];
+    this->Ai = new int[this->nnz];
+    std::copy(m->get_Ap(), m->get_Ap() + this->size + 1, this->Ap);
+    std::copy(m->get_Ai(), m->get_Ai() + this->nnz, this->Ai);
+    if (is_complex())
+    {
+        this->Ax_cplx = new cplx[this->nnz];
+        std::copy(m->get_Ax_cplx(), m->get_Ax_cplx() + this->nnz, this->Ax_cplx);
+    }
+    else
+    {
+        this->Ax = new double[this->nnz];
+        std::copy(m->get_Ax(), m->get_Ax() + this->nnz, this->Ax);
+    }
+}
+
+template<typename T>
+bool CSRMatrix::add_from_typed(Matrix *m)
+{
+    CSRMatrixT<T> *mcsr = dynamic_cast<CSRMatrixT<T>*>(m);
+    if (mcsr == NULL)
+    {
+        if (!dynamic_cast<CSCMatrixT<T>*>(m))
+            return false;
+        CSCMatrix csc(m);
+        add_from_csc(&csc);
+        return true;
+    }
+
+    free_data();
+
+    this->size = mcsr->get_size();
+    this->nnz = mcsr->get_nnz();
+    this->complex = mcsr->is_complex();
+
+    this->Ap = new int[this->size + 1];
+    this->Ai = new int[this->nnz];
+    std::copy(mcsr->get_Ap(), mcsr->get_Ap() + this->size + 1, this->Ap);
+    std::copy(mcsr->get_Ai(), mcsr->get_Ai() + this->nnz, this->Ai);
+    widen_typed_values(this->nnz, mcsr->get_Ax(), this->Ax, this->Ax_cplx);
+    return true;
+}
+
+void CSRMatrix::set_zero()
+{
+    if (is_complex())
+        std::fill(this->Ax_cplx, this->Ax_cplx + this->nnz, cplx(0));
+    else
+        std::fill(this->Ax, this->Ax + this->nnz, 0.0);
+}
+
+void CSRMatrix::add(int m, int n, double v)
+{
+    if (this->complex)
+        _error("can't use add(int, int, double) for complex matrix");
+
+    // the lower triangle is folded into the upper one
+    if (this->symmetric && m > n)
+        std::swap(m, n);
+
+    int index = find_sorted_index(this->Ai, this->Ap[m], this->Ap[m+1], n);
+    if (index < 0)
+        _error("CSR matrix add(): entry is not in the sparsity pattern.");
+    this->Ax[index] += v;
+}
+
+void CSRMatrix::add(int m, int n, cplx v)
+{
+    if (!(this->complex))
+        _error("can't use add(int, int, cplx) for real matrix");
+
+    // the lower triangle is folded into the upper one
+    if (this->symmetric && m > n)
+        std::swap(m, n);
+
+    int index = find_sorted_index(this->Ai, this->Ap[m], this->Ap[m+1], n);
+    if (index < 0)
+        _error("CSR matrix add(): entry is not in the sparsity pattern.");
+    this->Ax_cplx[index] += v;
+}
+
+void CSRMatrix::add_block(int *iidx, int ilen, int *jidx, int jlen, double** mat)
+{
+    if (this->complex)
+        _error("can't use add_block() with double values for complex matrix");
+
+    if (!csr_add_block(this->Ap, this->Ai, this->Ax, iidx, ilen, jidx, jlen, mat, this->symmetric))
+        _error("CSR matrix add_block(): entry is not in the sparsity pattern.");
+}
+
+void CSRMatrix::add_block(int *iidx, int ilen, int *jidx, int jlen, cplx** mat)
+{
+    if (!(this->complex))
+        _error("can't use add_block() with cplx values for real matrix");
+
+    if (!csr_add_block(this->Ap, this->Ai, this->Ax_cplx, iidx, ilen, jidx, jlen, mat, this->symmetric))
+        _error("CSR matrix add_block(): entry is not in the sparsity pattern.");
+}
+
+void CSRMatrix::add_block(int *iidx, int ilen, int *jidx, int jlen, double** mat, ScatterMap *map)
+{
+    if (this->complex)
+        _error("can't use add_block() with double values for complex matrix");
+    if (ilen == 0 || jlen == 0)
+        return;
+
+    if (map->is_empty())
+    {
+        map->init(ilen, jlen);
+        if (!csr_find_block(this->Ap, this->Ai, iidx, ilen, jidx, jlen, map->get_offsets(), this->symmetric))
+        {
+            map->free_data();
+            _error("CSR matrix add_block(): entry is not in the sparsity pattern.");
+        }
+    }
+    else if (map->get_ilen() != ilen || map->get_jlen() != jlen)
+        _error("CSR matrix add_block(): the scatter map does not match the block.");
+
+    scatter_block(map->get_offsets(), ilen, jlen, mat, this->Ax);
+}
+
+void CSRMatrix::add_block(int *iidx, int ilen, int *jidx, int jlen, cplx** mat, ScatterMap *map)
+{
+    if (!(this->complex))
+        _error("can't use add_block() with cplx values for real matrix");
+    if (ilen == 0 || jlen == 0)
+        return;
+
+    if (map->is_empty())
+    {
+        map->init(ilen, jlen);
+        if (!csr_find_block(this->Ap, this->Ai, iidx, ilen, jidx, jlen, map->get_offsets(), this->symmetric))
+        {
+            map->free_data();
+            _error("CSR matrix add_block(): entry is not in the sparsity pattern.");
+        }
+    }
+    else if (map->get_ilen() != ilen || map->get_jlen() != jlen)
+        _error("CSR matrix add_block(): the scatter map does not match the block.");
+
+    scatter_block(map->get_offsets(), ilen, jlen, mat, this->Ax_cplx);
+}
+
+double CSRMatrix::get(int m, int n)
+{
+    if (this->complex)
+        _error("can't use get() for complex matrix");
+
+    if (this->symmetric && m > n)
+        std::swap(m, n);
+    int index = find_sorted_index(this->Ai, this->Ap[m], this->Ap[m+1], n);
+    return (index < 0) ? 0.0 : this->Ax[index];
+}
+
+cplx CSRMatrix::get_cplx(int m, int n)
+{
+    if (!(this->complex))
+        _error("can't use get_cplx() for real matrix");
+
+    if (this->symmetric && m > n)
+        std::swap(m, n);
+    int index = find_sorted_index(this->Ai, this->Ap[m], this->Ap[m+1], n);
+    return (index < 0) ? cplx(0) : this->Ax_cplx[index];
+}
+
+void CSRMatrix::times_vector(double* vec, double* result, int rank)
+{
+    if (this->complex) _error("CSRMatrix::times_vector(): the matrix is complex.");
+    if (this->symmetric)
+        csr_symmetric_times_vector<double>(this->size, this->Ap, this->Ai, this->Ax, vec, result);
+    else
+        csr_times_vector<double>(this->size, this->Ap, this->Ai, this->Ax, vec, result);
+}
+
+void CSRMatrix::times_vector(cplx* vec, cplx* result, int rank)
+{
+    if (!this->complex) _error("CSRMatrix::times_vector(): the matrix is real.");
+    if (this->symmetric)
+        csr_symmetric_times_vector<cplx>(this->size, this->Ap, this->Ai, this->Ax_cplx, vec, result);
+    else
+        csr_times_vector<cplx>(this->size, this->Ap, this->Ai, this->Ax_cplx, vec, result);
+}
+
+void CSRMatrix::times_vector(double *x, double *y, double alpha, double beta)
+{
+    if (this->complex) _error("CSRMatrix::times_vector(): the matrix is complex.");
+    if (this->symmetric)
+        csr_symmetric_times_vector<double>(this->size, this->Ap, this->Ai, this->Ax, x, y, alpha, beta);
+    else
+        csr_times_vector<double>(this->size, this->Ap, this->Ai, this->Ax, x, y, alpha, beta);
+}
+
+void CSRMatrix::times_vector(cplx *x, cplx *y, cplx alpha, cplx beta)
+{
+    if (!this->complex) _error("CSRMatrix::times_vector(): the matrix is real.");
+    if (this->symmetric)
+        csr_symmetric_times_vector<cplx>(this->size, this->Ap, this->Ai, this->Ax_cplx, x, y, alpha, beta);
+    else
+        csr_times_vector<cplx>(this->size, this->Ap, this->Ai, this->Ax_cplx, x, y, alpha, beta);
+}
+
+void CSRMatrix::set_symmetric(bool symmetric)
+{
+    if (symmetric)
+    {
+        for (int i = 0; i < this->size; i++)
+            if (this->Ap[i] < this->Ap[i+1] && this->Ai[this->Ap[i]] < i)
+                _error("CSRMatrix::set_symmetric(): the matrix has entries below the diagonal.");
+    }
+    this->symmetric = symmetric;
+}
+
+void CSRMatrix::expand_symmetric()
+{
+    if (!this->symmetric)
+        return;
+
+    int size = this->size;
+    int nnz = csr_symmetric_expanded_nnz(size, this->Ap, this->Ai);
+    bool complex = this->complex;
+    int *Bp = new int[size + 1];
+    int *Bi = new int[nnz];
+    double *Bx = NULL;
+    cplx *Bx_cplx = NULL;
+    if (complex)
+    {
+        Bx_cplx = new cplx[nnz];
+        csr_symmetric_expand<cplx>(size, this->Ap, this->Ai, this->Ax_cplx, Bp, Bi, Bx_cplx);
+    }
+    else
+    {
+        Bx = new double[nnz];
+        csr_symmetric_expand<double>(size, this->Ap, this->Ai, this->Ax, Bp, Bi, Bx);
+    }
+
+    // the expanded arrays are always owned
+    free_data();
+    this->size = size;
+    this->nnz = nnz;
+    this->complex = complex;
+    this->Ap = Bp;
+    this->Ai = Bi;
+    this->Ax = Bx;
+    this->Ax_cplx = Bx_cplx;
+}
+
+void CSRMatrix::get_rcm_ordering(int *perm)
+{
+    rcm_ordering(this->size, this->Ap, this->Ai, perm);
+}
+
+void CSRMatrix::permute(int *perm)
+{
+    int size = this->size;
+    int nnz = this->nnz;
+    bool complex = this->complex;
+    bool symmetric = this->symmetric;
+    int *Bp = new int[size + 1];
+    int *Bi = new int[nnz];
+    double *Bx = NULL;
+    cplx *Bx_cplx = NULL;
+    if (complex)
+    {
+        Bx_cplx = new cplx[nnz];
+        csr_permute(size, nnz, this->Ap, this->Ai, this->Ax_cplx, perm, Bp, Bi, Bx_cplx, symmetric);
+    }
+    else
+    {
+        Bx = new double[nnz];
+        csr_permute(size, nnz, this->Ap, this->Ai, this->Ax, perm, Bp, Bi, Bx, symmetric);
+    }
+
+    // the permuted arrays are always owned
+    free_data();
+    this->size = size;
+    this->nnz = nnz;
+    this->complex = complex;
+    this->symmetric = symmetric;
+    this->Ap = Bp;
+    this->Ai = Bi;
+    this->Ax = Bx;
+    this->Ax_cplx = Bx_cplx;
+}
+
+/// The values of the CSR matrix m as cplx, the values of a real matrix are
+/// promoted into the new array tmp (NULL otherwise), which the caller frees.
+static cplx *csr_values_cplx(CSRMatrix *m, cplx *&tmp)
+{
+    tmp = NULL;
+    if (m->is_complex())
+        return m->get_Ax_cplx();
+    tmp = new cplx[m->get_nnz()];
+    std::copy(m->get_Ax(), m->get_Ax() + m->get_nnz(), tmp);
+    return tmp;
+}
+
+void CSRMatrix::init_result(CSRMatrix *A, CSRMatrix *B, bool product, bool complex, bool reuse_pattern)
+{
+    if (A == this || B == this)
+        _error("CSRMatrix: the result can't be one of the operands.");
+    if (A->get_size() != B->get_size())
+        _error("CSRMatrix: the matrices have different sizes.");
+    if (A->is_symmetric() || B->is_symmetric())
+        _error("CSRMatrix: expand the symmetric matrices first.");
+
+    int size = A->get_size();
+    if (reuse_pattern && this->Ap != NULL && this->size == size && this->complex == complex && !this->symmetric)
+        return;
+
+    int *Cp, *Ci;
+    int nnz;
+    if (product)
+        nnz = csr_multiply_symbolic(size, size, A->Ap, A->Ai, B->Ap, B->Ai, Cp, Ci);
+    else
+        nnz = csr_add_symbolic(size, A->Ap, A->Ai, B->Ap, B->Ai, Cp, Ci);
+
+    free_data();
+    this->size = size;
+    this->nnz = nnz;
+    this->complex = complex;
+    this->Ap = Cp;
+    this->Ai = Ci;
+    if (complex)
+        this->Ax_cplx = new cplx[nnz];
+    else
+        this->Ax = new double[nnz];
+}
+
+void CSRMatrix::set_product(CSRMatrix *A, CSRMatrix *B, bool reuse_pattern)
+{
+    bool complex = A->is_complex() || B->is_complex();
+    init_result(A, B, true, complex, reuse_pattern);
+
+    if (complex)
+    {
+        cplx *Atmp, *Btmp;
+        cplx *Ax = csr_values_cplx(A, Atmp);
+        cplx *Bx = csr_values_cplx(B, Btmp);
+        csr_multiply_numeric(this->size, this->size, A->Ap, A->Ai, Ax, B->Ap, B->Ai, Bx, this->Ap, this->Ai, this->Ax_cplx);
+        delete[] Atmp;
+        delete[] Btmp;
+    }
+    else
+        csr_multiply_numeric(this->size, this->size, A->Ap, A->Ai, A->Ax, B->Ap, B->Ai, B->Ax, this->Ap, this->Ai, this->Ax);
+}
+
+void CSRMatrix::set_sum(double alpha, CSRMatrix *A, double beta, CSRMatrix *B, bool reuse_pattern)
+{
+    if (A->is_complex() || B->is_complex())
+    {
+        set_sum(cplx(alpha), A, cplx(beta), B, reuse_pattern);
+        return;
+    }
+
+    init_result(A, B, false, false, reuse_pattern);
+    csr_add_numeric(this->size, alpha, A->Ap, A->Ai, A->Ax, beta, B->Ap, B->Ai, B->Ax, this->Ap, this->Ai, this->Ax);
+}
+
+void CSRMatrix::set_sum(cplx alpha, CSRMatrix *A, cplx beta, CSRMatrix *B, bool reuse_pattern)
+{
+    init_result(A, B, false, true, reuse_pattern);
+
+    cplx *Atmp, *Btmp;
+    cplx *Ax = csr_values_cplx(A, Atmp);
+    cplx *Bx = csr_values_cplx(B, Btmp);
+    csr_add_numeric(this->size, alpha, A->Ap, A->Ai, Ax, beta, B->Ap, B->Ai, Bx, this->Ap, this->Ai, this->Ax_cplx);
+    delete[] Atmp;
+    delete[] Btmp;
+}
+
+void CSRMatrix::print()
+{
+    printf("\nCSR Matrix:\n");
+    printf("size: %i\n", this->size);
+    printf("nzz: %i\n", this->nnz);
+
+    print_vector("row_ptr", this->Ap, this->size+1);
+    print_vector("col_ind", this->Ai, this->nnz);
+    if (is_complex())
+        print_vector("data", this->Ax_cplx, this->nnz);
+    else
+        print_vector("data", this->Ax, this->nnz);
+}
+
+// *********************************************************************************************************************
+
+CSCMatrix::CSCMatrix(int size) : Matrix()
+{
+    init();
+    this->size = size;
+}
+
+CSCMatrix::CSCMatrix(CooMatrix *m) : Matrix()
+{
+    init();
+    this->add_from_coo(m);
+}
+
+CSCMatrix::CSCMatrix(DenseMatrix *m) : Matrix()
+{
+    init();
+    this->add_from_dense(m);
+}
+
+CSCMatrix::CSCMatrix(CSRMatrix *m) : Matrix()
+{
     init();
     this->add_from_csr(m);
 }
 
+CSCMatrix::CSCMatrix(BSRMatrix *m) : Matrix()
+{
+    init();
+    this->add_from_bsr(m);
+}
+
+CSCMatrix::CSCMatrix(SELLMatrix *m) : Matrix()
+{
+    init();
+    this->add_from_sell(m);
+}
+
+CSCMatrix::CSCMatrix(CSRMatrix64 *m) : Matrix()
+{
+    init();
+    this->add_from_csr64(m);
+}
+
 CSCMatrix::CSCMatrix(Matrix *m) : Matrix()
 {
     init();
@@ -704,26 +2093,35 @@ CSCMatrix::CSCMatrix(Matrix *m) : Matrix()
         this->add_from_dense((DenseMatrix *) m);
     else if (dynamic_cast<CSRMatrix *>(m))
         this->add_from_csr((CSRMatrix *) m);
-    else
+    else if (dynamic_cast<BSRMatrix *>(m))
+        this->add_from_bsr((BSRMatrix *) m);
+    else if (dynamic_cast<SELLMatrix *>(m))
+        this->add_from_sell((SELLMatrix *) m);
+    else if (dynamic_cast<CSRMatrix64 *>(m))
+        this->add_from_csr64((CSRMatrix64 *) m);
+    else if (!add_from_typed_matrix(this, m))
         _error("Matrix type not supported.");
 }
 
-CSCMatrix::CSCMatrix(int size, int nnz, int *Ap, int *Ai, double *Ax)
+CSCMatrix::CSCMatrix(int size, int nnz, int *Ap, int *Ai, double *Ax, bool owner) : Matrix()
 {
+    init();
     this->size = size;
     this->nnz = nnz;
-    this->complex = false;
+    this->owner = owner;
 
     this->Ap = Ap;
     this->Ai = Ai;
     this->Ax = Ax;
 }
 
-CSCMatrix::CSCMatrix(int size, int nnz, int *Ap, int *Ai, cplx *Ax_cplx)
+CSCMatrix::CSCMatrix(int size, int nnz, int *Ap, int *Ai, cplx *Ax_cplx, bool owner) : Matrix()
 {
+    init();
     this->size = size;
     this->nnz = nnz;
     this->complex = true;
+    this->owner = owner;
 
     this->Ap = Ap;
     this->Ai = Ai;
@@ -741,6 +2139,7 @@ void CSCMatrix::init()
     this->complex = false;
     this->size = 0;
     this->nnz = 0;
+    this->owner = true;
 
     this->Ax = NULL;
     this->Ax_cplx = NULL;
@@ -750,10 +2149,18 @@ void CSCMatrix::init()
 
 void CSCMatrix::free_data()
 {
-    if (this->Ap) { delete[] this->Ap; this->Ap = NULL; }
-    if (this->Ai) { delete[] this->Ai; this->Ai = NULL; }
-    if (this->Ax) { delete[] this->Ax; this->Ax = NULL; }
-    if (this->Ax_cplx) { delete[] this->Ax_cplx; this->Ax_cplx = NULL; }
+    if (this->owner)
+    {
+        if (this->Ap) delete[] this->Ap;
+        if (this->Ai) delete[] this->Ai;
+        if (this->Ax) delete[] this->Ax;
+        if (this->Ax_cplx) delete[] this->Ax_cplx;
+    }
+    this->Ap = NULL;
+    this->Ai = NULL;
+    this->Ax = NULL;
+    this->Ax_cplx = NULL;
+    this->owner = true;
 
     size = 0;
     nnz = 0;
@@ -803,6 +2210,14 @@ void CSCMatrix::add_from_dense(DenseMatrix *m)
 
 void CSCMatrix::add_from_coo(CooMatrix *m)
 {
+    if (m->is_symmetric())
+    {
+        // expanded from the upper triangle in CSR
+        CSRMatrix upper(m);
+        add_from_csr(&upper);
+        return;
+    }
+
     free_data();
 
     this->size = m->get_size();
@@ -817,27 +2232,11 @@ void CSCMatrix::add_from_coo(CooMatrix *m)
     else
         this->Ax = new double[this->nnz];
 
-    // get data
-    int *row = new int[this->nnz];
-    int *col = new int[this->nnz];
+    // no temporary triplets
     if (is_complex())
-    {
-        cplx *data = new cplx[this->nnz];
-        m->get_row_col_data(row, col, data);
-        coo_to_csc(this->size, this->nnz, row, col, data, Ap, Ai, Ax_cplx);
-        if (data) delete[] data;
-    }
+        m->get_csc(Ap, Ai, Ax_cplx);
     else
-    {
-        double *data = new double[this->nnz];
-        m->get_row_col_data(row, col, data);
-        coo_to_csc(this->size, this->nnz, row, col, data, Ap, Ai, Ax);
-        if (data) delete[] data;
-    }
-
-    // free data
-    if (row) delete[] row;
-    if (col) delete[] col;
+        m->get_csc(Ap, Ai, Ax);
 }
 
 void CSCMatrix::add_from_csr(CSRMatrix *m)
@@ -848,6 +2247,26 @@ void CSCMatrix::add_from_csr(CSRMatrix *m)
     this->nnz = m->get_nnz();
     this->complex = m->is_complex();
 
+    if (m->is_symmetric())
+    {
+        // the full matrix is symmetric, so its CSR arrays are also its CSC
+        // arrays
+        this->nnz = csr_symmetric_expanded_nnz(this->size, m->get_Ap(), m->get_Ai());
+        this->Ap = new int[this->size + 1];
+        this->Ai = new int[this->nnz];
+        if (is_complex())
+        {
+            this->Ax_cplx = new cplx[this->nnz];
+            csr_symmetric_expand(this->size, m->get_Ap(), m->get_Ai(), m->get_Ax_cplx(), Ap, Ai, Ax_cplx);
+        }
+        else
+        {
+            this->Ax = new double[this->nnz];
+            csr_symmetric_expand(this->size, m->get_Ap(), m->get_Ai(), m->get_Ax(), Ap, Ai, Ax);
+        }
+        return;
+    }
+
     // allocate data
     this->Ap = new int[this->size + 1];
     this->Ai = new int[this->nnz];
@@ -866,272 +2285,3425 @@ void CSCMatrix::add_from_csr(CSRMatrix *m)
     }
 }
 
-void CSCMatrix::print()
+void CSCMatrix::add_from_bsr(BSRMatrix *m)
 {
-    printf("\nCSC Matrix:\n");
-    printf("size: %i\n", this->size);
-    printf("nzz: %i\n", this->nnz);
+    free_data();
 
-    print_vector("col_ptr", this->Ap, this->size+1);
-    print_vector("row_ind", this->Ai, this->nnz);
+    this->size = m->get_size();
+    this->nnz = m->get_nnz();
+    this->complex = m->is_complex();
+
+    // allocate data
+    this->Ap = new int[this->size + 1];
+    this->Ai = new int[this->nnz];
     if (is_complex())
-        print_vector("data", this->Ax_cplx, this->nnz);
+        this->Ax_cplx = new cplx[this->nnz];
     else
-        print_vector("data", this->Ax, this->nnz);
+        this->Ax = new double[this->nnz];
+
+    if (is_complex())
+        m->get_csc(Ap, Ai, Ax_cplx);
+    else
+        m->get_csc(Ap, Ai, Ax);
 }
 
-// ******************************************************************************************************************************
+void CSCMatrix::add_from_csr64(CSRMatrix64 *m)
+{
+    CSRMatrix narrow(m);
+    add_from_csr(&narrow);
+}
 
 template<typename T>
-void dense_to_coo(int size, int nnz, T **Ad, int *row, int *col, T *A)
+bool CSCMatrix::add_from_typed(Matrix *m)
 {
-    int count = 0;
-    for (int i = 0; i < size; i++)
+    CSCMatrixT<T> *mcsc = dynamic_cast<CSCMatrixT<T>*>(m);
+    if (mcsc == NULL)
     {
-        for (int j = 0; j < size; j++)
-        {
-            if (std::abs(Ad[i][j]) > 1e-12)
-            {
-                row[count] = i;
-                col[count] = j;
-                A[count] = Ad[i][j];
-
-                count++;
-            }
-        }
+        if (!dynamic_cast<CSRMatrixT<T>*>(m))
+            return false;
+        CSRMatrix csr(m);
+        add_from_csr(&csr);
+        return true;
     }
+
+    free_data();
+
+    this->size = mcsc->get_size();
+    this->nnz = mcsc->get_nnz();
+    this->complex = mcsc->is_complex();
+
+    this->Ap = new int[this->size + 1];
+    this->Ai = new int[this->nnz];
+    std::copy(mcsc->get_Ap(), mcsc->get_Ap() + this->size + 1, this->Ap);
+    std::copy(mcsc->get_Ai(), mcsc->get_Ai() + this->nnz, this->Ai);
+    widen_typed_values(this->nnz, mcsc->get_Ax(), this->Ax, this->Ax_cplx);
+    return true;
 }
 
-template<typename T>
-void coo_to_csr(int size, int nnz, int *row, int *col, T *A, int *Ap, int *Ai, T *Ax)
+void CSCMatrix::add_from_sell(SELLMatrix *m)
 {
-    std::fill(Ap, Ap + size, 0);
+    free_data();
 
-    for (int n = 0; n < nnz; n++)
-    {
-        Ap[row[n]]++;
-    }
+    this->size = m->get_size();
+    this->nnz = m->get_nnz();
+    this->complex = m->is_complex();
 
-    // cumsum the nnz per row to get this->row_ptr[]
-    for(int i = 0, cumsum = 0; i < size; i++)
-    {
-        int temp = Ap[i];
-        Ap[i] = cumsum;
-        cumsum += temp;
-    }
-    Ap[size] = nnz;
+    // allocate data
+    this->Ap = new int[this->size + 1];
+    this->Ai = new int[this->nnz];
+    if (is_complex())
+        this->Ax_cplx = new cplx[this->nnz];
+    else
+        this->Ax = new double[this->nnz];
 
-    // write Aj, Ax into Bj, Bx
-    for(int n = 0; n < nnz; n++)
-    {
-        int index  = row[n];
-        int dest = Ap[index];
+    if (is_complex())
+        m->get_csc(Ap, Ai, Ax_cplx);
+    else
+        m->get_csc(Ap, Ai, Ax);
+}
 
-        Ai[dest] = col[n];
-        Ax[dest] = A[n];
+void CSCMatrix::set_zero()
+{
+    if (is_complex())
+        std::fill(this->Ax_cplx, this->Ax_cplx + this->nnz, cplx(0));
+    else
+        std::fill(this->Ax, this->Ax + this->nnz, 0.0);
+}
 
-        Ap[index]++;
-    }
+void CSCMatrix::add(int m, int n, double v)
+{
+    if (this->complex)
+        _error("can't use add(int, int, double) for complex matrix");
 
-    for(int i = 0, last = 0; i <= size; i++)
-    {
-        int temp = Ap[i];
-        Ap[i]  = last;
-        last   = temp;
-    }
+    int index = find_sorted_index(this->Ai, this->Ap[n], this->Ap[n+1], m);
+    if (index < 0)
+        _error("CSC matrix add(): entry is not in the sparsity pattern.");
+    this->Ax[index] += v;
 }
 
-template<typename T>
-void coo_to_csc(int size, int nnz, int *row, int *col, T *A, int *Ap, int *Ai, T *Ax)
+void CSCMatrix::add(int m, int n, cplx v)
 {
-    coo_to_csr(size, nnz, col, row, A, Ap, Ai, Ax);
+    if (!(this->complex))
+        _error("can't use add(int, int, cplx) for real matrix");
+
+    int index = find_sorted_index(this->Ai, this->Ap[n], this->Ap[n+1], m);
+    if (index < 0)
+        _error("CSC matrix add(): entry is not in the sparsity pattern.");
+    this->Ax_cplx[index] += v;
 }
 
-template<typename T>
-void csr_to_csc(int size, int nnz, int *Arp, int *Ari, T *Arx, int *Acp, int *Aci, T *Acx)
+void CSCMatrix::add_block(int *iidx, int ilen, int *jidx, int jlen, double** mat)
 {
-    //compute number of non-zero entries per column of A
-    std::fill(Acp, Acp + size, 0);
+    if (this->complex)
+        _error("can't use add_block() with double values for complex matrix");
 
-    for (int n = 0; n < nnz; n++)
-        Acp[Ari[n]]++;
+    if (!csc_add_block(this->Ap, this->Ai, this->Ax, iidx, ilen, jidx, jlen, mat))
+        _error("CSC matrix add_block(): entry is not in the sparsity pattern.");
+}
 
-    // cumsum the nnz per column to get Bp[]
-    for(int col = 0, cumsum = 0; col < size; col++)
-    {
-        int temp  = Acp[col];
-        Acp[col] = cumsum;
-        cumsum += temp;
-    }
-    Acp[size] = nnz;
+void CSCMatrix::add_block(int *iidx, int ilen, int *jidx, int jlen, cplx** mat)
+{
+    if (!(this->complex))
+        _error("can't use add_block() with cplx values for real matrix");
 
-    for(int row = 0; row < size; row++)
+    if (!csc_add_block(this->Ap, this->Ai, this->Ax_cplx, iidx, ilen, jidx, jlen, mat))
+        _error("CSC matrix add_block(): entry is not in the sparsity pattern.");
+}
+
+void CSCMatrix::add_block(int *iidx, int ilen, int *jidx, int jlen, double** mat, ScatterMap *map)
+{
+    if (this->complex)
+        _error("can't use add_block() with double values for complex matrix");
+    if (ilen == 0 || jlen == 0)
+        return;
+
+    if (map->is_empty())
     {
-        for(int jj = Arp[row]; jj < Arp[row+1]; jj++)
+        map->init(ilen, jlen);
+        if (!csc_find_block(this->Ap, this->Ai, iidx, ilen, jidx, jlen, map->get_offsets()))
         {
-            int col  = Ari[jj];
-            int dest = Acp[col];
+            map->free_data();
+            _error("CSC matrix add_block(): entry is not in the sparsity pattern.");
+        }
+    }
+    else if (map->get_ilen() != ilen || map->get_jlen() != jlen)
+        _error("CSC matrix add_block(): the scatter map does not match the block.");
 
-            Aci[dest] = row;
-            Acx[dest] = Arx[jj];
+    scatter_block(map->get_offsets(), ilen, jlen, mat, this->Ax);
+}
 
-            Acp[col]++;
+void CSCMatrix::add_block(int *iidx, int ilen, int *jidx, int jlen, cplx** mat, ScatterMap *map)
+{
+    if (!(this->complex))
+        _error("can't use add_block() with cplx values for real matrix");
+    if (ilen == 0 || jlen == 0)
+        return;
+
+    if (map->is_empty())
+    {
+        map->init(ilen, jlen);
+        if (!csc_find_block(this->Ap, this->Ai, iidx, ilen, jidx, jlen, map->get_offsets()))
+        {
+            map->free_data();
+            _error("CSC matrix add_block(): entry is not in the sparsity pattern.");
         }
     }
+    else if (map->get_ilen() != ilen || map->get_jlen() != jlen)
+        _error("CSC matrix add_block(): the scatter map does not match the block.");
+
+    scatter_block(map->get_offsets(), ilen, jlen, mat, this->Ax_cplx);
+}
+
+double CSCMatrix::get(int m, int n)
+{
+    if (this->complex)
+        _error("can't use get() for complex matrix");
+
+    int index = find_sorted_index(this->Ai, this->Ap[n], this->Ap[n+1], m);
+    return (index < 0) ? 0.0 : this->Ax[index];
+}
+
+cplx CSCMatrix::get_cplx(int m, int n)
+{
+    if (!(this->complex))
+        _error("can't use get_cplx() for real matrix");
+
+    int index = find_sorted_index(this->Ai, this->Ap[n], this->Ap[n+1], m);
+    return (index < 0) ? cplx(0) : this->Ax_cplx[index];
+}
+
+void CSCMatrix::times_vector(double* vec, double* result, int rank)
+{
+    if (this->complex) _error("CSCMatrix::times_vector(): the matrix is complex.");
+    csc_times_vector<double>(this->size, this->Ap, this->Ai, this->Ax, vec, result);
+}
+
+void CSCMatrix::times_vector(cplx* vec, cplx* result, int rank)
+{
+    if (!this->complex) _error("CSCMatrix::times_vector(): the matrix is real.");
+    csc_times_vector<cplx>(this->size, this->Ap, this->Ai, this->Ax_cplx, vec, result);
+}
+
+void CSCMatrix::times_vector(double *x, double *y, double alpha, double beta)
+{
+    if (this->complex) _error("CSCMatrix::times_vector(): the matrix is complex.");
+    csc_times_vector<double>(this->size, this->Ap, this->Ai, this->Ax, x, y, alpha, beta);
+}
 
-    for(int col = 0, last = 0; col <= size; col++)
+void CSCMatrix::times_vector(cplx *x, cplx *y, cplx alpha, cplx beta)
+{
+    if (!this->complex) _error("CSCMatrix::times_vector(): the matrix is real.");
+    csc_times_vector<cplx>(this->size, this->Ap, this->Ai, this->Ax_cplx, x, y, alpha, beta);
+}
+
+void CSCMatrix::get_rcm_ordering(int *perm)
+{
+    rcm_ordering(this->size, this->Ap, this->Ai, perm);
+}
+
+void CSCMatrix::permute(int *perm)
+{
+    // the columns of A are the rows of A^T, and P A^T P^T = (P A P^T)^T
+    int size = this->size;
+    int nnz = this->nnz;
+    bool complex = this->complex;
+    int *Bp = new int[size + 1];
+    int *Bi = new int[nnz];
+    double *Bx = NULL;
+    cplx *Bx_cplx = NULL;
+    if (complex)
     {
-        int temp  = Acp[col];
-        Acp[col] = last;
-        last = temp;
+        Bx_cplx = new cplx[nnz];
+        csr_permute(size, nnz, this->Ap, this->Ai, this->Ax_cplx, perm, Bp, Bi, Bx_cplx);
+    }
+    else
+    {
+        Bx = new double[nnz];
+        csr_permute(size, nnz, this->Ap, this->Ai, this->Ax, perm, Bp, Bi, Bx);
     }
+
+    free_data();
+    this->size = size;
+    this->nnz = nnz;
+    this->complex = complex;
+    this->Ap = Bp;
+    this->Ai = Bi;
+    this->Ax = Bx;
+    this->Ax_cplx = Bx_cplx;
+}
+
+void CSCMatrix::print()
+{
+    printf("\nCSC Matrix:\n");
+    printf("size: %i\n", this->size);
+    printf("nzz: %i\n", this->nnz);
+
+    print_vector("col_ptr", this->Ap, this->size+1);
+    print_vector("row_ind", this->Ai, this->nnz);
+    if (is_complex())
+        print_vector("data", this->Ax_cplx, this->nnz);
+    else
+        print_vector("data", this->Ax, this->nnz);
 }
 
+// *********************************************************************************************************************
+
+/// Converts the CSR matrix (Ap, Ai, Ax) to the BSR format with b x b blocks,
+/// allocates Bp[nb+1], Bi[nnzb] and Bx[nnzb*b*b] and returns nnzb.
 template<typename T>
-void csc_to_csr(int size, int nnz, int *Acp, int *Aci, T *Acx, int *Arp, int *Ari, T *Arx)
+static int csr_to_bsr(int size, int *Ap, int *Ai, T *Ax, int b, int nb, int *&Bp, int *&Bi, T *&Bx)
 {
-    csr_to_csc(size, nnz, Acp, Aci, Acx, Arp, Ari, Arx);
+    // last block row that has the block column J, and the position of the block
+    int *seen = new int[nb];
+    int *where = new int[nb];
+    std::fill(seen, seen + nb, -1);
+
+    Bp = new int[nb + 1];
+    Bp[0] = 0;
+    for (int I = 0; I < nb; I++)
+    {
+        int count = 0;
+        for (int i = I*b; i < std::min((I+1)*b, size); i++)
+            for (int k = Ap[i]; k < Ap[i+1]; k++)
+                if (seen[Ai[k] / b] != I)
+                {
+                    seen[Ai[k] / b] = I;
+                    count++;
+                }
+        Bp[I+1] = Bp[I] + count;
+    }
+
+    int nnzb = Bp[nb];
+    int bb = b*b;
+    Bi = new int[nnzb];
+    Bx = new T[(size_t) nnzb * bb];
+    std::fill(Bx, Bx + (size_t) nnzb * bb, T(0.0));
+
+    std::fill(seen, seen + nb, -1);
+    for (int I = 0; I < nb; I++)
+    {
+        int pos = Bp[I];
+        for (int i = I*b; i < std::min((I+1)*b, size); i++)
+            for (int k = Ap[i]; k < Ap[i+1]; k++)
+                if (seen[Ai[k] / b] != I)
+                {
+                    seen[Ai[k] / b] = I;
+                    Bi[pos++] = Ai[k] / b;
+                }
+        std::sort(Bi + Bp[I], Bi + Bp[I+1]);
+        for (int k = Bp[I]; k < Bp[I+1]; k++)
+            where[Bi[k]] = k;
+
+        for (int i = I*b; i < std::min((I+1)*b, size); i++)
+            for (int k = Ap[i]; k < Ap[i+1]; k++)
+            {
+                int J = Ai[k] / b;
+                Bx[(size_t) where[J] * bb + (i - I*b) * b + (Ai[k] - J*b)] += Ax[k];
+            }
+    }
+
+    delete[] seen;
+    delete[] where;
+    return nnzb;
 }
 
+/// Expands the BSR matrix (Bp, Bi, Bx) to the CSR matrix (Ap, Ai, Ax), all
+/// entries of the blocks within size x size are kept.
 template<typename T>
-void csc_to_coo(int size, int nnz, int *Ap, int *Ai, T *Ax, int *row, int *col, T *A)
+static void bsr_to_csr(int size, int b, int nb, int *Bp, int *Bi, T *Bx, int *Ap, int *Ai, T *Ax)
 {
+    int bb = b*b;
     int count = 0;
-    // loop through columns...
-    for (int i = 1; i <= size; i++)
+    Ap[0] = 0;
+    for (int I = 0; I < nb; I++)
     {
-        for (int j = count; j < Ap[i]; j++)
+        for (int r = 0; r < b && I*b + r < size; r++)
         {
-            A[count] = Ax[count];
-            row[count] = Ai[count];
-            col[count] = i-1;
-
-            count++;
+            for (int k = Bp[I]; k < Bp[I+1]; k++)
+            {
+                int J = Bi[k];
+                T *row = Bx + (size_t) k * bb + r * b;
+                for (int c = 0; c < b && J*b + c < size; c++)
+                {
+                    Ai[count] = J*b + c;
+                    Ax[count] = row[c];
+                    count++;
+                }
+            }
+            Ap[I*b + r + 1] = count;
         }
     }
 }
 
+/// Adds the block mat[ilen][jlen] into the existing blocks of the BSR matrix
+/// (Ap, Ai, Ax). Negative indices are skipped. Returns false if an entry is
+/// not in the sparsity pattern.
 template<typename T>
-void csr_to_coo(int size, int nnz, int *Ap, int *Ai, T *Ax, int *row, int *col, T *A)
+static bool bsr_add_block(int b, int *Ap, int *Ai, T *Ax, int *iidx, int ilen, int *jidx, int jlen, T **mat)
 {
-    int count = 0;
-    // loop through rows...
-    for (int i = 1; i <= size; i++)
+    int bb = b*b;
+    for (int i = 0; i < ilen; i++)
     {
-        for (int j = count; j < Ap[i]; j++)
+        if (iidx[i] < 0) continue;
+        int I = iidx[i] / b;
+        int r = iidx[i] - I*b;
+        // the columns of an element block usually come by nodes, so that the
+        // block found for the previous column is tried first
+        int J_last = -1;
+        int index = -1;
+        for (int j = 0; j < jlen; j++)
         {
-            A[count] = Ax[count];
-            col[count] = Ai[count];
-            row[count] = i-1;
-
-            count++;
+            if (jidx[j] < 0) continue;
+            int J = jidx[j] / b;
+            if (J != J_last)
+            {
+                index = find_sorted_index(Ai, Ap[I], Ap[I+1], J);
+                if (index < 0) return false;
+                J_last = J;
+            }
+            Ax[(size_t) index * bb + r * b + (jidx[j] - J*b)] += mat[i][j];
         }
     }
+    return true;
 }
 
-// matrix vector multiplication
-void mat_dot(Matrix *A, double *x, double *result, int n_dof)
+/// Number of entries of the expansion of the BSR matrix (Ap, Ai) to CSR.
+static int bsr_expanded_nnz(int size, int b, int nb, int *Ap, int *Ai)
 {
-    A->times_vector(x, result, n_dof);
+    int nnz = 0;
+    for (int I = 0; I < nb; I++)
+        for (int k = Ap[I]; k < Ap[I+1]; k++)
+            nnz += std::min(b, size - I*b) * std::min(b, size - Ai[k]*b);
+    return nnz;
 }
 
-// vector vector multiplication
-double vec_dot(double *r, double *s, int n_dof)
+BSRMatrix::BSRMatrix(CooMatrix *m, int bsize) : Matrix()
 {
-    double result = 0;
-    for (int i=0; i < n_dof; i++) result += r[i]*s[i];
-    return result;
+    init();
+    this->add_from_coo(m, bsize);
 }
 
-/// Solves the set of n linear equations A*x = b, where a is a positive-definite symmetric matrix.
-/// a[n][n] and p[n] are input as the output of the routine choldc. Only the lower
-/// subdiagonal portion of a is accessed. b[n] is input as the right-hand side vector. The
-/// solution vector is returned in x[n]. a, n, and p are not modified and can be left in place
-/// for successive calls with different right-hand sides b. b is not modified unless you identify b and
-/// x in the calling sequence, which is allowed. The right-hand side b can be complex, in which case
-/// the solution x is also complex.
-void ludcmp(double** a, int n, int* indx, double* d)
+BSRMatrix::BSRMatrix(CSRMatrix *m, int bsize) : Matrix()
 {
-    int i, imax = 0, j, k;
-    double big, dum, sum, temp;
-    double* vv = new double[n];
+    init();
+    this->add_from_csr(m, bsize);
+}
 
-    *d = 1.0;
-    for (i = 0; i < n; i++)
-    {
-        big=0.0;
-        for (j = 0; j < n; j++)
-            if ((temp = fabs(a[i][j])) > big)
-                big = temp;
+BSRMatrix::~BSRMatrix()
+{
+    free_data();
+}
+
+void BSRMatrix::init()
+{
+    this->complex = false;
+    this->size = 0;
+    this->bsize = 1;
+    this->nb = 0;
+    this->nnzb = 0;
+    this->nnz = 0;
+
+    this->Ap = NULL;
+    this->Ai = NULL;
+    this->Ax = NULL;
+    this->Ax_cplx = NULL;
+}
+
+void BSRMatrix::free_data()
+{
+    if (this->Ap) delete[] this->Ap;
+    if (this->Ai) delete[] this->Ai;
+    if (this->Ax) delete[] this->Ax;
+    if (this->Ax_cplx) delete[] this->Ax_cplx;
+    this->Ap = NULL;
+    this->Ai = NULL;
+    this->Ax = NULL;
+    this->Ax_cplx = NULL;
+
+    this->size = 0;
+    this->nb = 0;
+    this->nnzb = 0;
+    this->nnz = 0;
+}
+
+void BSRMatrix::add_from_coo(CooMatrix *m, int bsize)
+{
+    CSRMatrix csr(m);
+    this->add_from_csr(&csr, bsize);
+}
+
+void BSRMatrix::add_from_csr(CSRMatrix *m, int bsize)
+{
+    if (bsize < 1)
+        _error("BSR matrix: the block size must be positive.");
+
+    if (m->is_symmetric())
+    {
+        // the expanded CSC arrays are also the CSR arrays of the full matrix
+        CSCMatrix full(m);
+        if (full.is_complex())
+        {
+            CSRMatrix view(full.get_size(), full.get_nnz(), full.get_Ap(), full.get_Ai(), full.get_Ax_cplx(), false);
+            add_from_csr(&view, bsize);
+        }
+        else
+        {
+            CSRMatrix view(full.get_size(), full.get_nnz(), full.get_Ap(), full.get_Ai(), full.get_Ax(), false);
+            add_from_csr(&view, bsize);
+        }
+        return;
+    }
+
+    free_data();
+
+    this->size = m->get_size();
+    this->complex = m->is_complex();
+    this->bsize = bsize;
+    this->nb = (this->size + bsize - 1) / bsize;
+
+    if (is_complex())
+        this->nnzb = csr_to_bsr(this->size, m->get_Ap(), m->get_Ai(), m->get_Ax_cplx(),
+                                bsize, this->nb, this->Ap, this->Ai, this->Ax_cplx);
+    else
+        this->nnzb = csr_to_bsr(this->size, m->get_Ap(), m->get_Ai(), m->get_Ax(),
+                                bsize, this->nb, this->Ap, this->Ai, this->Ax);
+
+    this->nnz = bsr_expanded_nnz(this->size, bsize, this->nb, this->Ap, this->Ai);
+}
+
+void BSRMatrix::set_zero()
+{
+    size_t n = (size_t) this->nnzb * this->bsize * this->bsize;
+    if (is_complex())
+        std::fill(this->Ax_cplx, this->Ax_cplx + n, cplx(0));
+    else
+        std::fill(this->Ax, this->Ax + n, 0.0);
+}
+
+void BSRMatrix::add(int m, int n, double v)
+{
+    if (this->complex)
+        _error("can't use add(int, int, double) for complex matrix");
+
+    int *iidx = &m;
+    int *jidx = &n;
+    double *row = &v;
+    if (!bsr_add_block(this->bsize, this->Ap, this->Ai, this->Ax, iidx, 1, jidx, 1, &row))
+        _error("BSR matrix add(): entry is not in the sparsity pattern.");
+}
+
+void BSRMatrix::add(int m, int n, cplx v)
+{
+    if (!(this->complex))
+        _error("can't use add(int, int, cplx) for real matrix");
+
+    int *iidx = &m;
+    int *jidx = &n;
+    cplx *row = &v;
+    if (!bsr_add_block(this->bsize, this->Ap, this->Ai, this->Ax_cplx, iidx, 1, jidx, 1, &row))
+        _error("BSR matrix add(): entry is not in the sparsity pattern.");
+}
+
+void BSRMatrix::add_block(int *iidx, int ilen, int *jidx, int jlen, double** mat)
+{
+    if (this->complex)
+        _error("can't use add_block() with double values for complex matrix");
+
+    if (!bsr_add_block(this->bsize, this->Ap, this->Ai, this->Ax, iidx, ilen, jidx, jlen, mat))
+        _error("BSR matrix add_block(): entry is not in the sparsity pattern.");
+}
+
+void BSRMatrix::add_block(int *iidx, int ilen, int *jidx, int jlen, cplx** mat)
+{
+    if (!(this->complex))
+        _error("can't use add_block() with cplx values for real matrix");
+
+    if (!bsr_add_block(this->bsize, this->Ap, this->Ai, this->Ax_cplx, iidx, ilen, jidx, jlen, mat))
+        _error("BSR matrix add_block(): entry is not in the sparsity pattern.");
+}
+
+double BSRMatrix::get(int m, int n)
+{
+    int b = this->bsize;
+    int index = find_sorted_index(this->Ai, this->Ap[m / b], this->Ap[m / b + 1], n / b);
+    return (index < 0) ? 0.0 : this->Ax[(size_t) index * b * b + (m % b) * b + n % b];
+}
+
+cplx BSRMatrix::get_cplx(int m, int n)
+{
+    int b = this->bsize;
+    int index = find_sorted_index(this->Ai, this->Ap[m / b], this->Ap[m / b + 1], n / b);
+    return (index < 0) ? cplx(0) : this->Ax_cplx[(size_t) index * b * b + (m % b) * b + n % b];
+}
+
+void BSRMatrix::times_vector(double* vec, double* result, int rank)
+{
+    if (this->complex) _error("BSRMatrix::times_vector(): the matrix is complex.");
+    bsr_times_vector<double>(this->size, this->bsize, this->Ap, this->Ai, this->Ax, vec, result);
+}
+
+void BSRMatrix::times_vector(cplx* vec, cplx* result, int rank)
+{
+    if (!this->complex) _error("BSRMatrix::times_vector(): the matrix is real.");
+    bsr_times_vector<cplx>(this->size, this->bsize, this->Ap, this->Ai, this->Ax_cplx, vec, result);
+}
+
+void BSRMatrix::times_vector(double *x, double *y, double alpha, double beta)
+{
+    if (this->complex) _error("BSRMatrix::times_vector(): the matrix is complex.");
+    bsr_times_vector<double>(this->size, this->bsize, this->Ap, this->Ai, this->Ax, x, y, alpha, beta);
+}
+
+void BSRMatrix::times_vector(cplx *x, cplx *y, cplx alpha, cplx beta)
+{
+    if (!this->complex) _error("BSRMatrix::times_vector(): the matrix is real.");
+    bsr_times_vector<cplx>(this->size, this->bsize, this->Ap, this->Ai, this->Ax_cplx, x, y, alpha, beta);
+}
+
+void BSRMatrix::get_csr(int *Ap, int *Ai, double *Ax)
+{
+    bsr_to_csr(this->size, this->bsize, this->nb, this->Ap, this->Ai, this->Ax, Ap, Ai, Ax);
+}
+
+void BSRMatrix::get_csr(int *Ap, int *Ai, cplx *Ax)
+{
+    bsr_to_csr(this->size, this->bsize, this->nb, this->Ap, this->Ai, this->Ax_cplx, Ap, Ai, Ax);
+}
+
+void BSRMatrix::get_csc(int *Ap, int *Ai, double *Ax)
+{
+    int *Bp = new int[this->size + 1];
+    int *Bi = new int[this->nnz];
+    double *Bx = new double[this->nnz];
+    get_csr(Bp, Bi, Bx);
+    csr_to_csc(this->size, this->nnz, Bp, Bi, Bx, Ap, Ai, Ax);
+    delete[] Bp;
+    delete[] Bi;
+    delete[] Bx;
+}
+
+void BSRMatrix::get_csc(int *Ap, int *Ai, cplx *Ax)
+{
+    int *Bp = new int[this->size + 1];
+    int *Bi = new int[this->nnz];
+    cplx *Bx = new cplx[this->nnz];
+    get_csr(Bp, Bi, Bx);
+    csr_to_csc(this->size, this->nnz, Bp, Bi, Bx, Ap, Ai, Ax);
+    delete[] Bp;
+    delete[] Bi;
+    delete[] Bx;
+}
+
+void BSRMatrix::print()
+{
+    printf("\nBSR Matrix:\n");
+    printf("size: %i\n", this->size);
+    printf("block size: %i\n", this->bsize);
+    printf("blocks: %i\n", this->nnzb);
+
+    print_vector("block_row_ptr", this->Ap, this->nb+1);
+    print_vector("block_col_ind", this->Ai, this->nnzb);
+    if (is_complex())
+        print_vector("data", this->Ax_cplx, this->nnzb * this->bsize * this->bsize);
+    else
+        print_vector("data", this->Ax, this->nnzb * this->bsize * this->bsize);
+}
+
+// *********************************************************************************************************************
+
+/// Orders the rows by decreasing length, the sort is stable.
+struct RowLengthGreater
+{
+    int *len;
+    RowLengthGreater(int *len) : len(len) {}
+    bool operator()(int a, int b) const { return len[a] > len[b]; }
+};
+
+/// Converts the CSR matrix (Ap, Ai, Ax) to the SELL-C-sigma format, allocates
+/// cs[nchunks+1], rl[size], perm[size], iperm[size], col[] and val[].
+template<typename T>
+static void csr_to_sell(int size, int *Ap, int *Ai, T *Ax, int chunk, int sigma,
+                        int *&cs, int *&rl, int *&perm, int *&iperm, int *&col, T *&val)
+{
+    int nchunks = (size + chunk - 1) / chunk;
+
+    int *len = new int[size];
+    perm = new int[size];
+    for (int i = 0; i < size; i++)
+    {
+        len[i] = Ap[i+1] - Ap[i];
+        perm[i] = i;
+    }
+    if (sigma > 1)
+        for (int w = 0; w < size; w += sigma)
+            std::stable_sort(perm + w, perm + std::min(w + sigma, size), RowLengthGreater(len));
+
+    iperm = new int[size];
+    rl = new int[size];
+    for (int s = 0; s < size; s++)
+    {
+        iperm[perm[s]] = s;
+        rl[s] = len[perm[s]];
+    }
+    delete[] len;
+
+    // each chunk is as wide as its longest row
+    cs = new int[nchunks + 1];
+    cs[0] = 0;
+    for (int c = 0; c < nchunks; c++)
+    {
+        int width = 0;
+        for (int s = c * chunk; s < std::min((c+1) * chunk, size); s++)
+            width = std::max(width, rl[s]);
+        cs[c+1] = cs[c] + width * chunk;
+    }
+
+    col = new int[cs[nchunks]];
+    val = new T[cs[nchunks]];
+    for (int c = 0; c < nchunks; c++)
+    {
+        int width = (cs[c+1] - cs[c]) / chunk;
+        for (int r = 0; r < chunk; r++)
+        {
+            int s = c * chunk + r;
+            int length = (s < size) ? rl[s] : 0;
+            int start = (s < size) ? Ap[perm[s]] : 0;
+            for (int j = 0; j < width; j++)
+            {
+                int pos = cs[c] + j * chunk + r;
+                if (j < length)
+                {
+                    col[pos] = Ai[start + j];
+                    val[pos] = Ax[start + j];
+                }
+                else
+                {
+                    col[pos] = 0;
+                    val[pos] = 0.0;
+                }
+            }
+        }
+    }
+}
+
+/// Converts the SELL-C-sigma matrix back to the CSR matrix (Ap, Ai, Ax).
+template<typename T>
+static void sell_to_csr(int size, int chunk, int *cs, int *rl, int *iperm, int *col, T *val, int *Ap, int *Ai, T *Ax)
+{
+    Ap[0] = 0;
+    for (int i = 0; i < size; i++)
+    {
+        int s = iperm[i];
+        int base = cs[s / chunk] + s % chunk;
+        Ap[i+1] = Ap[i] + rl[s];
+        for (int j = 0; j < rl[s]; j++)
+        {
+            Ai[Ap[i] + j] = col[base + j * chunk];
+            Ax[Ap[i] + j] = val[base + j * chunk];
+        }
+    }
+}
+
+SELLMatrix::SELLMatrix(CSRMatrix *m, int chunk, int sigma) : Matrix()
+{
+    init();
+    this->add_from_csr(m, chunk, sigma);
+}
+
+SELLMatrix::SELLMatrix(CooMatrix *m, int chunk, int sigma) : Matrix()
+{
+    init();
+    CSRMatrix csr(m);
+    this->add_from_csr(&csr, chunk, sigma);
+}
+
+SELLMatrix::~SELLMatrix()
+{
+    free_data();
+}
+
+void SELLMatrix::init()
+{
+    this->complex = false;
+    this->size = 0;
+    this->chunk = 1;
+    this->sigma = 1;
+    this->nchunks = 0;
+    this->nnz = 0;
+
+    this->cs = NULL;
+    this->rl = NULL;
+    this->perm = NULL;
+    this->iperm = NULL;
+    this->col = NULL;
+    this->val = NULL;
+    this->val_cplx = NULL;
+}
+
+void SELLMatrix::free_data()
+{
+    if (this->cs) delete[] this->cs;
+    if (this->rl) delete[] this->rl;
+    if (this->perm) delete[] this->perm;
+    if (this->iperm) delete[] this->iperm;
+    if (this->col) delete[] this->col;
+    if (this->val) delete[] this->val;
+    if (this->val_cplx) delete[] this->val_cplx;
+    this->cs = NULL;
+    this->rl = NULL;
+    this->perm = NULL;
+    this->iperm = NULL;
+    this->col = NULL;
+    this->val = NULL;
+    this->val_cplx = NULL;
+
+    this->size = 0;
+    this->nchunks = 0;
+    this->nnz = 0;
+}
+
+void SELLMatrix::add_from_csr(CSRMatrix *m, int chunk, int sigma)
+{
+    if (chunk < 1 || sigma < 1)
+        _error("SELL matrix: the chunk height and sigma must be positive.");
+
+    if (m->is_symmetric())
+    {
+        // the expanded CSC arrays are also the CSR arrays of the full matrix
+        CSCMatrix full(m);
+        if (full.is_complex())
+        {
+            CSRMatrix view(full.get_size(), full.get_nnz(), full.get_Ap(), full.get_Ai(), full.get_Ax_cplx(), false);
+            add_from_csr(&view, chunk, sigma);
+        }
+        else
+        {
+            CSRMatrix view(full.get_size(), full.get_nnz(), full.get_Ap(), full.get_Ai(), full.get_Ax(), false);
+            add_from_csr(&view, chunk, sigma);
+        }
+        return;
+    }
+
+    free_data();
+
+    this->size = m->get_size();
+    this->complex = m->is_complex();
+    this->chunk = chunk;
+    this->sigma = sigma;
+    this->nchunks = (this->size + chunk - 1) / chunk;
+    this->nnz = m->get_nnz();
+
+    if (is_complex())
+        csr_to_sell(this->size, m->get_Ap(), m->get_Ai(), m->get_Ax_cplx(), chunk, sigma,
+                    this->cs, this->rl, this->perm, this->iperm, this->col, this->val_cplx);
+    else
+        csr_to_sell(this->size, m->get_Ap(), m->get_Ai(), m->get_Ax(), chunk, sigma,
+                    this->cs, this->rl, this->perm, this->iperm, this->col, this->val);
+}
+
+void SELLMatrix::set_zero()
+{
+    // the padding stays zero too
+    if (is_complex())
+        std::fill(this->val_cplx, this->val_cplx + this->cs[this->nchunks], cplx(0));
+    else
+        std::fill(this->val, this->val + this->cs[this->nchunks], 0.0);
+}
+
+int SELLMatrix::find_entry(int m, int n)
+{
+    // the columns of a row are sorted, but stored with the stride chunk
+    int s = this->iperm[m];
+    int base = this->cs[s / this->chunk] + s % this->chunk;
+    int lo = 0;
+    int hi = this->rl[s];
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (this->col[base + mid * this->chunk] < n)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < this->rl[s] && this->col[base + lo * this->chunk] == n)
+        return base + lo * this->chunk;
+    return -1;
+}
+
+void SELLMatrix::add(int m, int n, double v)
+{
+    if (this->complex)
+        _error("can't use add(int, int, double) for complex matrix");
+
+    int index = find_entry(m, n);
+    if (index < 0)
+        _error("SELL matrix add(): entry is not in the sparsity pattern.");
+    this->val[index] += v;
+}
+
+void SELLMatrix::add(int m, int n, cplx v)
+{
+    if (!(this->complex))
+        _error("can't use add(int, int, cplx) for real matrix");
+
+    int index = find_entry(m, n);
+    if (index < 0)
+        _error("SELL matrix add(): entry is not in the sparsity pattern.");
+    this->val_cplx[index] += v;
+}
+
+double SELLMatrix::get(int m, int n)
+{
+    int index = find_entry(m, n);
+    return (index < 0) ? 0.0 : this->val[index];
+}
+
+cplx SELLMatrix::get_cplx(int m, int n)
+{
+    int index = find_entry(m, n);
+    return (index < 0) ? cplx(0) : this->val_cplx[index];
+}
+
+void SELLMatrix::times_vector(double* vec, double* result, int rank)
+{
+    if (this->complex) _error("SELLMatrix::times_vector(): the matrix is complex.");
+    sell_times_vector<double>(this->size, this->chunk, this->cs, this->perm, this->col, this->val, vec, result);
+}
+
+void SELLMatrix::times_vector(cplx* vec, cplx* result, int rank)
+{
+    if (!this->complex) _error("SELLMatrix::times_vector(): the matrix is real.");
+    sell_times_vector<cplx>(this->size, this->chunk, this->cs, this->perm, this->col, this->val_cplx, vec, result);
+}
+
+void SELLMatrix::times_vector(double *x, double *y, double alpha, double beta)
+{
+    if (this->complex) _error("SELLMatrix::times_vector(): the matrix is complex.");
+    sell_times_vector<double>(this->size, this->chunk, this->cs, this->perm, this->col, this->val, x, y, alpha, beta);
+}
+
+void SELLMatrix::times_vector(cplx *x, cplx *y, cplx alpha, cplx beta)
+{
+    if (!this->complex) _error("SELLMatrix::times_vector(): the matrix is real.");
+    sell_times_vector<cplx>(this->size, this->chunk, this->cs, this->perm, this->col, this->val_cplx, x, y, alpha, beta);
+}
+
+void SELLMatrix::get_csr(int *Ap, int *Ai, double *Ax)
+{
+    sell_to_csr(this->size, this->chunk, this->cs, this->rl, this->iperm, this->col, this->val, Ap, Ai, Ax);
+}
+
+void SELLMatrix::get_csr(int *Ap, int *Ai, cplx *Ax)
+{
+    sell_to_csr(this->size, this->chunk, this->cs, this->rl, this->iperm, this->col, this->val_cplx, Ap, Ai, Ax);
+}
+
+void SELLMatrix::get_csc(int *Ap, int *Ai, double *Ax)
+{
+    int *Bp = new int[this->size + 1];
+    int *Bi = new int[this->nnz];
+    double *Bx = new double[this->nnz];
+    get_csr(Bp, Bi, Bx);
+    csr_to_csc(this->size, this->nnz, Bp, Bi, Bx, Ap, Ai, Ax);
+    delete[] Bp;
+    delete[] Bi;
+    delete[] Bx;
+}
+
+void SELLMatrix::get_csc(int *Ap, int *Ai, cplx *Ax)
+{
+    int *Bp = new int[this->size + 1];
+    int *Bi = new int[this->nnz];
+    cplx *Bx = new cplx[this->nnz];
+    get_csr(Bp, Bi, Bx);
+    csr_to_csc(this->size, this->nnz, Bp, Bi, Bx, Ap, Ai, Ax);
+    delete[] Bp;
+    delete[] Bi;
+    delete[] Bx;
+}
+
+void SELLMatrix::print()
+{
+    printf("\nSELL-%i-%i Matrix:\n", this->chunk, this->sigma);
+    printf("size: %i\n", this->size);
+    printf("nzz: %i (padded %i)\n", this->nnz, this->cs[this->nchunks]);
+
+    print_vector("chunk_ptr", this->cs, this->nchunks+1);
+    print_vector("perm", this->perm, this->size);
+    print_vector("col_ind", this->col, this->cs[this->nchunks]);
+    if (is_complex())
+        print_vector("data", this->val_cplx, this->cs[this->nchunks]);
+    else
+        print_vector("data", this->val, this->cs[this->nchunks]);
+}
+
+// ******************************************************************************************************************************
+
+CSRMatrix64::CSRMatrix64(int size) : Matrix()
+{
+    init();
+    this->size = size;
+}
+
+CSRMatrix64::CSRMatrix64(CooMatrix *m) : Matrix()
+{
+    init();
+    this->add_from_coo(m);
+}
+
+CSRMatrix64::CSRMatrix64(CSRMatrix *m) : Matrix()
+{
+    init();
+    this->add_from_csr(m);
+}
+
+CSRMatrix64::CSRMatrix64(Matrix *m) : Matrix()
+{
+    init();
+
+    if (dynamic_cast<CooMatrix*>(m))
+        this->add_from_coo((CooMatrix*)m);
+    else if (dynamic_cast<CSRMatrix*>(m))
+        this->add_from_csr((CSRMatrix*)m);
+    else
+        _error("Matrix type not supported.");
+}
+
+CSRMatrix64::~CSRMatrix64()
+{
+    free_data();
+}
+
+void CSRMatrix64::init()
+{
+    this->complex = false;
+    this->symmetric = false;
+    this->size = 0;
+    this->nnz = 0;
+
+    this->Ax = NULL;
+    this->Ax_cplx = NULL;
+    this->Ap = NULL;
+    this->Ai = NULL;
+}
+
+void CSRMatrix64::free_data()
+{
+    if (this->Ap) delete[] this->Ap;
+    if (this->Ai) delete[] this->Ai;
+    if (this->Ax) delete[] this->Ax;
+    if (this->Ax_cplx) delete[] this->Ax_cplx;
+    this->Ap = NULL;
+    this->Ai = NULL;
+    this->Ax = NULL;
+    this->Ax_cplx = NULL;
+
+    this->size = 0;
+    this->nnz = 0;
+    this->symmetric = false;
+}
+
+void CSRMatrix64::add_from_coo(CooMatrix *m)
+{
+    free_data();
+
+    this->size = m->get_size();
+    this->nnz = m->get_nnz64();
+    this->complex = m->is_complex();
+    this->symmetric = m->is_symmetric();
+
+    // allocate data
+    this->Ap = new long long[this->size + 1];
+    this->Ai = new long long[this->nnz];
+    if (is_complex())
+        this->Ax_cplx = new cplx[this->nnz];
+    else
+        this->Ax = new double[this->nnz];
+
+    if (is_complex())
+        m->get_csr(Ap, Ai, Ax_cplx);
+    else
+        m->get_csr(Ap, Ai, Ax);
+}
+
+void CSRMatrix64::add_from_csr(CSRMatrix *m)
+{
+    free_data();
+
+    this->size = m->get_size();
+    this->nnz = m->get_nnz();
+    this->complex = m->is_complex();
+    this->symmetric = m->is_symmetric();
+
+    // widen the indices
+    this->Ap = new long long[this->size + 1];
+    this->Ai = new long long[this->nnz];
+    std::copy(m->get_Ap(), m->get_Ap() + this->size + 1, this->Ap);
+    std::copy(m->get_Ai(), m->get_Ai() + this->nnz, this->Ai);
+    if (is_complex())
+    {
+        this->Ax_cplx = new cplx[this->nnz];
+        std::copy(m->get_Ax_cplx(), m->get_Ax_cplx() + this->nnz, this->Ax_cplx);
+    }
+    else
+    {
+        this->Ax = new double[this->nnz];
+        std::copy(m->get_Ax(), m->get_Ax() + this->nnz, this->Ax);
+    }
+}
+
+void CSRMatrix64::set_zero()
+{
+    if (is_complex())
+        std::fill(this->Ax_cplx, this->Ax_cplx + this->nnz, cplx(0));
+    else
+        std::fill(this->Ax, this->Ax + this->nnz, 0.0);
+}
+
+void CSRMatrix64::add(int m, int n, double v)
+{
+    if (this->complex)
+        _error("can't use add(int, int, double) for complex matrix");
+
+    if (this->symmetric && m > n)
+        std::swap(m, n);
+
+    long long index = find_sorted_index(this->Ai, this->Ap[m], this->Ap[m+1], n);
+    if (index < 0)
+        _error("CSR64 matrix add(): entry is not in the sparsity pattern.");
+    this->Ax[index] += v;
+}
+
+void CSRMatrix64::add(int m, int n, cplx v)
+{
+    if (!(this->complex))
+        _error("can't use add(int, int, cplx) for real matrix");
+
+    if (this->symmetric && m > n)
+        std::swap(m, n);
+
+    long long index = find_sorted_index(this->Ai, this->Ap[m], this->Ap[m+1], n);
+    if (index < 0)
+        _error("CSR64 matrix add(): entry is not in the sparsity pattern.");
+    this->Ax_cplx[index] += v;
+}
+
+double CSRMatrix64::get(int m, int n)
+{
+    if (this->symmetric && m > n)
+        std::swap(m, n);
+    long long index = find_sorted_index(this->Ai, this->Ap[m], this->Ap[m+1], n);
+    return (index < 0) ? 0.0 : this->Ax[index];
+}
+
+cplx CSRMatrix64::get_cplx(int m, int n)
+{
+    if (this->symmetric && m > n)
+        std::swap(m, n);
+    long long index = find_sorted_index(this->Ai, this->Ap[m], this->Ap[m+1], n);
+    return (index < 0) ? cplx(0) : this->Ax_cplx[index];
+}
+
+void CSRMatrix64::times_vector(double* vec, double* result, int rank)
+{
+    times_vector(vec, result, 1.0, 0.0);
+}
+
+void CSRMatrix64::times_vector(cplx* vec, cplx* result, int rank)
+{
+    times_vector(vec, result, cplx(1.0), cplx(0.0));
+}
+
+void CSRMatrix64::times_vector(double *x, double *y, double alpha, double beta)
+{
+    if (this->complex) _error("CSRMatrix64::times_vector(): the matrix is complex.");
+    if (this->symmetric)
+        csr_symmetric_times_vector<double>(this->size, this->Ap, this->Ai, this->Ax, x, y, alpha, beta);
+    else
+        csr_times_vector<double>(this->size, this->Ap, this->Ai, this->Ax, x, y, alpha, beta);
+}
+
+void CSRMatrix64::times_vector(cplx *x, cplx *y, cplx alpha, cplx beta)
+{
+    if (!this->complex) _error("CSRMatrix64::times_vector(): the matrix is real.");
+    if (this->symmetric)
+        csr_symmetric_times_vector<cplx>(this->size, this->Ap, this->Ai, this->Ax_cplx, x, y, alpha, beta);
+    else
+        csr_times_vector<cplx>(this->size, this->Ap, this->Ai, this->Ax_cplx, x, y, alpha, beta);
+}
+
+void CSRMatrix64::print()
+{
+    printf("\nCSR64 Matrix:\n");
+    printf("size: %i\n", this->size);
+    printf("nzz: %lld\n", this->nnz);
+
+    print_vector("row_ptr", this->Ap, this->size+1);
+    print_vector("col_ind", this->Ai, (int) this->nnz);
+    if (is_complex())
+        print_vector("data", this->Ax_cplx, (int) this->nnz);
+    else
+        print_vector("data", this->Ax, (int) this->nnz);
+}
+
+// ******************************************************************************************************************************
+
+// copies the values of a CSR or CSC matrix into the typed array (promotes
+// the real values of a complex matrix)
+template<typename T>
+static void copy_typed_values(int nnz, bool complex, double *Ax, cplx *Ax_cplx, T *dst)
+{
+    if (complex)
+        for (int k = 0; k < nnz; k++)
+            dst[k] = MatrixScalar<T>::from_cplx(Ax_cplx[k]);
+    else
+        for (int k = 0; k < nnz; k++)
+            dst[k] = Ax[k];
+}
+
+static void print_typed_vector(const char *label, double *value, int size) { print_vector(label, value, size); }
+static void print_typed_vector(const char *label, cplx *value, int size) { print_vector(label, value, size); }
+
+static void print_typed_vector(const char *label, float *value, int size)
+{
+    printf("%s [", label);
+    for (int i = 0; i < size; i++)
+        printf(i < size-1 ? "%f, " : "%f", value[i]);
+    printf("]\n");
+}
+
+static inline double real_part(double v) { return v; }
+static inline double real_part(float v) { return v; }
+static inline double real_part(cplx v) { return v.real(); }
+
+template<typename T>
+CSRMatrixT<T>::CSRMatrixT(Matrix *m) : Matrix()
+{
+    init();
+
+    if (dynamic_cast<CSRMatrix*>(m))
+        this->add_from_csr((CSRMatrix*)m);
+    else
+    {
+        CSRMatrix csr(m);
+        this->add_from_csr(&csr);
+    }
+}
+
+template<typename T>
+CSRMatrixT<T>::~CSRMatrixT()
+{
+    free_data();
+}
+
+template<typename T>
+void CSRMatrixT<T>::init()
+{
+    this->complex = MatrixScalar<T>::complex;
+    this->size = 0;
+    this->nnz = 0;
+
+    this->Ap = NULL;
+    this->Ai = NULL;
+    this->Ax = NULL;
+}
+
+template<typename T>
+void CSRMatrixT<T>::free_data()
+{
+    if (this->Ap) delete[] this->Ap;
+    if (this->Ai) delete[] this->Ai;
+    if (this->Ax) delete[] this->Ax;
+    this->Ap = NULL;
+    this->Ai = NULL;
+    this->Ax = NULL;
+
+    this->size = 0;
+    this->nnz = 0;
+}
+
+template<typename T>
+void CSRMatrixT<T>::add_from_csr(CSRMatrix *m)
+{
+    if (m->is_symmetric())
+    {
+        // the expanded CSC arrays are also the CSR arrays of the full matrix
+        CSCMatrix full(m);
+        free_data();
+        this->size = full.get_size();
+        this->nnz = full.get_nnz();
+        this->Ap = new int[this->size + 1];
+        this->Ai = new int[this->nnz];
+        this->Ax = new T[this->nnz];
+        std::copy(full.get_Ap(), full.get_Ap() + this->size + 1, this->Ap);
+        std::copy(full.get_Ai(), full.get_Ai() + this->nnz, this->Ai);
+        copy_typed_values(this->nnz, full.is_complex(), full.get_Ax(), full.get_Ax_cplx(), this->Ax);
+        return;
+    }
+
+    free_data();
+
+    this->size = m->get_size();
+    this->nnz = m->get_nnz();
+
+    this->Ap = new int[this->size + 1];
+    this->Ai = new int[this->nnz];
+    this->Ax = new T[this->nnz];
+    std::copy(m->get_Ap(), m->get_Ap() + this->size + 1, this->Ap);
+    std::copy(m->get_Ai(), m->get_Ai() + this->nnz, this->Ai);
+    copy_typed_values(this->nnz, m->is_complex(), m->get_Ax(), m->get_Ax_cplx(), this->Ax);
+}
+
+template<typename T>
+void CSRMatrixT<T>::set_zero()
+{
+    std::fill(this->Ax, this->Ax + this->nnz, T(0));
+}
+
+template<typename T>
+void CSRMatrixT<T>::add(int m, int n, double v)
+{
+    int index = find_sorted_index(this->Ai, this->Ap[m], this->Ap[m+1], n);
+    if (index < 0)
+        _error("CSR matrix add(): entry is not in the sparsity pattern.");
+    this->Ax[index] += v;
+}
+
+template<typename T>
+void CSRMatrixT<T>::add(int m, int n, cplx v)
+{
+    int index = find_sorted_index(this->Ai, this->Ap[m], this->Ap[m+1], n);
+    if (index < 0)
+        _error("CSR matrix add(): entry is not in the sparsity pattern.");
+    this->Ax[index] += MatrixScalar<T>::from_cplx(v);
+}
+
+template<typename T>
+double CSRMatrixT<T>::get(int m, int n)
+{
+    int index = find_sorted_index(this->Ai, this->Ap[m], this->Ap[m+1], n);
+    return (index < 0) ? 0.0 : real_part(this->Ax[index]);
+}
+
+template<typename T>
+cplx CSRMatrixT<T>::get_cplx(int m, int n)
+{
+    int index = find_sorted_index(this->Ai, this->Ap[m], this->Ap[m+1], n);
+    return (index < 0) ? cplx(0) : cplx(this->Ax[index]);
+}
+
+template<typename T>
+void CSRMatrixT<T>::times_vector(V* vec, V* result, int rank)
+{
+    csr_times_vector(this->size, this->Ap, this->Ai, this->Ax, vec, result, V(1.0), V(0.0));
+}
+
+template<typename T>
+void CSRMatrixT<T>::times_vector(V *x, V *y, V alpha, V beta)
+{
+    csr_times_vector(this->size, this->Ap, this->Ai, this->Ax, x, y, alpha, beta);
+}
+
+template<typename T>
+void CSRMatrixT<T>::print()
+{
+    printf("\nCSR Matrix:\n");
+    printf("size: %i\n", this->size);
+    printf("nzz: %i\n", this->nnz);
+
+    print_vector("row_ptr", this->Ap, this->size+1);
+    print_vector("col_ind", this->Ai, this->nnz);
+    print_typed_vector("data", this->Ax, this->nnz);
+}
+
+// ******************************************************************************************************************************
+
+template<typename T>
+CSCMatrixT<T>::CSCMatrixT(Matrix *m) : Matrix()
+{
+    init();
+
+    if (dynamic_cast<CSCMatrix*>(m))
+        this->add_from_csc((CSCMatrix*)m);
+    else
+    {
+        CSCMatrix csc(m);
+        this->add_from_csc(&csc);
+    }
+}
+
+template<typename T>
+CSCMatrixT<T>::~CSCMatrixT()
+{
+    free_data();
+}
+
+template<typename T>
+void CSCMatrixT<T>::init()
+{
+    this->complex = MatrixScalar<T>::complex;
+    this->size = 0;
+    this->nnz = 0;
+
+    this->Ap = NULL;
+    this->Ai = NULL;
+    this->Ax = NULL;
+}
+
+template<typename T>
+void CSCMatrixT<T>::free_data()
+{
+    if (this->Ap) delete[] this->Ap;
+    if (this->Ai) delete[] this->Ai;
+    if (this->Ax) delete[] this->Ax;
+    this->Ap = NULL;
+    this->Ai = NULL;
+    this->Ax = NULL;
+
+    this->size = 0;
+    this->nnz = 0;
+}
+
+template<typename T>
+void CSCMatrixT<T>::add_from_csc(CSCMatrix *m)
+{
+    free_data();
+
+    this->size = m->get_size();
+    this->nnz = m->get_nnz();
+
+    this->Ap = new int[this->size + 1];
+    this->Ai = new int[this->nnz];
+    this->Ax = new T[this->nnz];
+    std::copy(m->get_Ap(), m->get_Ap() + this->size + 1, this->Ap);
+    std::copy(m->get_Ai(), m->get_Ai() + this->nnz, this->Ai);
+    copy_typed_values(this->nnz, m->is_complex(), m->get_Ax(), m->get_Ax_cplx(), this->Ax);
+}
+
+template<typename T>
+void CSCMatrixT<T>::set_zero()
+{
+    std::fill(this->Ax, this->Ax + this->nnz, T(0));
+}
+
+template<typename T>
+void CSCMatrixT<T>::add(int m, int n, double v)
+{
+    int index = find_sorted_index(this->Ai, this->Ap[n], this->Ap[n+1], m);
+    if (index < 0)
+        _error("CSC matrix add(): entry is not in the sparsity pattern.");
+    this->Ax[index] += v;
+}
+
+template<typename T>
+void CSCMatrixT<T>::add(int m, int n, cplx v)
+{
+    int index = find_sorted_index(this->Ai, this->Ap[n], this->Ap[n+1], m);
+    if (index < 0)
+        _error("CSC matrix add(): entry is not in the sparsity pattern.");
+    this->Ax[index] += MatrixScalar<T>::from_cplx(v);
+}
+
+template<typename T>
+double CSCMatrixT<T>::get(int m, int n)
+{
+    int index = find_sorted_index(this->Ai, this->Ap[n], this->Ap[n+1], m);
+    return (index < 0) ? 0.0 : real_part(this->Ax[index]);
+}
+
+template<typename T>
+cplx CSCMatrixT<T>::get_cplx(int m, int n)
+{
+    int index = find_sorted_index(this->Ai, this->Ap[n], this->Ap[n+1], m);
+    return (index < 0) ? cplx(0) : cplx(this->Ax[index]);
+}
+
+template<typename T>
+void CSCMatrixT<T>::times_vector(V* vec, V* result, int rank)
+{
+    csc_times_vector(this->size, this->Ap, this->Ai, this->Ax, vec, result, V(1.0), V(0.0));
+}
+
+template<typename T>
+void CSCMatrixT<T>::times_vector(V *x, V *y, V alpha, V beta)
+{
+    csc_times_vector(this->size, this->Ap, this->Ai, this->Ax, x, y, alpha, beta);
+}
+
+template<typename T>
+void CSCMatrixT<T>::print()
+{
+    printf("\nCSC Matrix:\n");
+    printf("size: %i\n", this->size);
+    printf("nzz: %i\n", this->nnz);
+
+    print_vector("col_ptr", this->Ap, this->size+1);
+    print_vector("row_ind", this->Ai, this->nnz);
+    print_typed_vector("data", this->Ax, this->nnz);
+}
+
+template class CSRMatrixT<double>;
+template class CSRMatrixT<cplx>;
+template class CSRMatrixT<float>;
+template class CSCMatrixT<double>;
+template class CSCMatrixT<cplx>;
+template class CSCMatrixT<float>;
+template bool CSRMatrix::add_from_typed<double>(Matrix *m);
+template bool CSRMatrix::add_from_typed<cplx>(Matrix *m);
+template bool CSRMatrix::add_from_typed<float>(Matrix *m);
+template bool CSCMatrix::add_from_typed<double>(Matrix *m);
+template bool CSCMatrix::add_from_typed<cplx>(Matrix *m);
+template bool CSCMatrix::add_from_typed<float>(Matrix *m);
+
+// ******************************************************************************************************************************
+
+static ParallelMode parallel_mode = ParallelMode_Parallel;
+static int num_threads = 0;
+
+void set_parallel_mode(ParallelMode mode)
+{
+    parallel_mode = mode;
+}
+
+ParallelMode get_parallel_mode()
+{
+    return parallel_mode;
+}
+
+void set_num_threads(int n)
+{
+    num_threads = n;
+}
+
+int get_num_threads()
+{
+    if (parallel_mode == ParallelMode_Serial)
+        return 1;
+#ifdef COMMON_WITH_OPENMP
+    if (num_threads > 0)
+        return num_threads;
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+/// Number of threads for a conversion of a matrix with nnz entries and size
+/// rows (columns). Each thread needs a histogram of the size entries, so that
+/// the number of threads is limited to keep the histograms smaller than the
+/// matrix, and each thread gets at least a few thousand entries.
+static int conversion_threads(int size, long long nnz)
+{
+    long long n = get_num_threads();
+    n = std::min(n, nnz / 4096);
+    n = std::min(n, 2 * nnz / (size + 1));
+    return (int) std::max(n, 1LL);
+}
+
+/// First entry of the t-th of n equal chunks of [0, total).
+template<typename I>
+static inline I chunk_begin(I total, int t, int n)
+{
+    return (I) (((long long) total * t) / n);
+}
+
+/// Replaces a[0...n) by its exclusive prefix sum and returns the total.
+template<typename I>
+static I exclusive_scan(I *a, int n, int num_threads)
+{
+    if (num_threads == 1)
+    {
+        I sum = 0;
+        for (int i = 0; i < n; i++)
+        {
+            I temp = a[i];
+            a[i] = sum;
+            sum += temp;
+        }
+        return sum;
+    }
+
+    // scan the chunks independently, then add the chunk offsets
+    I *offset = new I[num_threads + 1];
+    #pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int t = 0; t < num_threads; t++)
+    {
+        I sum = 0;
+        for (int i = chunk_begin(n, t, num_threads); i < chunk_begin(n, t+1, num_threads); i++)
+        {
+            I temp = a[i];
+            a[i] = sum;
+            sum += temp;
+        }
+        offset[t+1] = sum;
+    }
+    offset[0] = 0;
+    for (int t = 0; t < num_threads; t++)
+        offset[t+1] += offset[t];
+
+    #pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int t = 1; t < num_threads; t++)
+        for (int i = chunk_begin(n, t, num_threads); i < chunk_begin(n, t+1, num_threads); i++)
+            a[i] += offset[t];
+
+    I total = offset[num_threads];
+    delete[] offset;
+    return total;
+}
+
+/// Turns the per-thread histograms count[num_threads][size] into the
+/// pointers Ap[size+1] and the per-thread offsets within each row (column).
+template<typename I>
+static void reduce_histograms(int size, I nnz, I *count, I *Ap, int num_threads)
+{
+    #pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int i = 0; i < size; i++)
+    {
+        I sum = 0;
+        for (int t = 0; t < num_threads; t++)
+        {
+            I temp = count[(size_t) t * size + i];
+            count[(size_t) t * size + i] = sum;
+            sum += temp;
+        }
+        Ap[i] = sum;
+    }
+    exclusive_scan(Ap, size, num_threads);
+    Ap[size] = nnz;
+}
+
+/// Parallel coo_to_csr(): per-thread histograms of the rows, a prefix sum and
+/// a parallel scatter. Every thread scatters its chunk of the triplets in the
+/// original order, so that the result is the same as the serial one.
+template<typename T, typename I>
+static void coo_to_csr_parallel(int size, I nnz, I *row, I *col, T *A, I *Ap, I *Ai, T *Ax, int num_threads)
+{
+    I *count = new I[(size_t) num_threads * size];
+
+    #pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int t = 0; t < num_threads; t++)
+    {
+        I *c = count + (size_t) t * size;
+        std::fill(c, c + size, 0);
+        for (I n = chunk_begin(nnz, t, num_threads); n < chunk_begin(nnz, t+1, num_threads); n++)
+            c[row[n]]++;
+    }
+
+    reduce_histograms(size, nnz, count, Ap, num_threads);
+
+    #pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int t = 0; t < num_threads; t++)
+    {
+        I *c = count + (size_t) t * size;
+        for (I n = chunk_begin(nnz, t, num_threads); n < chunk_begin(nnz, t+1, num_threads); n++)
+        {
+            I dest = Ap[row[n]] + c[row[n]]++;
+            Ai[dest] = col[n];
+            Ax[dest] = A[n];
+        }
+    }
+
+    delete[] count;
+}
+
+/// Parallel csr_to_csc(), the threads get chunks of rows with about the same
+/// number of entries. The result is the same as the serial one.
+template<typename T, typename I>
+static void csr_to_csc_parallel(int size, I nnz, I *Arp, I *Ari, T *Arx, I *Acp, I *Aci, T *Acx, int num_threads)
+{
+    int *first_row = new int[num_threads + 1];
+    for (int t = 0; t < num_threads; t++)
+        first_row[t] = std::lower_bound(Arp, Arp + size, chunk_begin(nnz, t, num_threads)) - Arp;
+    first_row[num_threads] = size;
+
+    I *count = new I[(size_t) num_threads * size];
+
+    #pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int t = 0; t < num_threads; t++)
+    {
+        I *c = count + (size_t) t * size;
+        std::fill(c, c + size, 0);
+        for (I jj = Arp[first_row[t]]; jj < Arp[first_row[t+1]]; jj++)
+            c[Ari[jj]]++;
+    }
+
+    reduce_histograms(size, nnz, count, Acp, num_threads);
+
+    #pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int t = 0; t < num_threads; t++)
+    {
+        I *c = count + (size_t) t * size;
+        for (int row = first_row[t]; row < first_row[t+1]; row++)
+        {
+            for (I jj = Arp[row]; jj < Arp[row+1]; jj++)
+            {
+                I dest = Acp[Ari[jj]] + c[Ari[jj]]++;
+                Aci[dest] = row;
+                Acx[dest] = Arx[jj];
+            }
+        }
+    }
+
+    delete[] count;
+    delete[] first_row;
+}
+
+// ******************************************************************************************************************************
+
+template<typename T>
+void dense_to_coo(int size, int nnz, T **Ad, int *row, int *col, T *A)
+{
+    int count = 0;
+    for (int i = 0; i < size; i++)
+    {
+        for (int j = 0; j < size; j++)
+        {
+            if (std::abs(Ad[i][j]) > 1e-12)
+            {
+                row[count] = i;
+                col[count] = j;
+                A[count] = Ad[i][j];
+
+                count++;
+            }
+        }
+    }
+}
+
+template<typename T, typename I>
+void coo_to_csr(int size, I nnz, I *row, I *col, T *A, I *Ap, I *Ai, T *Ax)
+{
+    int num_threads = conversion_threads(size, nnz);
+    if (num_threads > 1)
+    {
+        coo_to_csr_parallel(size, nnz, row, col, A, Ap, Ai, Ax, num_threads);
+        return;
+    }
+
+    std::fill(Ap, Ap + size, 0);
+
+    for (I n = 0; n < nnz; n++)
+    {
+        Ap[row[n]]++;
+    }
+
+    // cumsum the nnz per row to get this->row_ptr[]
+    I cumsum = 0;
+    for(int i = 0; i < size; i++)
+    {
+        I temp = Ap[i];
+        Ap[i] = cumsum;
+        cumsum += temp;
+    }
+    Ap[size] = nnz;
+
+    // write Aj, Ax into Bj, Bx
+    for(I n = 0; n < nnz; n++)
+    {
+        I index  = row[n];
+        I dest = Ap[index];
+
+        Ai[dest] = col[n];
+        Ax[dest] = A[n];
+
+        Ap[index]++;
+    }
+
+    I last = 0;
+    for(int i = 0; i <= size; i++)
+    {
+        I temp = Ap[i];
+        Ap[i]  = last;
+        last   = temp;
+    }
+}
+
+template<typename T, typename I>
+void coo_to_csc(int size, I nnz, I *row, I *col, T *A, I *Ap, I *Ai, T *Ax)
+{
+    coo_to_csr(size, nnz, col, row, A, Ap, Ai, Ax);
+}
+
+template<typename T, typename I>
+void csr_to_csc(int size, I nnz, I *Arp, I *Ari, T *Arx, I *Acp, I *Aci, T *Acx)
+{
+    int num_threads = conversion_threads(size, nnz);
+    if (num_threads > 1)
+    {
+        csr_to_csc_parallel(size, nnz, Arp, Ari, Arx, Acp, Aci, Acx, num_threads);
+        return;
+    }
+
+    //compute number of non-zero entries per column of A
+    std::fill(Acp, Acp + size, 0);
+
+    for (I n = 0; n < nnz; n++)
+        Acp[Ari[n]]++;
+
+    // cumsum the nnz per column to get Bp[]
+    I cumsum = 0;
+    for(int col = 0; col < size; col++)
+    {
+        I temp  = Acp[col];
+        Acp[col] = cumsum;
+        cumsum += temp;
+    }
+    Acp[size] = nnz;
+
+    for(int row = 0; row < size; row++)
+    {
+        for(I jj = Arp[row]; jj < Arp[row+1]; jj++)
+        {
+            I col  = Ari[jj];
+            I dest = Acp[col];
+
+            Aci[dest] = row;
+            Acx[dest] = Arx[jj];
+
+            Acp[col]++;
+        }
+    }
+
+    I last = 0;
+    for(int col = 0; col <= size; col++)
+    {
+        I temp  = Acp[col];
+        Acp[col] = last;
+        last = temp;
+    }
+}
+
+template<typename T, typename I>
+void csc_to_csr(int size, I nnz, I *Acp, I *Aci, T *Acx, I *Arp, I *Ari, T *Arx)
+{
+    csr_to_csc(size, nnz, Acp, Aci, Acx, Arp, Ari, Arx);
+}
+
+template<typename T, typename I>
+I csr_sum_duplicates(int size, I *Ap, I *Ai, T *Ax, I *Bp, I *Bi, T *Bx)
+{
+    int num_threads = conversion_threads(size, Ap[size]);
+
+    // count the unique entries in each row
+    #pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int i = 0; i < size; i++)
+    {
+        I count = 0;
+        for (I j = Ap[i]; j < Ap[i+1]; j++)
+            if (j == Ap[i] || Ai[j] != Ai[j-1])
+                count++;
+        Bp[i] = count;
+    }
+    I nnz = exclusive_scan(Bp, size, num_threads);
+    Bp[size] = nnz;
+
+    // sum duplicates, each row is summed in order
+    #pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int i = 0; i < size; i++)
+    {
+        I dest = Bp[i] - 1;
+        for (I j = Ap[i]; j < Ap[i+1]; j++)
+        {
+            if (j == Ap[i] || Ai[j] != Ai[j-1])
+            {
+                dest++;
+                Bi[dest] = Ai[j];
+                Bx[dest] = Ax[j];
+            }
+            else
+                Bx[dest] += Ax[j];
+        }
+    }
+
+    return nnz;
+}
+
+template<typename T, typename I>
+void csc_to_coo(int size, I nnz, I *Ap, I *Ai, T *Ax, I *row, I *col, T *A)
+{
+    I count = 0;
+    // loop through columns...
+    for (int i = 1; i <= size; i++)
+    {
+        for (I j = count; j < Ap[i]; j++)
+        {
+            A[count] = Ax[count];
+            row[count] = Ai[count];
+            col[count] = i-1;
+
+            count++;
+        }
+    }
+}
+
+template<typename T, typename I>
+void csr_to_coo(int size, I nnz, I *Ap, I *Ai, T *Ax, I *row, I *col, T *A)
+{
+    I count = 0;
+    // loop through rows...
+    for (int i = 1; i <= size; i++)
+    {
+        for (I j = count; j < Ap[i]; j++)
+        {
+            A[count] = Ax[count];
+            col[count] = Ai[count];
+            row[count] = i-1;
+
+            count++;
+        }
+    }
+}
+
+template<typename I>
+I csr_symmetric_expanded_nnz(int size, I *Ap, I *Ai)
+{
+    I diag = 0;
+    for (int i = 0; i < size; i++)
+        if (Ap[i] < Ap[i+1] && Ai[Ap[i]] == i)
+            diag++;
+    return 2 * Ap[size] - diag;
+}
+
+template<typename T, typename I>
+I csr_symmetric_expand(int size, I *Ap, I *Ai, T *Ax, I *Bp, I *Bi, T *Bx)
+{
+    // row counts of the full matrix
+    std::fill(Bp, Bp + size + 1, 0);
+    for (int i = 0; i < size; i++)
+        for (I k = Ap[i]; k < Ap[i+1]; k++)
+        {
+            Bp[i+1]++;
+            if (Ai[k] != i)
+                Bp[Ai[k]+1]++;
+        }
+    for (int i = 0; i < size; i++)
+        Bp[i+1] += Bp[i];
+
+    // going through the rows in order keeps the columns sorted: the mirrored
+    // entries (j, i) of row j come from the rows i < j, before the row j itself
+    I *next = new I[size];
+    std::copy(Bp, Bp + size, next);
+    for (int i = 0; i < size; i++)
+        for (I k = Ap[i]; k < Ap[i+1]; k++)
+        {
+            I j = Ai[k];
+            Bi[next[i]] = j;
+            Bx[next[i]++] = Ax[k];
+            if (j != i)
+            {
+                Bi[next[j]] = i;
+                Bx[next[j]++] = Ax[k];
+            }
+        }
+    delete[] next;
+
+    return Bp[size];
+}
+
+/// Number of threads for a matrix-vector product with nnz entries, each
+/// thread gets at least a few thousand entries.
+static int spmv_threads(long long nnz)
+{
+    return (int) std::max(1LL, std::min((long long) get_num_threads(), nnz / 4096));
+}
+
+/// First row (column) of the t-th of n parts of the CSR (CSC) matrix with
+/// about the same number of entries.
+template<typename I>
+static inline int nnz_split(int size, I *Ap, int t, int n)
+{
+    if (t == n) return size;
+    return (int) (std::lower_bound(Ap, Ap + size, Ap[0] + chunk_begin(Ap[size] - Ap[0], t, n)) - Ap);
+}
+
+template<typename V, typename T, typename I>
+static inline void csr_times_vector_rows(int begin, int end, I *Ap, I *Ai, V *Ax, T *x, T *y, T alpha, T beta)
+{
+    for (int i = begin; i < end; i++)
+    {
+        // four independent sums, so that the loop is not bound by the
+        // latency of the additions
+        T s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+        I k = Ap[i];
+        I k_end = Ap[i+1];
+        for (; k + 3 < k_end; k += 4)
+        {
+            s0 += Ax[k] * x[Ai[k]];
+            s1 += Ax[k+1] * x[Ai[k+1]];
+            s2 += Ax[k+2] * x[Ai[k+2]];
+            s3 += Ax[k+3] * x[Ai[k+3]];
+        }
+        for (; k < k_end; k++)
+            s0 += Ax[k] * x[Ai[k]];
+        T sum = (s0 + s1) + (s2 + s3);
+
+        if (beta == T(0.0))
+            y[i] = alpha * sum;
+        else
+            y[i] = alpha * sum + beta * y[i];
+    }
+}
+
+/// The complex rows with the real and imaginary parts multiplied out: the
+/// products of std::complex check for nan and keep the loop from being
+/// vectorized, the sums of the parts map to vector registers.
+template<typename I>
+static inline void csr_times_vector_rows(int begin, int end, I *Ap, I *Ai, cplx *Ax, cplx *x, cplx *y, cplx alpha, cplx beta)
+{
+    const double *a = reinterpret_cast<const double *>(Ax);
+    const double *v = reinterpret_cast<const double *>(x);
+    for (int i = begin; i < end; i++)
+    {
+        double re0 = 0, im0 = 0, re1 = 0, im1 = 0;
+        I k = Ap[i];
+        I k_end = Ap[i+1];
+        for (; k + 1 < k_end; k += 2)
+        {
+            double ar0 = a[2*k], ai0 = a[2*k+1];
+            double xr0 = v[2*Ai[k]], xi0 = v[2*Ai[k]+1];
+            double ar1 = a[2*k+2], ai1 = a[2*k+3];
+            double xr1 = v[2*Ai[k+1]], xi1 = v[2*Ai[k+1]+1];
+            re0 += ar0 * xr0 - ai0 * xi0;
+            im0 += ar0 * xi0 + ai0 * xr0;
+            re1 += ar1 * xr1 - ai1 * xi1;
+            im1 += ar1 * xi1 + ai1 * xr1;
+        }
+        for (; k < k_end; k++)
+        {
+            double ar = a[2*k], ai = a[2*k+1];
+            double xr = v[2*Ai[k]], xi = v[2*Ai[k]+1];
+            re0 += ar * xr - ai * xi;
+            im0 += ar * xi + ai * xr;
+        }
+        double re = re0 + re1, im = im0 + im1;
+
+        if (alpha == 1.0 && beta == 0.0)
+            y[i] = cplx(re, im);
+        else
+        {
+            double sr = alpha.real() * re - alpha.imag() * im;
+            double si = alpha.real() * im + alpha.imag() * re;
+            if (beta != 0.0)
+            {
+                double yr = y[i].real(), yi = y[i].imag();
+                sr += beta.real() * yr - beta.imag() * yi;
+                si += beta.real() * yi + beta.imag() * yr;
+            }
+            y[i] = cplx(sr, si);
+        }
+    }
+}
+
+/// csr_times_vector() with the values of the type V, which may be float for
+/// the vectors of doubles.
+template<typename V, typename T, typename I>
+static void csr_product(int size, I *Ap, I *Ai, V *Ax, T *x, T *y, T alpha, T beta)
+{
+    // the rows are independent, so that any split gives the same result
+    int num_threads = spmv_threads(Ap[size]);
+    if (num_threads == 1)
+    {
+        csr_times_vector_rows(0, size, Ap, Ai, Ax, x, y, alpha, beta);
+        return;
+    }
+
+    #pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int t = 0; t < num_threads; t++)
+        csr_times_vector_rows(nnz_split(size, Ap, t, num_threads), nnz_split(size, Ap, t+1, num_threads),
+                              Ap, Ai, Ax, x, y, alpha, beta);
+}
+
+template<typename T, typename I>
+void csr_times_vector(int size, I *Ap, I *Ai, T *Ax, T *x, T *y, T alpha, T beta)
+{
+    csr_product(size, Ap, Ai, Ax, x, y, alpha, beta);
+}
+
+void csr_times_vector(int size, int *Ap, int *Ai, float *Ax, double *x, double *y, double alpha, double beta)
+{
+    csr_product(size, Ap, Ai, Ax, x, y, alpha, beta);
+}
+
+template<typename V, typename T, typename I>
+static inline void csc_times_vector_columns(int begin, int end, I *Ap, I *Ai, V *Ax, T *x, T *y)
+{
+    for (int j = begin; j < end; j++)
+    {
+        T xj = x[j];
+        if (xj == T(0.0)) continue;
+        for (I k = Ap[j]; k < Ap[j+1]; k++)
+            y[Ai[k]] += Ax[k] * xj;
+    }
+}
+
+/// csc_times_vector() with the values of the type V (see csr_product()).
+template<typename V, typename T, typename I>
+static void csc_product(int size, I *Ap, I *Ai, V *Ax, T *x, T *y, T alpha, T beta)
+{
+    // every thread needs its own copy of y, so that the number of threads is
+    // limited like in the conversions
+    int num_threads = std::min(spmv_threads(Ap[size]), conversion_threads(size, Ap[size]));
+    if (num_threads == 1)
+    {
+        if (alpha == T(0.0) || beta != T(1.0))
+            for (int i = 0; i < size; i++)
+                y[i] = (beta == T(0.0)) ? T(0.0) : beta * y[i];
+        if (alpha == T(0.0))
+            return;
+
+        for (int j = 0; j < size; j++)
+        {
+            T xj = alpha * x[j];
+            if (xj == T(0.0)) continue;
+            for (I k = Ap[j]; k < Ap[j+1]; k++)
+                y[Ai[k]] += Ax[k] * xj;
+        }
+        return;
+    }
+
+    T *buffer = new T[(size_t) num_threads * size];
+
+    #pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int t = 0; t < num_threads; t++)
+    {
+        T *b = buffer + (size_t) t * size;
+        std::fill(b, b + size, T(0.0));
+        csc_times_vector_columns(nnz_split(size, Ap, t, num_threads), nnz_split(size, Ap, t+1, num_threads),
+                                 Ap, Ai, Ax, x, b);
+    }
+
+    #pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int i = 0; i < size; i++)
+    {
+        T sum = 0.0;
+        for (int t = 0; t < num_threads; t++)
+            sum += buffer[(size_t) t * size + i];
+
+        if (beta == T(0.0))
+            y[i] = alpha * sum;
+        else
+            y[i] = alpha * sum + beta * y[i];
+    }
+
+    delete[] buffer;
+}
+
+template<typename T, typename I>
+void csc_times_vector(int size, I *Ap, I *Ai, T *Ax, T *x, T *y, T alpha, T beta)
+{
+    csc_product(size, Ap, Ai, Ax, x, y, alpha, beta);
+}
+
+void csc_times_vector(int size, int *Ap, int *Ai, float *Ax, double *x, double *y, double alpha, double beta)
+{
+    csc_product(size, Ap, Ai, Ax, x, y, alpha, beta);
+}
+
+template<typename T, typename I>
+void csr_symmetric_times_vector(int size, I *Ap, I *Ai, T *Ax, T *x, T *y, T alpha, T beta)
+{
+    int n = std::min(spmv_threads(Ap[size]), conversion_threads(size, Ap[size]));
+    if (n == 1)
+    {
+        if (beta == T(0))
+            std::fill(y, y + size, T(0));
+        else if (beta != T(1))
+            for (int i = 0; i < size; i++)
+                y[i] *= beta;
+
+        for (int i = 0; i < size; i++)
+        {
+            T s = 0;
+            T ax = alpha * x[i];
+            for (I k = Ap[i]; k < Ap[i+1]; k++)
+            {
+                I j = Ai[k];
+                s += Ax[k] * x[j];
+                if (j != i)
+                    y[j] += Ax[k] * ax;
+            }
+            y[i] += alpha * s;
+        }
+        return;
+    }
+
+    // the transposed part scatters into arbitrary rows, so every thread
+    // accumulates into its own vector and these are summed up afterwards
+    T *buf = new T[(size_t) n * size];
+
+#pragma omp parallel for num_threads(n) schedule(static)
+    for (int t = 0; t < n; t++)
+    {
+        T *yt = buf + (size_t) t * size;
+        std::fill(yt, yt + size, T(0));
+        int end = nnz_split(size, Ap, t + 1, n);
+        for (int i = nnz_split(size, Ap, t, n); i < end; i++)
+        {
+            T s = 0;
+            for (I k = Ap[i]; k < Ap[i+1]; k++)
+            {
+                I j = Ai[k];
+                s += Ax[k] * x[j];
+                if (j != i)
+                    yt[j] += Ax[k] * x[i];
+            }
+            yt[i] += s;
+        }
+    }
+
+#pragma omp parallel for num_threads(n) schedule(static)
+    for (int t = 0; t < n; t++)
+    {
+        int end = chunk_begin(size, t + 1, n);
+        for (int i = chunk_begin(size, t, n); i < end; i++)
+        {
+            T s = 0;
+            for (int u = 0; u < n; u++)
+                s += buf[(size_t) u * size + i];
+            y[i] = (beta == T(0)) ? alpha * s : alpha * s + beta * y[i];
+        }
+    }
+
+    delete[] buf;
+}
+
+/// Unrolled s[r] += sum_c blk[r*B + c] x[c] for the rows r < R of a B x B
+/// block (the compilers do not unroll the nested loops at -O2).
+template<typename T, int B, int C>
+struct BsrDot
+{
+    static inline T dot(const T *a, const T *x) { return BsrDot<T, B, C-1>::dot(a, x) + a[C-1] * x[C-1]; }
+};
+template<typename T, int B>
+struct BsrDot<T, B, 1>
+{
+    static inline T dot(const T *a, const T *x) { return a[0] * x[0]; }
+};
+template<typename T, int B, int R>
+struct BsrBlock
+{
+    static inline void apply(const T *blk, const T *x, T *s)
+    {
+        BsrBlock<T, B, R-1>::apply(blk, x, s);
+        s[R-1] += BsrDot<T, B, B>::dot(blk + (R-1)*B, x);
+    }
+};
+template<typename T, int B>
+struct BsrBlock<T, B, 0>
+{
+    static inline void apply(const T *blk, const T *x, T *s) { }
+};
+
+/// Block rows [begin, end) of y = alpha A x + beta y for a block size B
+/// known at compile time, so that the block loops are unrolled and the
+/// partial sums stay in registers.
+template<typename T, int B>
+static void bsr_times_vector_rows(int begin, int end, int *Ap, int *Ai, T *Ax, T *x, T *y, T alpha, T beta)
+{
+    for (int I = begin; I < end; I++)
+    {
+        T s[B];
+        for (int r = 0; r < B; r++)
+            s[r] = 0.0;
+
+        for (int k = Ap[I]; k < Ap[I+1]; k++)
+            BsrBlock<T, B, B>::apply(Ax + (size_t) k * B * B, x + (size_t) Ai[k] * B, s);
+
+        T *yi = y + (size_t) I * B;
+        for (int r = 0; r < B; r++)
+        {
+            if (beta == T(0.0))
+                yi[r] = alpha * s[r];
+            else
+                yi[r] = alpha * s[r] + beta * yi[r];
+        }
+    }
+}
+
+/// Same for any block size b.
+template<typename T>
+static void bsr_times_vector_rows(int b, int begin, int end, int *Ap, int *Ai, T *Ax, T *x, T *y, T alpha, T beta)
+{
+    T *s = new T[b];
+    for (int I = begin; I < end; I++)
+    {
+        for (int r = 0; r < b; r++)
+            s[r] = 0.0;
+
+        for (int k = Ap[I]; k < Ap[I+1]; k++)
+        {
+            const T *blk = Ax + (size_t) k * b * b;
+            const T *xj = x + (size_t) Ai[k] * b;
+            for (int r = 0; r < b; r++)
+                for (int c = 0; c < b; c++)
+                    s[r] += blk[r*b + c] * xj[c];
+        }
+
+        T *yi = y + (size_t) I * b;
+        for (int r = 0; r < b; r++)
+        {
+            if (beta == T(0.0))
+                yi[r] = alpha * s[r];
+            else
+                yi[r] = alpha * s[r] + beta * yi[r];
+        }
+    }
+    delete[] s;
+}
+
+template<typename T>
+void bsr_times_vector(int size, int bsize, int *Ap, int *Ai, T *Ax, T *x, T *y, T alpha, T beta)
+{
+    int b = bsize;
+    int nb = (size + b - 1) / b;
+
+    // the last block row and column are padded with zeros if size is not
+    // a multiple of the block size
+    T *xp = x;
+    T *yp = y;
+    if (nb * b != size)
+    {
+        xp = new T[nb * b];
+        yp = new T[nb * b];
+        std::copy(x, x + size, xp);
+        std::fill(xp + size, xp + nb * b, T(0.0));
+        if (beta != T(0.0))
+            std::copy(y, y + size, yp);
+        std::fill(yp + size, yp + nb * b, T(0.0));
+    }
+
+    int num_threads = spmv_threads((long long) Ap[nb] * b * b);
+    #pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int t = 0; t < num_threads; t++)
+    {
+        int begin = nnz_split(nb, Ap, t, num_threads);
+        int end = nnz_split(nb, Ap, t+1, num_threads);
+        switch (b)
+        {
+        case 2: bsr_times_vector_rows<T, 2>(begin, end, Ap, Ai, Ax, xp, yp, alpha, beta); break;
+        case 3: bsr_times_vector_rows<T, 3>(begin, end, Ap, Ai, Ax, xp, yp, alpha, beta); break;
+        case 4: bsr_times_vector_rows<T, 4>(begin, end, Ap, Ai, Ax, xp, yp, alpha, beta); break;
+        case 5: bsr_times_vector_rows<T, 5>(begin, end, Ap, Ai, Ax, xp, yp, alpha, beta); break;
+        case 6: bsr_times_vector_rows<T, 6>(begin, end, Ap, Ai, Ax, xp, yp, alpha, beta); break;
+        case 7: bsr_times_vector_rows<T, 7>(begin, end, Ap, Ai, Ax, xp, yp, alpha, beta); break;
+        case 8: bsr_times_vector_rows<T, 8>(begin, end, Ap, Ai, Ax, xp, yp, alpha, beta); break;
+        default: bsr_times_vector_rows<T>(b, begin, end, Ap, Ai, Ax, xp, yp, alpha, beta);
+        }
+    }
+
+    if (nb * b != size)
+    {
+        std::copy(yp, yp + size, y);
+        delete[] xp;
+        delete[] yp;
+    }
+}
+
+/// Chunks [begin, end) of y = alpha A x + beta y for a chunk height C known
+/// at compile time, the loop over the rows of a chunk vectorizes.
+template<typename T, int C>
+static void sell_times_vector_chunks(int size, int begin, int end, int *cs, int *perm, int *col, T *val,
+                                     T *x, T *y, T alpha, T beta)
+{
+    for (int c = begin; c < end; c++)
+    {
+        T s[C];
+        for (int r = 0; r < C; r++)
+            s[r] = 0.0;
+
+        for (int k = cs[c]; k < cs[c+1]; k += C)
+        {
+            const T *v = val + k;
+            const int *ci = col + k;
+            for (int r = 0; r < C; r++)
+                s[r] += v[r] * x[ci[r]];
+        }
+
+        for (int r = 0; r < C && c*C + r < size; r++)
+        {
+            int i = perm[c*C + r];
+            if (beta == T(0.0))
+                y[i] = alpha * s[r];
+            else
+                y[i] = alpha * s[r] + beta * y[i];
+        }
+    }
+}
+
+/// Same for any chunk height.
+template<typename T>
+static void sell_times_vector_chunks(int chunk, int size, int begin, int end, int *cs, int *perm, int *col, T *val,
+                                     T *x, T *y, T alpha, T beta)
+{
+    T *s = new T[chunk];
+    for (int c = begin; c < end; c++)
+    {
+        for (int r = 0; r < chunk; r++)
+            s[r] = 0.0;
+
+        for (int k = cs[c]; k < cs[c+1]; k += chunk)
+        {
+            const T *v = val + k;
+            const int *ci = col + k;
+            for (int r = 0; r < chunk; r++)
+                s[r] += v[r] * x[ci[r]];
+        }
+
+        for (int r = 0; r < chunk && c*chunk + r < size; r++)
+        {
+            int i = perm[c*chunk + r];
+            if (beta == T(0.0))
+                y[i] = alpha * s[r];
+            else
+                y[i] = alpha * s[r] + beta * y[i];
+        }
+    }
+    delete[] s;
+}
+
+template<typename T>
+void sell_times_vector(int size, int chunk, int *cs, int *perm, int *col, T *val, T *x, T *y, T alpha, T beta)
+{
+    int nchunks = (size + chunk - 1) / chunk;
+
+    // the chunks are independent, the split gives the same padded entries
+    // to each thread
+    int num_threads = spmv_threads(cs[nchunks]);
+    #pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int t = 0; t < num_threads; t++)
+    {
+        int begin = nnz_split(nchunks, cs, t, num_threads);
+        int end = nnz_split(nchunks, cs, t+1, num_threads);
+        switch (chunk)
+        {
+        case 4: sell_times_vector_chunks<T, 4>(size, begin, end, cs, perm, col, val, x, y, alpha, beta); break;
+        case 8: sell_times_vector_chunks<T, 8>(size, begin, end, cs, perm, col, val, x, y, alpha, beta); break;
+        case 16: sell_times_vector_chunks<T, 16>(size, begin, end, cs, perm, col, val, x, y, alpha, beta); break;
+        default: sell_times_vector_chunks<T>(chunk, size, begin, end, cs, perm, col, val, x, y, alpha, beta);
+        }
+    }
+}
+
+// matrix vector multiplication
+void mat_dot(Matrix *A, double *x, double *result, int n_dof)
+{
+    A->times_vector(x, result, n_dof);
+}
+
+// vector vector multiplication
+double vec_dot(double *r, double *s, int n_dof)
+{
+    double result = 0;
+    for (int i=0; i < n_dof; i++) result += r[i]*s[i];
+    return result;
+}
+
+/// Solves the set of n linear equations A*x = b, where a is a positive-definite symmetric matrix.
+/// a[n][n] and p[n] are input as the output of the routine choldc. Only the lower
+/// subdiagonal portion of a is accessed. b[n] is input as the right-hand side vector. The
+/// solution vector is returned in x[n]. a, n, and p are not modified and can be left in place
+/// for successive calls with different right-hand sides b. b is not modified unless you identify b and
+/// x in the calling sequence, which is allowed. The right-hand side b can be complex, in which case
+/// the solution x is also complex.
+void ludcmp(double** a, int n, int* indx, double* d)
+{
+    int i, imax = 0, j, k;
+    double big, dum, sum, temp;
+    double* vv = new double[n];
+
+    *d = 1.0;
+    for (i = 0; i < n; i++)
+    {
+        big=0.0;
+        for (j = 0; j < n; j++)
+            if ((temp = fabs(a[i][j])) > big)
+                big = temp;
         if (big == 0.0) _error("Singular matrix!");
         vv[i] = 1.0 / big;
     }
-    for (j = 0; j < n; j++)
+    for (j = 0; j < n; j++)
+    {
+        for (i = 0; i < j; i++)
+        {
+            sum = a[i][j];
+            for (k = 0; k < i; k++) sum -= a[i][k]*a[k][j];
+            a[i][j] = sum;
+        }
+        big = 0.0;
+        for (i = j; i < n; i++)
+        {
+            sum = a[i][j];
+            for (k = 0; k < j; k++) sum -= a[i][k]*a[k][j];
+            a[i][j] = sum;
+            if ((dum = vv[i]*fabs(sum)) >= big)
+            {
+                big = dum;
+                imax = i;
+            }
+        }
+        if (j != imax)
+        {
+            for (k = 0; k < n; k++)
+            {
+                dum = a[imax][k];
+                a[imax][k] = a[j][k];
+                a[j][k] = dum;
+            }
+            *d = -(*d);
+            vv[imax] = vv[j];
+        }
+        indx[j] = imax;
+        if (a[j][j] == 0.0) a[j][j] = 1e-20;
+        if (j != n-1)
+        {
+            dum = 1.0 / (a[j][j]);
+            for (i = j+1; i < n; i++) a[i][j] *= dum;
+        }
+    }
+    delete [] vv;
+}
+
+/// Solves the set of n linear equations AX = B. Here a[n][n] is input, not as the matrix
+/// A but rather as its LU decomposition, determined by the routine ludcmp. indx[n] is input
+/// as the permutation vector returned by ludcmp. b[n] is input as the right-hand side vector
+/// B, and returns with the solution vector X. a, n, and indx are not modified by this routine
+/// and can be left in place for successive calls with different right-hand sides b. This routine takes
+/// into account the possibility that b will begin with many zero elements, so it is efficient for use
+/// in matrix inversion.
+void lubksb(double** a, int n, int* indx, double* b)
+{
+    int i, ip, j;
+    double sum;
+
+    for (i = 0; i < n; i++)
+    {
+        ip = indx[i];
+        sum = b[ip];
+        b[ip] = b[i];
+        for (j = 0; j < i; j++) sum -= a[i][j]*b[j];
+        b[i] = sum;
+    }
+    for (i = n-1; i >= 0; i--)
+    {
+        sum = b[i];
+        for (j = i+1; j < n; j++) sum -= a[i][j]*b[j];
+        b[i] = sum / a[i][i];
+    }
+}
+
+// ********************************************************************************************************************
+
+// alignment of the columns of DenseLU (in bytes)
+#define DENSE_LU_ALIGN 64
+// columns of the panels of DenseLU
+#define DENSE_LU_BLOCK 64
+// rows of the trailing submatrix updated at once, a block of L21 with
+// DENSE_LU_ROWS x DENSE_LU_BLOCK entries should fit into the L2 cache
+#define DENSE_LU_ROWS 256
+
+// magnitude used for the choice of pivots, |re| + |im| for complex numbers
+// is as good as the modulus and cheaper
+static inline double pivot_abs(double a)
+{
+    return fabs(a);
+}
+
+static inline double pivot_abs(cplx a)
+{
+    return fabs(a.real()) + fabs(a.imag());
+}
+
+/// Number of threads for an update of ncols columns of length nrows.
+static int dense_lu_threads(int nrows, int ncols)
+{
+    int n = get_num_threads();
+    n = std::min(n, ncols / 16);
+    if ((long long) nrows * ncols < 65536)
+        n = 1;
+    return std::max(n, 1);
+}
+
+template<typename T>
+DenseLU<T>::DenseLU()
+{
+    this->n = 0;
+    this->ld = 0;
+    this->lu = NULL;
+    this->lu_mem = NULL;
+    this->ipiv = NULL;
+}
+
+template<typename T>
+DenseLU<T>::~DenseLU()
+{
+    free_data();
+}
+
+template<typename T>
+void DenseLU<T>::free_data()
+{
+    if (this->lu_mem) delete[] this->lu_mem;
+    if (this->ipiv) delete[] this->ipiv;
+    this->lu = NULL;
+    this->lu_mem = NULL;
+    this->ipiv = NULL;
+    this->n = 0;
+    this->ld = 0;
+}
+
+template<typename T>
+void DenseLU<T>::factorize(T **a, int n)
+{
+    this->factorize_columns(NULL, n, 0);
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < n; j++)
+            this->lu[i + (size_t) j * this->ld] = a[i][j];
+    this->factorize_data();
+}
+
+template<typename T>
+void DenseLU<T>::factorize_columns(T *a, int n, int lda)
+{
+    if (n < 0) _error("DenseLU: negative size.");
+    if (a != NULL && lda < n) _error("DenseLU: lda is smaller than the matrix size.");
+
+    // reuse the storage if the size did not change
+    if (n != this->n || this->lu == NULL)
+    {
+        free_data();
+        int per_line = DENSE_LU_ALIGN / sizeof(T);
+        if (per_line < 1) per_line = 1;
+        this->n = n;
+        this->ld = ((n + per_line - 1) / per_line) * per_line;
+        if (this->ld == 0) this->ld = per_line;
+        this->lu_mem = new char[sizeof(T) * (size_t) this->ld * std::max(n, 1) + DENSE_LU_ALIGN];
+        size_t addr = (size_t) this->lu_mem;
+        this->lu = (T *) (addr + (DENSE_LU_ALIGN - addr % DENSE_LU_ALIGN) % DENSE_LU_ALIGN);
+        this->ipiv = new int[std::max(n, 1)];
+    }
+
+    // called by factorize(T **a, int n) just to allocate
+    if (a == NULL)
+        return;
+
+    for (int j = 0; j < n; j++)
+        memcpy(this->lu + (size_t) j * this->ld, a + (size_t) j * lda, sizeof(T) * n);
+    this->factorize_data();
+}
+
+template<typename T>
+void DenseLU<T>::factorize_data()
+{
+    int n = this->n;
+    size_t ld = this->ld;
+    T *lu = this->lu;
+
+    for (int k = 0; k < n; k += DENSE_LU_BLOCK)
     {
-        for (i = 0; i < j; i++)
+        int kb = std::min(DENSE_LU_BLOCK, n - k);
+        int ke = k + kb;
+
+        // unblocked factorization of the panel lu[k...n)[k...ke)
+        for (int j = k; j < ke; j++)
         {
-            sum = a[i][j];
-            for (k = 0; k < i; k++) sum -= a[i][k]*a[k][j];
-            a[i][j] = sum;
+            T *cj = lu + j * ld;
+
+            int p = j;
+            double big = pivot_abs(cj[j]);
+            for (int i = j + 1; i < n; i++)
+            {
+                double temp = pivot_abs(cj[i]);
+                if (temp > big)
+                {
+                    big = temp;
+                    p = i;
+                }
+            }
+            if (big == 0.0) _error("Singular matrix!");
+            this->ipiv[j] = p;
+
+            // interchange the whole rows, so that the L already computed and
+            // the columns right of the panel are permuted too
+            if (p != j)
+                for (int c = 0; c < n; c++)
+                    std::swap(lu[j + c * ld], lu[p + c * ld]);
+
+            T inv = T(1.0) / cj[j];
+            for (int i = j + 1; i < n; i++)
+                cj[i] *= inv;
+
+            for (int jj = j + 1; jj < ke; jj++)
+            {
+                T *cjj = lu + jj * ld;
+                T u = cjj[j];
+                if (u == T(0.0)) continue;
+                for (int i = j + 1; i < n; i++)
+                    cjj[i] -= cj[i] * u;
+            }
         }
-        big = 0.0;
-        for (i = j; i < n; i++)
+
+        if (ke == n)
+            break;
+
+        // U12 = L11^-1 A12 and A22 -= L21 U12, the columns are independent
+        int ncols = n - ke;
+        int num_threads = dense_lu_threads(n - k, ncols);
+        #pragma omp parallel for num_threads(num_threads) schedule(static)
+        for (int t = 0; t < num_threads; t++)
         {
-            sum = a[i][j];
-            for (k = 0; k < j; k++) sum -= a[i][k]*a[k][j];
-            a[i][j] = sum;
-            if ((dum = vv[i]*fabs(sum)) >= big)
+            int jb = ke + chunk_begin(ncols, t, num_threads);
+            int je = ke + chunk_begin(ncols, t+1, num_threads);
+
+            for (int jj = jb; jj < je; jj++)
             {
-                big = dum;
-                imax = i;
+                T *cjj = lu + jj * ld;
+                for (int j = k; j < ke; j++)
+                {
+                    T u = cjj[j];
+                    const T *cj = lu + j * ld;
+                    for (int i = j + 1; i < ke; i++)
+                        cjj[i] -= cj[i] * u;
+                }
+            }
+
+            // the rows are processed by blocks to keep the block of L21 in
+            // cache, four columns of L21 are applied at once to save loads
+            // and stores of A22
+            for (int ib = ke; ib < n; ib += DENSE_LU_ROWS)
+            {
+                int ie = std::min(ib + DENSE_LU_ROWS, n);
+                for (int jj = jb; jj < je; jj++)
+                {
+                    T *cjj = lu + jj * ld;
+                    int j = k;
+                    for (; j + 3 < ke; j += 4)
+                    {
+                        T u0 = cjj[j], u1 = cjj[j+1], u2 = cjj[j+2], u3 = cjj[j+3];
+                        const T *c0 = lu + j * ld;
+                        const T *c1 = c0 + ld;
+                        const T *c2 = c1 + ld;
+                        const T *c3 = c2 + ld;
+                        for (int i = ib; i < ie; i++)
+                            cjj[i] -= c0[i] * u0 + c1[i] * u1 + c2[i] * u2 + c3[i] * u3;
+                    }
+                    for (; j < ke; j++)
+                    {
+                        T u = cjj[j];
+                        const T *cj = lu + j * ld;
+                        for (int i = ib; i < ie; i++)
+                            cjj[i] -= cj[i] * u;
+                    }
+                }
             }
         }
-        if (j != imax)
+    }
+}
+
+template<typename T>
+void DenseLU<T>::solve(T *B, int nrhs, int ldb)
+{
+    if (this->lu == NULL) _error("DenseLU: the matrix is not factorized.");
+    int n = this->n;
+    size_t ld = this->ld;
+    T *lu = this->lu;
+    if (ldb == 0) ldb = n;
+    if (ldb < n) _error("DenseLU: ldb is smaller than the matrix size.");
+
+    // the right-hand sides are independent, each thread solves a group of
+    // them column by column of L and U, so that each column is loaded once
+    // for the whole group
+    int num_threads = std::max(1, std::min(get_num_threads(), nrhs));
+    if ((long long) n * n * nrhs < 65536)
+        num_threads = 1;
+    #pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int t = 0; t < num_threads; t++)
+    {
+        int rb = chunk_begin(nrhs, t, num_threads);
+        int re = chunk_begin(nrhs, t+1, num_threads);
+
+        for (int r = rb; r < re; r++)
         {
-            for (k = 0; k < n; k++)
+            T *b = B + (size_t) r * ldb;
+            for (int i = 0; i < n; i++)
+                if (this->ipiv[i] != i)
+                    std::swap(b[i], b[this->ipiv[i]]);
+        }
+
+        // L y = P b
+        for (int j = 0; j < n; j++)
+        {
+            const T *cj = lu + j * ld;
+            for (int r = rb; r < re; r++)
             {
-                dum = a[imax][k];
-                a[imax][k] = a[j][k];
-                a[j][k] = dum;
+                T *b = B + (size_t) r * ldb;
+                T bj = b[j];
+                if (bj == T(0.0)) continue;
+                for (int i = j + 1; i < n; i++)
+                    b[i] -= cj[i] * bj;
             }
-            *d = -(*d);
-            vv[imax] = vv[j];
         }
-        indx[j] = imax;
-        if (a[j][j] == 0.0) a[j][j] = 1e-20;
-        if (j != n-1)
+
+        // U x = y
+        for (int j = n - 1; j >= 0; j--)
         {
-            dum = 1.0 / (a[j][j]);
-            for (i = j+1; i < n; i++) a[i][j] *= dum;
+            const T *cj = lu + j * ld;
+            for (int r = rb; r < re; r++)
+            {
+                T *b = B + (size_t) r * ldb;
+                b[j] /= cj[j];
+                T bj = b[j];
+                if (bj == T(0.0)) continue;
+                for (int i = 0; i < j; i++)
+                    b[i] -= cj[i] * bj;
+            }
         }
     }
-    delete [] vv;
 }
 
-/// Solves the set of n linear equations AX = B. Here a[n][n] is input, not as the matrix
-/// A but rather as its LU decomposition, determined by the routine ludcmp. indx[n] is input
-/// as the permutation vector returned by ludcmp. b[n] is input as the right-hand side vector
-/// B, and returns with the solution vector X. a, n, and indx are not modified by this routine
-/// and can be left in place for successive calls with different right-hand sides b. This routine takes
-/// into account the possibility that b will begin with many zero elements, so it is efficient for use
-/// in matrix inversion.
-void lubksb(double** a, int n, int* indx, double* b)
+template class DenseLU<double>;
+template class DenseLU<cplx>;
+
+// ********************************************************************************************************************
+
+/// Adjacency of the graph of A + A^T without the diagonal: Gp[size+1] and
+/// Gi (allocated here), the neighbours of each node are sorted.
+static void symmetric_adjacency(int size, int *Ap, int *Ai, int *&Gp, int *&Gi)
 {
-    int i, ip, j;
-    double sum;
+    int nnz = Ap[size];
 
-    for (i = 0; i < n; i++)
+    // the off-diagonal entries and their transposes as triplets
+    int *row = new int[2 * nnz];
+    int *col = new int[2 * nnz];
+    char *dummy = new char[2 * nnz];
+    int n = 0;
+    for (int i = 0; i < size; i++)
+        for (int k = Ap[i]; k < Ap[i+1]; k++)
+        {
+            int j = Ai[k];
+            if (j == i) continue;
+            row[n] = i; col[n] = j; n++;
+            row[n] = j; col[n] = i; n++;
+        }
+
+    // sort by rows and columns and remove the duplicates
+    int *Tp = new int[size + 1];
+    int *Ti = new int[n];
+    char *Tx = new char[n];
+    coo_to_csc(size, n, row, col, dummy, Tp, Ti, Tx);
+    Gp = new int[size + 1];
+    csc_to_csr(size, n, Tp, Ti, Tx, Gp, col, dummy);
+    int *Gi_all = col;
+    Gi = new int[n];
+    int count = 0;
+    for (int i = 0; i < size; i++)
     {
-        ip = indx[i];
-        sum = b[ip];
-        b[ip] = b[i];
-        for (j = 0; j < i; j++) sum -= a[i][j]*b[j];
-        b[i] = sum;
+        int begin = Gp[i];
+        Gp[i] = count;
+        for (int k = begin; k < Gp[i+1]; k++)
+            if (k == begin || Gi_all[k] != Gi_all[k-1])
+                Gi[count++] = Gi_all[k];
     }
-    for (i = n-1; i >= 0; i--)
+    Gp[size] = count;
+
+    delete[] row;
+    delete[] col;
+    delete[] dummy;
+    delete[] Tp;
+    delete[] Ti;
+    delete[] Tx;
+}
+
+/// Breadth-first search from the node root, writes the nodes of its component
+/// in the order of the levels into order (returns their number) and the
+/// level of each node into level (-1 for the other nodes, which have to be
+/// -1 on entry). Returns the number of levels in *depth.
+static int bfs_levels(int *Gp, int *Gi, int root, int *order, int *level, int *depth)
+{
+    int n = 0;
+    order[n++] = root;
+    level[root] = 0;
+    for (int head = 0; head < n; head++)
     {
-        sum = b[i];
-        for (j = i+1; j < n; j++) sum -= a[i][j]*b[j];
-        b[i] = sum / a[i][i];
+        int v = order[head];
+        for (int k = Gp[v]; k < Gp[v+1]; k++)
+            if (level[Gi[k]] < 0)
+            {
+                level[Gi[k]] = level[v] + 1;
+                order[n++] = Gi[k];
+            }
+    }
+    *depth = level[order[n-1]] + 1;
+    return n;
+}
+
+int pseudo_peripheral_node(int size, int *Gp, int *Gi, int start)
+{
+    int *order = new int[size];
+    int *level = new int[size];
+    std::fill(level, level + size, -1);
+
+    int depth;
+    int n = bfs_levels(Gp, Gi, start, order, level, &depth);
+    while (true)
+    {
+        // the node of the smallest degree in the last level
+        int candidate = -1;
+        for (int k = n - 1; k >= 0 && level[order[k]] == depth - 1; k--)
+            if (candidate < 0 || Gp[order[k]+1] - Gp[order[k]] < Gp[candidate+1] - Gp[candidate])
+                candidate = order[k];
+
+        for (int k = 0; k < n; k++)
+            level[order[k]] = -1;
+        int candidate_depth;
+        bfs_levels(Gp, Gi, candidate, order, level, &candidate_depth);
+        if (candidate_depth <= depth)
+        {
+            for (int k = 0; k < n; k++)
+                level[order[k]] = -1;
+            break;
+        }
+        start = candidate;
+        depth = candidate_depth;
+    }
+
+    delete[] order;
+    delete[] level;
+    return start;
+}
+
+/// Orders by increasing degree, ties by the index, so that the ordering
+/// does not depend on the sort.
+struct DegreeLess
+{
+    int *Gp;
+    DegreeLess(int *Gp) : Gp(Gp) {}
+    inline bool operator()(int a, int b) const
+    {
+        int da = Gp[a+1] - Gp[a], db = Gp[b+1] - Gp[b];
+        return da < db || (da == db && a < b);
+    }
+};
+
+void rcm_ordering(int size, int *Ap, int *Ai, int *perm)
+{
+    int *Gp, *Gi;
+    symmetric_adjacency(size, Ap, Ai, Gp, Gi);
+
+    // the nodes by increasing degree, the next component starts at the
+    // first unnumbered one
+    int *nodes = new int[size];
+    for (int i = 0; i < size; i++)
+        nodes[i] = i;
+    std::sort(nodes, nodes + size, DegreeLess(Gp));
+
+    bool *numbered = new bool[size];
+    std::fill(numbered, numbered + size, false);
+    int n = 0;
+    for (int s = 0; s < size; s++)
+    {
+        if (numbered[nodes[s]]) continue;
+
+        // Cuthill-McKee numbering of the component
+        int root = pseudo_peripheral_node(size, Gp, Gi, nodes[s]);
+        perm[n++] = root;
+        numbered[root] = true;
+        for (int head = n - 1; head < n; head++)
+        {
+            int v = perm[head];
+            int first = n;
+            for (int k = Gp[v]; k < Gp[v+1]; k++)
+                if (!numbered[Gi[k]])
+                {
+                    numbered[Gi[k]] = true;
+                    perm[n++] = Gi[k];
+                }
+            std::sort(perm + first, perm + n, DegreeLess(Gp));
+        }
     }
+
+    std::reverse(perm, perm + size);
+
+    delete[] nodes;
+    delete[] numbered;
+    delete[] Gp;
+    delete[] Gi;
+}
+
+/// Approximate minimum degree elimination of the quotient graph with the
+/// variable adjacency Gp, Gi (without the diagonal, may be NULL) and the
+/// initial elements Ep, Ei (lists of variables, may be NULL), writes the
+/// elimination order into perm.
+static void minimum_degree(int size, int *Gp, int *Gi, int nelements, int *Ep, int *Ei, int *perm)
+{
+    // the variables adjacent to each variable, the elements of each variable
+    // and the variables of each element (the element of the variable p is
+    // nelements + p)
+    std::vector<std::vector<int> > adj(size), elem(size), vars(nelements + size);
+    bool *eliminated = new bool[size];
+    bool *alive = new bool[nelements + size];
+    std::fill(eliminated, eliminated + size, false);
+    std::fill(alive, alive + nelements + size, false);
+    for (int e = 0; e < nelements; e++)
+    {
+        vars[e].assign(Ei + Ep[e], Ei + Ep[e+1]);
+        for (int k = Ep[e]; k < Ep[e+1]; k++)
+            elem[Ei[k]].push_back(e);
+        alive[e] = true;
+    }
+
+    // the initial degrees (bounds for the elements), the variables of each
+    // degree in a doubly linked list
+    int *degree = new int[size];
+    int *head = new int[size];
+    int *next = new int[size];
+    int *prev = new int[size];
+    std::fill(head, head + size, -1);
+    for (int i = 0; i < size; i++)
+    {
+        if (Gp != NULL)
+            adj[i].assign(Gi + Gp[i], Gi + Gp[i+1]);
+        long long d = adj[i].size();
+        for (size_t k = 0; k < elem[i].size(); k++)
+            d += vars[elem[i][k]].size() - 1;
+        degree[i] = (int) std::min(d, (long long) size - 1);
+    }
+    for (int i = size - 1; i >= 0; i--)
+    {
+        prev[i] = -1;
+        next[i] = head[degree[i]];
+        if (next[i] != -1) prev[next[i]] = i;
+        head[degree[i]] = i;
+    }
+
+    // mark[v] == tag for the variables of the new element, w[e] is |Le \ Lp|
+    // for the elements with wflag[e] == tag
+    int *mark = new int[size];
+    int *w = new int[nelements + size];
+    int *wflag = new int[nelements + size];
+    std::fill(mark, mark + size, -1);
+    std::fill(wflag, wflag + nelements + size, -1);
+    std::vector<int> kept;
+    int mindeg = 0;
+    for (int tag = 0; tag < size; tag++)
+    {
+        while (head[mindeg] == -1)
+            mindeg++;
+        int p = head[mindeg];
+        head[mindeg] = next[p];
+        if (next[p] != -1) prev[next[p]] = -1;
+        eliminated[p] = true;
+        perm[tag] = p;
+
+        // the new element Lp: the neighbours of p and the variables of its
+        // elements, which are absorbed
+        int ep = nelements + p;
+        std::vector<int> &Lp = vars[ep];
+        mark[p] = tag;
+        for (size_t k = 0; k < adj[p].size(); k++)
+        {
+            int v = adj[p][k];
+            if (!eliminated[v] && mark[v] != tag)
+            {
+                mark[v] = tag;
+                Lp.push_back(v);
+            }
+        }
+        for (size_t k = 0; k < elem[p].size(); k++)
+        {
+            int e = elem[p][k];
+            if (!alive[e]) continue;
+            for (size_t l = 0; l < vars[e].size(); l++)
+            {
+                int v = vars[e][l];
+                if (!eliminated[v] && mark[v] != tag)
+                {
+                    mark[v] = tag;
+                    Lp.push_back(v);
+                }
+            }
+            alive[e] = false;
+            std::vector<int>().swap(vars[e]);
+        }
+        std::vector<int>().swap(adj[p]);
+        std::vector<int>().swap(elem[p]);
+        alive[ep] = true;
+
+        // |Le \ Lp| of the other elements of the variables in Lp
+        for (size_t k = 0; k < Lp.size(); k++)
+        {
+            std::vector<int> &E = elem[Lp[k]];
+            for (size_t l = 0; l < E.size(); l++)
+            {
+                int e = E[l];
+                if (!alive[e]) continue;
+                if (wflag[e] != tag)
+                {
+                    wflag[e] = tag;
+                    w[e] = vars[e].size();
+                }
+                w[e]--;
+            }
+        }
+
+        // the variables of Lp lose the absorbed elements, the elements inside
+        // Lp (aggressive absorption) and the neighbours in Lp, and get the
+        // bound of AMD as the new degree
+        int nleft = size - tag - 1;
+        int lp = Lp.size();
+        for (int k = 0; k < lp; k++)
+        {
+            int i = Lp[k];
+            if (prev[i] != -1) next[prev[i]] = next[i];
+            else head[degree[i]] = next[i];
+            if (next[i] != -1) prev[next[i]] = prev[i];
+
+            long long external = 0;
+            kept.clear();
+            for (size_t l = 0; l < elem[i].size(); l++)
+            {
+                int e = elem[i][l];
+                if (!alive[e]) continue;
+                if (w[e] == 0)
+                {
+                    alive[e] = false;
+                    std::vector<int>().swap(vars[e]);
+                    continue;
+                }
+                kept.push_back(e);
+                external += w[e];
+            }
+            kept.push_back(ep);
+            elem[i].swap(kept);
+            kept.clear();
+            for (size_t l = 0; l < adj[i].size(); l++)
+            {
+                int v = adj[i][l];
+                if (!eliminated[v] && mark[v] != tag)
+                    kept.push_back(v);
+            }
+            adj[i].swap(kept);
+
+            long long d = std::min((long long) degree[i] + lp - 1, (long long) adj[i].size() + lp - 1 + external);
+            degree[i] = (int) std::min(d, (long long) nleft);
+            prev[i] = -1;
+            next[i] = head[degree[i]];
+            if (next[i] != -1) prev[next[i]] = i;
+            head[degree[i]] = i;
+            mindeg = std::min(mindeg, degree[i]);
+        }
+    }
+
+    delete[] eliminated;
+    delete[] alive;
+    delete[] degree;
+    delete[] head;
+    delete[] next;
+    delete[] prev;
+    delete[] mark;
+    delete[] w;
+    delete[] wflag;
+}
+
+void amd_ordering(int size, int *Ap, int *Ai, int *perm)
+{
+    int *Gp, *Gi;
+    symmetric_adjacency(size, Ap, Ai, Gp, Gi);
+    minimum_degree(size, Gp, Gi, 0, NULL, NULL, perm);
+    delete[] Gp;
+    delete[] Gi;
+}
+
+void column_amd_ordering(int size, int *Ap, int *Ai, int *perm)
+{
+    int nnz = Ap[size];
+    int dense = std::max(16, (int) (10 * sqrt((double) size)));
+
+    // the rows with their columns, without the dense rows
+    int *count = new int[size];
+    std::fill(count, count + size, 0);
+    for (int k = 0; k < nnz; k++)
+        count[Ai[k]]++;
+    int *Rp = new int[size + 1];
+    Rp[0] = 0;
+    for (int i = 0; i < size; i++)
+        Rp[i+1] = Rp[i] + (count[i] > dense ? 0 : count[i]);
+    int *Ri = new int[Rp[size]];
+    std::copy(Rp, Rp + size, count);
+    for (int j = 0; j < size; j++)
+        for (int k = Ap[j]; k < Ap[j+1]; k++)
+        {
+            int i = Ai[k];
+            if (count[i] < Rp[i+1])
+                Ri[count[i]++] = j;
+        }
+    minimum_degree(size, NULL, NULL, size, Rp, Ri, perm);
+
+    delete[] count;
+    delete[] Rp;
+    delete[] Ri;
+}
+
+template<typename T>
+void csr_permute(int size, int nnz, int *Ap, int *Ai, T *Ax, int *perm, int *Bp, int *Bi, T *Bx, bool upper)
+{
+    int *inv = new int[size];
+    for (int i = 0; i < size; i++)
+        inv[perm[i]] = i;
+
+    // the permuted entries as triplets
+    int *row = new int[nnz];
+    int *col = new int[nnz];
+    int threads = conversion_threads(size, nnz);
+#ifdef COMMON_WITH_OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static)
+#endif
+    for (int i = 0; i < size; i++)
+        for (int k = Ap[i]; k < Ap[i+1]; k++)
+        {
+            int ni = inv[i], nj = inv[Ai[k]];
+            if (upper && ni > nj)
+                std::swap(ni, nj);
+            row[k] = ni;
+            col[k] = nj;
+        }
+
+    // sorting by columns and then by rows sorts the columns in each row
+    int *Cp = new int[size + 1];
+    int *Ci = new int[nnz];
+    T *Cx = new T[nnz];
+    coo_to_csc(size, nnz, row, col, Ax, Cp, Ci, Cx);
+    csc_to_csr(size, nnz, Cp, Ci, Cx, Bp, Bi, Bx);
+
+    delete[] inv;
+    delete[] row;
+    delete[] col;
+    delete[] Cp;
+    delete[] Ci;
+    delete[] Cx;
+}
+
+template<typename T>
+void permute_vector(int size, int *perm, T *x, T *y)
+{
+    for (int i = 0; i < size; i++)
+        y[i] = x[perm[i]];
 }
+
+template<typename T>
+void unpermute_vector(int size, int *perm, T *x, T *y)
+{
+    for (int i = 0; i < size; i++)
+        y[perm[i]] = x[i];
+}
+
+int csr_bandwidth(int size, int *Ap, int *Ai)
+{
+    int bandwidth = 0;
+    for (int i = 0; i < size; i++)
+        for (int k = Ap[i]; k < Ap[i+1]; k++)
+            bandwidth = std::max(bandwidth, std::abs(Ai[k] - i));
+    return bandwidth;
+}
+
+// ********************************************************************************************************************
+
+int csr_multiply_symbolic(int m, int n, int *Ap, int *Ai, int *Bp, int *Bi, int *&Cp, int *&Ci)
+{
+    Cp = new int[m + 1];
+    int threads = spmv_threads(Ap[m]);
+
+    // count the entries of each row of C, marker[j] is the last row in which
+    // the column j was seen
+    #pragma omp parallel for num_threads(threads) schedule(static)
+    for (int t = 0; t < threads; t++)
+    {
+        int *marker = new int[n];
+        std::fill(marker, marker + n, -1);
+        for (int i = nnz_split(m, Ap, t, threads); i < nnz_split(m, Ap, t+1, threads); i++)
+        {
+            int count = 0;
+            for (int ka = Ap[i]; ka < Ap[i+1]; ka++)
+                for (int kb = Bp[Ai[ka]]; kb < Bp[Ai[ka]+1]; kb++)
+                    if (marker[Bi[kb]] != i)
+                    {
+                        marker[Bi[kb]] = i;
+                        count++;
+                    }
+            Cp[i] = count;
+        }
+        delete[] marker;
+    }
+    int nnz = exclusive_scan(Cp, m, conversion_threads(m, Ap[m]));
+    Cp[m] = nnz;
+
+    // the columns of each row, sorted
+    Ci = new int[nnz];
+    #pragma omp parallel for num_threads(threads) schedule(static)
+    for (int t = 0; t < threads; t++)
+    {
+        int *marker = new int[n];
+        std::fill(marker, marker + n, -1);
+        for (int i = nnz_split(m, Ap, t, threads); i < nnz_split(m, Ap, t+1, threads); i++)
+        {
+            int index = Cp[i];
+            for (int ka = Ap[i]; ka < Ap[i+1]; ka++)
+                for (int kb = Bp[Ai[ka]]; kb < Bp[Ai[ka]+1]; kb++)
+                    if (marker[Bi[kb]] != i)
+                    {
+                        marker[Bi[kb]] = i;
+                        Ci[index++] = Bi[kb];
+                    }
+            std::sort(Ci + Cp[i], Ci + Cp[i+1]);
+        }
+        delete[] marker;
+    }
+
+    return nnz;
+}
+
+template<typename T>
+void csr_multiply_numeric(int m, int n, int *Ap, int *Ai, T *Ax, int *Bp, int *Bi, T *Bx, int *Cp, int *Ci, T *Cx)
+{
+    int threads = spmv_threads(Cp[m]);
+
+    // position[j] is the position of the column j in the current row of C
+    #pragma omp parallel for num_threads(threads) schedule(static)
+    for (int t = 0; t < threads; t++)
+    {
+        int *position = new int[n];
+        for (int i = nnz_split(m, Cp, t, threads); i < nnz_split(m, Cp, t+1, threads); i++)
+        {
+            for (int k = Cp[i]; k < Cp[i+1]; k++)
+            {
+                position[Ci[k]] = k;
+                Cx[k] = 0.0;
+            }
+            for (int ka = Ap[i]; ka < Ap[i+1]; ka++)
+            {
+                T a = Ax[ka];
+                for (int kb = Bp[Ai[ka]]; kb < Bp[Ai[ka]+1]; kb++)
+                    Cx[position[Bi[kb]]] += a * Bx[kb];
+            }
+        }
+        delete[] position;
+    }
+}
+
+int csr_add_symbolic(int m, int *Ap, int *Ai, int *Bp, int *Bi, int *&Cp, int *&Ci)
+{
+    Cp = new int[m + 1];
+    int threads = spmv_threads((long long) Ap[m] + Bp[m]);
+
+    // merges of the sorted rows, counted first
+    #pragma omp parallel for num_threads(threads) schedule(static)
+    for (int t = 0; t < threads; t++)
+        for (int i = chunk_begin(m, t, threads); i < chunk_begin(m, t+1, threads); i++)
+        {
+            int ka = Ap[i], kb = Bp[i], count = 0;
+            while (ka < Ap[i+1] || kb < Bp[i+1])
+            {
+                if (kb == Bp[i+1] || (ka < Ap[i+1] && Ai[ka] < Bi[kb]))
+                    ka++;
+                else if (ka == Ap[i+1] || Bi[kb] < Ai[ka])
+                    kb++;
+                else
+                {
+                    ka++;
+                    kb++;
+                }
+                count++;
+            }
+            Cp[i] = count;
+        }
+    int nnz = exclusive_scan(Cp, m, conversion_threads(m, Ap[m]));
+    Cp[m] = nnz;
+
+    Ci = new int[nnz];
+    #pragma omp parallel for num_threads(threads) schedule(static)
+    for (int t = 0; t < threads; t++)
+        for (int i = chunk_begin(m, t, threads); i < chunk_begin(m, t+1, threads); i++)
+        {
+            int ka = Ap[i], kb = Bp[i], index = Cp[i];
+            while (ka < Ap[i+1] || kb < Bp[i+1])
+            {
+                if (kb == Bp[i+1] || (ka < Ap[i+1] && Ai[ka] < Bi[kb]))
+                    Ci[index++] = Ai[ka++];
+                else if (ka == Ap[i+1] || Bi[kb] < Ai[ka])
+                    Ci[index++] = Bi[kb++];
+                else
+                {
+                    Ci[index++] = Ai[ka++];
+                    kb++;
+                }
+            }
+        }
+
+    return nnz;
+}
+
+template<typename T>
+void csr_add_numeric(int m, T alpha, int *Ap, int *Ai, T *Ax, T beta, int *Bp, int *Bi, T *Bx, int *Cp, int *Ci, T *Cx)
+{
+    int threads = spmv_threads(Cp[m]);
+
+    // the rows of A and B are subsets of the rows of C, all sorted
+    int missing = 0;
+    #pragma omp parallel for num_threads(threads) schedule(static) reduction(+:missing)
+    for (int t = 0; t < threads; t++)
+        for (int i = nnz_split(m, Cp, t, threads); i < nnz_split(m, Cp, t+1, threads); i++)
+        {
+            int ka = Ap[i], kb = Bp[i];
+            for (int k = Cp[i]; k < Cp[i+1]; k++)
+            {
+                T sum = 0.0;
+                if (ka < Ap[i+1] && Ai[ka] == Ci[k])
+                    sum += alpha * Ax[ka++];
+                if (kb < Bp[i+1] && Bi[kb] == Ci[k])
+                    sum += beta * Bx[kb++];
+                Cx[k] = sum;
+            }
+            if (ka != Ap[i+1] || kb != Bp[i+1])
+                missing++;
+        }
+    if (missing)
+        _error("csr_add_numeric(): the pattern of C does not contain A and B.");
+}
+
+// explicit instantiations
+#define INSTANTIATE_CONVERSIONS(T, I) \
+    template void coo_to_csr<T, I>(int size, I nnz, I *row, I *col, T *A, I *Ap, I *Ai, T *Ax); \
+    template void coo_to_csc<T, I>(int size, I nnz, I *row, I *col, T *A, I *Ap, I *Ai, T *Ax); \
+    template void csr_to_csc<T, I>(int size, I nnz, I *Arp, I *Ari, T *Arx, I *Acp, I *Aci, T *Acx); \
+    template void csc_to_csr<T, I>(int size, I nnz, I *Acp, I *Aci, T *Acx, I *Arp, I *Ari, T *Arx); \
+    template void csc_to_coo<T, I>(int size, I nnz, I *Ap, I *Ai, T *Ax, I *row, I *col, T *A); \
+    template void csr_to_coo<T, I>(int size, I nnz, I *Ap, I *Ai, T *Ax, I *row, I *col, T *A); \
+    template I csr_sum_duplicates<T, I>(int size, I *Ap, I *Ai, T *Ax, I *Bp, I *Bi, T *Bx); \
+    template I csr_symmetric_expand<T, I>(int size, I *Ap, I *Ai, T *Ax, I *Bp, I *Bi, T *Bx); \
+    template void csr_times_vector<T, I>(int size, I *Ap, I *Ai, T *Ax, T *x, T *y, T alpha, T beta); \
+    template void csc_times_vector<T, I>(int size, I *Ap, I *Ai, T *Ax, T *x, T *y, T alpha, T beta); \
+    template void csr_symmetric_times_vector<T, I>(int size, I *Ap, I *Ai, T *Ax, T *x, T *y, T alpha, T beta);
+
+// the dense and block formats have 32-bit indices only
+#define INSTANTIATE_PRODUCTS(T) \
+    template void dense_to_coo<T>(int size, int nnz, T **Ad, int *row, int *col, T *A); \
+    template void bsr_times_vector<T>(int size, int bsize, int *Ap, int *Ai, T *Ax, T *x, T *y, T alpha, T beta); \
+    template void sell_times_vector<T>(int size, int chunk, int *cs, int *perm, int *col, T *val, T *x, T *y, T alpha, T beta);
+
+INSTANTIATE_CONVERSIONS(double, int)
+INSTANTIATE_CONVERSIONS(cplx, int)
+INSTANTIATE_CONVERSIONS(double, long long)
+INSTANTIATE_CONVERSIONS(cplx, long long)
+INSTANTIATE_PRODUCTS(double)
+INSTANTIATE_PRODUCTS(cplx)
+template void csr_permute<double>(int size, int nnz, int *Ap, int *Ai, double *Ax, int *perm, int *Bp, int *Bi, double *Bx, bool upper);
+template void csr_permute<cplx>(int size, int nnz, int *Ap, int *Ai, cplx *Ax, int *perm, int *Bp, int *Bi, cplx *Bx, bool upper);
+template void permute_vector<double>(int size, int *perm, double *x, double *y);
+template void permute_vector<cplx>(int size, int *perm, cplx *x, cplx *y);
+template void unpermute_vector<double>(int size, int *perm, double *x, double *y);
+template void unpermute_vector<cplx>(int size, int *perm, cplx *x, cplx *y);
+template void csr_multiply_numeric<double>(int m, int n, int *Ap, int *Ai, double *Ax, int *Bp, int *Bi, double *Bx, int *Cp, int *Ci, double *Cx);
+template void csr_multiply_numeric<cplx>(int m, int n, int *Ap, int *Ai, cplx *Ax, int *Bp, int *Bi, cplx *Bx, int *Cp, int *Ci, cplx *Cx);
+template void csr_add_numeric<double>(int m, double alpha, int *Ap, int *Ai, double *Ax, double beta, int *Bp, int *Bi, double *Bx, int *Cp, int *Ci, double *Cx);
+template void csr_add_numeric<cplx>(int m, cplx alpha, int *Ap, int *Ai, cplx *Ax, cplx beta, int *Bp, int *Bi, cplx *Bx, int *Cp, int *Ci, cplx *Cx);
+template int csr_symmetric_expanded_nnz<int>(int size, int *Ap, int *Ai);
+template long long csr_symmetric_expanded_nnz<long long>(int size, long long *Ap, long long *Ai);
@@ -16,6 +16,9 @@
 #include <string.h>
 #include <complex>
 #include <map>
+#include <vector>
+#include <algorithm>
+#include <climits>
 
 typedef std::complex<double> cplx;
 class Matrix;
@@ -28,6 +31,22 @@ class Matrix;
 class CooMatrix;
 class CSRMatrix;
 class CSCMatrix;
+class BSRMatrix;
+class SELLMatrix;
+class CSRMatrix64;
+template<typename T> class CSRMatrixT;
+template<typename T> class CSCMatrixT;
+
+// the compressed formats with the scalar type fixed at compile time, the
+// float matrices keep float values and multiply double vectors (the memory
+// traffic per entry is 8 instead of 12 bytes, the entries are rounded to
+// about 1e-7 relative)
+typedef CSRMatrixT<double> CSRMatrixDouble;
+typedef CSRMatrixT<cplx> CSRMatrixCplx;
+typedef CSRMatrixT<float> CSRMatrixFloat;
+typedef CSCMatrixT<double> CSCMatrixDouble;
+typedef CSCMatrixT<cplx> CSCMatrixCplx;
+typedef CSCMatrixT<float> CSCMatrixFloat;
 
 /// Creates a new (full) matrix with m rows and n columns with entries of the type T.
 /// The entries can be accessed by matrix[i][j]. To delete the matrix, just
@@ -36,7 +55,7 @@ template<typename T>
 T** _new_matrix(int m, int n = 0)
 {
     if (!n) n = m;
-    T** vec = (T**) new char[sizeof(T*)*m + sizeof(T)*m*n];
+    T** vec = (T**) new char[sizeof(T*) * m + sizeof(T) * (size_t) m * n];
     if (vec == NULL) _error("Out of memory.");
     T* row = (T*) (vec + m);
     for (int i = 0; i < m; i++, row += n)
@@ -46,7 +65,7 @@ T** _new_matrix(int m, int n = 0)
 
 class Matrix {
 public:
-    Matrix() {}
+    Matrix() { this->symmetric = false; }
     virtual ~Matrix() {}
 
     inline virtual void init() { this->complex = false; free_data(); }
@@ -56,6 +75,9 @@ public:
 
     inline virtual int get_size() { return this->size; }
     inline bool is_complex() { return this->complex; }
+    // true if only the upper triangle of a symmetric (not hermitian) matrix
+    // is stored (CooMatrix, CSRMatrix)
+    inline bool is_symmetric() { return this->symmetric; }
     virtual void print() = 0;
 
     virtual void add(int m, int n, double v) = 0;
@@ -63,18 +85,20 @@ public:
     {
         _error("internal error: add(int, int, cplx) not implemented.");
     }
+    // the blocks of a symmetric matrix are symmetric, only their entries in
+    // the upper triangle are added
     virtual void add_block(int *iidx, int ilen, int *jidx, int jlen, double** mat)
     {
         for (int i = 0; i < ilen; i++)
             for (int j=0; j < jlen; j++)
-                if (iidx[i] >= 0 && jidx[j] >= 0)
+                if (iidx[i] >= 0 && jidx[j] >= 0 && (!symmetric || iidx[i] <= jidx[j]))
                     this->add(iidx[i], jidx[j], mat[i][j]);
     }
     virtual void add_block(int *iidx, int ilen, int *jidx, int jlen, cplx** mat)
     {
         for (int i = 0; i < ilen; i++)
             for (int j=0; j < jlen; j++)
-                if (iidx[i] >= 0 && jidx[j] >= 0)
+                if (iidx[i] >= 0 && jidx[j] >= 0 && (!symmetric || iidx[i] <= jidx[j]))
                     this->add(iidx[i], jidx[j], mat[i][j]);
     }
     virtual double get(int m, int n) = 0;
@@ -89,25 +113,51 @@ public:
     {
         _error("internal error: times_vector() not implemented.");
     }
+    virtual void times_vector(cplx* vec, cplx* result, int rank)
+    {
+        _error("internal error: times_vector(cplx) not implemented.");
+    }
 
 protected:
     int size;
     bool complex;
+    bool symmetric;
 };
 
 // **********************************************************************************************************
 
+/// Sparse matrix in the coordinate format, used for assembling.
+///
+/// Two storage modes are available. CooMatrixStorage_Map (the default) keeps
+/// the entries in nested std::maps, so that duplicates are summed on insertion.
+/// CooMatrixStorage_Triplets appends the raw (row, col, value) triplets to
+/// contiguous arrays and only sorts them and sums the duplicates when the
+/// matrix is read (get_nnz(), get_row_col_data(), conversions, ...), or when
+/// compress() is called explicitly. The triplet mode is much faster for
+/// assembling large matrices.
+///
+/// A symmetric matrix (set_symmetric()) stores only its upper triangle.
+/// add(m, n, v) with m > n adds v to the entry (n, m), add_block() takes
+/// only the upper triangle entries of the (symmetric) block. The CSR matrix
+/// converted from a symmetric matrix is symmetric too, the other formats
+/// (dense, CSC, ...) are expanded to the full matrix.
 class CooMatrix : public Matrix {
 public:
+    enum CooMatrixStorage
+    {
+        CooMatrixStorage_Map,
+        CooMatrixStorage_Triplets
+    };
+
     CooMatrix(bool complex = false);
-    CooMatrix(int size, bool complex = false);
+    CooMatrix(int size, bool complex = false, CooMatrixStorage storage = CooMatrixStorage_Map);
     CooMatrix(Matrix *m);
     CooMatrix(CooMatrix *m);
     CooMatrix(CSRMatrix *m);
     CooMatrix(CSCMatrix *m);
     ~CooMatrix();
 
-    inline virtual void init() { this->complex = false; free_data(); }
+    inline virtual void init() { this->complex = false; this->symmetric = false; this->storage = CooMatrixStorage_Map; free_data(); }
     virtual void free_data();
 
     virtual void set_zero()
@@ -116,8 +166,21 @@ public:
     }
 
     virtual int get_nnz();
+    // get_nnz() of matrices with more than 2^31 - 1 entries (see CSRMatrix64)
+    long long get_nnz64();
     virtual void print();
 
+    inline CooMatrixStorage get_storage() { return this->storage; }
+    // switches the storage mode, the entries are kept
+    void set_storage(CooMatrixStorage storage);
+    // preallocates the triplet arrays for nnz entries (triplet mode only)
+    void reserve(int nnz);
+    // sorts the triplets by rows and columns and sums the duplicates
+    // (triplet mode only, does nothing for the map storage)
+    void compress();
+    // stores only the upper triangle, the matrix has to be empty
+    void set_symmetric(bool symmetric);
+
     void add_from_csr(CSRMatrix *m);
     void add_from_csc(CSCMatrix *m);
 
@@ -126,16 +189,105 @@ public:
     void get_row_col_data(int *row, int *col, double *data);
     void get_row_col_data(int *row, int *col, cplx *data);
     void get_row_col_data(int *row, int *col, double *data_real, double *data_imag);
+    // writes the matrix directly into CSR (CSC) arrays, Ap must have room for
+    // get_size()+1 entries, Ai and Ax for get_nnz() entries
+    void get_csr(int *Ap, int *Ai, double *Ax);
+    void get_csr(int *Ap, int *Ai, cplx *Ax);
+    void get_csc(int *Ap, int *Ai, double *Ax);
+    void get_csc(int *Ap, int *Ai, cplx *Ax);
+    // same with 64-bit indices, Ai and Ax must have room for get_nnz64() entries
+    void get_csr(long long *Ap, long long *Ai, double *Ax);
+    void get_csr(long long *Ap, long long *Ai, cplx *Ax);
 
     virtual void copy_into(Matrix *m);
 
-    inline virtual double get(int m, int n) { return A[m][n]; }
+    virtual double get(int m, int n);
+    virtual cplx get_cplx(int m, int n);
 
     virtual void times_vector(double* vec, double* result, int rank);
+    virtual void times_vector(cplx* vec, cplx* result, int rank);
 
 protected:
+    CooMatrixStorage storage;
+
+    // map storage
     std::map<size_t, std::map<size_t, double> > A;
     std::map<size_t, std::map<size_t, cplx> > A_cplx;
+
+    // triplet storage
+    std::vector<int> t_row;
+    std::vector<int> t_col;
+    std::vector<double> t_data;
+    std::vector<cplx> t_data_cplx;
+    // true if the triplets are sorted and contain no duplicates
+    bool compressed;
+
+    int find_triplet(int m, int n);
+
+    friend class CooAssembler;
+};
+
+// **********************************************************************************************************
+
+/// Thread-parallel assembly into a CooMatrix.
+///
+/// Each OpenMP thread appends its entries (add(), add_block()) to its own
+/// triplet buffer, so no locking is needed. There is one buffer per thread
+/// of the parallel regions: pass their number if they set num_threads,
+/// the default is omp_get_max_threads(). merge() then moves all buffers
+/// into the matrix. It sorts the entries by rows and columns and sums the
+/// duplicates. The matrix is switched to the triplet storage.
+///
+/// The duplicates of each entry are summed in the order of their values,
+/// not in the order in which they were added. The assembled matrix is
+/// therefore bitwise the same for any number of threads and any schedule
+/// of the element loop.
+///
+/// CooMatrix A(size);
+/// CooAssembler assembler(&A);
+/// #pragma omp parallel for
+/// for (int e = 0; e < n_elements; e++)
+///     assembler.add_block(...);
+/// assembler.merge();
+class CooAssembler
+{
+public:
+    CooAssembler(CooMatrix *mat, int num_threads = 0);
+    ~CooAssembler();
+
+    // thread safe, the entries go to the buffer of the calling thread
+    void add(int m, int n, double v);
+    void add(int m, int n, cplx v);
+    void add_block(int *iidx, int ilen, int *jidx, int jlen, double** mat);
+    void add_block(int *iidx, int ilen, int *jidx, int jlen, cplx** mat);
+
+    // adds the buffers to the matrix and empties them, call it outside of
+    // the parallel region
+    void merge();
+
+    // number of entries in the buffers
+    long long get_buffered_nnz();
+
+private:
+    // triplets of one thread, padded so that the vectors of neighbouring
+    // threads are not on the same cache line
+    struct Buffer
+    {
+        std::vector<int> row;
+        std::vector<int> col;
+        std::vector<double> data;
+        std::vector<cplx> data_cplx;
+        int size;
+        char pad[64];
+    };
+
+    Buffer *get_buffer();
+    template<typename T>
+    void merge_buffers(std::vector<T> &t_data, std::vector<T> Buffer::*data);
+
+    CooMatrix *mat;
+    int num_buffers;
+    Buffer *buffers;
 };
 
 // **********************************************************************************************************
@@ -195,37 +347,101 @@ private:
 
 // **********************************************************************************************************
 
+/// Positions of the entries of an element block in the value array (Ax) of a
+/// CSRMatrix or CSCMatrix.
+///
+/// The first add_block() with an empty map resolves the positions (binary
+/// searches) and records them, every following add_block() with the same map
+/// just scatters the block into Ax. Keep one map per element and clear it
+/// (free_data()) when the sparsity pattern of the matrix changes.
+class ScatterMap
+{
+public:
+    ScatterMap() : ilen(0), jlen(0) {}
+
+    inline void free_data() { std::vector<int>().swap(offsets); ilen = jlen = 0; }
+    inline bool is_empty() { return offsets.empty(); }
+    inline int get_ilen() { return ilen; }
+    inline int get_jlen() { return jlen; }
+    // position of the block entry (i, j) in Ax, -1 for skipped entries
+    inline int get_offset(int i, int j) { return offsets[i*jlen + j]; }
+
+    inline int *get_offsets() { return &offsets[0]; }
+    void init(int ilen, int jlen)
+    {
+        this->ilen = ilen;
+        this->jlen = jlen;
+        offsets.resize(ilen * jlen);
+    }
+
+private:
+    int ilen;
+    int jlen;
+    std::vector<int> offsets;
+};
+
+// **********************************************************************************************************
+
+/// Sparse matrix in the compressed sparse row format.
+///
+/// Once the sparsity pattern (Ap, Ai) is set, the matrix can be reassembled
+/// in place: set_zero() clears the values and add(), add_block() add into the
+/// existing entries (located by a binary search in the sorted row), so that
+/// only Ax is touched. Adding an entry outside of the pattern is an error.
+/// The column indices within each row have to be sorted, which is the case
+/// for all matrices created by the conversions below.
+///
+/// A matrix created from existing arrays (Ap, Ai, Ax) either takes them over
+/// (owner = true, they are freed with delete[]), or is only a view of them
+/// (owner = false): the arrays are used in place, without a copy, and are
+/// never freed by the matrix. The caller has to keep them alive.
+///
+/// A symmetric matrix (converted from a symmetric CooMatrix, or marked by
+/// set_symmetric()) stores only its upper triangle, add() and add_block()
+/// work like in CooMatrix and times_vector() applies each off-diagonal
+/// entry twice. The solvers that need the full matrix expand it.
 class CSRMatrix : public Matrix
 {
 public:
     CSRMatrix(int size);
+    CSRMatrix(int size, int nnz, int *Ap, int *Ai, double *Ax, bool owner = true);
+    CSRMatrix(int size, int nnz, int *Ap, int *Ai, cplx *Ax_cplx, bool owner = true);
     CSRMatrix(Matrix *m);
     CSRMatrix(CooMatrix *m);
     CSRMatrix(CSCMatrix *m);
     CSRMatrix(DenseMatrix *m);
+    CSRMatrix(BSRMatrix *m);
+    CSRMatrix(SELLMatrix *m);
+    CSRMatrix(CSRMatrix64 *m);
     ~CSRMatrix();
 
     virtual void init();
     virtual void free_data();
 
-    virtual void set_zero()
-    {
-        _error("CSRMatrix::set_zero() not implemented.");
-    }
+    virtual void set_zero();
 
     void add_from_dense(DenseMatrix *m);
     void add_from_coo(CooMatrix *m);
     void add_from_csc(CSCMatrix *m);
+    void add_from_bsr(BSRMatrix *m);
+    void add_from_sell(SELLMatrix *m);
+    // narrows the indices to 32 bits, fails if the matrix does not fit
+    void add_from_csr64(CSRMatrix64 *m);
+    // from a typed matrix, CSRMatrixT<T> or CSCMatrixT<T> (the float values
+    // are widened to double), returns false if m is neither
+    template<typename T>
+    bool add_from_typed(Matrix *m);
 
-    virtual void add(int m, int n, double v)
-    {
-        _error("CSR matrix add() not implemented.");
-    }
+    virtual void add(int m, int n, double v);
+    virtual void add(int m, int n, cplx v);
+    virtual void add_block(int *iidx, int ilen, int *jidx, int jlen, double** mat);
+    virtual void add_block(int *iidx, int ilen, int *jidx, int jlen, cplx** mat);
+    // add_block() with a cached scatter map (see ScatterMap)
+    void add_block(int *iidx, int ilen, int *jidx, int jlen, double** mat, ScatterMap *map);
+    void add_block(int *iidx, int ilen, int *jidx, int jlen, cplx** mat, ScatterMap *map);
 
-    virtual double get(int m, int n)
-    {
-        _error("CSR matrix get() not implemented.");
-    }
+    virtual double get(int m, int n);
+    virtual cplx get_cplx(int m, int n);
 
     virtual int get_size()
     {
@@ -236,16 +452,53 @@ public:
         _error("CSR matrix copy_into() not implemented.");
     }
 
+    // result = A vec, multithreaded (see set_parallel_mode())
+    virtual void times_vector(double* vec, double* result, int rank);
+    virtual void times_vector(cplx* vec, cplx* result, int rank);
+    // y = alpha A x + beta y, y is not read if beta is zero
+    void times_vector(double *x, double *y, double alpha, double beta);
+    void times_vector(cplx *x, cplx *y, cplx alpha, cplx beta);
+
     virtual void print();
 
+    // false if the arrays belong to someone else (the matrix is a view)
+    inline bool is_owner() { return this->owner; }
+
+    // marks the arrays as the upper triangle of a symmetric matrix
+    void set_symmetric(bool symmetric);
+    // converts a symmetric matrix to the full storage
+    void expand_symmetric();
+
+    // reverse Cuthill-McKee ordering of the matrix (see rcm_ordering()),
+    // perm must have room for get_size() entries
+    void get_rcm_ordering(int *perm);
+    // replaces the matrix by P A P^T, a view gets its own arrays
+    void permute(int *perm);
+
+    // this = A B and this = alpha A + beta B of matrices of the same size
+    // (see csr_multiply_symbolic()). The result is complex if one of the
+    // operands is. With reuse_pattern the pattern of this matrix (computed
+    // by a previous call with the same patterns of A and B) is kept and only
+    // the values are computed. The symmetric storage has to be expanded
+    // first (expand_symmetric()).
+    void set_product(CSRMatrix *A, CSRMatrix *B, bool reuse_pattern = false);
+    void set_sum(double alpha, CSRMatrix *A, double beta, CSRMatrix *B, bool reuse_pattern = false);
+    void set_sum(cplx alpha, CSRMatrix *A, cplx beta, CSRMatrix *B, bool reuse_pattern = false);
+
     inline int *get_Ap() { return this->Ap; }
     inline int *get_Ai() { return this->Ai; }
     inline double *get_Ax() { return this->Ax; }
     inline cplx *get_Ax_cplx() { return this->Ax_cplx; }
 
 private:
+    // allocates the values for the pattern Ap, Ai of A op B, or keeps the
+    // current pattern (reuse_pattern), for set_product() and set_sum()
+    void init_result(CSRMatrix *A, CSRMatrix *B, bool product, bool complex, bool reuse_pattern);
+
     // number of non-zeros
     int nnz;
+    // true if Ap, Ai, Ax are freed by the matrix
+    bool owner;
 
     int *Ap;
     int *Ai;
@@ -255,6 +508,10 @@ private:
 
 // **********************************************************************************************************
 
+/// Sparse matrix in the compressed sparse column format.
+///
+/// Supports the same in-place reassembly and views of external arrays as
+/// CSRMatrix, the row indices within each column have to be sorted.
 class CSCMatrix : public Matrix
 {
 public:
@@ -263,30 +520,40 @@ public:
     CSCMatrix(DenseMatrix *m);
     CSCMatrix(CooMatrix *m);
     CSCMatrix(CSRMatrix *m);
-    CSCMatrix(int size, int nnz, int *Ap, int *Ai, double *Ax);
-    CSCMatrix(int size, int nnz, int *Ap, int *Ai, cplx *Ax_cplx);
+    CSCMatrix(BSRMatrix *m);
+    CSCMatrix(SELLMatrix *m);
+    CSCMatrix(CSRMatrix64 *m);
+    CSCMatrix(int size, int nnz, int *Ap, int *Ai, double *Ax, bool owner = true);
+    CSCMatrix(int size, int nnz, int *Ap, int *Ai, cplx *Ax_cplx, bool owner = true);
     ~CSCMatrix();
 
     virtual void init();
     virtual void free_data();
 
-    virtual void set_zero()
-    {
-        _error("CSCMatrix::set_zero() not implemented.");
-    }
+    virtual void set_zero();
 
     void add_from_dense(DenseMatrix *m);
     void add_from_coo(CooMatrix *m);
     void add_from_csr(CSRMatrix *m);
+    void add_from_bsr(BSRMatrix *m);
+    void add_from_sell(SELLMatrix *m);
+    // narrows the indices to 32 bits, fails if the matrix does not fit
+    void add_from_csr64(CSRMatrix64 *m);
+    // from a typed matrix, CSRMatrixT<T> or CSCMatrixT<T> (the float values
+    // are widened to double), returns false if m is neither
+    template<typename T>
+    bool add_from_typed(Matrix *m);
 
-    virtual void add(int m, int n, double v)
-    {
-        _error("CSC matrix add() not implemented.");
-    }
-    virtual double get(int m, int n)
-    {
-        _error("CSC matrix get() not implemented.");
-    }
+    virtual void add(int m, int n, double v);
+    virtual void add(int m, int n, cplx v);
+    virtual void add_block(int *iidx, int ilen, int *jidx, int jlen, double** mat);
+    virtual void add_block(int *iidx, int ilen, int *jidx, int jlen, cplx** mat);
+    // add_block() with a cached scatter map (see ScatterMap)
+    void add_block(int *iidx, int ilen, int *jidx, int jlen, double** mat, ScatterMap *map);
+    void add_block(int *iidx, int ilen, int *jidx, int jlen, cplx** mat, ScatterMap *map);
+
+    virtual double get(int m, int n);
+    virtual cplx get_cplx(int m, int n);
 
     virtual int get_size()
     {
@@ -299,8 +566,24 @@ public:
         _error("CSC matrix copy_into() not implemented.");
     }
 
+    // result = A vec, multithreaded (see set_parallel_mode())
+    virtual void times_vector(double* vec, double* result, int rank);
+    virtual void times_vector(cplx* vec, cplx* result, int rank);
+    // y = alpha A x + beta y, y is not read if beta is zero
+    void times_vector(double *x, double *y, double alpha, double beta);
+    void times_vector(cplx *x, cplx *y, cplx alpha, cplx beta);
+
     virtual void print();
 
+    // false if the arrays belong to someone else (the matrix is a view)
+    inline bool is_owner() { return this->owner; }
+
+    // reverse Cuthill-McKee ordering of the matrix (see rcm_ordering()),
+    // perm must have room for get_size() entries
+    void get_rcm_ordering(int *perm);
+    // replaces the matrix by P A P^T, a view gets its own arrays
+    void permute(int *perm);
+
     inline int *get_Ap() { return this->Ap; }
     inline int *get_Ai() { return this->Ai; }
     inline double *get_Ax() { return this->Ax; }
@@ -309,16 +592,411 @@ public:
 private:
     // number of non-zeros
     int nnz;
+    // true if Ap, Ai, Ax are freed by the matrix
+    bool owner;
+
+    double *Ax;
+    cplx *Ax_cplx;
+
+    int *Ap;
+    int *Ai;
+};
+
+// **********************************************************************************************************
+
+/// Sparse matrix in the block compressed sparse row format, for systems with
+/// dense bsize x bsize blocks (several fields sharing a node).
+///
+/// The matrix is stored by block rows, Ap[nb+1] points to the block columns
+/// Ai (sorted within each block row) and the blocks are stored one after
+/// another in Ax, bsize*bsize entries each, by rows. nb is size/bsize rounded
+/// up, the entries of the last block row and column beyond size are zero.
+/// times_vector() is specialized for the block sizes 2 to 8. The direct
+/// solvers expand the matrix to CSR or CSC, get_nnz() is the number of
+/// entries of this expansion.
+class BSRMatrix : public Matrix
+{
+public:
+    BSRMatrix(CooMatrix *m, int bsize);
+    BSRMatrix(CSRMatrix *m, int bsize);
+    ~BSRMatrix();
+
+    virtual void init();
+    virtual void free_data();
+
+    virtual void set_zero();
+
+    void add_from_coo(CooMatrix *m, int bsize);
+    void add_from_csr(CSRMatrix *m, int bsize);
+
+    virtual void add(int m, int n, double v);
+    virtual void add(int m, int n, cplx v);
+    virtual void add_block(int *iidx, int ilen, int *jidx, int jlen, double** mat);
+    virtual void add_block(int *iidx, int ilen, int *jidx, int jlen, cplx** mat);
+
+    virtual double get(int m, int n);
+    virtual cplx get_cplx(int m, int n);
+
+    virtual int get_size()
+    {
+        return this->size;
+    }
+    inline int get_nnz() { return this->nnz; }
+    virtual void copy_into(Matrix *m)
+    {
+        _error("BSR matrix copy_into() not implemented.");
+    }
+
+    // result = A vec, multithreaded (see set_parallel_mode())
+    virtual void times_vector(double* vec, double* result, int rank);
+    virtual void times_vector(cplx* vec, cplx* result, int rank);
+    // y = alpha A x + beta y, y is not read if beta is zero
+    void times_vector(double *x, double *y, double alpha, double beta);
+    void times_vector(cplx *x, cplx *y, cplx alpha, cplx beta);
+
+    virtual void print();
+
+    // expansion to the scalar formats, Ap must have room for size + 1
+    // entries, Ai and Ax for get_nnz() entries
+    void get_csr(int *Ap, int *Ai, double *Ax);
+    void get_csr(int *Ap, int *Ai, cplx *Ax);
+    void get_csc(int *Ap, int *Ai, double *Ax);
+    void get_csc(int *Ap, int *Ai, cplx *Ax);
+
+    inline int get_bsize() { return this->bsize; }
+    inline int get_nb() { return this->nb; }
+    inline int get_nnzb() { return this->nnzb; }
+    inline int *get_Ap() { return this->Ap; }
+    inline int *get_Ai() { return this->Ai; }
+    inline double *get_Ax() { return this->Ax; }
+    inline cplx *get_Ax_cplx() { return this->Ax_cplx; }
+
+private:
+    // block size, number of block rows and of blocks
+    int bsize;
+    int nb;
+    int nnzb;
+    // number of entries of the expansion to CSR
+    int nnz;
+
+    int *Ap;
+    int *Ai;
+    double *Ax;
+    cplx *Ax_cplx;
+};
+
+// **********************************************************************************************************
+
+/// Sparse matrix in the sliced ELLPACK format SELL-C-sigma, for matrix-vector
+/// products that vectorize well even if the row lengths vary a lot.
+///
+/// The rows are sorted by decreasing length within windows of sigma rows and
+/// the sorted rows are grouped into chunks of C rows. Each chunk is padded to
+/// its longest row and stored by columns, so that times_vector() processes
+/// the C rows of a chunk at once with contiguous loads of the values. C should
+/// be a multiple of the SIMD width (4 or 8 doubles, the kernels are
+/// specialized for C = 4, 8, 16) and sigma a multiple of C. A larger sigma
+/// means less padding, but the access to the vector is less local (sigma = 1
+/// keeps the original order). The matrix is built from a CSRMatrix, the
+/// columns within each row have to be sorted, and the entries can be changed
+/// only within the pattern.
+class SELLMatrix : public Matrix
+{
+public:
+    SELLMatrix(CSRMatrix *m, int chunk = 8, int sigma = 256);
+    SELLMatrix(CooMatrix *m, int chunk = 8, int sigma = 256);
+    ~SELLMatrix();
+
+    virtual void init();
+    virtual void free_data();
+
+    virtual void set_zero();
+
+    void add_from_csr(CSRMatrix *m, int chunk, int sigma);
+
+    virtual void add(int m, int n, double v);
+    virtual void add(int m, int n, cplx v);
+
+    virtual double get(int m, int n);
+    virtual cplx get_cplx(int m, int n);
+
+    virtual int get_size()
+    {
+        return this->size;
+    }
+    // number of entries without the padding
+    inline int get_nnz() { return this->nnz; }
+    // number of stored entries including the padding
+    inline int get_padded_nnz() { return this->cs[this->nchunks]; }
+    virtual void copy_into(Matrix *m)
+    {
+        _error("SELL matrix copy_into() not implemented.");
+    }
+
+    // result = A vec, multithreaded (see set_parallel_mode())
+    virtual void times_vector(double* vec, double* result, int rank);
+    virtual void times_vector(cplx* vec, cplx* result, int rank);
+    // y = alpha A x + beta y, y is not read if beta is zero
+    void times_vector(double *x, double *y, double alpha, double beta);
+    void times_vector(cplx *x, cplx *y, cplx alpha, cplx beta);
+
+    virtual void print();
+
+    // conversion to the scalar formats, Ap must have room for size + 1
+    // entries, Ai and Ax for get_nnz() entries
+    void get_csr(int *Ap, int *Ai, double *Ax);
+    void get_csr(int *Ap, int *Ai, cplx *Ax);
+    void get_csc(int *Ap, int *Ai, double *Ax);
+    void get_csc(int *Ap, int *Ai, cplx *Ax);
+
+    inline int get_chunk() { return this->chunk; }
+    inline int get_sigma() { return this->sigma; }
+
+private:
+    // position of the entry (m, n) in col and val, -1 if it is not there
+    int find_entry(int m, int n);
+
+    int chunk;
+    int sigma;
+    int nchunks;
+    // number of entries without the padding
+    int nnz;
+
+    // start of the chunks in col and val (nchunks + 1)
+    int *cs;
+    // lengths of the sorted rows
+    int *rl;
+    // original index of the sorted rows and its inverse
+    int *perm;
+    int *iperm;
+    // column indices and values, padded with zeros
+    int *col;
+    double *val;
+    cplx *val_cplx;
+};
+
+// **********************************************************************************************************
+
+/// Sparse matrix in the compressed sparse row format with 64-bit row pointers
+/// and column indices, for the matrices with more than 2^31 - 1 entries.
+///
+/// CSRMatrix keeps 32-bit indices, which take less memory and cache, this
+/// one is only needed for the largest problems. It is built from a CooMatrix
+/// (use the map storage, the triplets are limited to 32-bit indices) and
+/// supports the in-place reassembly and the symmetric storage of CSRMatrix.
+/// The iterative solvers use it as it is, the solvers that take 32-bit
+/// indices only (UMFPACK, SuperLU, SparseLib) narrow it to CSRMatrix or
+/// CSCMatrix, which fails if the matrix does not fit (see fits_int()).
+class CSRMatrix64 : public Matrix
+{
+public:
+    CSRMatrix64(int size);
+    CSRMatrix64(Matrix *m);
+    CSRMatrix64(CooMatrix *m);
+    CSRMatrix64(CSRMatrix *m);
+    ~CSRMatrix64();
+
+    virtual void init();
+    virtual void free_data();
+
+    virtual void set_zero();
+
+    void add_from_coo(CooMatrix *m);
+    void add_from_csr(CSRMatrix *m);
+
+    virtual void add(int m, int n, double v);
+    virtual void add(int m, int n, cplx v);
+
+    virtual double get(int m, int n);
+    virtual cplx get_cplx(int m, int n);
+
+    inline long long get_nnz() { return this->nnz; }
+    // true if the matrix can be narrowed to 32-bit indices
+    inline bool fits_int() { return this->nnz <= INT_MAX; }
+    virtual void copy_into(Matrix *m)
+    {
+        _error("CSR64 matrix copy_into() not implemented.");
+    }
+
+    // result = A vec, multithreaded (see set_parallel_mode())
+    virtual void times_vector(double* vec, double* result, int rank);
+    virtual void times_vector(cplx* vec, cplx* result, int rank);
+    // y = alpha A x + beta y, y is not read if beta is zero
+    void times_vector(double *x, double *y, double alpha, double beta);
+    void times_vector(cplx *x, cplx *y, cplx alpha, cplx beta);
+
+    virtual void print();
+
+    inline long long *get_Ap() { return this->Ap; }
+    inline long long *get_Ai() { return this->Ai; }
+    inline double *get_Ax() { return this->Ax; }
+    inline cplx *get_Ax_cplx() { return this->Ax_cplx; }
+
+private:
+    // number of non-zeros
+    long long nnz;
 
+    long long *Ap;
+    long long *Ai;
     double *Ax;
     cplx *Ax_cplx;
+};
+
+// **********************************************************************************************************
+
+/// Scalar types of the typed matrices (CSRMatrixT, CSCMatrixT): the type of
+/// the vectors they are multiplied with and the conversion of the assembled
+/// values. The float matrices work on double vectors, only their entries
+/// are rounded.
+template<typename T>
+struct MatrixScalar;
+
+template<>
+struct MatrixScalar<double>
+{
+    typedef double vector_type;
+    static const bool complex = false;
+    static inline double from_cplx(cplx v)
+    {
+        _error("Matrix: complex value added to a real matrix.");
+        return 0.0;
+    }
+};
+
+template<>
+struct MatrixScalar<float>
+{
+    typedef double vector_type;
+    static const bool complex = false;
+    static inline float from_cplx(cplx v)
+    {
+        _error("Matrix: complex value added to a real matrix.");
+        return 0.0f;
+    }
+};
+
+template<>
+struct MatrixScalar<cplx>
+{
+    typedef cplx vector_type;
+    static const bool complex = true;
+    static inline cplx from_cplx(cplx v) { return v; }
+};
+
+/// Sparse matrix in the compressed sparse row format with the scalar type
+/// fixed at compile time (T = double, cplx or float).
+///
+/// CSRMatrix chooses between its double and cplx arrays at runtime, which
+/// is what the assembly in Hermes needs. The typed matrix keeps a single
+/// array of values and no complex branches, it is converted from any other
+/// format (a symmetric one is expanded), add() and set_zero() reassemble it
+/// in place. A real matrix converted to CSRMatrixCplx is promoted, a complex
+/// one cannot be converted to a real type. CSRMatrix and CSCMatrix convert
+/// the typed matrices back (see CSRMatrix::add_from_typed()).
+///
+/// The specialization stops at these classes: Matrix, CooMatrix, DenseMatrix,
+/// CSRMatrix, CSCMatrix and the other formats still carry both the double
+/// and the cplx storage and branch on is_complex() at runtime.
+template<typename T>
+class CSRMatrixT : public Matrix
+{
+public:
+    typedef typename MatrixScalar<T>::vector_type V;
+
+    CSRMatrixT(Matrix *m);
+    ~CSRMatrixT();
+
+    virtual void init();
+    virtual void free_data();
+
+    virtual void set_zero();
+
+    void add_from_csr(CSRMatrix *m);
+
+    virtual void add(int m, int n, double v);
+    virtual void add(int m, int n, cplx v);
+    virtual double get(int m, int n);
+    virtual cplx get_cplx(int m, int n);
+
+    inline int get_nnz() { return this->nnz; }
+    virtual void copy_into(Matrix *m)
+    {
+        _error("CSR matrix copy_into() not implemented.");
+    }
+
+    // result = A vec, multithreaded (see set_parallel_mode())
+    virtual void times_vector(V* vec, V* result, int rank);
+    // y = alpha A x + beta y, y is not read if beta is zero
+    void times_vector(V *x, V *y, V alpha, V beta);
+
+    virtual void print();
+
+    inline int *get_Ap() { return this->Ap; }
+    inline int *get_Ai() { return this->Ai; }
+    inline T *get_Ax() { return this->Ax; }
+
+private:
+    // number of non-zeros
+    int nnz;
+
+    int *Ap;
+    int *Ai;
+    T *Ax;
+};
+
+/// Sparse matrix in the compressed sparse column format with the scalar
+/// type fixed at compile time, see CSRMatrixT.
+template<typename T>
+class CSCMatrixT : public Matrix
+{
+public:
+    typedef typename MatrixScalar<T>::vector_type V;
+
+    CSCMatrixT(Matrix *m);
+    ~CSCMatrixT();
+
+    virtual void init();
+    virtual void free_data();
+
+    virtual void set_zero();
+
+    void add_from_csc(CSCMatrix *m);
+
+    virtual void add(int m, int n, double v);
+    virtual void add(int m, int n, cplx v);
+    virtual double get(int m, int n);
+    virtual cplx get_cplx(int m, int n);
+
+    inline int get_nnz() { return this->nnz; }
+    virtual void copy_into(Matrix *m)
+    {
+        _error("CSC matrix copy_into() not implemented.");
+    }
+
+    // result = A vec, multithreaded (see set_parallel_mode())
+    virtual void times_vector(V* vec, V* result, int rank);
+    // y = alpha A x + beta y, y is not read if beta is zero
+    void times_vector(V *x, V *y, V alpha, V beta);
+
+    virtual void print();
+
+    inline int *get_Ap() { return this->Ap; }
+    inline int *get_Ai() { return this->Ai; }
+    inline T *get_Ax() { return this->Ax; }
+
+private:
+    // number of non-zeros
+    int nnz;
 
     int *Ap;
     int *Ai;
+    T *Ax;
 };
 
 // print vector - int
 void print_vector(const char *label, int *value, int size);
+// print vector - long long
+void print_vector(const char *label, long long *value, int size);
 // print vector - double
 void print_vector(const char *label, double *value, int size);
 // print vector - cplx
@@ -326,18 +1004,142 @@ void print_vector(const char *label, cplx *value, int size);
 
 template<typename T>
 void dense_to_coo(int size, int nnz, T **Ad, int *row, int *col, T *A);
+// The CSR and CSC conversions and products below are instantiated for the
+// 32-bit (int) and 64-bit (long long) index type I of nnz and the index
+// arrays, the number of rows stays int (see CSRMatrix64).
+template<typename T, typename I>
+void coo_to_csr(int size, I nnz, I *row, I *col, T *A, I *Ap, I *Ai, T *Ax);
+template<typename T, typename I>
+void coo_to_csc(int size, I nnz, I *row, I *col, T *A, I *Ap, I *Ai, T *Ax);
+template<typename T, typename I>
+void csr_to_csc(int size, I nnz, I *Arp, I *Ari, T *Arx, I *Acp, I *Aci, T *Acx);
+template<typename T, typename I>
+void csc_to_csr(int size, I nnz, I *Acp, I *Aci, T *Acx, I *Arp, I *Ari, T *Arx);
+template<typename T, typename I>
+void csc_to_coo(int size, I nnz, I *Ap, I *Ai, T *Ax, I *row, I *col, T *A);
+template<typename T, typename I>
+void csr_to_coo(int size, I nnz, I *Ap, I *Ai, T *Ax, I *row, I *col, T *A);
+/// Sums the duplicate entries of the CSR matrix (Ap, Ai, Ax), whose rows must
+/// be sorted by columns, into the CSR matrix (Bp, Bi, Bx). Bi and Bx must have
+/// room for Ap[size] entries. Returns the number of entries of B.
+template<typename T, typename I>
+I csr_sum_duplicates(int size, I *Ap, I *Ai, T *Ax, I *Bp, I *Bi, T *Bx);
+/// Expands the upper triangle (Ap, Ai, Ax) of a symmetric matrix, whose rows
+/// must be sorted by columns, to the full CSR matrix (Bp, Bi, Bx), which is
+/// also its CSC matrix. Bi and Bx must have room for
+/// csr_symmetric_expanded_nnz() entries, which is returned.
+template<typename T, typename I>
+I csr_symmetric_expand(int size, I *Ap, I *Ai, T *Ax, I *Bp, I *Bi, T *Bx);
+template<typename I>
+I csr_symmetric_expanded_nnz(int size, I *Ap, I *Ai);
+/// Sparse matrix-vector products y = alpha A x + beta y of the CSR (CSC)
+/// matrix (Ap, Ai, Ax). y is not read if beta is zero. The CSR product is
+/// split by rows with the same number of entries, the CSC product by columns,
+/// each thread summing into its own copy of y.
+template<typename T, typename I>
+void csr_times_vector(int size, I *Ap, I *Ai, T *Ax, T *x, T *y, T alpha = 1.0, T beta = 0.0);
+template<typename T, typename I>
+void csc_times_vector(int size, I *Ap, I *Ai, T *Ax, T *x, T *y, T alpha = 1.0, T beta = 0.0);
+/// Mixed precision products with float values, the vectors and the sums are
+/// double (see CSRMatrixFloat).
+void csr_times_vector(int size, int *Ap, int *Ai, float *Ax, double *x, double *y, double alpha = 1.0, double beta = 0.0);
+void csc_times_vector(int size, int *Ap, int *Ai, float *Ax, double *x, double *y, double alpha = 1.0, double beta = 0.0);
+/// Same for the upper triangle (Ap, Ai, Ax) of a symmetric matrix, each
+/// entry is read once and applied twice. The threads sum into their own
+/// copies of y like in csc_times_vector.
+template<typename T, typename I>
+void csr_symmetric_times_vector(int size, I *Ap, I *Ai, T *Ax, T *x, T *y, T alpha = 1.0, T beta = 0.0);
+/// Same for the BSR matrix (Ap, Ai, Ax) with bsize x bsize blocks, x and y
+/// have size entries.
+template<typename T>
+void bsr_times_vector(int size, int bsize, int *Ap, int *Ai, T *Ax, T *x, T *y, T alpha = 1.0, T beta = 0.0);
+/// Same for the SELL-C-sigma matrix with chunks of the given height (see
+/// SELLMatrix).
 template<typename T>
-void coo_to_csr(int size, int nnz, int *row, int *col, T *A, int *Ap, int *Ai, T *Ax);
+void sell_times_vector(int size, int chunk, int *cs, int *perm, int *col, T *val, T *x, T *y, T alpha = 1.0, T beta = 0.0);
+
+// Reorderings. A permutation perm maps the new indices to the old ones: the
+// row (and column) i of the permuted matrix P A P^T is the row perm[i] of A.
+
+/// Reverse Cuthill-McKee ordering of the graph of A + A^T (the pattern Ap,
+/// Ai of a CSR or CSC matrix, a symmetric upper triangle works as well).
+/// Each connected component is numbered by a breadth-first search from a
+/// pseudo-peripheral node (George-Liu), the neighbours in the order of
+/// increasing degree, and the whole numbering is reversed. This reduces the
+/// bandwidth, so that the products reuse the cached entries of x and the
+/// ILU factors have less fill outside of the pattern.
+void rcm_ordering(int size, int *Ap, int *Ai, int *perm);
+/// Approximate minimum degree ordering (Amestoy, Davis, Duff) of the graph
+/// of A + A^T, given like in rcm_ordering(): the node with the smallest
+/// bound of the external degree is eliminated first. The eliminated nodes
+/// become the elements of the quotient graph, which absorb each other, so
+/// that the memory stays within the pattern of A and the elements. There is
+/// no detection of the supervariables, so that it is slower than AMD on
+/// matrices with several unknowns per node. Reduces the fill of the LU and
+/// Cholesky factors of P A P^T.
+void amd_ordering(int size, int *Ap, int *Ai, int *perm);
+/// Column ordering for LU with partial pivoting (as COLAMD): the approximate
+/// minimum degree ordering of the graph of A^T A, which is not formed, the
+/// rows of the CSC matrix (Ap, Ai) are the initial elements of the quotient
+/// graph. Rows with more than 10 sqrt(size) entries are ignored. The column
+/// k of A Q is the column perm[k] of A.
+void column_amd_ordering(int size, int *Ap, int *Ai, int *perm);
+/// Pseudo-peripheral node of the connected component of the node start
+/// (George-Liu), the graph is given by the symmetric adjacency Gp, Gi.
+int pseudo_peripheral_node(int size, int *Gp, int *Gi, int start);
+/// Writes P A P^T of the CSR matrix (Ap, Ai, Ax) into Bp, Bi, Bx with
+/// sorted columns, Bi and Bx must have room for nnz entries. With upper set
+/// the entries that move below the diagonal are folded into the upper
+/// triangle (symmetric storage). The same call permutes a CSC matrix.
 template<typename T>
-void coo_to_csc(int size, int nnz, int *row, int *col, T *A, int *Ap, int *Ai, T *Ax);
+void csr_permute(int size, int nnz, int *Ap, int *Ai, T *Ax, int *perm, int *Bp, int *Bi, T *Bx, bool upper = false);
+// y = P x, i.e. y[i] = x[perm[i]]
 template<typename T>
-void csr_to_csc(int size, int nnz, int *Arp, int *Ari, T *Arx, int *Acp, int *Aci, T *Acx);
+void permute_vector(int size, int *perm, T *x, T *y);
+// y = P^T x, i.e. y[perm[i]] = x[i]
 template<typename T>
-void csc_to_csr(int size, int nnz, int *Acp, int *Aci, T *Acx, int *Arp, int *Ari, T *Arx);
+void unpermute_vector(int size, int *perm, T *x, T *y);
+// the largest |i - j| of the entries of a CSR or CSC matrix
+int csr_bandwidth(int size, int *Ap, int *Ai);
+
+// Sparse products and sums of CSR matrices with sorted columns, the result
+// has sorted columns too. The symbolic phase computes the pattern of the
+// result (allocates Cp[m+1] and Ci, returns nnz), the numeric phase the
+// values on that pattern (Cx has room for nnz entries), so that the
+// symbolic phase is only repeated when the patterns of the operands change.
+// The rows are processed in parallel (see set_parallel_mode()).
+
+/// Pattern of C = A B (Gustavson's algorithm), A has m rows and B has n
+/// columns, so that the matrices may be rectangular (e.g. for P^T A P with
+/// the CSR arrays of P and P^T).
+int csr_multiply_symbolic(int m, int n, int *Ap, int *Ai, int *Bp, int *Bi, int *&Cp, int *&Ci);
 template<typename T>
-void csc_to_coo(int size, int nnz, int *Ap, int *Ai, T *Ax, int *row, int *col, T *A);
+void csr_multiply_numeric(int m, int n, int *Ap, int *Ai, T *Ax, int *Bp, int *Bi, T *Bx, int *Cp, int *Ci, T *Cx);
+/// Pattern of C = alpha A + beta B, both with m rows, the union of the
+/// patterns of A and B (no cancellation).
+int csr_add_symbolic(int m, int *Ap, int *Ai, int *Bp, int *Bi, int *&Cp, int *&Ci);
 template<typename T>
-void csr_to_coo(int size, int nnz, int *Ap, int *Ai, T *Ax, int *row, int *col, T *A);
+void csr_add_numeric(int m, T alpha, int *Ap, int *Ai, T *Ax, T beta, int *Bp, int *Bi, T *Bx, int *Cp, int *Ci, T *Cx);
+
+// The conversions (coo_to_csr, coo_to_csc, csr_to_csc, csc_to_csr,
+// csr_sum_duplicates) and the matrix-vector products (csr_times_vector,
+// csc_times_vector, csr_symmetric_times_vector, bsr_times_vector,
+// sell_times_vector) of large matrices run in parallel if hermes_common is
+// compiled with OpenMP (COMMON_WITH_OPENMP) and the parallel mode is
+// selected. Both modes give exactly the same results, except for the
+// rounding of csc_times_vector and csr_symmetric_times_vector, which
+// depends on the number of threads.
+enum ParallelMode
+{
+    ParallelMode_Serial,
+    ParallelMode_Parallel
+};
+void set_parallel_mode(ParallelMode mode);
+ParallelMode get_parallel_mode();
+// number of threads in the parallel mode, 0 (default) means all available
+void set_num_threads(int num_threads);
+// number of threads that will be used, 1 in the serial mode
+int get_num_threads();
 
 // matrix vector multiplication
 void mat_dot(Matrix *A, double *x, double *result, int n_dof);
@@ -347,4 +1149,51 @@ double vec_dot(double *r, double *s, int n_dof);
 void ludcmp(double** a, int n, int* indx, double* d);
 void lubksb(double** a, int n, int* indx, double* b);
 
+/// LU factorization with partial pivoting P A = L U of a dense matrix, T is
+/// double or cplx.
+///
+/// The matrix is copied into contiguous column-major storage with aligned
+/// columns and factorized by a blocked right-looking algorithm (the trailing
+/// submatrix is updated by panels of 64 columns, see DENSE_LU_BLOCK in
+/// matrix.cpp, which keeps the panel in cache and lets the compiler
+/// vectorize the column updates). The factors are kept, so that any number
+/// of right-hand sides can be solved by one factorization, and the storage
+/// is reused by the next factorize() of a matrix of the same size.
+template<typename T>
+class DenseLU
+{
+public:
+    DenseLU();
+    ~DenseLU();
+
+    void free_data();
+
+    /// Factorizes the matrix a[n][n] (a[i] is the i-th row, as returned by
+    /// _new_matrix() or DenseMatrix::get_A()), a is not modified.
+    void factorize(T **a, int n);
+    /// Factorizes the matrix stored by columns, a[i + j*lda] is the entry (i, j).
+    void factorize_columns(T *a, int n, int lda);
+
+    /// Solves A X = B in place, the nrhs right-hand sides are stored by
+    /// columns in B, B[i + k*ldb] is the i-th entry of the k-th one (ldb = 0
+    /// means ldb = n).
+    void solve(T *B, int nrhs = 1, int ldb = 0);
+
+    inline int get_size() { return this->n; }
+    inline bool is_factorized() { return this->lu != NULL; }
+
+private:
+    void factorize_data();
+
+    int n;
+    int ld;        // leading dimension of lu, multiple of the alignment
+    T *lu;         // L (unit diagonal not stored) and U by columns
+    char *lu_mem;  // unaligned allocation behind lu
+    int *ipiv;     // row i was interchanged with row ipiv[i]
+
+    // no copies
+    DenseLU(const DenseLU &);
+    DenseLU &operator=(const DenseLU &);
+};
+
 #endif
@@ -0,0 +1,441 @@
+// Copyright (c) 2009 hp-FEM group at the University of Nevada, Reno (UNR).
+// Distributed under the terms of the BSD license (see the LICENSE
+// file for the exact terms).
+// Email: hermes1d@googlegroups.com, home page: http://hpfem.org/
+
+#include <stdio.h>
+#include <time.h>
+#include <string>
+
+#include "matrix_analysis.h"
+#include "common_time_period.h"
+
+// position of the entry (i, j) among the sorted columns Ai[Ap[i]..Ap[i+1]),
+// -1 if there is none
+static int find_column(int *Ap, int *Ai, int i, int j)
+{
+    int *begin = Ai + Ap[i];
+    int *end = Ai + Ap[i+1];
+    int *p = std::lower_bound(begin, end, j);
+    if (p != end && *p == j)
+        return p - Ai;
+    return -1;
+}
+
+struct RowLengthDescending
+{
+    bool operator()(int a, int b) const { return a > b; }
+};
+
+template<typename T>
+static void analyze_csr(int size, int *Ap, int *Ai, T *Ax, MatrixStructure *s)
+{
+    s->row_nnz_min = (size > 0) ? INT_MAX : 0;
+    s->row_nnz_max = 0;
+    s->row_nnz_hist.clear();
+    s->profile = 0;
+    for (int i = 0; i < size; i++)
+    {
+        int len = Ap[i+1] - Ap[i];
+        s->row_nnz_min = std::min(s->row_nnz_min, len);
+        s->row_nnz_max = std::max(s->row_nnz_max, len);
+        unsigned int k = 0;
+        while ((1 << k) < len)
+            k++;
+        if (s->row_nnz_hist.size() <= k)
+            s->row_nnz_hist.resize(k + 1, 0);
+        s->row_nnz_hist[k]++;
+        if (len > 0 && Ai[Ap[i]] < i)
+            s->profile += i - Ai[Ap[i]];
+    }
+    s->row_nnz_mean = (size > 0) ? (double) s->nnz / size : 0.0;
+    s->bandwidth = csr_bandwidth(size, Ap, Ai);
+
+    // symmetry and diagonal dominance
+    long long offdiag = 0, matched = 0;
+    int diag = 0, upper = 0, lower_unmatched = 0;
+    s->numerically_symmetric = true;
+    s->dominant_rows = 0;
+    for (int i = 0; i < size; i++)
+    {
+        double d = -1.0;
+        double sum = 0.0;
+        for (int p = Ap[i]; p < Ap[i+1]; p++)
+        {
+            int j = Ai[p];
+            if (j == i)
+            {
+                d = std::abs(Ax[p]);
+                diag++;
+                continue;
+            }
+            sum += std::abs(Ax[p]);
+            offdiag++;
+            if (j > i)
+                upper++;
+            int q = find_column(Ap, Ai, j, i);
+            if (q >= 0)
+            {
+                matched++;
+                if (Ax[q] != Ax[p])
+                    s->numerically_symmetric = false;
+            }
+            else
+            {
+                s->numerically_symmetric = false;
+                if (j < i)
+                    lower_unmatched++;
+            }
+        }
+        if (d >= sum)
+            s->dominant_rows++;
+    }
+    s->structural_symmetry = (offdiag > 0) ? (double) matched / offdiag : 1.0;
+    s->diagonally_dominant = (s->dominant_rows == size);
+    s->missing_diagonal = size - diag;
+    // upper triangle of the pattern of A + A^T
+    int nnz_symmetric = diag + upper + lower_unmatched;
+
+    // blocks of the BSR formats, mark[jb] is the last block row that has an
+    // entry in the block column jb
+    for (int b = 2; b <= 4; b++)
+    {
+        int nb = (size + b - 1) / b;
+        int *mark = new int[nb];
+        std::fill(mark, mark + nb, -1);
+        int nnzb = 0;
+        for (int ib = 0; ib < nb; ib++)
+            for (int i = ib * b; i < std::min((ib+1) * b, size); i++)
+                for (int p = Ap[i]; p < Ap[i+1]; p++)
+                    if (mark[Ai[p] / b] != ib)
+                    {
+                        mark[Ai[p] / b] = ib;
+                        nnzb++;
+                    }
+        delete[] mark;
+        s->bsr_nnzb[b-2] = nnzb;
+    }
+
+    // SELL-8-256 padding (see csr_to_sell())
+    const int chunk = 8, sigma = 256;
+    int *len = new int[size];
+    for (int i = 0; i < size; i++)
+        len[i] = Ap[i+1] - Ap[i];
+    for (int w = 0; w < size; w += sigma)
+        std::sort(len + w, len + std::min(w + sigma, size), RowLengthDescending());
+    s->sell_padded_nnz = 0;
+    for (int c = 0; c < size; c += chunk)
+        s->sell_padded_nnz += (long long) len[c] * chunk;
+    delete[] len;
+
+    // memory with 4-byte indices
+    long long n = size, nnz = s->nnz;
+    long long value = sizeof(T);
+    s->bytes_coo = nnz * (8 + value);
+    s->bytes_csr = (n + 1) * 4 + nnz * (4 + value);
+    s->bytes_csc = s->bytes_csr;
+    s->bytes_csr_symmetric = (n + 1) * 4 + nnz_symmetric * (4 + value);
+    // there is no complex float matrix
+    s->bytes_csr_float = s->complex ? -1 : (n + 1) * 4 + nnz * (4 + 4);
+    s->bytes_dense = n * n * value;
+    for (int b = 2; b <= 4; b++)
+        s->bytes_bsr[b-2] = (long long) ((size + b - 1) / b + 1) * 4 + s->bsr_nnzb[b-2] * (4 + b * b * value);
+    // cs, rl, perm, iperm and the padded col and val
+    s->bytes_sell = ((n + chunk - 1) / chunk + 1) * 4 + 3 * n * 4 + s->sell_padded_nnz * (4 + value);
+}
+
+MatrixStructure analyze_matrix(CSRMatrix *A)
+{
+    if (A->is_symmetric())
+    {
+        // the expanded CSC arrays are also the CSR arrays of the full matrix
+        CSCMatrix full(A);
+        if (full.is_complex())
+        {
+            CSRMatrix view(full.get_size(), full.get_nnz(), full.get_Ap(), full.get_Ai(), full.get_Ax_cplx(), false);
+            return analyze_matrix(&view);
+        }
+        CSRMatrix view(full.get_size(), full.get_nnz(), full.get_Ap(), full.get_Ai(), full.get_Ax(), false);
+        return analyze_matrix(&view);
+    }
+
+    MatrixStructure s;
+    s.size = A->get_size();
+    s.nnz = A->get_nnz();
+    s.complex = A->is_complex();
+    if (s.complex)
+        analyze_csr(s.size, A->get_Ap(), A->get_Ai(), A->get_Ax_cplx(), &s);
+    else
+        analyze_csr(s.size, A->get_Ap(), A->get_Ai(), A->get_Ax(), &s);
+    return s;
+}
+
+void print_matrix_structure(MatrixStructure *s)
+{
+    printf("size: %d, nnz: %d, %s\n", s->size, s->nnz, s->complex ? "complex" : "real");
+    printf("nnz per row: min %d, max %d, mean %.2f\n", s->row_nnz_min, s->row_nnz_max, s->row_nnz_mean);
+    for (unsigned int k = 0; k < s->row_nnz_hist.size(); k++)
+        if (s->row_nnz_hist[k] > 0)
+            printf("  <= %8d: %d rows\n", 1 << k, s->row_nnz_hist[k]);
+    printf("bandwidth: %d, profile: %lld\n", s->bandwidth, s->profile);
+    printf("structural symmetry: %.3f, numerically symmetric: %s\n", s->structural_symmetry,
+           s->numerically_symmetric ? "yes" : "no");
+    printf("diagonally dominant rows: %d of %d, missing diagonal entries: %d\n", s->dominant_rows, s->size,
+           s->missing_diagonal);
+    printf("memory (bytes):\n");
+    printf("  coo           %lld\n", s->bytes_coo);
+    printf("  csr           %lld\n", s->bytes_csr);
+    printf("  csr symmetric %lld\n", s->bytes_csr_symmetric);
+    if (s->bytes_csr_float >= 0)
+        printf("  csr float     %lld\n", s->bytes_csr_float);
+    printf("  csc           %lld\n", s->bytes_csc);
+    printf("  dense         %lld\n", s->bytes_dense);
+    for (int b = 2; b <= 4; b++)
+        printf("  bsr %d         %lld (fill %.2f)\n", b, s->bytes_bsr[b-2],
+               s->nnz > 0 ? (double) s->bsr_nnzb[b-2] * b * b / s->nnz : 1.0);
+    printf("  sell 8 256    %lld (fill %.2f)\n", s->bytes_sell,
+           s->nnz > 0 ? (double) s->sell_padded_nnz / s->nnz : 1.0);
+}
+
+// copy of the full CSR matrix (Ap, Ai, Ax), only the upper triangle if
+// upper is set
+template<typename T>
+static CSRMatrix *csr_copy(int size, int *Ap, int *Ai, T *Ax, bool upper)
+{
+    int *Bp = new int[size + 1];
+    Bp[0] = 0;
+    for (int i = 0; i < size; i++)
+    {
+        int count = 0;
+        for (int p = Ap[i]; p < Ap[i+1]; p++)
+            if (!upper || Ai[p] >= i)
+                count++;
+        Bp[i+1] = Bp[i] + count;
+    }
+    int nnz = Bp[size];
+    int *Bi = new int[nnz];
+    T *Bx = new T[nnz];
+    for (int i = 0, q = 0; i < size; i++)
+        for (int p = Ap[i]; p < Ap[i+1]; p++)
+            if (!upper || Ai[p] >= i)
+            {
+                Bi[q] = Ai[p];
+                Bx[q] = Ax[p];
+                q++;
+            }
+    CSRMatrix *B = new CSRMatrix(size, nnz, Bp, Bi, Bx, true);
+    B->set_symmetric(upper);
+    return B;
+}
+
+Matrix *create_matrix(FormatAdvice *advice, CSRMatrix *A)
+{
+    if (A->is_symmetric() && (advice->format == MatrixFormat_CSR || advice->format == MatrixFormat_CSRSymmetric))
+    {
+        CSCMatrix full(A);
+        if (full.is_complex())
+        {
+            CSRMatrix view(full.get_size(), full.get_nnz(), full.get_Ap(), full.get_Ai(), full.get_Ax_cplx(), false);
+            return create_matrix(advice, &view);
+        }
+        CSRMatrix view(full.get_size(), full.get_nnz(), full.get_Ap(), full.get_Ai(), full.get_Ax(), false);
+        return create_matrix(advice, &view);
+    }
+
+    switch (advice->format)
+    {
+    case MatrixFormat_CSR:
+    case MatrixFormat_CSRSymmetric:
+    {
+        bool upper = (advice->format == MatrixFormat_CSRSymmetric);
+        if (A->is_complex())
+            return csr_copy(A->get_size(), A->get_Ap(), A->get_Ai(), A->get_Ax_cplx(), upper);
+        return csr_copy(A->get_size(), A->get_Ap(), A->get_Ai(), A->get_Ax(), upper);
+    }
+    case MatrixFormat_CSC:
+        return new CSCMatrix(A);
+    case MatrixFormat_BSR:
+        return new BSRMatrix(A, advice->bsize);
+    case MatrixFormat_SELL:
+        return new SELLMatrix(A, advice->chunk, advice->sigma);
+    }
+    _error("Matrix format not supported.");
+    return NULL;
+}
+
+// seconds per product y = A x, the products are repeated for at least
+// min_time seconds
+template<typename T>
+static double time_product(Matrix *A, double min_time)
+{
+    int size = A->get_size();
+    T *x = new T[size];
+    T *y = new T[size];
+    for (int i = 0; i < size; i++)
+        x[i] = 1.0 + (i % 7) * 0.125;
+
+    // the first product brings the matrix into the caches
+    A->times_vector(x, y, size);
+
+    TimePeriod timer;
+    int reps = 0;
+    do
+    {
+        A->times_vector(x, y, size);
+        reps++;
+        timer.tick();
+    } while (timer.accumulated() < min_time);
+
+    delete[] x;
+    delete[] y;
+    return timer.accumulated() / reps;
+}
+
+static double time_format(FormatAdvice *advice, CSRMatrix *A, double min_time)
+{
+    Matrix *B = create_matrix(advice, A);
+    double t = A->is_complex() ? time_product<cplx>(B, min_time) : time_product<double>(B, min_time);
+    delete B;
+    return t;
+}
+
+// makes the candidate the advice if it is faster than the advice so far
+static void select_format(FormatAdvice *advice, FormatAdvice *candidate, double time, double *best)
+{
+    if (*best < 0 || time < *best)
+    {
+        advice->format = candidate->format;
+        advice->bsize = candidate->bsize;
+        advice->chunk = candidate->chunk;
+        advice->sigma = candidate->sigma;
+        *best = time;
+    }
+}
+
+FormatAdvice advise_format(CSRMatrix *A, double min_time, double max_fill)
+{
+    MatrixStructure s = analyze_matrix(A);
+
+    FormatAdvice advice;
+    advice.format = MatrixFormat_CSR;
+    advice.bsize = 1;
+    advice.chunk = 8;
+    advice.sigma = 256;
+    advice.threads = get_num_threads();
+    advice.time_csr = advice.time_csr_symmetric = advice.time_csc = advice.time_sell = -1;
+    for (int b = 0; b < 3; b++)
+        advice.time_bsr[b] = -1;
+
+    double best = -1;
+    FormatAdvice candidate = advice;
+
+    candidate.format = MatrixFormat_CSR;
+    advice.time_csr = time_format(&candidate, A, min_time);
+    select_format(&advice, &candidate, advice.time_csr, &best);
+
+    if (s.numerically_symmetric)
+    {
+        candidate.format = MatrixFormat_CSRSymmetric;
+        advice.time_csr_symmetric = time_format(&candidate, A, min_time);
+        select_format(&advice, &candidate, advice.time_csr_symmetric, &best);
+    }
+
+    candidate.format = MatrixFormat_CSC;
+    advice.time_csc = time_format(&candidate, A, min_time);
+    select_format(&advice, &candidate, advice.time_csc, &best);
+
+    for (int b = 2; b <= 4; b++)
+    {
+        if (s.size < b || (double) s.bsr_nnzb[b-2] * b * b > max_fill * s.nnz)
+            continue;
+        candidate.format = MatrixFormat_BSR;
+        candidate.bsize = b;
+        advice.time_bsr[b-2] = time_format(&candidate, A, min_time);
+        select_format(&advice, &candidate, advice.time_bsr[b-2], &best);
+    }
+    candidate.bsize = 1;
+
+    if ((double) s.sell_padded_nnz <= max_fill * s.nnz)
+    {
+        candidate.format = MatrixFormat_SELL;
+        advice.time_sell = time_format(&candidate, A, min_time);
+        select_format(&advice, &candidate, advice.time_sell, &best);
+    }
+
+    return advice;
+}
+
+static const char *format_names[] = {"csr", "csr_symmetric", "csc", "bsr", "sell"};
+static const int num_formats = 5;
+
+void print_format_advice(FormatAdvice *advice)
+{
+    printf("time per product (ms), %d threads:\n", advice->threads);
+    if (advice->time_csr >= 0)
+        printf("  csr           %.4f\n", advice->time_csr * 1e3);
+    if (advice->time_csr_symmetric >= 0)
+        printf("  csr symmetric %.4f\n", advice->time_csr_symmetric * 1e3);
+    if (advice->time_csc >= 0)
+        printf("  csc           %.4f\n", advice->time_csc * 1e3);
+    for (int b = 2; b <= 4; b++)
+        if (advice->time_bsr[b-2] >= 0)
+            printf("  bsr %d         %.4f\n", b, advice->time_bsr[b-2] * 1e3);
+    if (advice->time_sell >= 0)
+        printf("  sell %d %d    %.4f\n", advice->chunk, advice->sigma, advice->time_sell * 1e3);
+
+    switch (advice->format)
+    {
+    case MatrixFormat_CSR:
+        printf("recommended: CSRMatrix (csr_times_vector)\n");
+        break;
+    case MatrixFormat_CSRSymmetric:
+        printf("recommended: symmetric CSRMatrix (csr_symmetric_times_vector)\n");
+        break;
+    case MatrixFormat_CSC:
+        printf("recommended: CSCMatrix (csc_times_vector)\n");
+        break;
+    case MatrixFormat_BSR:
+        printf("recommended: BSRMatrix, bsize %d (bsr_times_vector)\n", advice->bsize);
+        break;
+    case MatrixFormat_SELL:
+        printf("recommended: SELLMatrix, chunk %d, sigma %d (sell_times_vector)\n", advice->chunk, advice->sigma);
+        break;
+    }
+}
+
+void write_format_advice(const char *filename, FormatAdvice *advice)
+{
+    FILE *f = fopen(filename, "w");
+    if (f == NULL)
+        _error("Cannot write the format advice.");
+    fprintf(f, "%s %d %d %d %d\n", format_names[advice->format], advice->bsize, advice->chunk, advice->sigma,
+            advice->threads);
+    fclose(f);
+}
+
+bool read_format_advice(const char *filename, FormatAdvice *advice)
+{
+    FILE *f = fopen(filename, "r");
+    if (f == NULL)
+        return false;
+    char name[32];
+    FormatAdvice a;
+    int n = fscanf(f, "%31s %d %d %d %d", name, &a.bsize, &a.chunk, &a.sigma, &a.threads);
+    fclose(f);
+    if (n != 5 || a.bsize < 1 || a.chunk < 1 || a.sigma < 1)
+        return false;
+
+    int k = 0;
+    while (k < num_formats && strcmp(name, format_names[k]) != 0)
+        k++;
+    if (k == num_formats)
+        return false;
+    a.format = (MatrixFormat) k;
+
+    // the times are not stored
+    a.time_csr = a.time_csr_symmetric = a.time_csc = a.time_sell = -1;
+    for (int b = 0; b < 3; b++)
+        a.time_bsr[b] = -1;
+    *advice = a;
+    return true;
+}
@@ -0,0 +1,120 @@
+// Copyright (c) 2009 hp-FEM group at the University of Nevada, Reno (UNR).
+// Distributed under the terms of the BSD license (see the LICENSE
+// file for the exact terms).
+// Email: hermes1d@googlegroups.com, home page: http://hpfem.org/
+
+#ifndef __HERMES_COMMON_MATRIX_ANALYSIS_H
+#define __HERMES_COMMON_MATRIX_ANALYSIS_H
+
+#include "matrix.h"
+
+/// Structure of a sparse matrix: the distribution of the entries, the
+/// symmetry and diagonal dominance, and the memory needed by each storage
+/// format (in bytes, with 4-byte indices). A symmetric matrix (upper triangle
+/// storage) is analyzed as the full matrix it represents.
+struct MatrixStructure
+{
+    int size;
+    int nnz;
+    bool complex;
+
+    // entries per row, row_nnz_hist[k] is the number of rows with 2^(k-1)
+    // < nnz <= 2^k entries (row_nnz_hist[0] counts the rows with at most one)
+    int row_nnz_min;
+    int row_nnz_max;
+    double row_nnz_mean;
+    std::vector<int> row_nnz_hist;
+
+    // the largest |i - j| and the envelope (the sum of the distances of the
+    // first entry of each row from the diagonal)
+    int bandwidth;
+    long long profile;
+
+    // fraction of the off-diagonal entries (i, j) such that (j, i) is an
+    // entry as well, 1 for a structurally symmetric matrix; the numeric
+    // symmetry compares the values too (a_ij = a_ji, not hermitian)
+    double structural_symmetry;
+    bool numerically_symmetric;
+
+    // rows with |a_ii| >= sum |a_ij| over j != i, and rows without a
+    // diagonal entry
+    int dominant_rows;
+    bool diagonally_dominant;
+    int missing_diagonal;
+
+    // blocks of the BSR formats with bsize = 2, 3, 4 (bsr_nnzb[bsize - 2])
+    // and the padded number of entries of SELL-8-256
+    int bsr_nnzb[3];
+    long long sell_padded_nnz;
+
+    // memory footprint of the formats
+    long long bytes_coo;
+    long long bytes_csr;
+    long long bytes_csr_symmetric;
+    long long bytes_csr_float;
+    long long bytes_csc;
+    long long bytes_dense;
+    long long bytes_bsr[3];
+    long long bytes_sell;
+};
+
+/// Analyzes the pattern and the values of A (the columns within each row
+/// have to be sorted, which is the case for every conversion to CSR).
+MatrixStructure analyze_matrix(CSRMatrix *A);
+void print_matrix_structure(MatrixStructure *s);
+
+/// Storage formats with a matrix-vector product, MatrixFormat_CSRSymmetric
+/// keeps the upper triangle of a symmetric matrix.
+enum MatrixFormat
+{
+    MatrixFormat_CSR,
+    MatrixFormat_CSRSymmetric,
+    MatrixFormat_CSC,
+    MatrixFormat_BSR,
+    MatrixFormat_SELL
+};
+
+/// Result of advise_format(): the fastest format and its parameters, and the
+/// measured time of one product with each candidate (-1 if the candidate was
+/// not measured, see advise_format()).
+struct FormatAdvice
+{
+    MatrixFormat format;
+    // block size of the BSR format
+    int bsize;
+    // chunk height and sorting window of the SELL format
+    int chunk;
+    int sigma;
+    // number of threads of the measurement (see get_num_threads())
+    int threads;
+
+    double time_csr;
+    double time_csr_symmetric;
+    double time_csc;
+    double time_bsr[3];
+    double time_sell;
+};
+
+/// Recommends the storage format for the matrix-vector products with
+/// matrices like A, by timing times_vector() of each candidate format on
+/// this machine with the current parallel mode (see set_parallel_mode()).
+/// The candidates are CSR, CSC, the symmetric CSR if A is numerically
+/// symmetric, BSR with bsize = 2, 3, 4 and SELL-8-256 if they do not store
+/// more than max_fill times the entries of A. Each candidate is timed for at
+/// least min_time seconds, so that the whole call takes about a second. The
+/// advice depends on the structure rather than on the values, so compute it
+/// once for a representative matrix of a model family and keep it (see
+/// write_format_advice()). There is no dense candidate, DenseMatrix has no
+/// matrix-vector product; its memory is reported by analyze_matrix().
+FormatAdvice advise_format(CSRMatrix *A, double min_time = 0.1, double max_fill = 1.5);
+void print_format_advice(FormatAdvice *advice);
+
+/// Converts A to the recommended format, the caller deletes the matrix.
+Matrix *create_matrix(FormatAdvice *advice, CSRMatrix *A);
+
+/// Stores the advice as a single line of text, read_format_advice() returns
+/// false if the file does not exist or is not valid.
+void write_format_advice(const char *filename, FormatAdvice *advice);
+bool read_format_advice(const char *filename, FormatAdvice *advice);
+
+#endif
@@ -21,7 +21,8 @@ CSCMatrix *read_hb_csc(const char *filename)
     double *Ax = new double[nnz];
 
     readHB_mat_double(filename, Ap, Ai, Ax);
-    CSCMatrix *Acsc = new CSCMatrix(size, nnz, Ap, Ai, Ax);
+    // the matrix takes over the arrays
+    CSCMatrix *Acsc = new CSCMatrix(size, nnz, Ap, Ai, Ax, true);
 
     return Acsc;
 }
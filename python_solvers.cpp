@@ -14,6 +14,7 @@ bool CommonSolverNumPy::solve(Matrix *mat, double *res)
   //printf("NumPy solver\n");
 
     CSRMatrix M(mat);
+    M.expand_symmetric();
     Python *p = new Python();
     p->push("m", c2py_CSRMatrix(&M));
     p->push("rhs", c2numpy_double_inplace(res, mat->get_size()));
@@ -32,6 +33,7 @@ bool CommonSolverNumPy::solve(Matrix *mat, cplx *res)
   //printf("NumPy solver - cplx\n");
 
     CSRMatrix M(mat);
+    M.expand_symmetric();
     Python *p = new Python();
     p->push("m", c2py_CSRMatrix(&M));
     p->push("rhs", c2numpy_double_complex_inplace(res, mat->get_size()));
@@ -94,6 +96,7 @@ bool CommonSolverSciPyCG::solve(Matrix *mat, double *res)
   //printf("SciPy CG solver\n");
 
     CSRMatrix M(mat);
+    M.expand_symmetric();
     Python *p = new Python();
     p->push("m", c2py_CSRMatrix(&M));
     p->push("rhs", c2numpy_double_inplace(res, mat->get_size()));
@@ -117,6 +120,7 @@ bool CommonSolverSciPyGMRES::solve(Matrix *mat, double *res)
   //printf("SciPy GMRES solver\n");
 
     CSRMatrix M(mat);
+    M.expand_symmetric();
     Python *p = new Python();
     p->push("m", c2py_CSRMatrix(&M));
     p->push("rhs", c2numpy_double_inplace(res, mat->get_size()));
@@ -6,73 +6,1426 @@
 #include "matrix.h"
 #include "solvers.h"
 
-// Standard CG method starting from zero vector
-// (because we solve for the increment)
-// x... comes as right-hand side, leaves as solution
+#ifdef COMMON_WITH_OPENMP
+#include <omp.h>
+#endif
+
+// the right-hand sides one after another
+bool CommonSolver::solve(Matrix *mat, double *B, int nrhs, int ldb)
+{
+    if (ldb == 0)
+        ldb = mat->get_size();
+    bool flag = true;
+    for (int k = 0; k < nrhs; k++)
+        if (!solve(mat, B + (long) k * ldb))
+            flag = false;
+    return flag;
+}
+
+bool CommonSolver::solve(Matrix *mat, cplx *B, int nrhs, int ldb)
+{
+    if (ldb == 0)
+        ldb = mat->get_size();
+    bool flag = true;
+    for (int k = 0; k < nrhs; k++)
+        if (!solve(mat, B + (long) k * ldb))
+            flag = false;
+    return flag;
+}
+
+// ***********************************************************************************************************************
+
+// Kernels of the native iterative solvers. The vector operations run in
+// parallel for long vectors (see set_parallel_mode()), the rounding of the
+// dot products depends on the number of threads.
+
+// number of threads for vectors of length n, at least a few thousand entries
+// per thread
+static int vector_threads(int n)
+{
+    return std::max(1, std::min(get_num_threads(), n / 4096));
+}
+
+static double dot(int n, double *a, double *b)
+{
+    int threads = vector_threads(n);
+    double sum = 0;
+    #pragma omp parallel for reduction(+:sum) num_threads(threads) schedule(static)
+    for (int i = 0; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+// q = A p for a CSR matrix, returns p.q
+static double csr_times_vector_dot(int size, int *Ap, int *Ai, double *Ax, double *p, double *q)
+{
+    int threads = vector_threads(size);
+    double sum = 0;
+    #pragma omp parallel for reduction(+:sum) num_threads(threads) schedule(static)
+    for (int i = 0; i < size; i++)
+    {
+        double s = 0;
+        for (int k = Ap[i]; k < Ap[i+1]; k++)
+            s += Ax[k] * p[Ai[k]];
+        q[i] = s;
+        sum += p[i] * s;
+    }
+    return sum;
+}
+
+// x += alpha p, r -= alpha q, returns r.r
+static double cg_update(int n, double alpha, double *p, double *q, double *x, double *r)
+{
+    int threads = vector_threads(n);
+    double sum = 0;
+    #pragma omp parallel for reduction(+:sum) num_threads(threads) schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        x[i] += alpha * p[i];
+        r[i] -= alpha * q[i];
+        sum += r[i] * r[i];
+    }
+    return sum;
+}
+
+// p = z + beta p
+static void cg_direction(int n, double *z, double beta, double *p)
+{
+    int threads = vector_threads(n);
+    #pragma omp parallel for num_threads(threads) schedule(static)
+    for (int i = 0; i < n; i++)
+        p[i] = z[i] + beta * p[i];
+}
+
+// x = alpha x
+static void vector_scale(int n, double alpha, double *x)
+{
+    int threads = vector_threads(n);
+    #pragma omp parallel for num_threads(threads) schedule(static)
+    for (int i = 0; i < n; i++)
+        x[i] *= alpha;
+}
+
+// rows of a block of the products with the GMRES basis, the block of w stays
+// in the cache while it meets all the basis vectors
+#define BASIS_BLOCK 512
+
+// h = V^T w for the k columns of V (of length n), each thread sums its rows
+// into partial (k entries per thread), which are added in a fixed order
+static void basis_project(int n, int k, double *V, double *w, double *h, double *partial)
+{
+    int threads = vector_threads(n);
+    #pragma omp parallel for num_threads(threads) schedule(static)
+    for (int t = 0; t < threads; t++)
+    {
+        int begin = (int) ((long) n * t / threads);
+        int end = (int) ((long) n * (t + 1) / threads);
+        double *ht = partial + (long) t * k;
+        for (int j = 0; j < k; j++)
+            ht[j] = 0;
+        for (int i0 = begin; i0 < end; i0 += BASIS_BLOCK)
+        {
+            int i1 = std::min(i0 + BASIS_BLOCK, end);
+            for (int j = 0; j < k; j++)
+            {
+                double *v = V + (long) j * n;
+                double sum = 0;
+                for (int i = i0; i < i1; i++)
+                    sum += v[i] * w[i];
+                ht[j] += sum;
+            }
+        }
+    }
+    for (int j = 0; j < k; j++)
+    {
+        double sum = 0;
+        for (int t = 0; t < threads; t++)
+            sum += partial[(long) t * k + j];
+        h[j] = sum;
+    }
+}
+
+// w += alpha V c for the k columns of V (of length n), returns w.w
+static double basis_update(int n, int k, double *V, double alpha, double *c, double *w)
+{
+    int threads = vector_threads(n);
+    int blocks = (n + BASIS_BLOCK - 1) / BASIS_BLOCK;
+    double sum = 0;
+    #pragma omp parallel for reduction(+:sum) num_threads(threads) schedule(static)
+    for (int b = 0; b < blocks; b++)
+    {
+        int i0 = b * BASIS_BLOCK;
+        int i1 = std::min(i0 + BASIS_BLOCK, n);
+        for (int j = 0; j < k; j++)
+        {
+            double *v = V + (long) j * n;
+            double a = alpha * c[j];
+            for (int i = i0; i < i1; i++)
+                w[i] += a * v[i];
+        }
+        for (int i = i0; i < i1; i++)
+            sum += w[i] * w[i];
+    }
+    return sum;
+}
+
+// y += alpha x, returns y.y
+static double vector_axpy(int n, double alpha, double *x, double *y)
+{
+    int threads = vector_threads(n);
+    double sum = 0;
+    #pragma omp parallel for reduction(+:sum) num_threads(threads) schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        y[i] += alpha * x[i];
+        sum += y[i] * y[i];
+    }
+    return sum;
+}
+
+// p = r + beta (p - omega v)
+static void bicgstab_direction(int n, double *r, double beta, double omega, double *v, double *p)
+{
+    int threads = vector_threads(n);
+    #pragma omp parallel for num_threads(threads) schedule(static)
+    for (int i = 0; i < n; i++)
+        p[i] = r[i] + beta * (p[i] - omega * v[i]);
+}
+
+// the real versions of the products of the complex solvers
+static double dotc(int n, double *a, double *b)
+{
+    return dot(n, a, b);
+}
+
+static double norm2(int n, double *a)
+{
+    return dot(n, a, a);
+}
+
+// Complex kernels on the interleaved real and imaginary parts, the products
+// are multiplied out (see csr_times_vector_rows() in matrix.cpp), the ones of
+// std::complex check for nan and keep the loops from being vectorized.
+
+static inline double *parts(cplx *x)
+{
+    return reinterpret_cast<double *>(x);
+}
+
+// a.b without conjugation
+static cplx dot(int n, cplx *a, cplx *b)
+{
+    double *x = parts(a);
+    double *y = parts(b);
+    int threads = vector_threads(n);
+    double re = 0, im = 0;
+    #pragma omp parallel for reduction(+:re,im) num_threads(threads) schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        re += x[2*i] * y[2*i] - x[2*i+1] * y[2*i+1];
+        im += x[2*i] * y[2*i+1] + x[2*i+1] * y[2*i];
+    }
+    return cplx(re, im);
+}
+
+// conj(a).b
+static cplx dotc(int n, cplx *a, cplx *b)
+{
+    double *x = parts(a);
+    double *y = parts(b);
+    int threads = vector_threads(n);
+    double re = 0, im = 0;
+    #pragma omp parallel for reduction(+:re,im) num_threads(threads) schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        re += x[2*i] * y[2*i] + x[2*i+1] * y[2*i+1];
+        im += x[2*i] * y[2*i+1] - x[2*i+1] * y[2*i];
+    }
+    return cplx(re, im);
+}
+
+// conj(a).a
+static double norm2(int n, cplx *a)
+{
+    return dot(2 * n, parts(a), parts(a));
+}
+
+static void vector_scale(int n, double alpha, cplx *x)
+{
+    vector_scale(2 * n, alpha, parts(x));
+}
+
+// z_i = d_i r_i
+static void vector_multiply(int n, cplx *d, cplx *r, cplx *z)
+{
+    double *a = parts(d);
+    double *x = parts(r);
+    double *y = parts(z);
+    int threads = vector_threads(n);
+    #pragma omp parallel for num_threads(threads) schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        double ar = a[2*i], ai = a[2*i+1], xr = x[2*i], xi = x[2*i+1];
+        y[2*i] = ar * xr - ai * xi;
+        y[2*i+1] = ar * xi + ai * xr;
+    }
+}
+
+// x += alpha p, r -= alpha q, returns conj(r).r
+static double cg_update(int n, cplx alpha, cplx *p, cplx *q, cplx *x, cplx *r)
+{
+    double ar = alpha.real(), ai = alpha.imag();
+    double *pp = parts(p);
+    double *qq = parts(q);
+    double *xx = parts(x);
+    double *rr = parts(r);
+    int threads = vector_threads(n);
+    double sum = 0;
+    #pragma omp parallel for reduction(+:sum) num_threads(threads) schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        double pr = pp[2*i], pi = pp[2*i+1], qr = qq[2*i], qi = qq[2*i+1];
+        xx[2*i] += ar * pr - ai * pi;
+        xx[2*i+1] += ar * pi + ai * pr;
+        rr[2*i] -= ar * qr - ai * qi;
+        rr[2*i+1] -= ar * qi + ai * qr;
+        sum += rr[2*i] * rr[2*i] + rr[2*i+1] * rr[2*i+1];
+    }
+    return sum;
+}
+
+// p = z + beta p
+static void cg_direction(int n, cplx *z, cplx beta, cplx *p)
+{
+    double br = beta.real(), bi = beta.imag();
+    double *zz = parts(z);
+    double *pp = parts(p);
+    int threads = vector_threads(n);
+    #pragma omp parallel for num_threads(threads) schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        double pr = pp[2*i], pi = pp[2*i+1];
+        pp[2*i] = zz[2*i] + br * pr - bi * pi;
+        pp[2*i+1] = zz[2*i+1] + br * pi + bi * pr;
+    }
+}
+
+// y += alpha x, returns conj(y).y
+static double vector_axpy(int n, cplx alpha, cplx *x, cplx *y)
+{
+    double ar = alpha.real(), ai = alpha.imag();
+    double *xx = parts(x);
+    double *yy = parts(y);
+    int threads = vector_threads(n);
+    double sum = 0;
+    #pragma omp parallel for reduction(+:sum) num_threads(threads) schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        double xr = xx[2*i], xi = xx[2*i+1];
+        yy[2*i] += ar * xr - ai * xi;
+        yy[2*i+1] += ar * xi + ai * xr;
+        sum += yy[2*i] * yy[2*i] + yy[2*i+1] * yy[2*i+1];
+    }
+    return sum;
+}
+
+// p = r + beta (p - omega v)
+static void bicgstab_direction(int n, cplx *r, cplx beta, cplx omega, cplx *v, cplx *p)
+{
+    double br = beta.real(), bi = beta.imag(), wr = omega.real(), wi = omega.imag();
+    double *rr = parts(r);
+    double *vv = parts(v);
+    double *pp = parts(p);
+    int threads = vector_threads(n);
+    #pragma omp parallel for num_threads(threads) schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        double vr = vv[2*i], vi = vv[2*i+1];
+        double tr = pp[2*i] - (wr * vr - wi * vi);
+        double ti = pp[2*i+1] - (wr * vi + wi * vr);
+        pp[2*i] = rr[2*i] + br * tr - bi * ti;
+        pp[2*i+1] = rr[2*i+1] + br * ti + bi * tr;
+    }
+}
+
+// h = V^H w for the k columns of V (see the real basis_project())
+static void basis_project(int n, int k, cplx *V, cplx *w, cplx *h, cplx *partial)
+{
+    double *ww = parts(w);
+    int threads = vector_threads(n);
+    #pragma omp parallel for num_threads(threads) schedule(static)
+    for (int t = 0; t < threads; t++)
+    {
+        int begin = (int) ((long) n * t / threads);
+        int end = (int) ((long) n * (t + 1) / threads);
+        double *ht = parts(partial + (long) t * k);
+        for (int j = 0; j < 2 * k; j++)
+            ht[j] = 0;
+        for (int i0 = begin; i0 < end; i0 += BASIS_BLOCK)
+        {
+            int i1 = std::min(i0 + BASIS_BLOCK, end);
+            for (int j = 0; j < k; j++)
+            {
+                double *v = parts(V + (long) j * n);
+                double re = 0, im = 0;
+                for (int i = i0; i < i1; i++)
+                {
+                    re += v[2*i] * ww[2*i] + v[2*i+1] * ww[2*i+1];
+                    im += v[2*i] * ww[2*i+1] - v[2*i+1] * ww[2*i];
+                }
+                ht[2*j] += re;
+                ht[2*j+1] += im;
+            }
+        }
+    }
+    for (int j = 0; j < k; j++)
+    {
+        cplx sum = 0;
+        for (int t = 0; t < threads; t++)
+            sum += partial[(long) t * k + j];
+        h[j] = sum;
+    }
+}
+
+// w += alpha V c for the k columns of V, returns conj(w).w
+static double basis_update(int n, int k, cplx *V, double alpha, cplx *c, cplx *w)
+{
+    double *ww = parts(w);
+    int threads = vector_threads(n);
+    int blocks = (n + BASIS_BLOCK - 1) / BASIS_BLOCK;
+    double sum = 0;
+    #pragma omp parallel for reduction(+:sum) num_threads(threads) schedule(static)
+    for (int b = 0; b < blocks; b++)
+    {
+        int i0 = b * BASIS_BLOCK;
+        int i1 = std::min(i0 + BASIS_BLOCK, n);
+        for (int j = 0; j < k; j++)
+        {
+            double *v = parts(V + (long) j * n);
+            double cr = alpha * c[j].real(), ci = alpha * c[j].imag();
+            for (int i = i0; i < i1; i++)
+            {
+                double vr = v[2*i], vi = v[2*i+1];
+                ww[2*i] += cr * vr - ci * vi;
+                ww[2*i+1] += cr * vi + ci * vr;
+            }
+        }
+        for (int i = i0; i < i1; i++)
+            sum += ww[2*i] * ww[2*i] + ww[2*i+1] * ww[2*i+1];
+    }
+    return sum;
+}
+
+// ***********************************************************************************************************************
+
+// The factors and the sweeps of the preconditioners for real and complex
+// values.
+
+// positions of the diagonal entries of the rows in Ai
+static void csr_find_diagonal(int size, int *Ap, int *Ai, int *diag)
+{
+    for (int i = 0; i < size; i++)
+    {
+        int *d = std::lower_bound(Ai + Ap[i], Ai + Ap[i+1], i);
+        if (d == Ai + Ap[i+1] || *d != i)
+            _error("Preconditioner: the matrix has no diagonal entry in a row.");
+        diag[i] = d - Ai;
+    }
+}
+
+template<typename T>
+static void csr_inverse_diagonal(int size, T *Ax, int *diag, T *inv_diag)
+{
+    for (int i = 0; i < size; i++)
+    {
+        if (Ax[diag[i]] == T(0.0))
+            _error("Preconditioner: zero diagonal entry.");
+        inv_diag[i] = T(1.0) / Ax[diag[i]];
+    }
+}
+
+// ILU(0) factors of Ax in LU (the same pattern), the inverse pivots in
+// inv_diag
+template<typename T>
+static void csr_ilu0(int size, int *Ap, int *Ai, T *Ax, int *diag, T *LU, T *inv_diag)
+{
+    std::copy(Ax, Ax + Ap[size], LU);
+
+    // row i is eliminated by the rows k < i of its pattern, the updates
+    // outside of the pattern are dropped (both rows are sorted)
+    for (int i = 0; i < size; i++)
+    {
+        for (int p = Ap[i]; p < diag[i]; p++)
+        {
+            int k = Ai[p];
+            LU[p] *= inv_diag[k];
+            T l = LU[p];
+            int q = p + 1;
+            for (int s = diag[k] + 1; s < Ap[k+1]; s++)
+            {
+                while (q < Ap[i+1] && Ai[q] < Ai[s])
+                    q++;
+                if (q == Ap[i+1])
+                    break;
+                if (Ai[q] == Ai[s])
+                    LU[q] -= l * LU[s];
+            }
+        }
+        if (LU[diag[i]] == T(0.0))
+            _error("ILU(0) preconditioner: zero pivot.");
+        inv_diag[i] = T(1.0) / LU[diag[i]];
+    }
+}
+
+// M = (D + omega L) D^-1 (D + omega U) / (omega (2 - omega)), the forward
+// sweep solves (D + omega L) y = r, the backward one (D + omega U) z = D y in
+// place; z is not scaled by omega (2 - omega)
+template<typename T>
+static void ssor_sweeps(int size, int *Ap, int *Ai, T *Ax, int *diag, T *inv_diag, double omega, T *r, T *z)
+{
+    for (int i = 0; i < size; i++)
+    {
+        T s = r[i];
+        for (int k = Ap[i]; k < diag[i]; k++)
+            s -= omega * Ax[k] * z[Ai[k]];
+        z[i] = s * inv_diag[i];
+    }
+    for (int i = size - 1; i >= 0; i--)
+    {
+        T s = 0.0;
+        for (int k = diag[i] + 1; k < Ap[i+1]; k++)
+            s += Ax[k] * z[Ai[k]];
+        z[i] -= omega * s * inv_diag[i];
+    }
+}
+
+// z = (LU)^-1 r
+template<typename T>
+static void ilu0_solve(int size, int *Ap, int *Ai, T *LU, int *diag, T *inv_diag, T *r, T *z)
+{
+    for (int i = 0; i < size; i++)
+    {
+        T s = r[i];
+        for (int k = Ap[i]; k < diag[i]; k++)
+            s -= LU[k] * z[Ai[k]];
+        z[i] = s;
+    }
+    for (int i = size - 1; i >= 0; i--)
+    {
+        T s = z[i];
+        for (int k = diag[i] + 1; k < Ap[i+1]; k++)
+            s -= LU[k] * z[Ai[k]];
+        z[i] = s * inv_diag[i];
+    }
+}
+
+CSRPreconditioner::CSRPreconditioner()
+{
+    this->type = CommonSolverPreconditioner_None;
+    this->size = 0;
+    this->nnz = 0;
+    this->omega = 1.0;
+    this->Ap = NULL;
+    this->Ai = NULL;
+    this->Ax = NULL;
+    this->diag = NULL;
+    this->inv_diag = NULL;
+    this->LU = NULL;
+    this->capacity_size = 0;
+    this->capacity_nnz = 0;
+    this->Ax_cplx = NULL;
+    this->inv_diag_cplx = NULL;
+    this->LU_cplx = NULL;
+    this->capacity_size_cplx = 0;
+    this->capacity_nnz_cplx = 0;
+}
+
+CSRPreconditioner::~CSRPreconditioner()
+{
+    delete[] this->diag;
+    delete[] this->inv_diag;
+    delete[] this->LU;
+    delete[] this->inv_diag_cplx;
+    delete[] this->LU_cplx;
+}
+
+void CSRPreconditioner::setup(CommonSolverPreconditioner type, int size, int *Ap, int *Ai, double *Ax, double omega)
+{
+    this->type = type;
+    this->size = size;
+    this->nnz = (Ap != NULL) ? Ap[size] : 0;
+    this->omega = omega;
+    this->Ap = Ap;
+    this->Ai = Ai;
+    this->Ax = Ax;
+    this->Ax_cplx = NULL;
+    if (type == CommonSolverPreconditioner_None)
+        return;
+    if (type == CommonSolverPreconditioner_SSOR && (omega <= 0 || omega >= 2))
+        _error("SSOR preconditioner: omega must be in (0, 2).");
+
+    if (size > this->capacity_size)
+    {
+        delete[] this->diag;
+        delete[] this->inv_diag;
+        this->diag = new int[size];
+        this->inv_diag = new double[size];
+        this->capacity_size = size;
+    }
+    csr_find_diagonal(size, Ap, Ai, this->diag);
+
+    if (type == CommonSolverPreconditioner_ILU)
+    {
+        if (this->nnz > this->capacity_nnz)
+        {
+            delete[] this->LU;
+            this->LU = new double[this->nnz];
+            this->capacity_nnz = this->nnz;
+        }
+        csr_ilu0(size, Ap, Ai, Ax, this->diag, this->LU, this->inv_diag);
+    }
+    else
+        csr_inverse_diagonal(size, Ax, this->diag, this->inv_diag);
+}
+
+void CSRPreconditioner::setup(CommonSolverPreconditioner type, int size, int *Ap, int *Ai, cplx *Ax, double omega)
+{
+    this->type = type;
+    this->size = size;
+    this->nnz = (Ap != NULL) ? Ap[size] : 0;
+    this->omega = omega;
+    this->Ap = Ap;
+    this->Ai = Ai;
+    this->Ax = NULL;
+    this->Ax_cplx = Ax;
+    if (type == CommonSolverPreconditioner_None)
+        return;
+    if (type == CommonSolverPreconditioner_SSOR && (omega <= 0 || omega >= 2))
+        _error("SSOR preconditioner: omega must be in (0, 2).");
+
+    if (size > this->capacity_size)
+    {
+        delete[] this->diag;
+        delete[] this->inv_diag;
+        this->diag = new int[size];
+        this->inv_diag = new double[size];
+        this->capacity_size = size;
+    }
+    if (size > this->capacity_size_cplx)
+    {
+        delete[] this->inv_diag_cplx;
+        this->inv_diag_cplx = new cplx[size];
+        this->capacity_size_cplx = size;
+    }
+    csr_find_diagonal(size, Ap, Ai, this->diag);
+
+    if (type == CommonSolverPreconditioner_ILU)
+    {
+        if (this->nnz > this->capacity_nnz_cplx)
+        {
+            delete[] this->LU_cplx;
+            this->LU_cplx = new cplx[this->nnz];
+            this->capacity_nnz_cplx = this->nnz;
+        }
+        csr_ilu0(size, Ap, Ai, Ax, this->diag, this->LU_cplx, this->inv_diag_cplx);
+    }
+    else
+        csr_inverse_diagonal(size, Ax, this->diag, this->inv_diag_cplx);
+}
+
+double CSRPreconditioner::apply(double *r, double *z)
+{
+    int size = this->size;
+    double *inv_diag = this->inv_diag;
+    if (this->type != CommonSolverPreconditioner_None && this->Ax == NULL)
+        _error("Preconditioner: the preconditioner is complex.");
+
+    switch (this->type)
+    {
+    case CommonSolverPreconditioner_None:
+    {
+        if (z != r)
+            std::copy(r, r + size, z);
+        return dot(size, r, r);
+    }
+    case CommonSolverPreconditioner_Jacobi:
+    {
+        int threads = vector_threads(size);
+        double sum = 0;
+        #pragma omp parallel for reduction(+:sum) num_threads(threads) schedule(static)
+        for (int i = 0; i < size; i++)
+        {
+            z[i] = inv_diag[i] * r[i];
+            sum += r[i] * z[i];
+        }
+        return sum;
+    }
+    case CommonSolverPreconditioner_SSOR:
+    {
+        ssor_sweeps(size, this->Ap, this->Ai, this->Ax, this->diag, inv_diag, this->omega, r, z);
+        double scale = this->omega * (2 - this->omega);
+        double sum = 0;
+        for (int i = 0; i < size; i++)
+        {
+            z[i] *= scale;
+            sum += r[i] * z[i];
+        }
+        return sum;
+    }
+    case CommonSolverPreconditioner_ILU:
+    {
+        ilu0_solve(size, this->Ap, this->Ai, this->LU, this->diag, inv_diag, r, z);
+        return dot(size, r, z);
+    }
+    }
+    _error("Preconditioner not supported.");
+    return 0;
+}
+
+cplx CSRPreconditioner::apply(cplx *r, cplx *z)
+{
+    int size = this->size;
+    cplx *inv_diag = this->inv_diag_cplx;
+    if (this->type != CommonSolverPreconditioner_None && this->Ax_cplx == NULL)
+        _error("Preconditioner: the preconditioner is real.");
+
+    switch (this->type)
+    {
+    case CommonSolverPreconditioner_None:
+    {
+        if (z != r)
+            std::copy(r, r + size, z);
+        return dot(size, r, r);
+    }
+    case CommonSolverPreconditioner_Jacobi:
+    {
+        vector_multiply(size, inv_diag, r, z);
+        return dot(size, r, z);
+    }
+    case CommonSolverPreconditioner_SSOR:
+    {
+        ssor_sweeps(size, this->Ap, this->Ai, this->Ax_cplx, this->diag, inv_diag, this->omega, r, z);
+        vector_scale(size, this->omega * (2 - this->omega), z);
+        return dot(size, r, z);
+    }
+    case CommonSolverPreconditioner_ILU:
+    {
+        ilu0_solve(size, this->Ap, this->Ai, this->LU_cplx, this->diag, inv_diag, r, z);
+        return dot(size, r, z);
+    }
+    }
+    _error("Preconditioner not supported.");
+    return 0;
+}
+
+// ***********************************************************************************************************************
+
+// a CSR matrix sharing the arrays of A
+static CSRMatrix *csr_view(CSRMatrix *A)
+{
+    CSRMatrix *B;
+    if (A->is_complex())
+        B = new CSRMatrix(A->get_size(), A->get_nnz(), A->get_Ap(), A->get_Ai(), A->get_Ax_cplx(), false);
+    else
+        B = new CSRMatrix(A->get_size(), A->get_nnz(), A->get_Ap(), A->get_Ai(), A->get_Ax(), false);
+    B->set_symmetric(A->is_symmetric());
+    return B;
+}
+
+// The matrix of the native iterative solvers. The matrix-vector products of
+// CSRMatrix are much faster than the ones of the assembling formats, so that
+// they are converted once (to Acsr); the RCM reordering permutes a CSR copy
+// (perm gets the permutation). Apre is the full CSR matrix of the
+// preconditioner: A itself if it is a CSRMatrix in the full storage, a copy
+// for the other formats if precondition is true, NULL otherwise. The caller
+// deletes Acsr, perm and Apre if it is not A.
+static Matrix *iterative_matrix(Matrix *A, CommonSolverReordering reordering, bool precondition,
+                                CSRMatrix *&Acsr, int *&perm, CSRMatrix *&Apre)
+{
+    Acsr = NULL;
+    perm = NULL;
+    if (reordering == CommonSolverReordering_RCM)
+    {
+        // a permuted CSR copy, a view of a CSRMatrix gets its own arrays
+        // in permute()
+        if (CSRMatrix *mcsr = dynamic_cast<CSRMatrix*>(A))
+            Acsr = csr_view(mcsr);
+        else
+            Acsr = new CSRMatrix(A);
+        perm = new int[Acsr->get_size()];
+        Acsr->get_rcm_ordering(perm);
+        Acsr->permute(perm);
+        A = Acsr;
+    }
+    else if (CooMatrix *mcoo = dynamic_cast<CooMatrix*>(A))
+        A = Acsr = new CSRMatrix(mcoo);
+    else if (DenseMatrix *mden = dynamic_cast<DenseMatrix*>(A))
+        A = Acsr = new CSRMatrix(mden);
+
+    // the other formats go through times_vector() and need a CSR copy for
+    // the preconditioner
+    Apre = dynamic_cast<CSRMatrix*>(A);
+    if (Apre != NULL && Apre->is_symmetric())
+        Apre = NULL;
+    if (Apre == NULL && precondition)
+    {
+        if (CSRMatrix *mcsr = dynamic_cast<CSRMatrix*>(A))
+            Apre = csr_view(mcsr);
+        else
+            Apre = new CSRMatrix(A);
+        Apre->expand_symmetric();
+    }
+    return A;
+}
+
+// ***********************************************************************************************************************
+
+CommonSolverCG::CommonSolverCG()
+{
+    this->reordering = CommonSolverReordering_None;
+    this->preconditioner = CommonSolverPreconditioner_None;
+    this->omega = 1.0;
+    this->num_iters = 0;
+    this->residual = 0;
+    this->capacity = 0;
+    this->r = this->z = this->p = this->q = NULL;
+}
+
+CommonSolverCG::~CommonSolverCG()
+{
+    delete[] this->r;
+    delete[] this->z;
+    delete[] this->p;
+    delete[] this->q;
+}
+
+void CommonSolverCG::reserve(int length)
+{
+    if (length > this->capacity)
+    {
+        delete[] this->r;
+        delete[] this->z;
+        delete[] this->p;
+        delete[] this->q;
+        this->r = new double[length];
+        this->z = new double[length];
+        this->p = new double[length];
+        this->q = new double[length];
+        this->capacity = length;
+    }
+}
+
 bool CommonSolverCG::solve(Matrix* A, double *x, double tol, int maxiter)
 {
-    printf("CG solver\n");
+    return solve(A, x, 1, 0, tol, maxiter);
+}
+
+bool CommonSolverCG::solve(Matrix* A, cplx *x, double tol, int maxiter)
+{
+    return solve(A, x, 1, 0, tol, maxiter);
+}
+
+// Preconditioned CG method starting from zero vector
+// (because we solve for the increment)
+// B... comes as right-hand sides, leaves as solutions
+bool CommonSolverCG::solve(Matrix* A, double *B, int nrhs, int ldb, double tol, int maxiter)
+{
+    CSRMatrix *Acsr = NULL;
+    int *perm = NULL;
+    CSRMatrix *Apre = NULL;
+    A = iterative_matrix(A, this->reordering, this->preconditioner != CommonSolverPreconditioner_None,
+                         Acsr, perm, Apre);
+
+    // the full CSR arrays are used directly by the fused product
+    CSRMatrix *full = (Apre == A && !Apre->is_complex()) ? Apre : NULL;
 
     int n_dof = A->get_size();
-    double *r = new double[n_dof];
-    double *p = new double[n_dof];
-    double *help_vec = new double[n_dof];
-    if (r == NULL || p == NULL || help_vec == NULL) {
-        _error("a vector could not be allocated in solve_linear_system_iter().");
-    }
-    // r = b - A*x0  (where b is x and x0 = 0)
-    for (int i=0; i < n_dof; i++) r[i] = x[i];
-    // p = r
-    for (int i=0; i < n_dof; i++) p[i] = r[i];
-
-    // setting initial condition x = 0
-    for (int i=0; i < n_dof; i++) x[i] = 0;
-
-    // CG iteration
-    int iter_current = 0;
-    double tol_current;
-    while (1)
-    {
-        mat_dot(A, p, help_vec, n_dof);
-        double r_times_r = vec_dot(r, r, n_dof);
-        double alpha = r_times_r / vec_dot(p, help_vec, n_dof);
-        for (int i=0; i < n_dof; i++) {
-            x[i] += alpha*p[i];
-            r[i] -= alpha*help_vec[i];
+    reserve(n_dof);
+    double *r = this->r;
+    double *p = this->p;
+    double *q = this->q;
+    // without a preconditioner z is r
+    double *z = (this->preconditioner == CommonSolverPreconditioner_None) ? r : this->z;
+    if (Apre != NULL)
+        this->precond.setup(this->preconditioner, n_dof, Apre->get_Ap(), Apre->get_Ai(), Apre->get_Ax(), this->omega);
+    else
+        this->precond.setup(CommonSolverPreconditioner_None, n_dof, NULL, NULL, (double *) NULL);
+
+    if (ldb == 0)
+        ldb = n_dof;
+    bool flag = true;
+    for (int k = 0; k < nrhs; k++)
+    {
+        double *x = B + (long) k * ldb;
+
+        // r = b - A*x0  (where b is x and x0 = 0)
+        if (perm)
+            permute_vector(n_dof, perm, x, r);
+        else
+            std::copy(x, x + n_dof, r);
+
+        // setting initial condition x = 0
+        std::fill(x, x + n_dof, 0.0);
+
+        // CG iteration
+        double r_times_r = dot(n_dof, r, r);
+        double r_times_z = this->precond.apply(r, z);
+        std::copy(z, z + n_dof, p);
+        int iter_current = 0;
+        double tol_current = sqrt(r_times_r);
+        while (tol_current >= tol && iter_current < maxiter)
+        {
+            double p_times_q;
+            if (full != NULL)
+                p_times_q = csr_times_vector_dot(n_dof, full->get_Ap(), full->get_Ai(), full->get_Ax(), p, q);
+            else
+            {
+                A->times_vector(p, q, n_dof);
+                p_times_q = dot(n_dof, p, q);
+            }
+            double alpha = r_times_z / p_times_q;
+            r_times_r = cg_update(n_dof, alpha, p, q, x, r);
+            iter_current++;
+            tol_current = sqrt(r_times_r);
+            if (tol_current < tol
+                || iter_current >= maxiter) break;
+            double r_times_z_new = (z == r) ? r_times_r : this->precond.apply(r, z);
+            double beta = r_times_z_new / r_times_z;
+            r_times_z = r_times_z_new;
+            cg_direction(n_dof, z, beta, p);
         }
-        double r_times_r_new = vec_dot(r, r, n_dof);
-        iter_current++;
-        tol_current = sqrt(r_times_r_new);
-        if (tol_current < tol
-            || iter_current >= maxiter) break;
-        double beta = r_times_r_new/r_times_r;
-        for (int i=0; i < n_dof; i++) p[i] = r[i] + beta*p[i];
-    }
-    bool flag;
-    if (tol_current <= tol)
-        flag = true;
+        if (tol_current > tol)
+            flag = false;
+
+        if (perm)
+        {
+            std::copy(x, x + n_dof, q);
+            unpermute_vector(n_dof, perm, q, x);
+        }
+
+        this->num_iters = iter_current;
+        this->residual = tol_current;
+    }
+
+    delete[] perm;
+    if (Apre != A) delete Apre;
+    if (Acsr != NULL) delete Acsr;
+
+    return flag;
+}
+
+
+// COCG, the CG above with the bilinear form r^T z, for complex symmetric
+// matrices
+bool CommonSolverCG::solve(Matrix* A, cplx *B, int nrhs, int ldb, double tol, int maxiter)
+{
+    if (!A->is_complex())
+        _error("CommonSolverCG: the matrix is real.");
+
+    CSRMatrix *Acsr = NULL;
+    int *perm = NULL;
+    CSRMatrix *Apre = NULL;
+    A = iterative_matrix(A, this->reordering, this->preconditioner != CommonSolverPreconditioner_None,
+                         Acsr, perm, Apre);
+
+    int n_dof = A->get_size();
+    reserve(2 * n_dof);
+    cplx *r = (cplx *) this->r;
+    cplx *p = (cplx *) this->p;
+    cplx *q = (cplx *) this->q;
+    // without a preconditioner z is r
+    cplx *z = (this->preconditioner == CommonSolverPreconditioner_None) ? r : (cplx *) this->z;
+    if (Apre != NULL)
+        this->precond.setup(this->preconditioner, n_dof, Apre->get_Ap(), Apre->get_Ai(), Apre->get_Ax_cplx(), this->omega);
+    else
+        this->precond.setup(CommonSolverPreconditioner_None, n_dof, NULL, NULL, (cplx *) NULL);
+
+    if (ldb == 0)
+        ldb = n_dof;
+    bool flag = true;
+    for (int k = 0; k < nrhs; k++)
+    {
+        cplx *x = B + (long) k * ldb;
+
+        if (perm)
+            permute_vector(n_dof, perm, x, r);
+        else
+            std::copy(x, x + n_dof, r);
+        std::fill(x, x + n_dof, cplx(0.0));
+
+        cplx r_times_z = this->precond.apply(r, z);
+        std::copy(z, z + n_dof, p);
+        int iter_current = 0;
+        double tol_current = sqrt(norm2(n_dof, r));
+        while (tol_current >= tol && iter_current < maxiter)
+        {
+            A->times_vector(p, q, n_dof);
+            cplx p_times_q = dot(n_dof, p, q);
+            // the bilinear form is not definite, the iteration breaks down
+            if (p_times_q == 0.0 || r_times_z == 0.0)
+                break;
+            cplx alpha = r_times_z / p_times_q;
+            double r_times_r = cg_update(n_dof, alpha, p, q, x, r);
+            iter_current++;
+            tol_current = sqrt(r_times_r);
+            if (tol_current < tol
+                || iter_current >= maxiter) break;
+            cplx r_times_z_new = this->precond.apply(r, z);
+            cplx beta = r_times_z_new / r_times_z;
+            r_times_z = r_times_z_new;
+            cg_direction(n_dof, z, beta, p);
+        }
+        if (tol_current > tol)
+            flag = false;
+
+        if (perm)
+        {
+            std::copy(x, x + n_dof, q);
+            unpermute_vector(n_dof, perm, q, x);
+        }
+
+        this->num_iters = iter_current;
+        this->residual = tol_current;
+    }
+
+    delete[] perm;
+    if (Apre != A) delete Apre;
+    if (Acsr != NULL) delete Acsr;
+
+    return flag;
+}
+
+// ***********************************************************************************************************************
+
+CommonSolverGMRES::CommonSolverGMRES()
+{
+    this->restart = 20;
+    this->preconditioner = CommonSolverPreconditioner_None;
+    this->omega = 1.0;
+    this->num_iters = 0;
+    this->residual = 0;
+    this->capacity_size = 0;
+    this->capacity_restart = 0;
+    this->capacity_threads = 0;
+    this->V = this->b = this->z = NULL;
+    this->H = this->cs = this->sn = this->g = this->h = this->partial = NULL;
+}
+
+CommonSolverGMRES::~CommonSolverGMRES()
+{
+    delete[] this->V;
+    delete[] this->b;
+    delete[] this->z;
+    delete[] this->H;
+    delete[] this->cs;
+    delete[] this->sn;
+    delete[] this->g;
+    delete[] this->h;
+    delete[] this->partial;
+}
+
+bool CommonSolverGMRES::solve(Matrix* A, double *x, double tol, int maxiter)
+{
+    return solve(A, x, 1, 0, tol, maxiter);
+}
+
+bool CommonSolverGMRES::solve(Matrix* A, cplx *x, double tol, int maxiter)
+{
+    return solve(A, x, 1, 0, tol, maxiter);
+}
+
+bool CommonSolverGMRES::solve(Matrix* A, double *B, int nrhs, int ldb, double tol, int maxiter)
+{
+    if (A->is_complex())
+        _error("CommonSolverGMRES: the matrix is complex.");
+    return gmres(A, B, nrhs, ldb, tol, maxiter);
+}
+
+bool CommonSolverGMRES::solve(Matrix* A, cplx *B, int nrhs, int ldb, double tol, int maxiter)
+{
+    if (!A->is_complex())
+        _error("CommonSolverGMRES: the matrix is real.");
+    return gmres(A, B, nrhs, ldb, tol, maxiter);
+}
+
+// Helpers of the solvers written for real and complex values.
+
+static inline double conjugate(double x)
+{
+    return x;
+}
+
+static inline cplx conjugate(cplx x)
+{
+    return std::conj(x);
+}
+
+static inline double *csr_values(CSRMatrix *A, double *)
+{
+    return A->get_Ax();
+}
+
+static inline cplx *csr_values(CSRMatrix *A, cplx *)
+{
+    return A->get_Ax_cplx();
+}
+
+// GMRES(m) with the right preconditioner starting from zero vector,
+// B... comes as right-hand sides, leaves as solutions
+template<typename T>
+bool CommonSolverGMRES::gmres(Matrix* A, T *B, int nrhs, int ldb, double tol, int maxiter)
+{
+    if (this->restart < 1)
+        _error("CommonSolverGMRES: the restart has to be positive.");
+
+    bool precondition = (this->preconditioner != CommonSolverPreconditioner_None);
+    CSRMatrix *Acsr = NULL;
+    int *perm = NULL;
+    CSRMatrix *Apre = NULL;
+    A = iterative_matrix(A, CommonSolverReordering_None, precondition, Acsr, perm, Apre);
+
+    // the Krylov space is not larger than the matrix; the vectors are
+    // counted in doubles, the small arrays have room for complex values
+    int n = A->get_size();
+    int m = std::min(this->restart, n);
+    int length = n * (int) (sizeof(T) / sizeof(double));
+    int max_threads = get_num_threads();
+    if (length > this->capacity_size || m > this->capacity_restart || max_threads > this->capacity_threads)
+    {
+        this->capacity_size = std::max(length, this->capacity_size);
+        this->capacity_restart = std::max(m, this->capacity_restart);
+        this->capacity_threads = std::max(max_threads, this->capacity_threads);
+        int cn = this->capacity_size;
+        int cm = this->capacity_restart;
+        delete[] this->V;
+        delete[] this->b;
+        delete[] this->z;
+        delete[] this->H;
+        delete[] this->cs;
+        delete[] this->sn;
+        delete[] this->g;
+        delete[] this->h;
+        delete[] this->partial;
+        this->V = new double[(long) (cm + 1) * cn];
+        this->b = new double[cn];
+        this->z = new double[cn];
+        this->H = new double[2 * (cm + 1) * cm];
+        this->cs = new double[2 * cm];
+        this->sn = new double[2 * cm];
+        this->g = new double[2 * (cm + 1)];
+        this->h = new double[2 * (cm + 1)];
+        this->partial = new double[2 * this->capacity_threads * (cm + 1)];
+    }
+    T *V = (T *) this->V;
+    T *b = (T *) this->b;
+    T *z = (T *) this->z;
+    T *H = (T *) this->H;
+    T *cs = (T *) this->cs;
+    T *sn = (T *) this->sn;
+    T *g = (T *) this->g;
+    T *h = (T *) this->h;
+    T *partial = (T *) this->partial;
+    if (Apre != NULL)
+        this->precond.setup(this->preconditioner, n, Apre->get_Ap(), Apre->get_Ai(), csr_values(Apre, (T *) NULL), this->omega);
     else
-        flag = false;
+        this->precond.setup(CommonSolverPreconditioner_None, n, NULL, NULL, (T *) NULL);
+
+    if (ldb == 0)
+        ldb = n;
+    bool flag = true;
+    for (int k = 0; k < nrhs; k++)
+    {
+        T *x = B + (long) k * ldb;
+        std::copy(x, x + n, b);
+        std::fill(x, x + n, T(0.0));
+        double norm_b = sqrt(norm2(n, b));
+        if (norm_b == 0)
+            norm_b = 1;
+
+        // r = b - A*x0 is the first vector of the basis
+        std::copy(b, b + n, V);
+        double beta = sqrt(norm2(n, V));
+        double resid = beta / norm_b;
+        int iter_current = 0;
+        while (resid > tol && iter_current < maxiter)
+        {
+            vector_scale(n, 1. / beta, V);
+            g[0] = beta;
+
+            // Arnoldi process, H is reduced to upper triangular by the Givens
+            // rotations as it grows
+            int j = 0;
+            while (j < m && iter_current < maxiter)
+            {
+                T *v = V + (long) j * n;
+                T *w = v + n;
+                T *Hj = H + j * (m + 1);
+                if (precondition)
+                {
+                    this->precond.apply(v, z);
+                    A->times_vector(z, w, n);
+                }
+                else
+                    A->times_vector(v, w, n);
 
-    if (r != NULL) delete [] r;
-    if (p != NULL) delete [] p;
-    if (help_vec != NULL) delete [] help_vec;
+                // classical Gram-Schmidt, twice
+                basis_project(n, j + 1, V, w, Hj, partial);
+                basis_update(n, j + 1, V, -1., Hj, w);
+                basis_project(n, j + 1, V, w, h, partial);
+                double w_times_w = basis_update(n, j + 1, V, -1., h, w);
+                for (int i = 0; i <= j; i++)
+                    Hj[i] += h[i];
+                double norm_w = sqrt(w_times_w);
+                Hj[j + 1] = norm_w;
+                if (norm_w != 0)
+                    vector_scale(n, 1. / norm_w, w);
+
+                // the rotations have a real cosine, [c s; -conj(s) c]
+                for (int i = 0; i < j; i++)
+                {
+                    T t = cs[i] * Hj[i] + sn[i] * Hj[i + 1];
+                    Hj[i + 1] = -conjugate(sn[i]) * Hj[i] + cs[i] * Hj[i + 1];
+                    Hj[i] = t;
+                }
+                double abs_h = std::abs(Hj[j]);
+                double rho = sqrt(abs_h * abs_h + norm_w * norm_w);
+                // A is singular on the Krylov space
+                if (rho == 0)
+                    break;
+                if (abs_h == 0)
+                {
+                    cs[j] = 0.0;
+                    sn[j] = 1.0;
+                    Hj[j] = norm_w;
+                }
+                else
+                {
+                    T phase = Hj[j] / abs_h;
+                    cs[j] = abs_h / rho;
+                    sn[j] = phase * (norm_w / rho);
+                    Hj[j] = phase * rho;
+                }
+                Hj[j + 1] = 0.0;
+                g[j + 1] = -conjugate(sn[j]) * g[j];
+                g[j] = cs[j] * g[j];
+                j++;
+                iter_current++;
+                // the estimate of the residual, zero if the space is invariant
+                if (std::abs(g[j]) <= tol * norm_b || norm_w == 0)
+                    break;
+            }
+            if (j == 0)
+                break;
+
+            // y = H^-1 g in h, x += M^-1 V y (with the first basis vector
+            // as the work vector)
+            for (int i = j - 1; i >= 0; i--)
+            {
+                T s = g[i];
+                for (int l = i + 1; l < j; l++)
+                    s -= H[l * (m + 1) + i] * h[l];
+                h[i] = s / H[i * (m + 1) + i];
+            }
+            if (precondition)
+            {
+                std::fill(z, z + n, T(0.0));
+                basis_update(n, j, V, 1., h, z);
+                this->precond.apply(z, V);
+                T one = 1.0;
+                basis_update(n, 1, V, 1., &one, x);
+            }
+            else
+                basis_update(n, j, V, 1., h, x);
+
+            // the residual of the restart is computed, not updated
+            A->times_vector(x, V, n);
+            int threads = vector_threads(n);
+            #pragma omp parallel for num_threads(threads) schedule(static)
+            for (int i = 0; i < n; i++)
+                V[i] = b[i] - V[i];
+            beta = sqrt(norm2(n, V));
+            resid = beta / norm_b;
+        }
+        if (resid > tol)
+            flag = false;
+
+        this->num_iters = iter_current;
+        this->residual = resid;
+    }
 
-    printf("CG solver: maxiter: %i, tol: %e\n",
-           iter_current, tol_current);
+    if (Apre != A) delete Apre;
+    if (Acsr != NULL) delete Acsr;
 
     return flag;
 }
 
+// ***********************************************************************************************************************
+
+CommonSolverBiCGSTAB::CommonSolverBiCGSTAB()
+{
+    this->preconditioner = CommonSolverPreconditioner_None;
+    this->omega = 1.0;
+    this->num_iters = 0;
+    this->residual = 0;
+    this->capacity = 0;
+    this->work = NULL;
+}
+
+CommonSolverBiCGSTAB::~CommonSolverBiCGSTAB()
+{
+    delete[] this->work;
+}
+
+bool CommonSolverBiCGSTAB::solve(Matrix* A, double *x, double tol, int maxiter)
+{
+    return solve(A, x, 1, 0, tol, maxiter);
+}
 
-bool CommonSolverCG::solve(Matrix* A, cplx *x)
+bool CommonSolverBiCGSTAB::solve(Matrix* A, cplx *x, double tol, int maxiter)
 {
-    _error("CommonSolverCG::solve(Matrix *mat, cplx *res) not implemented.");
+    return solve(A, x, 1, 0, tol, maxiter);
+}
+
+bool CommonSolverBiCGSTAB::solve(Matrix* A, double *B, int nrhs, int ldb, double tol, int maxiter)
+{
+    if (A->is_complex())
+        _error("CommonSolverBiCGSTAB: the matrix is complex.");
+    return bicgstab(A, B, nrhs, ldb, tol, maxiter);
+}
+
+bool CommonSolverBiCGSTAB::solve(Matrix* A, cplx *B, int nrhs, int ldb, double tol, int maxiter)
+{
+    if (!A->is_complex())
+        _error("CommonSolverBiCGSTAB: the matrix is real.");
+    return bicgstab(A, B, nrhs, ldb, tol, maxiter);
+}
+
+// BiCGSTAB with the right preconditioner starting from zero vector,
+// B... comes as right-hand sides, leaves as solutions
+template<typename T>
+bool CommonSolverBiCGSTAB::bicgstab(Matrix* A, T *B, int nrhs, int ldb, double tol, int maxiter)
+{
+    bool precondition = (this->preconditioner != CommonSolverPreconditioner_None);
+    CSRMatrix *Acsr = NULL;
+    int *perm = NULL;
+    CSRMatrix *Apre = NULL;
+    A = iterative_matrix(A, CommonSolverReordering_None, precondition, Acsr, perm, Apre);
+
+    int n = A->get_size();
+    int length = n * (int) (sizeof(T) / sizeof(double));
+    if (length > this->capacity)
+    {
+        delete[] this->work;
+        this->capacity = length;
+        this->work = new double[6 * (long) length];
+    }
+    T *r = (T *) this->work;
+    T *rhat = r + n;
+    T *p = rhat + n;
+    T *v = p + n;
+    T *t = v + n;
+    T *z = t + n;
+    if (Apre != NULL)
+        this->precond.setup(this->preconditioner, n, Apre->get_Ap(), Apre->get_Ai(), csr_values(Apre, (T *) NULL), this->omega);
+    else
+        this->precond.setup(CommonSolverPreconditioner_None, n, NULL, NULL, (T *) NULL);
+
+    if (ldb == 0)
+        ldb = n;
+    bool flag = true;
+    for (int k = 0; k < nrhs; k++)
+    {
+        T *x = B + (long) k * ldb;
+
+        // r = b - A*x0  (where b is x and x0 = 0), the shadow residual is r
+        std::copy(x, x + n, r);
+        std::copy(x, x + n, rhat);
+        std::fill(x, x + n, T(0.0));
+        double norm_b = sqrt(norm2(n, r));
+        if (norm_b == 0)
+            norm_b = 1;
+
+        double resid = sqrt(norm2(n, r)) / norm_b;
+        T rho_old = 1.0, alpha = 1.0, omega = 1.0;
+        int iter_current = 0;
+        while (resid > tol && iter_current < maxiter)
+        {
+            T rho = dotc(n, rhat, r);
+            // breakdown, rhat is orthogonal to r
+            if (rho == T(0.0))
+                break;
+            if (iter_current == 0)
+                std::copy(r, r + n, p);
+            else
+                bicgstab_direction(n, r, (rho / rho_old) * (alpha / omega), omega, v, p);
+
+            // half step with the direction p
+            T *phat = p;
+            if (precondition)
+            {
+                this->precond.apply(p, z);
+                phat = z;
+            }
+            A->times_vector(phat, v, n);
+            T rhat_times_v = dotc(n, rhat, v);
+            if (rhat_times_v == T(0.0))
+                break;
+            alpha = rho / rhat_times_v;
+            // s = r - alpha v is kept in r
+            double s_times_s = vector_axpy(n, -alpha, v, r);
+            vector_axpy(n, alpha, phat, x);
+            iter_current++;
+            resid = sqrt(s_times_s) / norm_b;
+            if (resid <= tol)
+                break;
+
+            // stabilizing step with the direction s
+            T *shat = r;
+            if (precondition)
+            {
+                this->precond.apply(r, z);
+                shat = z;
+            }
+            A->times_vector(shat, t, n);
+            double t_times_t = norm2(n, t);
+            if (t_times_t == 0)
+                break;
+            omega = dotc(n, t, r) / t_times_t;
+            vector_axpy(n, omega, shat, x);
+            double r_times_r = vector_axpy(n, -omega, t, r);
+            resid = sqrt(r_times_r) / norm_b;
+            rho_old = rho;
+            // breakdown, the residual is not reduced by the stabilizing step
+            if (omega == T(0.0))
+                break;
+        }
+        if (resid > tol)
+            flag = false;
+
+        this->num_iters = iter_current;
+        this->residual = resid;
+    }
+
+    if (Apre != A) delete Apre;
+    if (Acsr != NULL) delete Acsr;
+
+    return flag;
 }
 
 // ***********************************************************************************************************************
 
 bool CommonSolverDenseLU::solve(Matrix* A, double *x)
+{
+    return solve(A, x, 1, 0);
+}
+
+bool CommonSolverDenseLU::solve(Matrix* A, cplx *x)
+{
+    return solve(A, x, 1, 0);
+}
+
+// one factorization for all the right-hand sides
+bool CommonSolverDenseLU::solve(Matrix* A, double *B, int nrhs, int ldb)
 {
     printf("DenseLU solver\n");
 
@@ -85,19 +1438,41 @@ bool CommonSolverDenseLU::solve(Matrix* A, double *x)
     else
         _error("Matrix type not supported.");
 
-    int n = Aden->get_size();
-    int *indx = new int[n];
-    double **_mat = Aden->get_A();
-    double d;
-    ludcmp(_mat, n, indx, &d);
-    lubksb(_mat, n, indx, x);
+    if (Aden->is_complex())
+        _error("CommonSolverDenseLU::solve(Matrix *mat, double *res): the matrix is complex.");
+
+    DenseLU<double> lu;
+    lu.factorize(Aden->get_A(), Aden->get_size());
+    lu.solve(B, nrhs, ldb);
 
-    delete[] indx;
     if (!dynamic_cast<DenseMatrix*>(A))
         delete Aden;
+
+    return true;
 }
 
-bool CommonSolverDenseLU::solve(Matrix* A, cplx *x)
+bool CommonSolverDenseLU::solve(Matrix* A, cplx *B, int nrhs, int ldb)
 {
-    _error("CommonSolverDenseLU::solve(Matrix *mat, cplx *res) not implemented.");
+    printf("DenseLU solver\n");
+
+    DenseMatrix *Aden = NULL;
+
+    if (DenseMatrix *mden = dynamic_cast<DenseMatrix*>(A))
+        Aden = mden;
+    else if (CooMatrix *mcoo = dynamic_cast<CooMatrix*>(A))
+        Aden = new DenseMatrix(mcoo);
+    else
+        _error("Matrix type not supported.");
+
+    if (!Aden->is_complex())
+        _error("CommonSolverDenseLU::solve(Matrix *mat, cplx *res): the matrix is real.");
+
+    DenseLU<cplx> lu;
+    lu.factorize(Aden->get_A_cplx(), Aden->get_size());
+    lu.solve(B, nrhs, ldb);
+
+    if (!dynamic_cast<DenseMatrix*>(A))
+        delete Aden;
+
+    return true;
 }
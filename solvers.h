@@ -14,24 +14,168 @@ class CommonSolver
 public:
     virtual bool solve(Matrix *mat, double *res) = 0;
     virtual bool solve(Matrix *mat, cplx *res) = 0;
+    // nrhs right-hand sides stored by columns, B[i + k*ldb] is the i-th
+    // entry of the k-th one (ldb = 0 means the size of the matrix), B comes
+    // as right-hand sides, leaves as solutions. The direct solvers factorize
+    // the matrix once, the iterative ones set up their preconditioner once,
+    // the default solves the right-hand sides one after another. Returns
+    // false if any of the solves fails.
+    virtual bool solve(Matrix *mat, double *B, int nrhs, int ldb);
+    virtual bool solve(Matrix *mat, cplx *B, int nrhs, int ldb);
     inline char *get_log() { return log; }
 
 private:
     char *log;
 };
 
-// c++ cg
+// reorderings of the iterative solvers (see rcm_ordering()), the solvers
+// permute a copy of the matrix and the rhs and permute the solution back
+enum CommonSolverReordering
+{
+    CommonSolverReordering_None,
+    CommonSolverReordering_RCM
+};
+
+// preconditioners of the native iterative solvers (see CSRPreconditioner)
+enum CommonSolverPreconditioner
+{
+    CommonSolverPreconditioner_None,
+    CommonSolverPreconditioner_Jacobi,
+    CommonSolverPreconditioner_SSOR,
+    CommonSolverPreconditioner_ILU
+};
+
+/// Preconditioner z = M^-1 r built from the arrays of a full CSR matrix with
+/// sorted columns: Jacobi (the diagonal), SSOR with the relaxation factor
+/// omega (omega = 1 is the symmetric Gauss-Seidel) or ILU(0) (the LU factors
+/// restricted to the pattern of A). SSOR keeps pointers to the arrays of A,
+/// ILU(0) shares its pattern, so that the matrix must not change while the
+/// preconditioner is used. A repeated setup() for a matrix of the same size
+/// and number of entries reuses the arrays. The Jacobi step runs in parallel
+/// (see set_parallel_mode()), the triangular sweeps of SSOR and ILU(0) are
+/// sequential. The complex setup() builds the same preconditioners from
+/// complex values, the real and the complex factors are kept apart.
+class CSRPreconditioner
+{
+public:
+    CSRPreconditioner();
+    ~CSRPreconditioner();
+
+    void setup(CommonSolverPreconditioner type, int size, int *Ap, int *Ai, double *Ax, double omega = 1.0);
+    void setup(CommonSolverPreconditioner type, int size, int *Ap, int *Ai, cplx *Ax, double omega = 1.0);
+    // z = M^-1 r, returns the dot product r.z, z may be r for None; the
+    // complex product is not conjugated (the bilinear form of COCG)
+    double apply(double *r, double *z);
+    cplx apply(cplx *r, cplx *z);
+
+    inline CommonSolverPreconditioner get_type() { return this->type; }
+
+private:
+    CommonSolverPreconditioner type;
+    int size;
+    int nnz;
+    double omega;
+    int *Ap;
+    int *Ai;
+    double *Ax;
+    // positions of the diagonal entries in Ai
+    int *diag;
+    // inverse of the diagonal (of U for ILU(0))
+    double *inv_diag;
+    // ILU(0) factors on the pattern of A, the unit diagonal of L is not stored
+    double *LU;
+    int capacity_size;
+    int capacity_nnz;
+    // the same for the complex values
+    cplx *Ax_cplx;
+    cplx *inv_diag_cplx;
+    cplx *LU_cplx;
+    int capacity_size_cplx;
+    int capacity_nnz_cplx;
+
+    CSRPreconditioner(const CSRPreconditioner &);
+    CSRPreconditioner &operator=(const CSRPreconditioner &);
+};
+
+// c++ cg, the operator is applied through Matrix::times_vector(), so a
+// CSRMatrixFloat can be passed for float storage with double iterations. A
+// CSRMatrix in the full storage is used directly, the product is fused with
+// the dot product of the iteration. The work vectors are kept in the solver
+// and reused by the following solves of the same size. The preconditioners
+// are built from the CSR arrays (a copy for the other formats, CSRMatrixFloat
+// only works without a preconditioner). The iterations stop when the
+// Euclidean norm of the residual is below tol. A complex matrix has to be
+// complex symmetric (A^T = A, not hermitian) and is solved by COCG, the CG
+// with the bilinear form r^T z in place of the inner product; the
+// preconditioners are built from the complex values.
 class CommonSolverCG : public CommonSolver
 {
 public:
+    CommonSolverCG();
+    ~CommonSolverCG();
+
     bool solve(Matrix *mat, double *res)
     {
-        solve(mat, res, 1e-6, 1000);
+        return solve(mat, res, 1e-6, 1000);
     }
     bool solve(Matrix *mat, double *res,
                double tol,
                int maxiter);
-    bool solve(Matrix *mat, cplx *res);
+    bool solve(Matrix *mat, cplx *res)
+    {
+        return solve(mat, res, 1e-6, 1000);
+    }
+    bool solve(Matrix *mat, cplx *res,
+               double tol,
+               int maxiter);
+    bool solve(Matrix *mat, double *B, int nrhs, int ldb)
+    {
+        return solve(mat, B, nrhs, ldb, 1e-6, 1000);
+    }
+    bool solve(Matrix *mat, cplx *B, int nrhs, int ldb)
+    {
+        return solve(mat, B, nrhs, ldb, 1e-6, 1000);
+    }
+    // the iterations and the residual of the last right-hand side are kept
+    bool solve(Matrix *mat, double *B, int nrhs, int ldb,
+               double tol,
+               int maxiter);
+    bool solve(Matrix *mat, cplx *B, int nrhs, int ldb,
+               double tol,
+               int maxiter);
+    using CommonSolver::solve;
+    // the permuted matrix is a CSRMatrix
+    inline void set_reordering(CommonSolverReordering reordering) { this->reordering = reordering; }
+    // omega is the relaxation factor of SSOR
+    inline void set_preconditioner(CommonSolverPreconditioner preconditioner, double omega = 1.0)
+    {
+        this->preconditioner = preconditioner;
+        this->omega = omega;
+    }
+
+    // iterations and residual norm of the last solve
+    inline int get_num_iters() { return this->num_iters; }
+    inline double get_residual() { return this->residual; }
+
+private:
+    CommonSolverReordering reordering;
+    CommonSolverPreconditioner preconditioner;
+    double omega;
+    int num_iters;
+    double residual;
+
+    // work vectors of capacity doubles (two for a complex unknown)
+    int capacity;
+    double *r;
+    double *z;
+    double *p;
+    double *q;
+    CSRPreconditioner precond;
+
+    void reserve(int length);
+
+    CommonSolverCG(const CommonSolverCG &);
+    CommonSolverCG &operator=(const CommonSolverCG &);
 };
 inline bool solve_linear_system_cg(Matrix *mat, double *res,
                                    double tolerance,
@@ -46,12 +190,194 @@ inline bool solve_linear_system_cg(Matrix *mat, cplx *res)
     return solver.solve(mat, res);
 }
 
+// c++ gmres(m) for nonsymmetric matrices, restarted after m iterations
+// (set_restart()) and started from the zero vector. The Krylov basis is
+// orthogonalized by the classical Gram-Schmidt method with one
+// reorthogonalization, both passes are products with the whole basis that run
+// in parallel over blocks of rows, as the matrix-vector product does. The
+// preconditioner is applied from the right, so that the iterations measure
+// the residual of the original system; they stop when ||b - A x|| <= tol ||b||
+// (the defaults tol = 1e-5 and m = 20 are the ones of scipy's gmres). The
+// matrix formats and the preconditioners are used as in CommonSolverCG, the
+// basis and the other work arrays are kept in the solver and reused. Complex
+// matrices are solved with the hermitian Gram-Schmidt and complex rotations.
+class CommonSolverGMRES : public CommonSolver
+{
+public:
+    CommonSolverGMRES();
+    ~CommonSolverGMRES();
+
+    bool solve(Matrix *mat, double *res)
+    {
+        return solve(mat, res, 1e-5, 1000);
+    }
+    bool solve(Matrix *mat, double *res,
+               double tol,
+               int maxiter);
+    bool solve(Matrix *mat, cplx *res)
+    {
+        return solve(mat, res, 1e-5, 1000);
+    }
+    bool solve(Matrix *mat, cplx *res,
+               double tol,
+               int maxiter);
+    bool solve(Matrix *mat, double *B, int nrhs, int ldb)
+    {
+        return solve(mat, B, nrhs, ldb, 1e-5, 1000);
+    }
+    bool solve(Matrix *mat, cplx *B, int nrhs, int ldb)
+    {
+        return solve(mat, B, nrhs, ldb, 1e-5, 1000);
+    }
+    // the iterations and the residual of the last right-hand side are kept
+    bool solve(Matrix *mat, double *B, int nrhs, int ldb,
+               double tol,
+               int maxiter);
+    bool solve(Matrix *mat, cplx *B, int nrhs, int ldb,
+               double tol,
+               int maxiter);
+    using CommonSolver::solve;
+    inline void set_restart(int restart) { this->restart = restart; }
+    // omega is the relaxation factor of SSOR
+    inline void set_preconditioner(CommonSolverPreconditioner preconditioner, double omega = 1.0)
+    {
+        this->preconditioner = preconditioner;
+        this->omega = omega;
+    }
+
+    // iterations (over all the restarts) and relative residual
+    // ||b - A x|| / ||b|| of the last solve
+    inline int get_num_iters() { return this->num_iters; }
+    inline double get_residual() { return this->residual; }
+
+private:
+    int restart;
+    CommonSolverPreconditioner preconditioner;
+    double omega;
+    int num_iters;
+    double residual;
+
+    // work arrays for vectors of capacity_size doubles (two for a complex
+    // unknown), capacity_restart basis vectors and capacity_threads threads
+    int capacity_size;
+    int capacity_restart;
+    int capacity_threads;
+    // basis V (restart + 1 columns of length size), the rhs and a vector for
+    // the preconditioned directions
+    double *V;
+    double *b;
+    double *z;
+    // Hessenberg matrix (column major, restart + 1 rows), Givens rotations,
+    // rotated rhs of the least squares problem, the coefficients of the
+    // projections and their partial sums of each thread
+    double *H;
+    double *cs;
+    double *sn;
+    double *g;
+    double *h;
+    double *partial;
+    CSRPreconditioner precond;
+
+    template<typename T>
+    bool gmres(Matrix *mat, T *B, int nrhs, int ldb, double tol, int maxiter);
+
+    CommonSolverGMRES(const CommonSolverGMRES &);
+    CommonSolverGMRES &operator=(const CommonSolverGMRES &);
+};
+inline bool solve_linear_system_gmres(Matrix *mat, double *res,
+                                      double tolerance = 1e-5,
+                                      int maxiter = 1000)
+{
+    CommonSolverGMRES solver;
+    return solver.solve(mat, res, tolerance, maxiter);
+}
+
+// Native BiCGSTAB for general (nonsymmetric) real and complex matrices with
+// the right preconditioner, the matrix formats and the preconditioners are
+// used as in CommonSolverGMRES. It needs two products with the matrix per
+// iteration and a fixed amount of memory, but the residual does not decrease
+// monotonically and the method can break down.
+class CommonSolverBiCGSTAB : public CommonSolver
+{
+public:
+    CommonSolverBiCGSTAB();
+    ~CommonSolverBiCGSTAB();
+
+    bool solve(Matrix *mat, double *res)
+    {
+        return solve(mat, res, 1e-5, 1000);
+    }
+    bool solve(Matrix *mat, double *res,
+               double tol,
+               int maxiter);
+    bool solve(Matrix *mat, cplx *res)
+    {
+        return solve(mat, res, 1e-5, 1000);
+    }
+    bool solve(Matrix *mat, cplx *res,
+               double tol,
+               int maxiter);
+    bool solve(Matrix *mat, double *B, int nrhs, int ldb)
+    {
+        return solve(mat, B, nrhs, ldb, 1e-5, 1000);
+    }
+    bool solve(Matrix *mat, cplx *B, int nrhs, int ldb)
+    {
+        return solve(mat, B, nrhs, ldb, 1e-5, 1000);
+    }
+    // the iterations and the residual of the last right-hand side are kept
+    bool solve(Matrix *mat, double *B, int nrhs, int ldb,
+               double tol,
+               int maxiter);
+    bool solve(Matrix *mat, cplx *B, int nrhs, int ldb,
+               double tol,
+               int maxiter);
+    using CommonSolver::solve;
+    // omega is the relaxation factor of SSOR
+    inline void set_preconditioner(CommonSolverPreconditioner preconditioner, double omega = 1.0)
+    {
+        this->preconditioner = preconditioner;
+        this->omega = omega;
+    }
+
+    // iterations and relative residual ||b - A x|| / ||b|| of the last solve
+    inline int get_num_iters() { return this->num_iters; }
+    inline double get_residual() { return this->residual; }
+
+private:
+    CommonSolverPreconditioner preconditioner;
+    double omega;
+    int num_iters;
+    double residual;
+
+    // work vectors r, rhat, p, v, t and z of capacity doubles each (two for
+    // a complex unknown), in one array
+    int capacity;
+    double *work;
+    CSRPreconditioner precond;
+
+    template<typename T>
+    bool bicgstab(Matrix *mat, T *B, int nrhs, int ldb, double tol, int maxiter);
+
+    CommonSolverBiCGSTAB(const CommonSolverBiCGSTAB &);
+    CommonSolverBiCGSTAB &operator=(const CommonSolverBiCGSTAB &);
+};
+inline bool solve_linear_system_bicgstab(Matrix *mat, double *res,
+                                         double tolerance = 1e-5,
+                                         int maxiter = 1000)
+{
+    CommonSolverBiCGSTAB solver;
+    return solver.solve(mat, res, tolerance, maxiter);
+}
+
 // c++ lu
 class CommonSolverDenseLU : public CommonSolver
 {
 public:
     bool solve(Matrix *mat, double *res);
     bool solve(Matrix *mat, cplx *res);
+    bool solve(Matrix *mat, double *B, int nrhs, int ldb);
+    bool solve(Matrix *mat, cplx *B, int nrhs, int ldb);
 };
 inline void solve_linear_system_dense_lu(Matrix *mat, double *res)
 {
@@ -64,12 +390,181 @@ inline void solve_linear_system_dense_lu(Matrix *mat, cplx *res)
     solver.solve(mat, res);
 }
 
+// c++ sparse lu
+//
+// Sparse LU factorization P A Q = L U without external libraries. The
+// symbolic analysis orders the columns to reduce the fill (see
+// set_ordering()), the numeric factorization is the left-looking algorithm
+// of Gilbert and Peierls: each column of L and U is a sparse triangular
+// solve with the columns computed before, its pattern is found by a
+// depth-first search in the graph of L. The pivot of a column is its
+// diagonal entry if that is at least pivot_tolerance times the largest
+// candidate (threshold partial pivoting, the diagonal is not preferred with
+// the COLAMD ordering), otherwise the largest candidate. As in
+// CommonSolverUmfpack the factors are kept: solve(res) solves another
+// right-hand side, refactor() factorizes new values on the same pattern with
+// the pivot sequence and the pattern of the factors of the last
+// factorization (no search and no pivoting). The solver keeps a copy of the
+// CSC arrays of the matrix, the other formats are converted.
+class CommonSolverSparseLU : public CommonSolver
+{
+public:
+    // fill-reducing orderings of the columns: none, AMD of A + A^T (the
+    // rows are ordered the same way up to the pivoting, for matrices with
+    // an almost symmetric pattern), COLAMD (see column_amd_ordering()) and
+    // the automatic choice of AMD or COLAMD by the symmetry of the pattern
+    enum CommonSolverSparseLUOrdering
+    {
+        CommonSolverSparseLUOrdering_Natural,
+        CommonSolverSparseLUOrdering_AMD,
+        CommonSolverSparseLUOrdering_COLAMD,
+        CommonSolverSparseLUOrdering_Auto
+    };
+
+    CommonSolverSparseLU();
+    ~CommonSolverSparseLU();
+
+    bool solve(Matrix *mat, double *res);
+    bool solve(Matrix *mat, cplx *res);
+    bool solve(Matrix *mat, double *B, int nrhs, int ldb);
+    bool solve(Matrix *mat, cplx *B, int nrhs, int ldb);
+
+    inline void set_ordering(CommonSolverSparseLUOrdering ordering) { this->ordering = ordering; }
+    // 1 is the partial pivoting, 0 always takes the diagonal if it is not zero
+    inline void set_pivot_tolerance(double pivot_tolerance) { this->pivot_tolerance = pivot_tolerance; }
+
+    // symbolic analysis (the ordering) and numeric factorization
+    void factorize(Matrix *mat);
+    // symbolic analysis only
+    void analyze(Matrix *mat);
+    // numeric factorization with pivoting, the pattern of mat must be the
+    // analyzed one
+    void factorize_numeric(Matrix *mat);
+    // numeric factorization with the pivots of the last factorization, the
+    // pattern of mat must not change. Returns false if a pivot fails the
+    // threshold test, the factors are still usable but may be inaccurate,
+    // factorize_numeric() pivots again.
+    bool refactor(Matrix *mat);
+    // res comes as right-hand side, leaves as solution
+    bool solve(double *res);
+    bool solve(cplx *res);
+    bool solve(double *B, int nrhs, int ldb);
+    bool solve(cplx *B, int nrhs, int ldb);
+    void free_factorization();
+    inline bool is_factorized() { return this->factorized; }
+
+    // entries of L (with the unit diagonal) and U of the last factorization
+    inline int get_nnz_L() { return this->Lp ? this->Lp[this->size] : 0; }
+    inline int get_nnz_U() { return this->Up ? this->Up[this->size] : 0; }
+
+private:
+    CommonSolverSparseLUOrdering ordering;
+    double pivot_tolerance;
+
+    // the CSC arrays of the analyzed matrix
+    int size;
+    int nnz;
+    bool complex;
+    int *Ap;
+    int *Ai;
+    double *Ax;
+    cplx *Ax_cplx;
+    // the column k of L and U is the column q[k] of A, the row i of A is the
+    // row pinv[i] of L; the diagonal is preferred for the symmetric orderings
+    int *q;
+    int *pinv;
+    bool diagonal;
+    // L (unit diagonal first) and U (diagonal last) by columns with the rows
+    // in the pivot order, the capacities of the arrays of L and U, and a
+    // work vector of the solves
+    bool factorized;
+    int *Lp;
+    int *Li;
+    int *Up;
+    int *Ui;
+    double *Lx;
+    double *Ux;
+    cplx *Lx_cplx;
+    cplx *Ux_cplx;
+    int capacity_L;
+    int capacity_U;
+    double *work;
+
+    template<typename T>
+    void numeric_factorization(T *Ax, T *&Lx, T *&Ux);
+    template<typename T>
+    bool numeric_refactorization(T *Ax, T *Lx, T *Ux);
+    template<typename T>
+    void triangular_solves(T *Lx, T *Ux, T *B, int nrhs, int ldb);
+
+    CommonSolverSparseLU(const CommonSolverSparseLU &);
+    CommonSolverSparseLU &operator=(const CommonSolverSparseLU &);
+};
+inline void solve_linear_system_sparse_lu(Matrix *mat, double *res)
+{
+    CommonSolverSparseLU solver;
+    solver.solve(mat, res);
+}
+inline void solve_linear_system_sparse_lu(Matrix *mat, cplx *res)
+{
+    CommonSolverSparseLU solver;
+    solver.solve(mat, res);
+}
+
 // c++ umfpack - optional
+//
+// The factorization is kept in the solver: solve(mat, res) factorizes mat
+// and solves, solve(res) solves another right-hand side with the same
+// factors (the triangular solves only), refactor() factorizes new values on
+// the pattern of the factorized matrix and reuses the symbolic analysis
+// (fill-reducing ordering). The solver keeps a copy of the CSC arrays (the
+// CSR arrays of a full CSRMatrix, for the transposed system), refactor()
+// needs the matrix in the same format as the factorized one.
 class CommonSolverUmfpack : public CommonSolver
 {
 public:
+    CommonSolverUmfpack();
+    ~CommonSolverUmfpack();
+
     bool solve(Matrix *mat, double *res);
     bool solve(Matrix *mat, cplx *res);
+    bool solve(Matrix *mat, double *B, int nrhs, int ldb);
+    bool solve(Matrix *mat, cplx *B, int nrhs, int ldb);
+
+    // symbolic analysis and numeric factorization
+    void factorize(Matrix *mat);
+    // numeric factorization only, the pattern of mat must not change; the
+    // CSR, CSC, COO, BSR and SELL matrices refill the kept arrays in place,
+    // the other formats (symmetric, CSRMatrix64, typed) are converted again
+    void refactor(Matrix *mat);
+    // res comes as right-hand side, leaves as solution
+    bool solve(double *res);
+    bool solve(cplx *res);
+    bool solve(double *B, int nrhs, int ldb);
+    bool solve(cplx *B, int nrhs, int ldb);
+    void free_factorization();
+    inline bool is_factorized() { return this->numeric != NULL; }
+
+private:
+    int size;
+    int nnz;
+    bool complex;
+    // the arrays are the CSR arrays, the transposed system is solved
+    bool transposed;
+    int *Ap;
+    int *Ai;
+    double *Ax;
+    cplx *Ax_cplx;
+    // pattern of a COO, BSR or SELL matrix in refactor(), checked against Ap, Ai
+    int *Ap_work;
+    int *Ai_work;
+    void *symbolic;
+    void *numeric;
+
+    void numeric_factorization();
+
+    CommonSolverUmfpack(const CommonSolverUmfpack &);
+    CommonSolverUmfpack &operator=(const CommonSolverUmfpack &);
 };
 inline void solve_linear_system_umfpack(Matrix *mat, double *res)
 {
@@ -86,29 +581,76 @@ inline void solve_linear_system_umfpack(Matrix *mat, cplx *res)
 class CommonSolverSparseLib : public CommonSolver
 {
 public:
+    // the methods of IML++, CG and CHEBY need a symmetric positive definite
+    // matrix, GMRES restarts after set_restart() iterations, CHEBY needs the
+    // bounds of the spectrum of the preconditioned matrix
     enum CommonSolverSparseLibSolver
     {
         CommonSolverSparseLibSolver_ConjugateGradientSquared,
-        CommonSolverSparseLibSolver_RichardsonIterativeRefinement
+        CommonSolverSparseLibSolver_RichardsonIterativeRefinement,
+        CommonSolverSparseLibSolver_ConjugateGradient,
+        CommonSolverSparseLibSolver_BiConjugateGradient,
+        CommonSolverSparseLibSolver_BiConjugateGradientStabilized,
+        CommonSolverSparseLibSolver_GeneralizedMinimumResidual,
+        CommonSolverSparseLibSolver_QuasiMinimalResidual,
+        CommonSolverSparseLibSolver_Chebyshev
+    };
+
+    // ILUFloat keeps the ILU(0) factors in float, which cuts the memory
+    // traffic of the preconditioner, the iterations stay in double;
+    // IncompleteCholesky factors the lower triangle, so the matrix has to be
+    // symmetric positive definite with all diagonal entries present
+    enum CommonSolverSparseLibPreconditioner
+    {
+        CommonSolverSparseLibPreconditioner_ILU,
+        CommonSolverSparseLibPreconditioner_ILUFloat,
+        CommonSolverSparseLibPreconditioner_Diagonal,
+        CommonSolverSparseLibPreconditioner_IncompleteCholesky
     };
 
     CommonSolverSparseLib()
     {
         tolerance = 1e-8;
         maxiter = 1000;
+        restart = 30;
+        eigmin = eigmax = 0;
         method = CommonSolverSparseLibSolver_ConjugateGradientSquared;
+        preconditioner = CommonSolverSparseLibPreconditioner_ILU;
+        reordering = CommonSolverReordering_None;
+        num_iters = 0;
+        residual = 0;
     }
 
+    // the solve returns false if a rhs did not converge within maxiter
+    // iterations, a breakdown of the method is an error
     bool solve(Matrix *mat, double *res);
     bool solve(Matrix *mat, cplx *res);
+    bool solve(Matrix *mat, double *B, int nrhs, int ldb);
+    using CommonSolver::solve;
     inline void set_tolerance(double tolerance) { this->tolerance = tolerance; }
     inline void set_maxiter(int maxiter) { this->maxiter = maxiter; }
     inline void set_method(CommonSolverSparseLibSolver method) { this->method = method; }
+    inline void set_preconditioner(CommonSolverSparseLibPreconditioner preconditioner) { this->preconditioner = preconditioner; }
+    // the ordering also changes the ILU factors
+    inline void set_reordering(CommonSolverReordering reordering) { this->reordering = reordering; }
+    inline void set_restart(int restart) { this->restart = restart; }
+    inline void set_chebyshev_bounds(double eigmin, double eigmax) { this->eigmin = eigmin; this->eigmax = eigmax; }
+
+    // iterations and relative residual of the last solve (the largest over
+    // the right-hand sides of a block solve)
+    inline int get_num_iters() { return num_iters; }
+    inline double get_residual() { return residual; }
 
 private:
     double tolerance;
     int maxiter;
+    int restart;
+    double eigmin, eigmax;
     CommonSolverSparseLibSolver method;
+    CommonSolverSparseLibPreconditioner preconditioner;
+    CommonSolverReordering reordering;
+    int num_iters;
+    double residual;
 };
 inline void solve_linear_system_sparselib_cgs(Matrix *mat, double *res, double tolerance = 1e-8, int maxiter = 1000)
 {
@@ -134,6 +676,8 @@ public:
     bool solve(Matrix *mat, double *res);
     bool solve2(Matrix *mat, double *res);
     bool solve(Matrix *mat, cplx *res);
+    bool solve(Matrix *mat, double *B, int nrhs, int ldb);
+    using CommonSolver::solve;
 };
 inline void solve_linear_system_superlu(Matrix *mat, double *res)
 {
@@ -147,6 +691,7 @@ class CommonSolverNumPy : public CommonSolver
 public:
     bool solve(Matrix *mat, double *res);
     bool solve(Matrix *mat, cplx *res);
+    using CommonSolver::solve;
 };
 inline void solve_linear_system_numpy(Matrix *mat, double *res)
 {
@@ -165,6 +710,7 @@ class CommonSolverSciPyUmfpack : public CommonSolver
 public:
     bool solve(Matrix *mat, double *res);
     bool solve(Matrix *mat, cplx *res);
+    using CommonSolver::solve;
 };
 inline void solve_linear_system_scipy_umfpack(Matrix *mat, double *res)
 {
@@ -182,6 +728,7 @@ class CommonSolverSciPyCG : public CommonSolver
 public:
     bool solve(Matrix *mat, double *res);
     bool solve(Matrix *mat, cplx *res);
+    using CommonSolver::solve;
 };
 inline void solve_linear_system_scipy_cg(Matrix *mat, double *res)
 {
@@ -194,6 +741,7 @@ class CommonSolverSciPyGMRES : public CommonSolver
 public:
     bool solve(Matrix *mat, double *res);
     bool solve(Matrix *mat, cplx *res);
+    using CommonSolver::solve;
 };
 inline void solve_linear_system_scipy_gmres(Matrix *mat, double *res)
 {
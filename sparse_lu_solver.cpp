@@ -0,0 +1,541 @@
+// Copyright (c) 2009 hp-FEM group at the University of Nevada, Reno (UNR).
+// Distributed under the terms of the BSD license (see the LICENSE
+// file for the exact terms).
+// Email: hermes1d@googlegroups.com, home page: http://hpfem.org/
+
+#include "matrix.h"
+#include "solvers.h"
+
+CommonSolverSparseLU::CommonSolverSparseLU()
+{
+    this->ordering = CommonSolverSparseLUOrdering_Auto;
+    this->pivot_tolerance = 0.1;
+    this->size = 0;
+    this->nnz = 0;
+    this->complex = false;
+    this->Ap = this->Ai = NULL;
+    this->Ax = NULL;
+    this->Ax_cplx = NULL;
+    this->q = this->pinv = NULL;
+    this->diagonal = true;
+    this->factorized = false;
+    this->Lp = this->Li = this->Up = this->Ui = NULL;
+    this->Lx = this->Ux = NULL;
+    this->Lx_cplx = this->Ux_cplx = NULL;
+    this->capacity_L = this->capacity_U = 0;
+    this->work = NULL;
+}
+
+CommonSolverSparseLU::~CommonSolverSparseLU()
+{
+    free_factorization();
+}
+
+void CommonSolverSparseLU::free_factorization()
+{
+    delete[] this->Ap;
+    delete[] this->Ai;
+    delete[] this->Ax;
+    delete[] this->Ax_cplx;
+    delete[] this->q;
+    delete[] this->pinv;
+    delete[] this->Lp;
+    delete[] this->Li;
+    delete[] this->Up;
+    delete[] this->Ui;
+    delete[] this->Lx;
+    delete[] this->Ux;
+    delete[] this->Lx_cplx;
+    delete[] this->Ux_cplx;
+    delete[] this->work;
+    this->Ap = this->Ai = NULL;
+    this->Ax = NULL;
+    this->Ax_cplx = NULL;
+    this->q = this->pinv = NULL;
+    this->Lp = this->Li = this->Up = this->Ui = NULL;
+    this->Lx = this->Ux = NULL;
+    this->Lx_cplx = this->Ux_cplx = NULL;
+    this->capacity_L = this->capacity_U = 0;
+    this->work = NULL;
+    this->factorized = false;
+    this->size = 0;
+    this->nnz = 0;
+}
+
+// The matrix as CSC, the other formats are converted to csc (deleted by the
+// caller).
+static CSCMatrix *sparse_lu_matrix(Matrix *mat, CSCMatrix *&csc)
+{
+    csc = NULL;
+    if (CSCMatrix *mcsc = dynamic_cast<CSCMatrix*>(mat))
+        return mcsc;
+    csc = new CSCMatrix(mat);
+    return csc;
+}
+
+// fraction of the off-diagonal entries (i, j) of the CSC pattern such that
+// (j, i) is an entry as well
+static double structural_symmetry(int size, int *Ap, int *Ai)
+{
+    // the rows of the pattern
+    int nnz = Ap[size];
+    int *Rp = new int[size + 1];
+    int *Ri = new int[nnz];
+    std::fill(Rp, Rp + size + 1, 0);
+    for (int k = 0; k < nnz; k++)
+        Rp[Ai[k] + 1]++;
+    for (int i = 0; i < size; i++)
+        Rp[i+1] += Rp[i];
+    int *next = new int[size];
+    std::copy(Rp, Rp + size, next);
+    for (int j = 0; j < size; j++)
+        for (int k = Ap[j]; k < Ap[j+1]; k++)
+            Ri[next[Ai[k]]++] = j;
+
+    // the entries (i, j) of the column j are marked, (j, i) are the entries
+    // of the row j
+    int *mark = next;
+    std::fill(mark, mark + size, -1);
+    long long offdiag = 0, matched = 0;
+    for (int j = 0; j < size; j++)
+    {
+        for (int k = Ap[j]; k < Ap[j+1]; k++)
+        {
+            mark[Ai[k]] = j;
+            if (Ai[k] != j) offdiag++;
+        }
+        for (int k = Rp[j]; k < Rp[j+1]; k++)
+            if (Ri[k] != j && mark[Ri[k]] == j)
+                matched++;
+    }
+
+    delete[] Rp;
+    delete[] Ri;
+    delete[] next;
+    return offdiag == 0 ? 1. : (double) matched / offdiag;
+}
+
+void CommonSolverSparseLU::analyze(Matrix *mat)
+{
+    free_factorization();
+
+    CSCMatrix *csc;
+    CSCMatrix *A = sparse_lu_matrix(mat, csc);
+    this->size = A->get_size();
+    this->nnz = A->get_nnz();
+    this->complex = A->is_complex();
+    int n = this->size;
+    this->Ap = new int[n + 1];
+    this->Ai = new int[this->nnz];
+    memcpy(this->Ap, A->get_Ap(), (n + 1) * sizeof(int));
+    memcpy(this->Ai, A->get_Ai(), this->nnz * sizeof(int));
+    if (this->complex)
+    {
+        this->Ax_cplx = new cplx[this->nnz];
+        memcpy(this->Ax_cplx, A->get_Ax_cplx(), this->nnz * sizeof(cplx));
+    }
+    else
+    {
+        this->Ax = new double[this->nnz];
+        memcpy(this->Ax, A->get_Ax(), this->nnz * sizeof(double));
+    }
+    delete csc;
+
+    /* fill-reducing ordering of the columns */
+    CommonSolverSparseLUOrdering ordering = this->ordering;
+    if (ordering == CommonSolverSparseLUOrdering_Auto)
+        ordering = structural_symmetry(n, this->Ap, this->Ai) >= 0.5 ?
+                   CommonSolverSparseLUOrdering_AMD : CommonSolverSparseLUOrdering_COLAMD;
+    this->q = new int[n];
+    if (ordering == CommonSolverSparseLUOrdering_AMD)
+        amd_ordering(n, this->Ap, this->Ai, this->q);
+    else if (ordering == CommonSolverSparseLUOrdering_COLAMD)
+        column_amd_ordering(n, this->Ap, this->Ai, this->q);
+    else
+        for (int k = 0; k < n; k++)
+            this->q[k] = k;
+    this->diagonal = (ordering != CommonSolverSparseLUOrdering_COLAMD);
+
+    this->pinv = new int[n];
+    this->Lp = new int[n + 1];
+    this->Up = new int[n + 1];
+    this->work = new double[2 * n];
+}
+
+// copies the values of mat into the analyzed arrays, the pattern has to be
+// the analyzed one
+static void sparse_lu_values(Matrix *mat, int size, int nnz, bool complex, int *Ap, int *Ai,
+                             double *Ax, cplx *Ax_cplx)
+{
+    CSCMatrix *csc;
+    CSCMatrix *A = sparse_lu_matrix(mat, csc);
+    if (A->get_size() != size || A->is_complex() != complex || A->get_nnz() != nnz ||
+        !std::equal(Ap, Ap + size + 1, A->get_Ap()) || !std::equal(Ai, Ai + nnz, A->get_Ai()))
+    {
+        delete csc;
+        _error("CommonSolverSparseLU: the pattern of the matrix is not the analyzed one, call factorize().");
+    }
+    if (complex)
+        memcpy(Ax_cplx, A->get_Ax_cplx(), nnz * sizeof(cplx));
+    else
+        memcpy(Ax, A->get_Ax(), nnz * sizeof(double));
+    delete csc;
+}
+
+void CommonSolverSparseLU::factorize(Matrix *mat)
+{
+    analyze(mat);
+    if (this->complex)
+        numeric_factorization(this->Ax_cplx, this->Lx_cplx, this->Ux_cplx);
+    else
+        numeric_factorization(this->Ax, this->Lx, this->Ux);
+}
+
+void CommonSolverSparseLU::factorize_numeric(Matrix *mat)
+{
+    if (this->q == NULL)
+        _error("CommonSolverSparseLU: factorize_numeric() without analyze().");
+    sparse_lu_values(mat, this->size, this->nnz, this->complex, this->Ap, this->Ai, this->Ax, this->Ax_cplx);
+    if (this->complex)
+        numeric_factorization(this->Ax_cplx, this->Lx_cplx, this->Ux_cplx);
+    else
+        numeric_factorization(this->Ax, this->Lx, this->Ux);
+}
+
+bool CommonSolverSparseLU::refactor(Matrix *mat)
+{
+    if (!this->factorized)
+        _error("CommonSolverSparseLU: refactor() without factorize().");
+    sparse_lu_values(mat, this->size, this->nnz, this->complex, this->Ap, this->Ai, this->Ax, this->Ax_cplx);
+    if (this->complex)
+        return numeric_refactorization(this->Ax_cplx, this->Lx_cplx, this->Ux_cplx);
+    else
+        return numeric_refactorization(this->Ax, this->Lx, this->Ux);
+}
+
+// grows the arrays of a factor to hold at least nnz entries
+template<typename T>
+static void sparse_lu_reserve(int nnz, int used, int &capacity, int *&Fi, T *&Fx)
+{
+    if (nnz <= capacity)
+        return;
+    capacity = std::max(nnz, 2 * capacity);
+    int *Fi_new = new int[capacity];
+    T *Fx_new = new T[capacity];
+    std::copy(Fi, Fi + used, Fi_new);
+    std::copy(Fx, Fx + used, Fx_new);
+    delete[] Fi;
+    delete[] Fx;
+    Fi = Fi_new;
+    Fx = Fx_new;
+}
+
+// Depth-first search from the entries of a column of A in the graph of L
+// (the row j of A leads to the rows of the column pinv[j] of L if j is
+// pivotal), writes the reached rows into xi[top..n-1] in a topological
+// order and returns top. The rows with visited[j] == stamp are visited.
+static int sparse_lu_reach(int n, int begin, int end, int *Ai, int *Lp, int *Li, int *pinv,
+                           int *xi, int *stack, int *pstack, int *visited, int stamp)
+{
+    int top = n;
+    for (int k = begin; k < end; k++)
+    {
+        if (visited[Ai[k]] == stamp) continue;
+        int head = 0;
+        stack[0] = Ai[k];
+        while (head >= 0)
+        {
+            int j = stack[head];
+            int J = pinv[j];
+            if (visited[j] != stamp)
+            {
+                visited[j] = stamp;
+                // the unit diagonal is the first entry of the column of L
+                pstack[head] = (J < 0) ? 0 : Lp[J] + 1;
+            }
+            bool done = true;
+            int pend = (J < 0) ? 0 : Lp[J+1];
+            for (int p = pstack[head]; p < pend; p++)
+            {
+                int i = Li[p];
+                if (visited[i] == stamp) continue;
+                pstack[head] = p + 1;
+                stack[++head] = i;
+                done = false;
+                break;
+            }
+            if (done)
+            {
+                head--;
+                xi[--top] = j;
+            }
+        }
+    }
+    return top;
+}
+
+// Gilbert-Peierls factorization with threshold partial pivoting, the rows
+// of L are the rows of A during the factorization and get the pivot order
+// at the end
+template<typename T>
+void CommonSolverSparseLU::numeric_factorization(T *Ax, T *&Lx, T *&Ux)
+{
+    this->factorized = false;
+    int n = this->size;
+    int *Ap = this->Ap;
+    int *Ai = this->Ai;
+    int *q = this->q;
+    int *pinv = this->pinv;
+    int *Lp = this->Lp;
+    int *Up = this->Up;
+    double tol = this->pivot_tolerance;
+    if (this->capacity_L == 0)
+    {
+        sparse_lu_reserve(4 * this->nnz + n, 0, this->capacity_L, this->Li, Lx);
+        sparse_lu_reserve(4 * this->nnz + n, 0, this->capacity_U, this->Ui, Ux);
+    }
+
+    T *x = new T[n];
+    int *xi = new int[n];
+    int *stack = new int[n];
+    int *pstack = new int[n];
+    int *visited = new int[n];
+    std::fill(x, x + n, T(0.0));
+    std::fill(visited, visited + n, -1);
+    std::fill(pinv, pinv + n, -1);
+
+    int lnz = 0, unz = 0;
+    for (int k = 0; k < n; k++)
+    {
+        // the column has at most n entries in L and U
+        sparse_lu_reserve(lnz + n, lnz, this->capacity_L, this->Li, Lx);
+        sparse_lu_reserve(unz + n, unz, this->capacity_U, this->Ui, Ux);
+        int *Li = this->Li;
+        int *Ui = this->Ui;
+        Lp[k] = lnz;
+        Up[k] = unz;
+
+        // x = L \ A(:, q[k]) on the pattern found by the search
+        int col = q[k];
+        int top = sparse_lu_reach(n, Ap[col], Ap[col+1], Ai, Lp, Li, pinv, xi, stack, pstack, visited, k);
+        for (int p = Ap[col]; p < Ap[col+1]; p++)
+            x[Ai[p]] = Ax[p];
+        for (int t = top; t < n; t++)
+        {
+            int j = xi[t];
+            int J = pinv[j];
+            if (J < 0) continue;
+            T xj = x[j];
+            for (int p = Lp[J] + 1; p < Lp[J+1]; p++)
+                x[Li[p]] -= Lx[p] * xj;
+        }
+
+        // the pivotal rows give U, the largest of the others is the pivot
+        int ipiv = -1;
+        double largest = -1;
+        for (int t = top; t < n; t++)
+        {
+            int i = xi[t];
+            if (pinv[i] < 0)
+            {
+                double a = std::abs(x[i]);
+                if (a > largest)
+                {
+                    largest = a;
+                    ipiv = i;
+                }
+            }
+            else
+            {
+                Ui[unz] = pinv[i];
+                Ux[unz++] = x[i];
+                x[i] = 0.0;
+            }
+        }
+        if (ipiv == -1 || largest <= 0)
+        {
+            delete[] x;
+            delete[] xi;
+            delete[] stack;
+            delete[] pstack;
+            delete[] visited;
+            _error("CommonSolverSparseLU: singular matrix.");
+        }
+        // the diagonal of A Q, x is zero outside of the pattern
+        if (this->diagonal && pinv[col] < 0 && std::abs(x[col]) > 0 && std::abs(x[col]) >= tol * largest)
+            ipiv = col;
+
+        T pivot = x[ipiv];
+        Ui[unz] = k;
+        Ux[unz++] = pivot;
+        pinv[ipiv] = k;
+        Li[lnz] = ipiv;
+        Lx[lnz++] = 1.0;
+        for (int t = top; t < n; t++)
+        {
+            int i = xi[t];
+            if (pinv[i] < 0)
+            {
+                Li[lnz] = i;
+                Lx[lnz++] = x[i] / pivot;
+            }
+            x[i] = 0.0;
+        }
+    }
+    Lp[n] = lnz;
+    Up[n] = unz;
+    for (int p = 0; p < lnz; p++)
+        this->Li[p] = pinv[this->Li[p]];
+    this->factorized = true;
+
+    delete[] x;
+    delete[] xi;
+    delete[] stack;
+    delete[] pstack;
+    delete[] visited;
+}
+
+// The same columns with the pivots and the patterns of L and U kept, the
+// entries of U are stored in the topological order of the search, so that
+// x is computed in the pivot order without the search
+template<typename T>
+bool CommonSolverSparseLU::numeric_refactorization(T *Ax, T *Lx, T *Ux)
+{
+    this->factorized = false;
+    int n = this->size;
+    int *Ap = this->Ap;
+    int *Ai = this->Ai;
+    int *Lp = this->Lp;
+    int *Li = this->Li;
+    int *Up = this->Up;
+    int *Ui = this->Ui;
+    T *x = (T *) this->work;
+    std::fill(x, x + n, T(0.0));
+
+    bool stable = true;
+    for (int k = 0; k < n; k++)
+    {
+        int col = this->q[k];
+        for (int p = Ap[col]; p < Ap[col+1]; p++)
+            x[this->pinv[Ai[p]]] = Ax[p];
+        for (int p = Up[k]; p < Up[k+1] - 1; p++)
+        {
+            int j = Ui[p];
+            T xj = x[j];
+            Ux[p] = xj;
+            x[j] = 0.0;
+            for (int l = Lp[j] + 1; l < Lp[j+1]; l++)
+                x[Li[l]] -= Lx[l] * xj;
+        }
+
+        T pivot = x[k];
+        x[k] = 0.0;
+        if (std::abs(pivot) == 0)
+        {
+            std::fill(x, x + n, T(0.0));
+            _error("CommonSolverSparseLU: zero pivot in refactor(), call factorize_numeric().");
+        }
+        Ux[Up[k+1] - 1] = pivot;
+        double largest = 0;
+        for (int l = Lp[k] + 1; l < Lp[k+1]; l++)
+        {
+            int i = Li[l];
+            largest = std::max(largest, std::abs(x[i]));
+            Lx[l] = x[i] / pivot;
+            x[i] = 0.0;
+        }
+        if (std::abs(pivot) < this->pivot_tolerance * largest)
+            stable = false;
+    }
+    this->factorized = true;
+
+    return stable;
+}
+
+// x = Q U^-1 L^-1 P b for each right-hand side
+template<typename T>
+void CommonSolverSparseLU::triangular_solves(T *Lx, T *Ux, T *B, int nrhs, int ldb)
+{
+    int n = this->size;
+    int *Lp = this->Lp;
+    int *Li = this->Li;
+    int *Up = this->Up;
+    int *Ui = this->Ui;
+    T *y = (T *) this->work;
+    if (ldb == 0)
+        ldb = n;
+    for (int k = 0; k < nrhs; k++)
+    {
+        T *b = B + (long) k * ldb;
+        for (int i = 0; i < n; i++)
+            y[this->pinv[i]] = b[i];
+        for (int j = 0; j < n; j++)
+        {
+            T yj = y[j];
+            for (int p = Lp[j] + 1; p < Lp[j+1]; p++)
+                y[Li[p]] -= Lx[p] * yj;
+        }
+        for (int j = n - 1; j >= 0; j--)
+        {
+            y[j] /= Ux[Up[j+1] - 1];
+            T yj = y[j];
+            for (int p = Up[j]; p < Up[j+1] - 1; p++)
+                y[Ui[p]] -= Ux[p] * yj;
+        }
+        for (int i = 0; i < n; i++)
+            b[this->q[i]] = y[i];
+    }
+}
+
+bool CommonSolverSparseLU::solve(double *res)
+{
+    return solve(res, 1, 0);
+}
+
+bool CommonSolverSparseLU::solve(cplx *res)
+{
+    return solve(res, 1, 0);
+}
+
+bool CommonSolverSparseLU::solve(double *B, int nrhs, int ldb)
+{
+    if (!this->factorized)
+        _error("CommonSolverSparseLU: solve() without factorize().");
+    if (this->complex)
+        _error("CommonSolverSparseLU: real right-hand side for a complex matrix.");
+    triangular_solves(this->Lx, this->Ux, B, nrhs, ldb);
+    return true;
+}
+
+bool CommonSolverSparseLU::solve(cplx *B, int nrhs, int ldb)
+{
+    if (!this->factorized)
+        _error("CommonSolverSparseLU: solve() without factorize().");
+    if (!this->complex)
+        _error("CommonSolverSparseLU: complex right-hand side for a real matrix.");
+    triangular_solves(this->Lx_cplx, this->Ux_cplx, B, nrhs, ldb);
+    return true;
+}
+
+bool CommonSolverSparseLU::solve(Matrix *mat, double *res)
+{
+    return solve(mat, res, 1, 0);
+}
+
+bool CommonSolverSparseLU::solve(Matrix *mat, cplx *res)
+{
+    return solve(mat, res, 1, 0);
+}
+
+// one factorization for all the right-hand sides
+bool CommonSolverSparseLU::solve(Matrix *mat, double *B, int nrhs, int ldb)
+{
+    factorize(mat);
+    return solve(B, nrhs, ldb);
+}
+
+bool CommonSolverSparseLU::solve(Matrix *mat, cplx *B, int nrhs, int ldb)
+{
+    factorize(mat);
+    return solve(B, nrhs, ldb);
+}
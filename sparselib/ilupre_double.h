@@ -51,6 +51,8 @@ class CompCol_ILUPreconditioner_double {
   int u_nz_;
 
   int dim_[2];
+
+  friend class CompCol_ILUPreconditioner_float;
   
  public:
   CompCol_ILUPreconditioner_double(const CompCol_Mat_double &A);
@@ -0,0 +1,115 @@
+/*+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+/*             ********   ***                                 SparseLib++    */
+/*          *******  **  ***       ***      ***                              */
+/*           *****      ***     ******** ********                            */
+/*            *****    ***     ******** ********              R. Pozo        */
+/*       **  *******  ***   **   ***      ***                 K. Remington   */
+/*        ********   ********                                 A. Lumsdaine   */
+/*+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+/*                                                                           */
+/*                                                                           */
+/*                     SparseLib++ : Sparse Matrix Library                   */
+/*                                                                           */
+/*               National Institute of Standards and Technology              */
+/*                        University of Notre Dame                           */
+/*              Authors: R. Pozo, K. Remington, A. Lumsdaine                 */
+/*                                                                           */
+/*                                 NOTICE                                    */
+/*                                                                           */
+/* Permission to use, copy, modify, and distribute this software and         */
+/* its documentation for any purpose and without fee is hereby granted       */
+/* provided that the above notice appear in all copies and supporting        */
+/* documentation.                                                            */
+/*                                                                           */
+/* Neither the Institutions (National Institute of Standards and Technology, */
+/* University of Notre Dame) nor the Authors make any representations about  */
+/* the suitability of this software for any purpose.  This software is       */
+/* provided ``as is'' without expressed or implied warranty.                 */
+/*                                                                           */
+/*+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+#include "ilupre_float.h"
+
+
+CompCol_ILUPreconditioner_float::
+CompCol_ILUPreconditioner_float(const CompCol_Mat_double &A)
+: l_val_(0), l_colptr_(0), l_rowind_(0), l_nz_(0),
+    u_val_(0), u_colptr_(0), u_rowind_(0), u_nz_(0)
+{
+  int i;
+
+  CompCol_ILUPreconditioner_double ilu(A);
+
+  dim_[0] = ilu.dim_[0];
+  dim_[1] = ilu.dim_[1];
+  l_nz_ = ilu.l_nz_;
+  u_nz_ = ilu.u_nz_;
+
+  l_colptr_ = ilu.l_colptr_;
+  l_rowind_ = ilu.l_rowind_;
+  u_colptr_ = ilu.u_colptr_;
+  u_rowind_ = ilu.u_rowind_;
+
+  l_val_.newsize(l_nz_);
+  u_val_.newsize(u_nz_);
+  for (i = 0; i < l_nz_; i++)
+    l_val_(i) = (float) ilu.l_val_(i);
+  for (i = 0; i < u_nz_; i++)
+    u_val_(i) = (float) ilu.u_val_(i);
+}
+
+
+// L is unit lower triangular, the diagonal of U is the last entry of
+// each of its columns.
+
+VECTOR_double
+CompCol_ILUPreconditioner_float::solve(const VECTOR_double &x) const
+{
+  int M = x.size();
+  VECTOR_double y(x);
+  int i, j;
+
+  // lower unit
+  for (j = 0; j < M; j++) {
+    double yj = y(j);
+    for (i = l_colptr_(j); i < l_colptr_(j+1); i++)
+      y(l_rowind_(i)) -= l_val_(i) * yj;
+  }
+
+  // upper diag
+  for (j = M - 1; j >= 0; j--) {
+    double yj = (y(j) /= u_val_(u_colptr_(j+1) - 1));
+    for (i = u_colptr_(j); i < u_colptr_(j+1) - 1; i++)
+      y(u_rowind_(i)) -= u_val_(i) * yj;
+  }
+
+  return y;
+}
+
+
+VECTOR_double
+CompCol_ILUPreconditioner_float::trans_solve(const VECTOR_double &x) const
+{
+  int M = x.size();
+  VECTOR_double y(M);
+  int i, j;
+
+  // upper diag transpose
+  for (j = 0; j < M; j++) {
+    double sum = x(j);
+    for (i = u_colptr_(j); i < u_colptr_(j+1) - 1; i++)
+      sum -= u_val_(i) * y(u_rowind_(i));
+    y(j) = sum / u_val_(u_colptr_(j+1) - 1);
+  }
+
+  // lower unit transpose
+  for (j = M - 1; j >= 0; j--) {
+    double sum = y(j);
+    for (i = l_colptr_(j); i < l_colptr_(j+1); i++)
+      sum -= l_val_(i) * y(l_rowind_(i));
+    y(j) = sum;
+  }
+
+  return y;
+}
@@ -0,0 +1,69 @@
+/*+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+/*             ********   ***                                 SparseLib++    */
+/*          *******  **  ***       ***      ***                              */
+/*           *****      ***     ******** ********                            */
+/*            *****    ***     ******** ********              R. Pozo        */
+/*       **  *******  ***   **   ***      ***                 K. Remington   */
+/*        ********   ********                                 A. Lumsdaine   */
+/*+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+/*                                                                           */
+/*                                                                           */
+/*                     SparseLib++ : Sparse Matrix Library                   */
+/*                                                                           */
+/*               National Institute of Standards and Technology              */
+/*                        University of Notre Dame                           */
+/*              Authors: R. Pozo, K. Remington, A. Lumsdaine                 */
+/*                                                                           */
+/*                                 NOTICE                                    */
+/*                                                                           */
+/* Permission to use, copy, modify, and distribute this software and         */
+/* its documentation for any purpose and without fee is hereby granted       */
+/* provided that the above notice appear in all copies and supporting        */
+/* documentation.                                                            */
+/*                                                                           */
+/* Neither the Institutions (National Institute of Standards and Technology, */
+/* University of Notre Dame) nor the Authors make any representations about  */
+/* the suitability of this software for any purpose.  This software is       */
+/* provided ``as is'' without expressed or implied warranty.                 */
+/*                                                                           */
+/*+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+
+#ifndef ILUPRE_FLOAT_H
+#define ILUPRE_FLOAT_H
+
+#include "vecdefs.h"
+#include VECTOR_H
+#include "compcol_double.h"
+#include "ilupre_double.h"
+
+
+// ILU(0) preconditioner with the factors stored in single precision.
+// The factorization is computed in double by CompCol_ILUPreconditioner_double,
+// the triangular solves read the float factors and accumulate in double.
+
+class CompCol_ILUPreconditioner_float {
+
+ private:
+  VECTOR_float  l_val_;
+  VECTOR_int    l_colptr_;
+  VECTOR_int    l_rowind_;
+  int l_nz_;
+
+  VECTOR_float  u_val_;
+  VECTOR_int    u_colptr_;
+  VECTOR_int    u_rowind_;
+  int u_nz_;
+
+  int dim_[2];
+
+ public:
+  CompCol_ILUPreconditioner_float(const CompCol_Mat_double &A);
+  ~CompCol_ILUPreconditioner_float(void){};
+
+  VECTOR_double     solve(const VECTOR_double &x) const;
+  VECTOR_double     trans_solve(const VECTOR_double &x) const;
+};
+
+
+#endif
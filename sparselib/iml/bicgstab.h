@@ -61,6 +61,7 @@ BiCGSTAB(const Matrix &A, Vector &x, const Vector &b,
     if ((resid = norm(s)/normb) < tol) {
       x += alpha(0) * phat;
       tol = resid;
+      max_iter = i;
       return 0;
     }
     shat = M.solve(s);
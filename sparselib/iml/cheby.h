@@ -5,7 +5,10 @@
 // system Ax = b using the Preconditioned Chebyshev Method
 //
 // CHEBY follows the algorithm described on p. 30 of the 
-// SIAM Templates book.
+// SIAM Templates book, with the coefficients corrected as in
+// Gutknecht and Roellin, "The Chebyshev iteration revisited"
+// (the book takes alpha = 2/d in the first step and drops the
+// division by the previous alpha, which diverges).
 //
 // The return value indicates convergence within max_iter (input)
 // iterations (0), or no convergence within max_iter iterations (1).
@@ -51,11 +54,15 @@ CHEBY(const Matrix &A, Vector &x, const Vector &b,
 
     if (i == 1) {
       p = z;
-      alpha = 2.0 / d;
+      alpha = 1.0 / d;
     } else {
-      beta = c * alpha / 2.0;       // calculate new beta
-      beta = beta * beta;
-      alpha = 1.0 / (d - beta);     // calculate new alpha
+      if (i == 2)
+        beta = 0.5 * (c * alpha) * (c * alpha);
+      else {
+        beta = c * alpha / 2.0;     // calculate new beta
+        beta = beta * beta;
+      }
+      alpha = 1.0 / (d - beta / alpha);  // calculate new alpha
       p = z + beta * p;             // update search direction
     }
 
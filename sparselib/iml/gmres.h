@@ -20,6 +20,13 @@
 //*****************************************************************
 
 
+// declared before GMRES, which calls them with arguments of builtin types
+template<class Real> 
+void GeneratePlaneRotation(Real &dx, Real &dy, Real &cs, Real &sn);
+template<class Real> 
+void ApplyPlaneRotation(Real &dx, Real &dy, Real &cs, Real &sn);
+
+
 template < class Matrix, class Vector >
 void 
 Update(Vector &x, int k, Matrix &h, Vector &s, Vector v[])
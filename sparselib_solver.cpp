@@ -9,7 +9,11 @@
 #include <coord_double.h>
 #include <compcol_double.h>
 #include <mvvd.h>
+#include <mvmd.h>
 #include <ilupre_double.h>
+#include <ilupre_float.h>
+#include <diagpre_double.h>
+#include <icpre_double.h>
 #include <bicg.h>
 #include <cg.h>
 #include <cgs.h>
@@ -19,9 +23,126 @@
 #include <ir.h>
 #include <qmr.h>
 
+// parameters of the methods besides the iteration limit and the tolerance
+struct SparseLibParameters
+{
+    CommonSolverSparseLib::CommonSolverSparseLibSolver method;
+    int restart;
+    double eigmin, eigmax;
+};
+
+// QMR takes a left and a right preconditioner, the right one is the identity
+class IdentityPreconditioner_double
+{
+public:
+    VECTOR_double solve(const VECTOR_double &x) const { return x; }
+    VECTOR_double trans_solve(const VECTOR_double &x) const { return x; }
+};
+
+// runs the method with the preconditioner, the initial guess is the
+// preconditioned rhs; returns 0 if the method converged, 1 if it did not
+// within maxiter iterations and a larger value on a breakdown
+template<typename Preconditioner>
+static int sparselib_solve(const SparseLibParameters &params,
+                           CompCol_Mat_double &Acc, VECTOR_double &xv, VECTOR_double &rhs,
+                           const Preconditioner &M, int &maxiter, double &tolerance)
+{
+    xv = M.solve(rhs);
+
+    switch (params.method)
+    {
+    case CommonSolverSparseLib::CommonSolverSparseLibSolver_ConjugateGradientSquared:
+        return CGS(Acc, xv, rhs, M, maxiter, tolerance);
+    case CommonSolverSparseLib::CommonSolverSparseLibSolver_RichardsonIterativeRefinement:
+        return IR(Acc, xv, rhs, M, maxiter, tolerance);
+    case CommonSolverSparseLib::CommonSolverSparseLibSolver_ConjugateGradient:
+        return CG(Acc, xv, rhs, M, maxiter, tolerance);
+    case CommonSolverSparseLib::CommonSolverSparseLibSolver_BiConjugateGradient:
+        return BiCG(Acc, xv, rhs, M, maxiter, tolerance);
+    case CommonSolverSparseLib::CommonSolverSparseLibSolver_BiConjugateGradientStabilized:
+        return BiCGSTAB(Acc, xv, rhs, M, maxiter, tolerance);
+    case CommonSolverSparseLib::CommonSolverSparseLibSolver_GeneralizedMinimumResidual:
+        {
+            // the Krylov space cannot be larger than the matrix
+            int m = std::min(params.restart, Acc.dim(0));
+            MATRIX_double H(m + 1, m, 0.0);
+            return GMRES(Acc, xv, rhs, M, H, m, maxiter, tolerance);
+        }
+    case CommonSolverSparseLib::CommonSolverSparseLibSolver_QuasiMinimalResidual:
+        return QMR(Acc, xv, rhs, M, IdentityPreconditioner_double(), maxiter, tolerance);
+    case CommonSolverSparseLib::CommonSolverSparseLibSolver_Chebyshev:
+        return CHEBY(Acc, xv, rhs, M, maxiter, tolerance, params.eigmin, params.eigmax);
+    default:
+        // reported by CommonSolverSparseLib::solve()
+        return -1;
+    }
+}
+
+// solves the nrhs columns of B (permuted by perm if it is not NULL) with the
+// same preconditioner, the methods overwrite the iteration limit and the
+// tolerance, so that each column starts from the given ones; num_iters and
+// residual are the largest over the columns. Returns 0 if all columns
+// converged, 1 if one did not and the status of the method on a breakdown
+// (the remaining columns are not solved), the caller frees the matrix before
+// raising the error
+template<typename Preconditioner>
+static int sparselib_solve_block(const SparseLibParameters &params,
+                                  CompCol_Mat_double &Acc, const Preconditioner &M, int *perm,
+                                  double *B, int nrhs, int ldb, int maxiter, double tolerance,
+                                  int &num_iters, double &residual)
+{
+    int size = Acc.dim(0);
+    double *b = new double[size];
+    VECTOR_double xv(size);
+    int status = 0;
+    num_iters = 0;
+    residual = 0;
+    for (int k = 0; k < nrhs; k++)
+    {
+        double *res = B + (long) k * ldb;
+        if (perm)
+            permute_vector(size, perm, res, b);
+        else
+            memcpy(b, res, size*sizeof(double));
+        VECTOR_double rhs(b, size);
+
+        int iters = maxiter;
+        double tol = tolerance;
+        int result = sparselib_solve(params, Acc, xv, rhs, M, iters, tol);
+        if (result != 0 && result != 1)
+        {
+            status = result;
+            break;
+        }
+        if (result == 1)
+            status = 1;
+        num_iters = std::max(num_iters, iters);
+        residual = std::max(residual, tol);
+
+        for (int i = 0 ; i < size ; i++)
+            b[i] = xv(i);
+        if (perm)
+            unpermute_vector(size, perm, b, res);
+        else
+            memcpy(res, b, size*sizeof(double));
+    }
+    delete[] b;
+    return status;
+}
+
 bool CommonSolverSparseLib::solve(Matrix *mat, double *res)
 {
-    printf("SparseLib++ solver\n");
+    return solve(mat, res, 1, 0);
+}
+
+// the matrix is converted and the preconditioner is computed once for all
+// the right-hand sides
+bool CommonSolverSparseLib::solve(Matrix *mat, double *B, int nrhs, int ldb)
+{
+    if (method == CommonSolverSparseLibSolver_GeneralizedMinimumResidual && restart < 1)
+        _error("SparseLib++ error. The GMRES restart has to be positive.");
+    if (method == CommonSolverSparseLibSolver_Chebyshev && !(eigmin > 0 && eigmax > eigmin))
+        _error("SparseLib++ error. Chebyshev needs 0 < eigmin < eigmax, see set_chebyshev_bounds().");
 
     CSCMatrix *Acsc = NULL;
 
@@ -33,52 +154,92 @@ bool CommonSolverSparseLib::solve(Matrix *mat, double *res)
         Acsc = mcsc;
     else if (CSRMatrix *mcsr = dynamic_cast<CSRMatrix*>(mat))
         Acsc = new CSCMatrix(mcsr);
+    else if (BSRMatrix *mbsr = dynamic_cast<BSRMatrix*>(mat))
+        Acsc = new CSCMatrix(mbsr);
+    else if (SELLMatrix *msell = dynamic_cast<SELLMatrix*>(mat))
+        Acsc = new CSCMatrix(msell);
+    else if (CSRMatrix64 *m64 = dynamic_cast<CSRMatrix64*>(mat))
+        Acsc = new CSCMatrix(m64);     // narrowed to 32-bit indices
     else
-        _error("Matrix type not supported.");
+        Acsc = new CSCMatrix(mat);     // the typed matrices, fails for the others
+
+    // the permuted copy of the matrix, the rhs and the solution are
+    // permuted in sparselib_solve_block()
+    int *perm = NULL;
+    if (this->reordering == CommonSolverReordering_RCM)
+    {
+        // a view of the matrix of the caller, permute() gives it its own arrays
+        if (Acsc == mat)
+            Acsc = new CSCMatrix(Acsc->get_size(), Acsc->get_nnz(), Acsc->get_Ap(), Acsc->get_Ai(), Acsc->get_Ax(), false);
+        perm = new int[Acsc->get_size()];
+        Acsc->get_rcm_ordering(perm);
+        Acsc->permute(perm);
+    }
 
     int nnz = Acsc->get_nnz();
     int size = Acsc->get_size();
+    if (ldb == 0)
+        ldb = size;
 
     CompCol_Mat_double Acc = CompCol_Mat_double(size, size, nnz,
                                                 Acsc->get_Ax(), Acsc->get_Ai(), Acsc->get_Ap());
 
-    // rhs
-    VECTOR_double rhs(res, size);
+    SparseLibParameters params;
+    params.method = method;
+    params.restart = restart;
+    params.eigmin = eigmin;
+    params.eigmax = eigmax;
 
-    // preconditioner
-    CompCol_ILUPreconditioner_double ILU(Acc);
-    VECTOR_double xv = ILU.solve(rhs);
-
-    // method
-    int result = -1;
-    switch (method)
+    // preconditioner and method, the iterations stay in double for both
+    // factor precisions
+    int status;
+    switch (preconditioner)
     {
-    case CommonSolverSparseLibSolver_ConjugateGradientSquared:
-        result = CGS(Acc, xv, rhs, ILU, maxiter, tolerance);
+    case CommonSolverSparseLibPreconditioner_ILU:
+        {
+            CompCol_ILUPreconditioner_double ILU(Acc);
+            status = sparselib_solve_block(params, Acc, ILU, perm, B, nrhs, ldb, maxiter, tolerance,
+                                           num_iters, residual);
+        }
+        break;
+    case CommonSolverSparseLibPreconditioner_ILUFloat:
+        {
+            CompCol_ILUPreconditioner_float ILU(Acc);
+            status = sparselib_solve_block(params, Acc, ILU, perm, B, nrhs, ldb, maxiter, tolerance,
+                                           num_iters, residual);
+        }
         break;
-    case CommonSolverSparseLibSolver_RichardsonIterativeRefinement:
-        result = IR(Acc, xv, rhs, ILU, maxiter, tolerance);
+    case CommonSolverSparseLibPreconditioner_Diagonal:
+        {
+            DiagPreconditioner_double D(Acc);
+            status = sparselib_solve_block(params, Acc, D, perm, B, nrhs, ldb, maxiter, tolerance,
+                                           num_iters, residual);
+        }
+        break;
+    case CommonSolverSparseLibPreconditioner_IncompleteCholesky:
+        {
+            ICPreconditioner_double IC(Acc);
+            status = sparselib_solve_block(params, Acc, IC, perm, B, nrhs, ldb, maxiter, tolerance,
+                                           num_iters, residual);
+        }
         break;
     default:
-        _error("SparseLib++ error. Method is not defined.");
+        status = -2;
     }
 
-    if (result == 0)
-        printf("SparseLib++ solver: maxiter: %i, tol: %e\n", maxiter, tolerance);
-    else
-        _error("SparseLib++ error.");
-
-    double *x;
-    x = (double*) malloc(size * sizeof(double));
+    delete[] perm;
 
-    for (int i = 0 ; i < xv.size() ; i++)
-        x[i] = xv(i);
+    if (Acsc != mat)
+        delete Acsc;
 
-    memcpy(res, x, size*sizeof(double));
-    delete[] x;
+    if (status == -1)
+        _error("SparseLib++ error. Method is not defined.");
+    if (status == -2)
+        _error("SparseLib++ error. Preconditioner is not defined.");
+    if (status > 1)
+        _error("SparseLib++ error. Breakdown of the method.");
 
-    if (!dynamic_cast<CSCMatrix*>(mat))
-        delete Acsc;
+    return status == 0;
 }
 
 bool CommonSolverSparseLib::solve(Matrix *mat, cplx *res)
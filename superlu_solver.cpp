@@ -10,6 +10,12 @@
 #include <superlu/slu_ddefs.h>
 
 bool CommonSolverSuperLU::solve(Matrix *mat, double *res)
+{
+    return solve(mat, res, 1, 0);
+}
+
+// dgssv() factorizes once and solves all the columns of the dense rhs matrix
+bool CommonSolverSuperLU::solve(Matrix *mat, double *res, int nrhs, int ldb)
 {
     printf("SuperLU solver\n");
 
@@ -21,27 +27,39 @@ bool CommonSolverSuperLU::solve(Matrix *mat, double *res)
     double *Ax = NULL;
 
     CSCMatrix *Acsc = NULL;
+    // CSR matrices are passed to SuperLU as they are (SLU_NR), without a copy
+    CSRMatrix *Acsr = dynamic_cast<CSRMatrix*>(mat);
 
     if (CooMatrix *mcoo = dynamic_cast<CooMatrix*>(mat))
         Acsc = new CSCMatrix(mcoo);
     else if (CSCMatrix *mcsc = dynamic_cast<CSCMatrix*>(mat))
         Acsc = mcsc;
-    else if (CSRMatrix *mcsr = dynamic_cast<CSRMatrix*>(mat))
-        Acsc = new CSCMatrix(mcsr);
-    else
-        _error("Matrix type not supported.");
+    else if (BSRMatrix *mbsr = dynamic_cast<BSRMatrix*>(mat))
+        Acsc = new CSCMatrix(mbsr);
+    else if (SELLMatrix *msell = dynamic_cast<SELLMatrix*>(mat))
+        Acsc = new CSCMatrix(msell);
+    else if (CSRMatrix64 *m64 = dynamic_cast<CSRMatrix64*>(mat))
+        Acsc = new CSCMatrix(m64);     // narrowed to 32-bit indices
+    else if (Acsr && Acsr->is_symmetric())
+    {
+        // only the upper triangle is stored, SuperLU needs the full matrix
+        Acsc = new CSCMatrix(Acsr);
+        Acsr = NULL;
+    }
+    else if (!Acsr)
+        Acsc = new CSCMatrix(mat);     // the typed matrices, fails for the others
 
-    nnz = Acsc->get_nnz();
-    Ap = Acsc->get_Ap();
-    Ai = Acsc->get_Ai();
-    Ax = Acsc->get_Ax();
+    nnz = Acsr ? Acsr->get_nnz() : Acsc->get_nnz();
+    Ap = Acsr ? Acsr->get_Ap() : Acsc->get_Ap();
+    Ai = Acsr ? Acsr->get_Ai() : Acsc->get_Ai();
+    Ax = Acsr ? Acsr->get_Ax() : Acsc->get_Ax();
 
     SuperMatrix A;
     SuperMatrix B;
     SuperMatrix L;      // factor L
     SuperMatrix U;      // factor U
 
-    int nrhs, info;
+    int info;
 
     superlu_options_t options;
     SuperLUStat_t stat;
@@ -61,14 +79,19 @@ bool CommonSolverSuperLU::solve(Matrix *mat, double *res)
     */
     set_default_options(&options);
 
-    // create csc matrix
-    dCreate_CompCol_Matrix(&A, size, size, nnz, Ax, Ai, Ap,
-                           SLU_NC, SLU_D, SLU_GE);
+    // create csc (csr) matrix
+    if (Acsr)
+        dCreate_CompRow_Matrix(&A, size, size, nnz, Ax, Ai, Ap,
+                               SLU_NR, SLU_D, SLU_GE);
+    else
+        dCreate_CompCol_Matrix(&A, size, size, nnz, Ax, Ai, Ap,
+                               SLU_NC, SLU_D, SLU_GE);
     // dPrint_CompCol_Matrix("A", &A);
 
-    nrhs = 1;
     // create rhs matrix
-    dCreate_Dense_Matrix(&B, size, nrhs, res, size,
+    if (ldb == 0)
+        ldb = size;
+    dCreate_Dense_Matrix(&B, size, nrhs, res, ldb,
                          SLU_DN, SLU_D, SLU_GE);
     // dPrint_Dense_Matrix("B", &B);
 
@@ -86,11 +109,7 @@ bool CommonSolverSuperLU::solve(Matrix *mat, double *res)
     mem_usage_t mem_usage;
     if ( info == 0 )
     {
-        // solution
-        double *x = (double*) ((DNformat*) B.Store)->nzval;
-
-        // copy result
-        memcpy(res, x, size*sizeof(double));
+        // the solution overwrites the rhs matrix, which is res
 
         /*
         SCformat *Lstore = (SCformat *) L.Store;
@@ -124,8 +143,10 @@ bool CommonSolverSuperLU::solve(Matrix *mat, double *res)
     Destroy_SuperNode_Matrix(&L);
     Destroy_CompCol_Matrix(&U);
 
-    if (!dynamic_cast<CSCMatrix*>(mat))
+    if (Acsc && !dynamic_cast<CSCMatrix*>(mat))
         delete Acsc;
+
+    return info == 0;
 }
 
 bool CommonSolverSuperLU::solve(Matrix *mat, cplx *res)
@@ -140,6 +161,11 @@ bool CommonSolverSuperLU::solve(Matrix *mat, double *res)
     _error("CommonSolverSuperLU::solve(Matrix *mat, double *res) not implemented.");
 }
 
+bool CommonSolverSuperLU::solve(Matrix *mat, double *res, int nrhs, int ldb)
+{
+    _error("CommonSolverSuperLU::solve(Matrix *mat, double *res, int nrhs, int ldb) not implemented.");
+}
+
 bool CommonSolverSuperLU::solve(Matrix *mat, cplx *res)
 {
     _error("CommonSolverSuperLU::solve(Matrix *mat, cplx *res) not implemented.");
@@ -0,0 +1,187 @@
+#include <iostream>
+#include <stdexcept>
+
+#include "matrix.h"
+#include "matrix_analysis.h"
+
+#define EPS 1e-12
+#define ERROR_SUCCESS                               0
+#define ERROR_FAILURE                              -1
+
+void _assert(bool a)
+{
+    if (!a) throw std::runtime_error("Assertion failed.");
+}
+
+// tridiagonal matrix (-1, 2, -1), only its upper triangle if symmetric
+void tridiagonal(CooMatrix *A, int size, bool symmetric)
+{
+    A->set_symmetric(symmetric);
+    for (int i = 0; i < size; i++)
+    {
+        A->add(i, i, 2.);
+        if (i + 1 < size)
+        {
+            A->add(i, i + 1, -1.);
+            if (!symmetric)
+                A->add(i + 1, i, -1.);
+        }
+    }
+}
+
+void test_matrix_structure()
+{
+    int size = 10;
+    CooMatrix coo(size);
+    tridiagonal(&coo, size, false);
+    CSRMatrix A(&coo);
+    MatrixStructure s = analyze_matrix(&A);
+    print_matrix_structure(&s);
+
+    _assert(s.size == size && s.nnz == 28 && !s.complex);
+    _assert(s.row_nnz_min == 2 && s.row_nnz_max == 3 && fabs(s.row_nnz_mean - 2.8) < EPS);
+    _assert(s.row_nnz_hist.size() == 3);
+    _assert(s.row_nnz_hist[0] == 0 && s.row_nnz_hist[1] == 2 && s.row_nnz_hist[2] == 8);
+    _assert(s.bandwidth == 1 && s.profile == 9);
+    _assert(s.structural_symmetry == 1.0 && s.numerically_symmetric);
+    _assert(s.dominant_rows == size && s.diagonally_dominant && s.missing_diagonal == 0);
+    _assert(s.bsr_nnzb[0] == 13);
+    _assert(s.bytes_csr == 11 * 4 + 28 * 12);
+    _assert(s.bytes_csr_symmetric == 11 * 4 + 19 * 12);
+    _assert(s.bytes_csr_float == 11 * 4 + 28 * 8);
+    _assert(s.bytes_dense == 800);
+    _assert(s.bytes_bsr[0] == 6 * 4 + 13 * (4 + 4 * 8));
+    // two chunks of 8 rows, 3 and 2 entries wide
+    _assert(s.sell_padded_nnz == 40);
+
+    // the upper triangle describes the same matrix
+    CooMatrix coo_sym(size);
+    tridiagonal(&coo_sym, size, true);
+    CSRMatrix S(&coo_sym);
+    _assert(S.is_symmetric());
+    MatrixStructure ss = analyze_matrix(&S);
+    _assert(ss.nnz == 28 && ss.bandwidth == 1 && ss.profile == 9 && ss.numerically_symmetric);
+    _assert(ss.bytes_csr_symmetric == s.bytes_csr_symmetric);
+
+    // an entry far from the diagonal without its transpose, and a row that
+    // is not dominant
+    coo.add(0, 5, 1.);
+    coo.add(7, 7, -1.);
+    CSRMatrix B(&coo);
+    MatrixStructure sb = analyze_matrix(&B);
+    _assert(sb.nnz == 29 && sb.bandwidth == 5 && sb.profile == 9);
+    _assert(fabs(sb.structural_symmetry - 18. / 19.) < EPS && !sb.numerically_symmetric);
+    _assert(sb.dominant_rows == size - 1 && !sb.diagonally_dominant);
+    _assert(sb.bytes_csr_symmetric == 11 * 4 + 20 * 12);
+
+    // complex values, a_ij = a_ji is not hermitian
+    CooMatrix cc(3, true);
+    cc.add(0, 0, cplx(4, 1));
+    cc.add(0, 1, cplx(1, 1));
+    cc.add(1, 0, cplx(1, 1));
+    cc.add(1, 1, cplx(4, 0));
+    cc.add(2, 1, cplx(0, 1));
+    CSRMatrix C(&cc);
+    MatrixStructure sc = analyze_matrix(&C);
+    _assert(sc.complex && sc.nnz == 5 && sc.missing_diagonal == 1);
+    _assert(sc.structural_symmetry == 2. / 3. && !sc.numerically_symmetric);
+    _assert(sc.bytes_csr == 4 * 4 + 5 * 20 && sc.bytes_csr_float == -1);
+}
+
+void test_format_advice()
+{
+    // 3 fields per node on a chain of nodes, dense 3 x 3 blocks
+    int nodes = 300, bsize = 3, size = nodes * bsize;
+    CooMatrix coo(size);
+    for (int n = 0; n < nodes; n++)
+        for (int m = std::max(n - 1, 0); m <= std::min(n + 1, nodes - 1); m++)
+            for (int i = 0; i < bsize; i++)
+                for (int j = 0; j < bsize; j++)
+                    coo.add(n * bsize + i, m * bsize + j, (n == m) ? (i == j ? 10. : 1.) : -1. - 0.1 * (n + m));
+    CSRMatrix A(&coo);
+
+    FormatAdvice advice = advise_format(&A, 0.01);
+    print_format_advice(&advice);
+    _assert(advice.time_csr > 0 && advice.time_csc > 0);
+    // symmetric, and bsize 3 has no padding
+    _assert(advice.time_csr_symmetric > 0 && advice.time_bsr[1] > 0);
+    // the 4 x 4 blocks are mostly padding
+    _assert(advice.time_bsr[2] < 0);
+    _assert(advice.threads == get_num_threads());
+
+    // the recommended matrix computes the same product
+    double *x = new double[size];
+    double *y = new double[size];
+    double *z = new double[size];
+    for (int i = 0; i < size; i++)
+        x[i] = 1. + i % 5;
+    A.times_vector(x, y, size);
+    for (int f = 0; f < 5; f++)
+    {
+        FormatAdvice a = advice;
+        a.format = (MatrixFormat) f;
+        a.bsize = bsize;
+        Matrix *B = create_matrix(&a, &A);
+        B->times_vector(x, z, size);
+        for (int i = 0; i < size; i++)
+            _assert(fabs(y[i] - z[i]) < 1e-10 * (1. + fabs(y[i])));
+        delete B;
+    }
+    delete[] x;
+    delete[] y;
+    delete[] z;
+
+    // the cached advice
+    const char *filename = "/tmp/hermes_common_format_advice.txt";
+    write_format_advice(filename, &advice);
+    FormatAdvice cached;
+    _assert(read_format_advice(filename, &cached));
+    remove(filename);
+    _assert(cached.format == advice.format && cached.bsize == advice.bsize && cached.chunk == advice.chunk &&
+            cached.sigma == advice.sigma && cached.threads == advice.threads);
+    _assert(!read_format_advice(filename, &cached));
+
+    // a complex matrix stored as its upper triangle
+    CooMatrix cc(size, true);
+    cc.set_symmetric(true);
+    for (int i = 0; i < size; i++)
+    {
+        cc.add(i, i, cplx(4, 1));
+        if (i + 1 < size)
+            cc.add(i, i + 1, cplx(-1, 0.5));
+    }
+    CSRMatrix C(&cc);
+    FormatAdvice ac = advise_format(&C, 0.01);
+    print_format_advice(&ac);
+    _assert(ac.time_csr > 0 && ac.time_csr_symmetric > 0);
+    Matrix *D = create_matrix(&ac, &C);
+    cplx *xc = new cplx[size];
+    cplx *yc = new cplx[size];
+    cplx *zc = new cplx[size];
+    for (int i = 0; i < size; i++)
+        xc[i] = cplx(1., i % 3);
+    C.times_vector(xc, yc, size);
+    D->times_vector(xc, zc, size);
+    for (int i = 0; i < size; i++)
+        _assert(std::abs(yc[i] - zc[i]) < 1e-10 * (1. + std::abs(yc[i])));
+    delete D;
+    delete[] xc;
+    delete[] yc;
+    delete[] zc;
+}
+
+int main(int argc, char* argv[])
+{
+    try {
+        test_matrix_structure();
+        test_format_advice();
+
+        return ERROR_SUCCESS;
+    } catch(std::exception const &ex) {
+        std::cout << "Exception raised: " << ex.what() << "\n";
+        return ERROR_FAILURE;
+    } catch(...) {
+        std::cout << "Exception raised." << "\n";
+        return ERROR_FAILURE;
+    }
+}
@@ -88,12 +88,1456 @@ void test_matrix3()
 
 }
 
+void test_matrix_triplets()
+{
+    // the same entries (including duplicates) in both storage modes
+    CooMatrix m(5);
+    CooMatrix t(5, false, CooMatrix::CooMatrixStorage_Triplets);
+    int rows[] = {3, 1, 4, 1, 0, 3, 2, 4, 1, 0};
+    int cols[] = {4, 3, 2, 3, 0, 4, 3, 2, 0, 4};
+    for (int k = 0; k < 10; k++)
+    {
+        m.add(rows[k], cols[k], 1.5 + k);
+        t.add(rows[k], cols[k], 1.5 + k);
+    }
+
+    int nnz = m.get_nnz();
+    _assert(t.get_nnz() == nnz);
+    _assert(t.get_size() == m.get_size());
+
+    int *row1 = new int[nnz];
+    int *col1 = new int[nnz];
+    double *data1 = new double[nnz];
+    int *row2 = new int[nnz];
+    int *col2 = new int[nnz];
+    double *data2 = new double[nnz];
+    m.get_row_col_data(row1, col1, data1);
+    t.get_row_col_data(row2, col2, data2);
+    for (int i = 0; i < nnz; i++)
+    {
+        _assert(row1[i] == row2[i]);
+        _assert(col1[i] == col2[i]);
+        _assert(data1[i] == data2[i]);
+    }
+    delete[] row1;
+    delete[] col1;
+    delete[] data1;
+    delete[] row2;
+    delete[] col2;
+    delete[] data2;
+
+    _assert(t.get(1, 3) == 2.5 + 4.5);
+    _assert(t.get(2, 2) == 0);
+
+    // adding after compression
+    t.add(2, 2, 1);
+    _assert(t.get_nnz() == nnz + 1);
+    _assert(t.get(2, 2) == 1);
+
+    // conversions work on the compressed data
+    CSRMatrix n1(&t);
+    _assert(n1.get_nnz() == nnz + 1);
+    CSCMatrix n2(&t);
+    _assert(n2.get_nnz() == nnz + 1);
+
+    // switching the storage keeps the entries
+    t.set_storage(CooMatrix::CooMatrixStorage_Map);
+    _assert(t.get_nnz() == nnz + 1);
+    _assert(t.get(1, 3) == 2.5 + 4.5);
+    m.set_storage(CooMatrix::CooMatrixStorage_Triplets);
+    _assert(m.get_nnz() == nnz);
+    _assert(m.get(3, 4) == 1.5 + 6.5);
+
+    // complex
+    CooMatrix c(3, true, CooMatrix::CooMatrixStorage_Triplets);
+    c.add(2, 1, cplx(1, 2));
+    c.add(0, 0, cplx(2, 1));
+    c.add(2, 1, cplx(3, 4));
+    _assert(c.get_nnz() == 2);
+    CSRMatrix n3(&c);
+    _assert(n3.get_Ax_cplx()[1] == cplx(4, 6));
+    _assert(c.get_cplx(2, 1) == cplx(4, 6));
+    _assert(c.get_cplx(1, 1) == cplx(0, 0));
+    c.set_storage(CooMatrix::CooMatrixStorage_Map);
+    _assert(c.get_cplx(0, 0) == cplx(2, 1));
+    bool complex_get = false;
+    try {
+        c.get(0, 0);
+    }
+    catch (std::runtime_error &) {
+        complex_get = true;
+    }
+    _assert(complex_get);
+}
+
+void test_matrix_refill()
+{
+    CooMatrix m(4);
+    m.add(0, 0, 4);
+    m.add(0, 1, -1);
+    m.add(1, 0, -1);
+    m.add(1, 1, 4);
+    m.add(1, 3, -1);
+    m.add(2, 2, 4);
+    m.add(3, 1, -1);
+    m.add(3, 3, 4);
+
+    CSRMatrix r(&m);
+    CSCMatrix c(&m);
+    int *Ap = r.get_Ap();
+    int *Ai = r.get_Ai();
+    double *Ax = r.get_Ax();
+
+    // reassemble twice the values into the same pattern
+    r.set_zero();
+    c.set_zero();
+    for (int i = 0; i < r.get_nnz(); i++)
+        _assert(r.get_Ax()[i] == 0 && c.get_Ax()[i] == 0);
+
+    int idx[2] = {1, 3};
+    double **mat = _new_matrix<double>(2, 2);
+    mat[0][0] = 2; mat[0][1] = -1;
+    mat[1][0] = -1; mat[1][1] = 2;
+    for (int k = 0; k < 2; k++)
+    {
+        r.add_block(idx, 2, idx, 2, mat);
+        c.add_block(idx, 2, idx, 2, mat);
+    }
+    r.add(0, 0, 1.5);
+    c.add(0, 0, 1.5);
+    delete[] mat;
+
+    // no reallocation
+    _assert(r.get_Ap() == Ap && r.get_Ai() == Ai && r.get_Ax() == Ax);
+
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            _assert(r.get(i, j) == c.get(i, j));
+    _assert(r.get(0, 0) == 1.5);
+    _assert(r.get(1, 1) == 4);
+    _assert(r.get(1, 3) == -2);
+    _assert(r.get(0, 1) == 0);
+    _assert(r.get(0, 3) == 0);
+
+    // entries outside of the pattern are rejected
+    bool failed = false;
+    try {
+        r.add(0, 3, 1.);
+    } catch(std::exception const &ex) {
+        failed = true;
+    }
+    _assert(failed);
+
+    // get() and get_cplx() check the type of the matrix
+    CooMatrix mc(2, true);
+    mc.add(0, 0, cplx(1, 2));
+    mc.add(1, 1, cplx(3, 0));
+    CSRMatrix rc(&mc);
+    CSCMatrix cc(&mc);
+    _assert(rc.get_cplx(0, 0) == cplx(1, 2) && cc.get_cplx(1, 1) == cplx(3, 0));
+    Matrix *wrong_type[4] = {&rc, &cc, &r, &c};
+    for (int k = 0; k < 4; k++)
+    {
+        failed = false;
+        try {
+            if (k < 2)
+                wrong_type[k]->get(0, 0);
+            else
+                wrong_type[k]->get_cplx(0, 0);
+        } catch(std::exception const &ex) {
+            failed = true;
+        }
+        _assert(failed);
+    }
+}
+
+void test_matrix_scatter_map()
+{
+    // two overlapping elements
+    int idx[2][3] = {{0, 2, 3}, {3, 1, -1}};
+    double **mat = _new_matrix<double>(3, 3);
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            mat[i][j] = 1 + i + 3*j;
+
+    CooMatrix m(4);
+    for (int e = 0; e < 2; e++)
+        m.add_block(idx[e], 3, idx[e], 3, mat);
+
+    CSRMatrix r(&m);
+    CSCMatrix c(&m);
+    ScatterMap rmaps[2];
+    ScatterMap cmaps[2];
+    for (int pass = 0; pass < 3; pass++)
+    {
+        r.set_zero();
+        c.set_zero();
+        for (int e = 0; e < 2; e++)
+        {
+            r.add_block(idx[e], 3, idx[e], 3, mat, &rmaps[e]);
+            c.add_block(idx[e], 3, idx[e], 3, mat, &cmaps[e]);
+        }
+        _assert(!rmaps[1].is_empty() && rmaps[1].get_offset(2, 0) == -1);
+
+        for (int i = 0; i < 4; i++)
+            for (int j = 0; j < 4; j++)
+            {
+                _assert(r.get(i, j) == m.get(i, j));
+                _assert(c.get(i, j) == m.get(i, j));
+            }
+    }
+    delete[] mat;
+}
+
+// converts the triplets to CSR and CSC, and sums their duplicates, in the
+// current parallel mode, returns the number of unique entries
+int convert(int size, int nnz, int *row, int *col, double *data,
+             int *Ap, int *Ai, double *Ax, int *Bp, int *Bi, double *Bx,
+             int *crow, int *ccol, double *cdata)
+{
+    coo_to_csr(size, nnz, row, col, data, Ap, Ai, Ax);
+    csr_to_csc(size, nnz, Ap, Ai, Ax, Bp, Bi, Bx);
+
+    CooMatrix m(size, false, CooMatrix::CooMatrixStorage_Triplets);
+    for (int i = 0; i < nnz; i++)
+        m.add(row[i], col[i], data[i]);
+    m.get_row_col_data(crow, ccol, cdata);
+    return m.get_nnz();
+}
+
+void test_matrix_parallel_conversions()
+{
+    // random matrix with duplicates, large enough for the parallel kernels
+    int size = 20000;
+    int nnz = 200000;
+    int *row = new int[nnz];
+    int *col = new int[nnz];
+    double *data = new double[nnz];
+    srand(1);
+    for (int i = 0; i < nnz; i++)
+    {
+        row[i] = rand() % size;
+        col[i] = (row[i] + rand() % 50) % size;
+        data[i] = (double) rand() / RAND_MAX;
+    }
+
+    int *p[2][6];
+    double *x[2][3];
+    for (int k = 0; k < 2; k++)
+    {
+        p[k][0] = new int[size + 1];
+        p[k][1] = new int[nnz];
+        p[k][2] = new int[size + 1];
+        p[k][3] = new int[nnz];
+        p[k][4] = new int[nnz];
+        p[k][5] = new int[nnz];
+        for (int i = 0; i < 3; i++)
+            x[k][i] = new double[nnz];
+    }
+
+    set_parallel_mode(ParallelMode_Serial);
+    _assert(get_num_threads() == 1);
+    int unique = convert(size, nnz, row, col, data, p[0][0], p[0][1], x[0][0], p[0][2], p[0][3], x[0][1], p[0][4], p[0][5], x[0][2]);
+
+    set_parallel_mode(ParallelMode_Parallel);
+    set_num_threads(4);
+    _assert(convert(size, nnz, row, col, data, p[1][0], p[1][1], x[1][0], p[1][2], p[1][3], x[1][1], p[1][4], p[1][5], x[1][2]) == unique);
+    set_num_threads(0);
+
+    // the results must be exactly the same
+    _assert(memcmp(p[0][0], p[1][0], (size + 1) * sizeof(int)) == 0);
+    _assert(memcmp(p[0][2], p[1][2], (size + 1) * sizeof(int)) == 0);
+    for (int k = 1; k < 6; k += 2)
+        _assert(memcmp(p[0][k], p[1][k], nnz * sizeof(int)) == 0);
+    for (int i = 0; i < 2; i++)
+        _assert(memcmp(x[0][i], x[1][i], nnz * sizeof(double)) == 0);
+    _assert(unique < nnz);
+    _assert(memcmp(p[0][4], p[1][4], unique * sizeof(int)) == 0);
+    _assert(memcmp(p[0][5], p[1][5], unique * sizeof(int)) == 0);
+    _assert(memcmp(x[0][2], x[1][2], unique * sizeof(double)) == 0);
+
+    for (int k = 0; k < 2; k++)
+    {
+        for (int i = 0; i < 6; i++)
+            delete[] p[k][i];
+        for (int i = 0; i < 3; i++)
+            delete[] x[k][i];
+    }
+    delete[] row;
+    delete[] col;
+    delete[] data;
+}
+
+void test_matrix_coo_to_compressed()
+{
+    CooMatrix m(6);
+    CooMatrix t(6, false, CooMatrix::CooMatrixStorage_Triplets);
+    int rows[] = {5, 1, 4, 1, 0, 3, 2, 4, 1, 0, 5};
+    int cols[] = {4, 3, 2, 3, 0, 5, 3, 2, 0, 4, 0};
+    for (int k = 0; k < 11; k++)
+    {
+        m.add(rows[k], cols[k], k - 2.5);
+        t.add(rows[k], cols[k], k - 2.5);
+    }
+
+    // directly from the map and from the triplets
+    CSRMatrix r1(&m);
+    CSRMatrix r2(&t);
+    CSCMatrix c1(&m);
+    CSCMatrix c2(&t);
+    // through the other compressed format
+    CSCMatrix c3(&r1);
+    CSRMatrix r3(&c1);
+
+    int nnz = m.get_nnz();
+    CSRMatrix *r[3] = {&r1, &r2, &r3};
+    CSCMatrix *c[3] = {&c1, &c2, &c3};
+    for (int k = 1; k < 3; k++)
+    {
+        _assert(r[k]->get_nnz() == nnz && c[k]->get_nnz() == nnz);
+        _assert(memcmp(r[k]->get_Ap(), r1.get_Ap(), 7 * sizeof(int)) == 0);
+        _assert(memcmp(r[k]->get_Ai(), r1.get_Ai(), nnz * sizeof(int)) == 0);
+        _assert(memcmp(r[k]->get_Ax(), r1.get_Ax(), nnz * sizeof(double)) == 0);
+        _assert(memcmp(c[k]->get_Ap(), c1.get_Ap(), 7 * sizeof(int)) == 0);
+        _assert(memcmp(c[k]->get_Ai(), c1.get_Ai(), nnz * sizeof(int)) == 0);
+        _assert(memcmp(c[k]->get_Ax(), c1.get_Ax(), nnz * sizeof(double)) == 0);
+    }
+    for (int i = 0; i < 6; i++)
+        for (int j = 0; j < 6; j++)
+            _assert(r1.get(i, j) == m.get(i, j) && c1.get(i, j) == m.get(i, j));
+}
+
+void test_matrix_view()
+{
+    // external arrays, e.g. owned by NumPy
+    int Ap[4] = {0, 2, 3, 5};
+    int Ai[5] = {0, 2, 1, 0, 2};
+    double Ax[5] = {1, 2, 3, 4, 5};
+
+    {
+        CSRMatrix v(3, 5, Ap, Ai, Ax, false);
+        _assert(!v.is_owner());
+        _assert(v.get_Ax() == Ax);
+        _assert(v.get(2, 0) == 4);
+
+        // the values are modified in place
+        v.set_zero();
+        v.add(0, 2, 1.5);
+        _assert(Ax[1] == 1.5);
+
+        CSCMatrix c(&v);
+        _assert(c.is_owner());
+        _assert(c.get(0, 2) == 1.5);
+
+        CSCMatrix w(3, 5, Ap, Ai, Ax, false);
+        _assert(w.get(2, 0) == 1.5);
+        // the views don't free the arrays
+    }
+    _assert(Ap[3] == 5 && Ai[4] == 2 && Ax[1] == 1.5);
+
+    // complex
+    cplx Bx[5];
+    {
+        CSRMatrix v(3, 5, Ap, Ai, Bx, false);
+        _assert(v.is_complex());
+        v.set_zero();
+        v.add(1, 1, cplx(1, 2));
+    }
+    _assert(Bx[2] == cplx(1, 2));
+}
+
+void test_matrix_times_vector()
+{
+    // random matrix, large enough for the parallel kernels
+    int size = 5000;
+    int nnz = 100000;
+    CooMatrix A(size, false, CooMatrix::CooMatrixStorage_Triplets);
+    CooMatrix B(size, true, CooMatrix::CooMatrixStorage_Triplets);
+    srand(1);
+    for (int i = 0; i < nnz; i++)
+    {
+        int r = rand() % size;
+        int c = (r + rand() % 50) % size;
+        double v = (double) rand() / RAND_MAX;
+        A.add(r, c, v);
+        B.add(r, c, cplx(v, 1 - v));
+    }
+
+    double *x = new double[size];
+    double *y = new double[size];
+    double *z = new double[size];
+    cplx *xc = new cplx[size];
+    cplx *yc = new cplx[size];
+    cplx *zc = new cplx[size];
+    for (int i = 0; i < size; i++)
+    {
+        x[i] = (double) rand() / RAND_MAX;
+        xc[i] = cplx(x[i], -x[i]);
+    }
+    A.times_vector(x, z, size);
+    B.times_vector(xc, zc, size);
+
+    CSRMatrix Ar(&A);
+    CSCMatrix Ac(&A);
+    CSRMatrix Br(&B);
+    CSCMatrix Bc(&B);
+
+    for (int mode = 0; mode < 2; mode++)
+    {
+        if (mode == 0)
+            set_parallel_mode(ParallelMode_Serial);
+        else
+        {
+            set_parallel_mode(ParallelMode_Parallel);
+            set_num_threads(4);
+        }
+
+        Ar.times_vector(x, y, size);
+        for (int i = 0; i < size; i++)
+            _assert(fabs(y[i] - z[i]) < 1e-12);
+        Ac.times_vector(x, y, size);
+        for (int i = 0; i < size; i++)
+            _assert(fabs(y[i] - z[i]) < 1e-12);
+        Br.times_vector(xc, yc, size);
+        for (int i = 0; i < size; i++)
+            _assert(std::abs(yc[i] - zc[i]) < 1e-12);
+        Bc.times_vector(xc, yc, size);
+        for (int i = 0; i < size; i++)
+            _assert(std::abs(yc[i] - zc[i]) < 1e-12);
+
+        // y = 2 A x - y, starting from y = A x
+        Ar.times_vector(x, y, 2., -1.);
+        for (int i = 0; i < size; i++)
+            _assert(fabs(y[i] - z[i]) < 1e-12);
+        Ac.times_vector(x, y, 2., -1.);
+        for (int i = 0; i < size; i++)
+            _assert(fabs(y[i] - z[i]) < 1e-12);
+        Br.times_vector(xc, yc, cplx(0, 1), cplx(1, -1));
+        for (int i = 0; i < size; i++)
+            _assert(std::abs(yc[i] - zc[i]) < 1e-11);
+        Bc.times_vector(xc, yc, cplx(0, 1), cplx(1, -1));
+        for (int i = 0; i < size; i++)
+            _assert(std::abs(yc[i] - zc[i]) < 1e-11);
+    }
+    set_num_threads(0);
+
+    delete[] x;
+    delete[] y;
+    delete[] z;
+    delete[] xc;
+    delete[] yc;
+    delete[] zc;
+}
+
+void test_matrix_bsr()
+{
+    // random matrix with a node structure, the size is not a multiple of
+    // most block sizes
+    int size = 301;
+    CooMatrix A(size);
+    CooMatrix Ac(size, true);
+    for (int i = 0; i < size; i++)
+    {
+        A.add(i, i, 1.);
+        Ac.add(i, i, cplx(1.));
+    }
+    srand(1);
+    for (int i = 0; i < 3000; i++)
+    {
+        int r = rand() % size;
+        int c = (r + rand() % 20) % size;
+        double v = (double) rand() / RAND_MAX;
+        A.add(r, c, v);
+        Ac.add(r, c, cplx(v, -2 * v));
+    }
+    CSRMatrix Ar(&A);
+    CSRMatrix Acr(&Ac);
+
+    double *x = new double[size];
+    double *y = new double[size];
+    double *z = new double[size];
+    cplx *xc = new cplx[size];
+    cplx *yc = new cplx[size];
+    cplx *zc = new cplx[size];
+    for (int i = 0; i < size; i++)
+    {
+        x[i] = (double) rand() / RAND_MAX;
+        xc[i] = cplx(1, x[i]);
+    }
+    Ar.times_vector(x, z, size);
+    Acr.times_vector(xc, zc, size);
+
+    for (int b = 1; b <= 9; b++)
+    {
+        BSRMatrix B(&A, b);
+        BSRMatrix Bc(&Ac, b);
+        _assert(B.get_bsize() == b);
+        _assert(B.get_nb() == (size + b - 1) / b);
+        _assert(B.get_nnz() >= Ar.get_nnz());
+
+        // entries
+        for (int i = 0; i < size; i += 7)
+            for (int j = 0; j < size; j += 3)
+            {
+                _assert(B.get(i, j) == Ar.get(i, j));
+                _assert(Bc.get_cplx(i, j) == Acr.get_cplx(i, j));
+            }
+
+        // products (the specialized kernels and the generic one for b = 1, 9)
+        B.times_vector(x, y, size);
+        for (int i = 0; i < size; i++)
+            _assert(fabs(y[i] - z[i]) < 1e-12);
+        B.times_vector(x, y, -1., 2.);
+        for (int i = 0; i < size; i++)
+            _assert(fabs(y[i] - z[i]) < 1e-12);
+        Bc.times_vector(xc, yc, size);
+        for (int i = 0; i < size; i++)
+            _assert(std::abs(yc[i] - zc[i]) < 1e-12);
+
+        // expansion, the zeros of the blocks are kept
+        CSRMatrix E(&B);
+        CSCMatrix F(&B);
+        _assert(E.get_nnz() == B.get_nnz());
+        _assert(F.get_nnz() == B.get_nnz());
+        for (int i = 0; i < size; i += 5)
+            for (int j = 0; j < size; j += 2)
+            {
+                _assert(E.get(i, j) == Ar.get(i, j));
+                _assert(F.get(i, j) == Ar.get(i, j));
+            }
+
+        // reassembly in place, within the blocks even outside of the
+        // original pattern
+        B.set_zero();
+        int iidx[2] = {0, 1 % size};
+        int jidx[3] = {0, -1, 1};
+        double row0[3] = {1., 2., 3.};
+        double row1[3] = {4., 5., 6.};
+        double *mat[2] = {row0, row1};
+        B.add_block(iidx, b > 1 ? 2 : 1, jidx, b > 1 ? 3 : 1, mat);
+        B.add(0, 0, 10.);
+        _assert(B.get(0, 0) == 11.);
+        if (b > 1)
+        {
+            _assert(B.get(0, 1) == 3.);
+            _assert(B.get(1, 0) == 4.);
+            _assert(B.get(1, 1) == 6.);
+        }
+        bool not_in_pattern = false;
+        try {
+            B.add(0, size - 1, 1.);
+        }
+        catch (std::runtime_error &) {
+            not_in_pattern = true;
+        }
+        _assert(not_in_pattern || B.get(0, size - 1) == 1.);
+    }
+
+    delete[] x;
+    delete[] y;
+    delete[] z;
+    delete[] xc;
+    delete[] yc;
+    delete[] zc;
+}
+
+void test_matrix_sell()
+{
+    // rows of very different lengths, the size is not a multiple of the
+    // chunk heights
+    int size = 1003;
+    CooMatrix A(size);
+    CooMatrix Ac(size, true);
+    srand(1);
+    for (int i = 0; i < size; i++)
+    {
+        int len = (i % 17 == 0) ? 60 : 1 + rand() % 8;
+        for (int k = 0; k < len; k++)
+        {
+            int j = (i + rand() % 200) % size;
+            double v = (double) rand() / RAND_MAX;
+            A.add(i, j, v);
+            Ac.add(i, j, cplx(v, v - 1));
+        }
+    }
+    CSRMatrix Ar(&A);
+    CSRMatrix Acr(&Ac);
+
+    double *x = new double[size];
+    double *y = new double[size];
+    double *z = new double[size];
+    cplx *xc = new cplx[size];
+    cplx *yc = new cplx[size];
+    cplx *zc = new cplx[size];
+    for (int i = 0; i < size; i++)
+    {
+        x[i] = (double) rand() / RAND_MAX;
+        xc[i] = cplx(x[i], 2);
+    }
+    Ar.times_vector(x, z, size);
+    Acr.times_vector(xc, zc, size);
+
+    int chunks[4] = {1, 4, 8, 6};
+    int sigmas[3] = {1, 32, 4096};
+    for (int ic = 0; ic < 4; ic++)
+        for (int is = 0; is < 3; is++)
+        {
+            SELLMatrix S(&Ar, chunks[ic], sigmas[is]);
+            SELLMatrix Sc(&Acr, chunks[ic], sigmas[is]);
+            _assert(S.get_nnz() == Ar.get_nnz());
+            _assert(S.get_padded_nnz() >= S.get_nnz());
+
+            S.times_vector(x, y, size);
+            for (int i = 0; i < size; i++)
+                _assert(fabs(y[i] - z[i]) < 1e-12);
+            S.times_vector(x, y, 3., -2.);
+            for (int i = 0; i < size; i++)
+                _assert(fabs(y[i] - z[i]) < 1e-12);
+            Sc.times_vector(xc, yc, size);
+            for (int i = 0; i < size; i++)
+                _assert(std::abs(yc[i] - zc[i]) < 1e-12);
+
+            // back to CSR and CSC
+            CSRMatrix B(&S);
+            CSCMatrix C(&S);
+            CSCMatrix Ref(&Ar);
+            _assert(memcmp(B.get_Ap(), Ar.get_Ap(), (size + 1) * sizeof(int)) == 0);
+            _assert(memcmp(B.get_Ai(), Ar.get_Ai(), Ar.get_nnz() * sizeof(int)) == 0);
+            _assert(memcmp(B.get_Ax(), Ar.get_Ax(), Ar.get_nnz() * sizeof(double)) == 0);
+            _assert(memcmp(C.get_Ai(), Ref.get_Ai(), Ar.get_nnz() * sizeof(int)) == 0);
+            _assert(memcmp(C.get_Ax(), Ref.get_Ax(), Ar.get_nnz() * sizeof(double)) == 0);
+
+            // entries
+            for (int i = 0; i < size; i += 3)
+            {
+                int *Ap = Ar.get_Ap();
+                int *Ai = Ar.get_Ai();
+                for (int k = Ap[i]; k < Ap[i+1]; k++)
+                {
+                    _assert(S.get(i, Ai[k]) == Ar.get_Ax()[k]);
+                    _assert(Sc.get_cplx(i, Ai[k]) == Acr.get_Ax_cplx()[k]);
+                }
+            }
+            S.set_zero();
+            S.add(17, Ar.get_Ai()[Ar.get_Ap()[17]], 2.5);
+            _assert(S.get(17, Ar.get_Ai()[Ar.get_Ap()[17]]) == 2.5);
+        }
+
+    delete[] x;
+    delete[] y;
+    delete[] z;
+    delete[] xc;
+    delete[] yc;
+    delete[] zc;
+}
+
+void test_matrix_symmetric()
+{
+    // the upper triangle (S) against the full matrix (F), half of the lower
+    // entries are added below the diagonal
+    int size = 2000;
+    CooMatrix S(size);
+    CooMatrix Sc(size, true);
+    CooMatrix F(size);
+    S.set_symmetric(true);
+    Sc.set_symmetric(true);
+    srand(3);
+    for (int i = 0; i < size; i++)
+    {
+        S.add(i, i, 10.);
+        Sc.add(i, i, cplx(10., 1.));
+        F.add(i, i, 10.);
+        if (i + 1 < size)
+        {
+            S.add(i, i + 1, 1.);
+            Sc.add(i + 1, i, cplx(1.));
+            F.add(i, i + 1, 1.);
+            F.add(i + 1, i, 1.);
+        }
+        for (int k = 0; k < 6; k++)
+        {
+            int j = (i + 1 + rand() % 300) % size;
+            double v = (double) rand() / RAND_MAX;
+            if (k % 2)
+            {
+                S.add(j, i, v);
+                Sc.add(j, i, cplx(v, -v));
+            }
+            else
+            {
+                S.add(i, j, v);
+                Sc.add(i, j, cplx(v, -v));
+            }
+            F.add(i, j, v);
+            F.add(j, i, v);
+        }
+    }
+    _assert(S.get(5, 2) == S.get(2, 5));
+    CSRMatrix Sr(&S);
+    CSRMatrix Scr(&Sc);
+    CSRMatrix Fr(&F);
+    _assert(Sr.is_symmetric() && Scr.is_symmetric() && !Fr.is_symmetric());
+    _assert(2 * Sr.get_nnz() - size == Fr.get_nnz());
+
+    double *x = new double[size];
+    double *y = new double[size];
+    double *z = new double[size];
+    cplx *xc = new cplx[size];
+    cplx *yc = new cplx[size];
+    cplx *zc = new cplx[size];
+    for (int i = 0; i < size; i++)
+    {
+        x[i] = (double) rand() / RAND_MAX;
+        xc[i] = cplx(x[i], 1 - x[i]);
+    }
+    Fr.times_vector(x, z, size);
+
+    S.times_vector(x, y, size);
+    for (int i = 0; i < size; i++)
+        _assert(fabs(y[i] - z[i]) < 1e-12);
+    for (int threads = 1; threads <= 4; threads += 3)
+    {
+        set_num_threads(threads);
+        Sr.times_vector(x, y, size);
+        for (int i = 0; i < size; i++)
+            _assert(fabs(y[i] - z[i]) < 1e-12);
+        Sr.times_vector(x, y, 2., -1.);
+        for (int i = 0; i < size; i++)
+            _assert(fabs(y[i] - z[i]) < 1e-12);
+
+        Scr.times_vector(xc, yc, size);
+        Sc.times_vector(xc, zc, size);
+        for (int i = 0; i < size; i++)
+            _assert(std::abs(yc[i] - zc[i]) < 1e-12);
+    }
+    set_num_threads(0);
+
+    // the other formats get the full matrix
+    CSCMatrix C(&Sr);
+    CSCMatrix Cc(&S);
+    CSCMatrix Ref(&Fr);
+    _assert(C.get_nnz() == Ref.get_nnz() && Cc.get_nnz() == Ref.get_nnz());
+    _assert(memcmp(C.get_Ap(), Ref.get_Ap(), (size + 1) * sizeof(int)) == 0);
+    _assert(memcmp(C.get_Ai(), Ref.get_Ai(), Ref.get_nnz() * sizeof(int)) == 0);
+    _assert(memcmp(Cc.get_Ai(), Ref.get_Ai(), Ref.get_nnz() * sizeof(int)) == 0);
+    for (int k = 0; k < Ref.get_nnz(); k++)
+        _assert(fabs(C.get_Ax()[k] - Ref.get_Ax()[k]) < 1e-14);
+    BSRMatrix B(&Sr, 4);
+    _assert(B.get_nnz() <= 16 * B.get_nnzb());
+    B.times_vector(x, y, size);
+    for (int i = 0; i < size; i++)
+        _assert(fabs(y[i] - z[i]) < 1e-12);
+    DenseMatrix D(&S);
+    _assert(D.get_A()[7][3] == F.get(7, 3) && D.get_A()[3][7] == F.get(3, 7));
+
+    CSRMatrix E(&S);
+    E.expand_symmetric();
+    _assert(!E.is_symmetric());
+    _assert(memcmp(E.get_Ap(), Fr.get_Ap(), (size + 1) * sizeof(int)) == 0);
+    _assert(memcmp(E.get_Ai(), Fr.get_Ai(), Fr.get_nnz() * sizeof(int)) == 0);
+
+    // add() folds the lower triangle, add_block() takes the upper part of
+    // the (symmetric) block only
+    Sr.set_zero();
+    int idx[2] = {11, 10};
+    double block[2][2] = {{4, -1}, {-1, 4}};
+    double *rows[2] = {block[0], block[1]};
+    Sr.add(10, 10, 4.);
+    Sr.add(11, 10, 0.5);
+    _assert(Sr.get(10, 11) == 0.5 && Sr.get(11, 10) == 0.5);
+    ScatterMap map;
+    Sr.add_block(idx, 2, idx, 2, rows);
+    Sr.add_block(idx, 2, idx, 2, rows, &map);
+    _assert(Sr.get(10, 10) == 12. && Sr.get(11, 11) == 8. && Sr.get(11, 10) == -1.5);
+
+    bool not_empty = false;
+    try {
+        F.set_symmetric(true);
+    }
+    catch (std::runtime_error &) {
+        not_empty = true;
+    }
+    _assert(not_empty);
+
+    delete[] x;
+    delete[] y;
+    delete[] z;
+    delete[] xc;
+    delete[] yc;
+    delete[] zc;
+}
+
+void test_matrix_csr64()
+{
+    int size = 3000;
+    CooMatrix A(size);
+    CooMatrix At(size, false, CooMatrix::CooMatrixStorage_Triplets);
+    CooMatrix Ac(size, true);
+    srand(5);
+    for (int i = 0; i < size; i++)
+        for (int k = 0; k < 8; k++)
+        {
+            int j = rand() % size;
+            double v = (double) rand() / RAND_MAX;
+            A.add(i, j, v);
+            At.add(i, j, v);
+            Ac.add(i, j, cplx(v, 1 - v));
+        }
+    CSRMatrix Ar(&A);
+    CSRMatrix64 B(&A);
+    CSRMatrix64 Bt(&At);
+    CSRMatrix64 Bc(&Ac);
+    _assert(B.get_nnz() == Ar.get_nnz() && Bt.get_nnz() == Ar.get_nnz() && B.fits_int());
+    for (int i = 0; i <= size; i++)
+        _assert(B.get_Ap()[i] == Ar.get_Ap()[i] && Bt.get_Ap()[i] == Ar.get_Ap()[i]);
+    for (int k = 0; k < Ar.get_nnz(); k++)
+    {
+        _assert(B.get_Ai()[k] == Ar.get_Ai()[k] && Bt.get_Ai()[k] == Ar.get_Ai()[k]);
+        _assert(B.get_Ax()[k] == Ar.get_Ax()[k] && fabs(Bt.get_Ax()[k] - Ar.get_Ax()[k]) < 1e-14);
+    }
+
+    // the templates with 64-bit indices give the same results, serial and
+    // in parallel
+    long long nnz = B.get_nnz();
+    long long *Cp = new long long[size + 1];
+    long long *Ci = new long long[nnz];
+    double *Cx = new double[nnz];
+    CSCMatrix Ref(&Ar);
+    double *x = new double[size];
+    double *y = new double[size];
+    double *z = new double[size];
+    for (int i = 0; i < size; i++)
+        x[i] = (double) rand() / RAND_MAX;
+    Ar.times_vector(x, z, size);
+    for (int threads = 1; threads <= 4; threads += 3)
+    {
+        set_num_threads(threads);
+        csr_to_csc(size, nnz, B.get_Ap(), B.get_Ai(), B.get_Ax(), Cp, Ci, Cx);
+        for (int i = 0; i <= size; i++)
+            _assert(Cp[i] == Ref.get_Ap()[i]);
+        for (int k = 0; k < nnz; k++)
+            _assert(Ci[k] == Ref.get_Ai()[k] && Cx[k] == Ref.get_Ax()[k]);
+
+        B.times_vector(x, y, size);
+        for (int i = 0; i < size; i++)
+            _assert(y[i] == z[i]);
+        csc_times_vector(size, Cp, Ci, Cx, x, y);
+        for (int i = 0; i < size; i++)
+            _assert(fabs(y[i] - z[i]) < 1e-12);
+    }
+    set_num_threads(0);
+
+    // narrowing
+    CSRMatrix N(&B);
+    CSCMatrix Nc((Matrix *) &Bc);
+    _assert(N.get_nnz() == Ar.get_nnz());
+    _assert(memcmp(N.get_Ai(), Ar.get_Ai(), Ar.get_nnz() * sizeof(int)) == 0);
+    _assert(Nc.get_nnz() == Ar.get_nnz());
+
+    // reassembly
+    B.set_zero();
+    int j = Ar.get_Ai()[Ar.get_Ap()[7]];
+    B.add(7, j, 1.5);
+    _assert(B.get(7, j) == 1.5);
+    CSRMatrix Acr(&Ac);
+    _assert(Bc.get_cplx(7, j) == Acr.get_cplx(7, j));
+
+    delete[] Cp;
+    delete[] Ci;
+    delete[] Cx;
+    delete[] x;
+    delete[] y;
+    delete[] z;
+}
+
+void test_matrix_float()
+{
+    int size = 3000;
+    CooMatrix A(size);
+    srand(6);
+    for (int i = 0; i < size; i++)
+        for (int k = 0; k < 8; k++)
+            A.add(i, rand() % size, (double) rand() / RAND_MAX);
+    CSRMatrix Ar(&A);
+    CSRMatrixFloat F(&Ar);
+    CSCMatrixFloat G(&A);
+    _assert(F.get_nnz() == Ar.get_nnz() && G.get_nnz() == Ar.get_nnz());
+    _assert(memcmp(F.get_Ai(), Ar.get_Ai(), Ar.get_nnz() * sizeof(int)) == 0);
+    for (int k = 0; k < Ar.get_nnz(); k++)
+        _assert(F.get_Ax()[k] == (float) Ar.get_Ax()[k]);
+
+    // the products only differ by the rounding of the entries, serial and
+    // in parallel
+    double *x = new double[size];
+    double *y = new double[size];
+    double *z = new double[size];
+    for (int i = 0; i < size; i++)
+        x[i] = (double) rand() / RAND_MAX;
+    Ar.times_vector(x, z, size);
+    for (int threads = 1; threads <= 4; threads += 3)
+    {
+        set_num_threads(threads);
+        F.times_vector(x, y, size);
+        for (int i = 0; i < size; i++)
+            _assert(fabs(y[i] - z[i]) < 1e-6 * fabs(z[i]));
+        G.times_vector(x, y, size);
+        for (int i = 0; i < size; i++)
+            _assert(fabs(y[i] - z[i]) < 1e-6 * fabs(z[i]));
+        G.times_vector(x, y, 2.0, -1.0);
+        for (int i = 0; i < size; i++)
+            _assert(fabs(y[i] - z[i]) < 1e-6 * fabs(z[i]));
+    }
+    set_num_threads(0);
+
+    // reassembly
+    int j = Ar.get_Ai()[Ar.get_Ap()[7]];
+    F.set_zero();
+    F.add(7, j, 1.5);
+    _assert(F.get(7, j) == 1.5);
+    G.add(7, j, 0.5);
+    _assert(fabs(G.get(7, j) - Ar.get(7, j) - 0.5) < 1e-6);
+
+    // widened back to double, in both formats
+    CSRMatrix Fr(&F);
+    CSCMatrix Fc(&F);
+    CSRMatrix Gr(&G);
+    _assert(Fr.get(7, j) == 1.5 && Fc.get(7, j) == 1.5 && Gr.get(7, j) == G.get(7, j));
+    _assert(Fr.get_nnz() == F.get_nnz() && Gr.get_nnz() == G.get_nnz());
+    _assert(memcmp(Gr.get_Ai(), Ar.get_Ai(), Ar.get_nnz() * sizeof(int)) == 0);
+    for (int k = 0; k < Ar.get_nnz(); k++)
+        _assert(Fr.get_Ax()[k] == F.get_Ax()[k]);
+
+    delete[] x;
+    delete[] y;
+    delete[] z;
+}
+
+void test_matrix_typed()
+{
+    int size = 500;
+    CooMatrix A(size);
+    CooMatrix Ac(size, true);
+    srand(7);
+    for (int i = 0; i < size; i++)
+        for (int k = 0; k < 6; k++)
+        {
+            int j = rand() % size;
+            double v = (double) rand() / RAND_MAX;
+            A.add(i, j, v);
+            Ac.add(i, j, cplx(v, 1 - v));
+        }
+    CSRMatrix Ar(&A);
+    CSRMatrix Acr(&Ac);
+
+    // the same products as the runtime typed matrices
+    CSRMatrixDouble D(&A);
+    CSCMatrixDouble Dc(&Ar);
+    CSRMatrixCplx C(&Ac);
+    CSCMatrixCplx Cc(&Acr);
+    _assert(!D.is_complex() && C.is_complex() && Cc.is_complex());
+    double *x = new double[size];
+    double *y = new double[size];
+    double *z = new double[size];
+    cplx *xc = new cplx[size];
+    cplx *yc = new cplx[size];
+    cplx *zc = new cplx[size];
+    for (int i = 0; i < size; i++)
+    {
+        x[i] = (double) rand() / RAND_MAX;
+        xc[i] = cplx(x[i], 1 - x[i]);
+    }
+    Ar.times_vector(x, z, size);
+    D.times_vector(x, y, size);
+    for (int i = 0; i < size; i++)
+        _assert(y[i] == z[i]);
+    Dc.times_vector(x, y, size);
+    for (int i = 0; i < size; i++)
+        _assert(fabs(y[i] - z[i]) < 1e-12);
+    Acr.times_vector(xc, zc, size);
+    C.times_vector(xc, yc, size);
+    for (int i = 0; i < size; i++)
+        _assert(yc[i] == zc[i]);
+    Cc.times_vector(xc, yc, size);
+    for (int i = 0; i < size; i++)
+        _assert(std::abs(yc[i] - zc[i]) < 1e-12);
+
+    // a real matrix is promoted, a complex one is not narrowed
+    CSRMatrixCplx P(&A);
+    _assert(P.is_complex() && P.get_nnz() == Ar.get_nnz());
+    int j = Ar.get_Ai()[Ar.get_Ap()[3]];
+    _assert(P.get_cplx(3, j) == cplx(Ar.get(3, j)));
+    bool failed = false;
+    try {
+        CSRMatrixDouble N(&Ac);
+    } catch(std::exception const &ex) {
+        failed = true;
+    }
+    _assert(failed);
+
+    // reassembly
+    C.set_zero();
+    C.add(3, j, cplx(1.0, 2.0));
+    C.add(3, j, 0.5);
+    _assert(C.get_cplx(3, j) == cplx(1.5, 2.0));
+
+    // converted back to the runtime typed matrices
+    CSRMatrix Br(&C);
+    CSCMatrix Bc(&C);
+    CSRMatrix Er(&Cc);
+    CSCMatrix Dcc(&Dc);
+    _assert(Br.is_complex() && Bc.is_complex() && Er.is_complex() && !Dcc.is_complex());
+    _assert(Br.get_cplx(3, j) == cplx(1.5, 2.0) && Bc.get_cplx(3, j) == cplx(1.5, 2.0));
+    _assert(Er.get_nnz() == Acr.get_nnz() && Dcc.get_nnz() == Ar.get_nnz());
+    Er.times_vector(xc, yc, size);
+    for (int i = 0; i < size; i++)
+        _assert(std::abs(yc[i] - zc[i]) < 1e-12);
+    Dcc.times_vector(x, y, size);
+    for (int i = 0; i < size; i++)
+        _assert(fabs(y[i] - z[i]) < 1e-12);
+
+    delete[] x;
+    delete[] y;
+    delete[] z;
+    delete[] xc;
+    delete[] yc;
+    delete[] zc;
+}
+
+// assembles a matrix with many duplicates by n threads, the elements are
+// given to the threads in a different order for each thread count
+void assemble_parallel(CooMatrix *A, int n, int elements, int size)
+{
+    CooAssembler assembler(A, n);
+#pragma omp parallel for num_threads(n) schedule(dynamic, 7)
+    for (int e = 0; e < elements; e++)
+    {
+        int el = (n % 2) ? elements - 1 - e : e;
+        int idx[3];
+        double block[3][3];
+        double *rows[3] = {block[0], block[1], block[2]};
+        for (int i = 0; i < 3; i++)
+        {
+            idx[i] = (el * 7 + i * 13) % size;
+            for (int j = 0; j < 3; j++)
+                block[i][j] = 1.0 / (1 + el + i + 3*j);
+        }
+        assembler.add_block(idx, 3, idx, 3, rows);
+    }
+    assembler.merge();
+}
+
+void test_matrix_parallel_assembly()
+{
+    int size = 1000, elements = 20000;
+
+    // the map storage sums the duplicates in the order of the elements
+    CooMatrix R(size);
+    for (int el = 0; el < elements; el++)
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+                R.add((el * 7 + i * 13) % size, (el * 7 + j * 13) % size, 1.0 / (1 + el + i + 3*j));
+    CSRMatrix Rr(&R);
+
+    CooMatrix A1(size);
+    assemble_parallel(&A1, 1, elements, size);
+    _assert(A1.get_storage() == CooMatrix::CooMatrixStorage_Triplets);
+    CSRMatrix B1(&A1);
+    _assert(B1.get_nnz() == Rr.get_nnz());
+    _assert(memcmp(B1.get_Ap(), Rr.get_Ap(), (size + 1) * sizeof(int)) == 0);
+    _assert(memcmp(B1.get_Ai(), Rr.get_Ai(), Rr.get_nnz() * sizeof(int)) == 0);
+    for (int k = 0; k < Rr.get_nnz(); k++)
+        _assert(fabs(B1.get_Ax()[k] - Rr.get_Ax()[k]) < 1e-12);
+
+    // bitwise the same for any number of threads and order of the elements
+    for (int n = 2; n <= 4; n++)
+    {
+        CooMatrix An(size);
+        assemble_parallel(&An, n, elements, size);
+        CSRMatrix Bn(&An);
+        _assert(Bn.get_nnz() == B1.get_nnz());
+        _assert(memcmp(Bn.get_Ai(), B1.get_Ai(), B1.get_nnz() * sizeof(int)) == 0);
+        _assert(memcmp(Bn.get_Ax(), B1.get_Ax(), B1.get_nnz() * sizeof(double)) == 0);
+    }
+
+    // complex symmetric, merged into the existing entries
+    CooMatrix C(size, true);
+    C.set_symmetric(true);
+    C.add(5, 5, cplx(1, 1));
+    CooAssembler assembler(&C, 3);
+#pragma omp parallel for num_threads(3)
+    for (int i = 0; i < size; i++)
+    {
+        assembler.add(i, (i + 1) % size, cplx(0, 1));
+        assembler.add((i + 1) % size, i, cplx(2, 0));
+    }
+    _assert(assembler.get_buffered_nnz() == 2 * size);
+    assembler.merge();
+    _assert(assembler.get_buffered_nnz() == 0);
+    _assert(C.get_nnz() == size + 1);
+    CSRMatrix Cr(&C);
+    _assert(Cr.is_symmetric());
+    _assert(Cr.get_cplx(5, 5) == cplx(1, 1));
+    _assert(Cr.get_cplx(6, 5) == cplx(2, 1));
+    _assert(Cr.get_cplx(0, size - 1) == cplx(2, 1));
+}
+
+void test_matrix_rcm()
+{
+    // 5-point Laplacian on an n x n grid with a random numbering of the nodes,
+    // plus a second component (a path) that is not connected to the grid
+    int n = 30, size = n*n + 10;
+    int *num = new int[size];
+    for (int i = 0; i < size; i++)
+        num[i] = i;
+    srand(8);
+    for (int i = size - 1; i > 0; i--)
+        std::swap(num[i], num[rand() % (i + 1)]);
+    CooMatrix A(size);
+    CooMatrix U(size);
+    U.set_symmetric(true);
+    for (int y = 0; y < n; y++)
+        for (int x = 0; x < n; x++)
+        {
+            int i = num[x + n*y];
+            A.add(i, i, 4.0);
+            U.add(i, i, 4.0);
+            if (x > 0) { A.add(i, num[x-1 + n*y], -1.0 - x); U.add(i, num[x-1 + n*y], -1.0 - x); }
+            if (x < n-1) { A.add(i, num[x+1 + n*y], -2.0 - x); U.add(num[x+1 + n*y], i, -2.0 - x); }
+            if (y > 0) { A.add(i, num[x + n*(y-1)], -1.0); U.add(i, num[x + n*(y-1)], -1.0); }
+            if (y < n-1) { A.add(i, num[x + n*(y+1)], -1.0); }
+        }
+    for (int k = n*n; k < size; k++)
+    {
+        A.add(num[k], num[k], 1.0);
+        if (k > n*n) A.add(num[k], num[k-1], 0.5);
+    }
+    CSRMatrix Ar(&A);
+
+    int *perm = new int[size];
+    Ar.get_rcm_ordering(perm);
+    bool *seen = new bool[size];
+    std::fill(seen, seen + size, false);
+    for (int i = 0; i < size; i++)
+    {
+        _assert(perm[i] >= 0 && perm[i] < size && !seen[perm[i]]);
+        seen[perm[i]] = true;
+    }
+
+    // the bandwidth of the grid is about n
+    CSRMatrix B(&A);
+    B.permute(perm);
+    _assert(csr_bandwidth(size, Ar.get_Ap(), Ar.get_Ai()) > size / 2);
+    _assert(csr_bandwidth(size, B.get_Ap(), B.get_Ai()) <= 2 * n);
+    _assert(B.get_nnz() == Ar.get_nnz());
+    for (int i = 0; i < size; i++)
+    {
+        for (int k = B.get_Ap()[i]; k < B.get_Ap()[i+1]; k++)
+        {
+            if (k > B.get_Ap()[i])
+                _assert(B.get_Ai()[k-1] < B.get_Ai()[k]);
+            _assert(B.get_Ax()[k] == Ar.get(perm[i], perm[B.get_Ai()[k]]));
+        }
+    }
+
+    // P A x = (P A P^T) P x, also for the symmetric storage and for CSC
+    double *x = new double[size];
+    double *y = new double[size];
+    double *z = new double[size];
+    double *px = new double[size];
+    for (int i = 0; i < size; i++)
+        x[i] = (double) rand() / RAND_MAX;
+    Ar.times_vector(x, y, size);
+    permute_vector(size, perm, x, px);
+    B.times_vector(px, z, size);
+    unpermute_vector(size, perm, z, px);
+    for (int i = 0; i < size; i++)
+        _assert(fabs(px[i] - y[i]) < 1e-12);
+
+    CSRMatrix S(&U);
+    _assert(S.is_symmetric());
+    CSRMatrix Sf(&U);
+    Sf.expand_symmetric();
+    Sf.times_vector(x, y, size);
+    S.permute(perm);
+    _assert(S.is_symmetric());
+    for (int i = 0; i < size; i++)
+        for (int k = S.get_Ap()[i]; k < S.get_Ap()[i+1]; k++)
+            _assert(S.get_Ai()[k] >= i);
+    permute_vector(size, perm, x, px);
+    S.times_vector(px, z, size);
+    unpermute_vector(size, perm, z, px);
+    for (int i = 0; i < size; i++)
+        _assert(fabs(px[i] - y[i]) < 1e-12);
+
+    CSCMatrix C(&A);
+    C.permute(perm);
+    Ar.times_vector(x, y, size);
+    permute_vector(size, perm, x, px);
+    C.times_vector(px, z, size);
+    unpermute_vector(size, perm, z, px);
+    for (int i = 0; i < size; i++)
+        _assert(fabs(px[i] - y[i]) < 1e-12);
+
+    delete[] num;
+    delete[] perm;
+    delete[] seen;
+    delete[] x;
+    delete[] y;
+    delete[] z;
+    delete[] px;
+}
+
+// number of entries of the Cholesky factor of P A P^T (symmetric pattern),
+// by the elimination of the graph
+int cholesky_fill(int size, int *Ap, int *Ai, int *perm)
+{
+    int *inv = new int[size];
+    for (int i = 0; i < size; i++)
+        inv[perm[i]] = i;
+    std::vector<std::vector<bool> > G(size, std::vector<bool>(size, false));
+    for (int i = 0; i < size; i++)
+        for (int k = Ap[i]; k < Ap[i+1]; k++)
+        {
+            G[inv[i]][inv[Ai[k]]] = true;
+            G[inv[Ai[k]]][inv[i]] = true;
+        }
+    int fill = 0;
+    for (int k = 0; k < size; k++)
+    {
+        std::vector<int> later;
+        for (int j = k + 1; j < size; j++)
+            if (G[k][j]) later.push_back(j);
+        fill += later.size() + 1;
+        for (size_t a = 0; a < later.size(); a++)
+            for (size_t b = 0; b < later.size(); b++)
+                G[later[a]][later[b]] = true;
+    }
+    delete[] inv;
+    return fill;
+}
+
+bool is_permutation(int size, int *perm)
+{
+    std::vector<bool> seen(size, false);
+    for (int i = 0; i < size; i++)
+    {
+        if (perm[i] < 0 || perm[i] >= size || seen[perm[i]])
+            return false;
+        seen[perm[i]] = true;
+    }
+    return true;
+}
+
+void test_matrix_amd()
+{
+    // 5-point Laplacian on an n x n grid with a random numbering of the nodes
+    int n = 15, size = n*n;
+    int *num = new int[size];
+    for (int i = 0; i < size; i++)
+        num[i] = i;
+    srand(5);
+    for (int i = size - 1; i > 0; i--)
+        std::swap(num[i], num[rand() % (i + 1)]);
+    CooMatrix A(size);
+    for (int y = 0; y < n; y++)
+        for (int x = 0; x < n; x++)
+        {
+            int i = num[x + n*y];
+            A.add(i, i, 4.0);
+            if (x > 0) A.add(i, num[x-1 + n*y], -1.0);
+            if (x < n-1) A.add(i, num[x+1 + n*y], -1.0);
+            if (y > 0) A.add(i, num[x + n*(y-1)], -1.0);
+            if (y < n-1) A.add(i, num[x + n*(y+1)], -1.0);
+        }
+    CSRMatrix Ar(&A);
+    int *Ap = Ar.get_Ap();
+    int *Ai = Ar.get_Ai();
+
+    // the fill of the natural grid numbering (a band of n) is about n^3, the
+    // minimum degree gets about n^2 log n, the random numbering is worse
+    int *perm = new int[size];
+    int *grid = new int[size];
+    for (int i = 0; i < size; i++)
+        grid[i] = num[i];
+    amd_ordering(size, Ap, Ai, perm);
+    _assert(is_permutation(size, perm));
+    int fill_amd = cholesky_fill(size, Ap, Ai, perm);
+    int fill_grid = cholesky_fill(size, Ap, Ai, grid);
+    rcm_ordering(size, Ap, Ai, grid);
+    _assert(fill_amd < fill_grid);
+    _assert(fill_amd < cholesky_fill(size, Ap, Ai, grid));
+
+    // an arrow: the hub is eliminated at the end, without fill
+    CooMatrix W(20);
+    for (int i = 0; i < 20; i++)
+    {
+        W.add(i, i, 2.0);
+        if (i != 7)
+        {
+            W.add(i, 7, 1.0);
+            W.add(7, i, 1.0);
+        }
+    }
+    CSRMatrix Wr(&W);
+    int wperm[20];
+    amd_ordering(20, Wr.get_Ap(), Wr.get_Ai(), wperm);
+    _assert(is_permutation(20, wperm));
+    _assert(cholesky_fill(20, Wr.get_Ap(), Wr.get_Ai(), wperm) == 20 + 19);
+
+    // the column ordering of the grid (A^T A is the 13-point stencil) and of
+    // a matrix with a dense row, which is ignored
+    CSCMatrix Ac(&A);
+    column_amd_ordering(size, Ac.get_Ap(), Ac.get_Ai(), perm);
+    _assert(is_permutation(size, perm));
+    for (int j = 0; j < size; j++)
+        A.add(3, j, 1.0);
+    CSCMatrix Ad(&A);
+    column_amd_ordering(size, Ad.get_Ap(), Ad.get_Ai(), perm);
+    _assert(is_permutation(size, perm));
+
+    delete[] num;
+    delete[] perm;
+    delete[] grid;
+}
+
+void test_matrix_spgemm()
+{
+    int size = 300;
+    CooMatrix A(size), B(size), Ac(size, true);
+    srand(9);
+    for (int i = 0; i < size; i++)
+        for (int k = 0; k < 5; k++)
+        {
+            int j = rand() % size;
+            double v = (double) rand() / RAND_MAX;
+            A.add(i, j, v);
+            Ac.add(i, j, cplx(v, 2*v));
+            B.add(j, rand() % size, 1 - v);
+        }
+    CSRMatrix Ar(&A), Br(&B), Acr(&Ac);
+    DenseMatrix Ad(&A), Bd(&B);
+
+    // the entries against the dense product, serial and in parallel
+    CSRMatrix C(size);
+    for (int threads = 1; threads <= 4; threads += 3)
+    {
+        set_num_threads(threads);
+        C.set_product(&Ar, &Br);
+        for (int i = 0; i < size; i++)
+        {
+            for (int k = C.get_Ap()[i]; k < C.get_Ap()[i+1]; k++)
+                if (k > C.get_Ap()[i])
+                    _assert(C.get_Ai()[k-1] < C.get_Ai()[k]);
+            for (int j = 0; j < size; j++)
+            {
+                double sum = 0;
+                bool nonzero = false;
+                for (int l = 0; l < size; l++)
+                    if (Ad.get(i, l) != 0 && Bd.get(l, j) != 0)
+                    {
+                        sum += Ad.get(i, l) * Bd.get(l, j);
+                        nonzero = true;
+                    }
+                _assert(fabs(C.get(i, j) - sum) < 1e-12);
+                if (nonzero)
+                    _assert(std::binary_search(C.get_Ai() + C.get_Ap()[i], C.get_Ai() + C.get_Ap()[i+1], j));
+            }
+        }
+    }
+    set_num_threads(0);
+
+    // only the values are recomputed, the pattern stays
+    int *Cp = C.get_Ap();
+    for (int k = 0; k < Ar.get_nnz(); k++)
+        Ar.get_Ax()[k] *= 2;
+    CSRMatrix C2(size);
+    C2.set_product(&Ar, &Br);
+    C.set_product(&Ar, &Br, true);
+    _assert(C.get_Ap() == Cp);
+    _assert(memcmp(C.get_Ax(), C2.get_Ax(), C.get_nnz() * sizeof(double)) == 0);
+
+    // complex times real
+    CSRMatrix Cc(size);
+    Cc.set_product(&Acr, &Br);
+    _assert(Cc.is_complex() && Cc.get_nnz() == C.get_nnz());
+    for (int k = 0; k < C.get_nnz(); k++)
+        _assert(std::abs(Cc.get_Ax_cplx()[k] - cplx(0.5, 1.0) * C.get_Ax()[k]) < 1e-12);
+
+    // sums
+    CSRMatrix S(size);
+    S.set_sum(2.0, &Ar, -3.0, &Br);
+    for (int i = 0; i < size; i++)
+        for (int j = 0; j < size; j++)
+            _assert(fabs(S.get(i, j) - (2 * Ar.get(i, j) - 3 * Br.get(i, j))) < 1e-12);
+    CSRMatrix Sc(size);
+    Sc.set_sum(cplx(0, 1), &Acr, 1.0, &Br);
+    for (int i = 0; i < size; i++)
+        for (int j = 0; j < size; j++)
+            _assert(std::abs(Sc.get_cplx(i, j) - (cplx(0, 1) * Acr.get_cplx(i, j) + Br.get(i, j))) < 1e-12);
+
+    // P^T A P of the rectangular aggregation P(i, i/2) = 1 by the kernels
+    int half = size / 2;
+    int *Pp = new int[size + 1], *Pi = new int[size];
+    int *Qp = new int[half + 1], *Qi = new int[size];
+    double *Px = new double[size];
+    for (int i = 0; i < size; i++)
+    {
+        Pp[i] = i;
+        Pi[i] = i / 2;
+        Px[i] = 1.0;
+        Qi[i] = i;
+    }
+    Pp[size] = size;
+    for (int j = 0; j <= half; j++)
+        Qp[j] = 2 * j;
+    int *APp, *APi, *Gp, *Gi;
+    int nnz = csr_multiply_symbolic(size, half, Ar.get_Ap(), Ar.get_Ai(), Pp, Pi, APp, APi);
+    double *APx = new double[nnz];
+    csr_multiply_numeric(size, half, Ar.get_Ap(), Ar.get_Ai(), Ar.get_Ax(), Pp, Pi, Px, APp, APi, APx);
+    nnz = csr_multiply_symbolic(half, half, Qp, Qi, APp, APi, Gp, Gi);
+    double *Gx = new double[nnz];
+    csr_multiply_numeric(half, half, Qp, Qi, Px, APp, APi, APx, Gp, Gi, Gx);
+    CSRMatrix G(half, nnz, Gp, Gi, Gx);
+    for (int i = 0; i < half; i++)
+        for (int j = 0; j < half; j++)
+        {
+            double sum = Ar.get(2*i, 2*j) + Ar.get(2*i+1, 2*j) + Ar.get(2*i, 2*j+1) + Ar.get(2*i+1, 2*j+1);
+            _assert(fabs(G.get(i, j) - sum) < 1e-12);
+        }
+
+    delete[] Pp;
+    delete[] Pi;
+    delete[] Px;
+    delete[] Qp;
+    delete[] Qi;
+    delete[] APp;
+    delete[] APi;
+    delete[] APx;
+}
+
 int main(int argc, char* argv[])
 {
     try {
         test_matrix1();
         test_matrix2();
         test_matrix3();
+        test_matrix_triplets();
+        test_matrix_refill();
+        test_matrix_scatter_map();
+        test_matrix_parallel_conversions();
+        test_matrix_coo_to_compressed();
+        test_matrix_view();
+        test_matrix_times_vector();
+        test_matrix_bsr();
+        test_matrix_sell();
+        test_matrix_symmetric();
+        test_matrix_csr64();
+        test_matrix_float();
+        test_matrix_typed();
+        test_matrix_parallel_assembly();
+        test_matrix_rcm();
+        test_matrix_amd();
+        test_matrix_spgemm();
 
         return ERROR_SUCCESS;
     } catch(std::exception const &ex) {
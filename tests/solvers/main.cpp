@@ -69,6 +69,287 @@ void test_solver_dense_lu2()
     _assert(fabs(res[3] - 0.2) < EPS);
 }
 
+// larger than DENSE_LU_BLOCK, so that the blocked update is used, and with
+// several right-hand sides solved by one factorization
+void test_solver_dense_lu3()
+{
+    int n = 150, nrhs = 3;
+    double **a = _new_matrix<double>(n, n);
+    srand(1);
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < n; j++)
+            a[i][j] = (double) rand() / RAND_MAX - 0.5;
+
+    // right-hand sides for the exact solutions x_k(i) = i + k
+    double *b = new double[n * nrhs];
+    for (int k = 0; k < nrhs; k++)
+        for (int i = 0; i < n; i++)
+        {
+            b[i + k*n] = 0;
+            for (int j = 0; j < n; j++)
+                b[i + k*n] += a[i][j] * (j + k);
+        }
+
+    DenseLU<double> lu;
+    lu.factorize(a, n);
+    lu.solve(b, nrhs);
+    for (int k = 0; k < nrhs; k++)
+        for (int i = 0; i < n; i++)
+            _assert(fabs(b[i + k*n] - (i + k)) < 1e-8);
+
+    // the same through the solver
+    DenseMatrix A(n);
+    double *x = new double[n];
+    for (int i = 0; i < n; i++)
+    {
+        x[i] = 0;
+        for (int j = 0; j < n; j++)
+        {
+            A.add(i, j, a[i][j]);
+            x[i] += a[i][j] * j;
+        }
+    }
+    solve_linear_system_dense_lu(&A, x);
+    for (int i = 0; i < n; i++)
+        _assert(fabs(x[i] - i) < 1e-8);
+
+    // a singular matrix is detected
+    for (int j = 0; j < n; j++)
+        a[7][j] = 0;
+    bool singular = false;
+    try {
+        lu.factorize(a, n);
+    }
+    catch (std::runtime_error &) {
+        singular = true;
+    }
+    _assert(singular);
+
+    delete[] x;
+    delete[] b;
+    delete[] a;
+}
+
+void test_solver_dense_lu_cplx()
+{
+    CooMatrix A(3, true);
+    A.add(0, 0, cplx(0, 1));
+    A.add(0, 1, cplx(2, 0));
+    A.add(1, 0, cplx(1, 1));
+    A.add(1, 1, cplx(1, -1));
+    A.add(1, 2, cplx(3, 0));
+    A.add(2, 2, cplx(0, -2));
+
+    // x = (1, i, 1 - i)
+    cplx res[3];
+    res[0] = cplx(0, 1) + cplx(2, 0) * cplx(0, 1);
+    res[1] = cplx(1, 1) + cplx(1, -1) * cplx(0, 1) + cplx(3, 0) * cplx(1, -1);
+    res[2] = cplx(0, -2) * cplx(1, -1);
+
+    solve_linear_system_dense_lu(&A, res);
+    _assert(std::abs(res[0] - cplx(1, 0)) < EPS);
+    _assert(std::abs(res[1] - cplx(0, 1)) < EPS);
+    _assert(std::abs(res[2] - cplx(1, -1)) < EPS);
+}
+
+void test_solver_sparse_lu1()
+{
+    // the system of test_solver_umfpack_refactor(), the row 3 has no
+    // diagonal entry
+    CooMatrix A(5);
+    A.add(0, 0, 2);
+    A.add(0, 1, 3);
+    A.add(1, 0, 3);
+    A.add(1, 2, 4);
+    A.add(1, 4, 6);
+    A.add(2, 1, -1);
+    A.add(2, 2, -3);
+    A.add(2, 3, 2);
+    A.add(3, 2, 1);
+    A.add(4, 1, 4);
+    A.add(4, 2, 2);
+    A.add(4, 4, 1);
+    CSRMatrix Acsr(&A);
+
+    CommonSolverSparseLU::CommonSolverSparseLUOrdering orderings[4] = {
+        CommonSolverSparseLU::CommonSolverSparseLUOrdering_Natural, CommonSolverSparseLU::CommonSolverSparseLUOrdering_AMD,
+        CommonSolverSparseLU::CommonSolverSparseLUOrdering_COLAMD, CommonSolverSparseLU::CommonSolverSparseLUOrdering_Auto};
+    CommonSolverSparseLU solver;
+    for (int o = 0; o < 4; o++)
+    {
+        solver.set_ordering(orderings[o]);
+        double res[5] = {8., 45., -3., 3., 19.};
+        _assert(solver.solve(&A, res));
+        for (int i = 0; i < 5; i++)
+            _assert(fabs(res[i] - (i + 1)) < EPS);
+    }
+
+    // two right-hand sides with one factorization
+    solver.set_ordering(CommonSolverSparseLU::CommonSolverSparseLUOrdering_Auto);
+    solver.factorize(&Acsr);
+    _assert(solver.is_factorized());
+    double res[5] = {8., 45., -3., 3., 19.};
+    _assert(solver.solve(res));
+    for (int i = 0; i < 5; i++)
+        _assert(fabs(res[i] - (i + 1)) < EPS);
+    double res2[5] = {16., 90., -6., 6., 38.};
+    _assert(solver.solve(res2));
+    for (int i = 0; i < 5; i++)
+        _assert(fabs(res2[i] - 2 * (i + 1)) < EPS);
+
+    // new values on the same pattern with the same pivots, and with pivoting
+    for (int k = 0; k < Acsr.get_nnz(); k++)
+        Acsr.get_Ax()[k] *= 2;
+    _assert(solver.refactor(&Acsr));
+    double res3[5] = {8., 45., -3., 3., 19.};
+    _assert(solver.solve(res3));
+    for (int i = 0; i < 5; i++)
+        _assert(fabs(res3[i] - 0.5 * (i + 1)) < EPS);
+    for (int k = 0; k < Acsr.get_nnz(); k++)
+        Acsr.get_Ax()[k] *= 0.5;
+    solver.factorize_numeric(&Acsr);
+    double res4[5] = {8., 45., -3., 3., 19.};
+    _assert(solver.solve(res4));
+    for (int i = 0; i < 5; i++)
+        _assert(fabs(res4[i] - (i + 1)) < EPS);
+
+    // a different pattern needs factorize()
+    A.add(3, 3, 1);
+    CSRMatrix B(&A);
+    bool failed = false;
+    try {
+        solver.refactor(&B);
+    } catch(std::exception const &ex) {
+        failed = true;
+    }
+    _assert(failed);
+
+    // a singular matrix
+    CooMatrix S(3);
+    S.add(0, 0, 1);
+    S.add(0, 1, 2);
+    S.add(1, 0, 2);
+    S.add(1, 1, 4);
+    S.add(2, 2, 1);
+    double ress[3] = {1., 2., 3.};
+    failed = false;
+    try {
+        solver.solve(&S, ress);
+    } catch(std::exception const &ex) {
+        failed = true;
+    }
+    _assert(failed && !solver.is_factorized());
+
+    // complex values, x = (1, i, 1 - i)
+    CooMatrix C(3, true);
+    C.add(0, 0, cplx(0, 1));
+    C.add(0, 1, cplx(2, 0));
+    C.add(1, 0, cplx(1, 1));
+    C.add(1, 1, cplx(1, -1));
+    C.add(1, 2, cplx(3, 0));
+    C.add(2, 2, cplx(0, -2));
+    cplx resc[3];
+    resc[0] = cplx(0, 1) + cplx(2, 0) * cplx(0, 1);
+    resc[1] = cplx(1, 1) + cplx(1, -1) * cplx(0, 1) + cplx(3, 0) * cplx(1, -1);
+    resc[2] = cplx(0, -2) * cplx(1, -1);
+    solve_linear_system_sparse_lu(&C, resc);
+    _assert(std::abs(resc[0] - cplx(1, 0)) < EPS);
+    _assert(std::abs(resc[1] - cplx(0, 1)) < EPS);
+    _assert(std::abs(resc[2] - cplx(1, -1)) < EPS);
+    solver.free_factorization();
+    _assert(!solver.is_factorized());
+
+    // several right-hand sides with one factorization
+    double rhs[10] = {8., 45., -3., 3., 19., 16., 90., -6., 6., 38.};
+    _assert(solver.solve(&Acsr, rhs, 2, 5));
+    for (int i = 0; i < 5; i++)
+    {
+        _assert(fabs(rhs[i] - (i + 1)) < EPS);
+        _assert(fabs(rhs[5 + i] - 2 * (i + 1)) < EPS);
+    }
+}
+
+void test_solver_sparse_lu2()
+{
+    // upwind convection-diffusion on an n x n grid with a random numbering
+    // of the nodes, x = 1 + i % 3
+    int n = 20, size = n * n;
+    double c = 2.;
+    int *num = new int[size];
+    for (int i = 0; i < size; i++)
+        num[i] = i;
+    srand(3);
+    for (int i = size - 1; i > 0; i--)
+        std::swap(num[i], num[rand() % (i + 1)]);
+    CooMatrix A(size);
+    for (int y = 0; y < n; y++)
+        for (int x = 0; x < n; x++)
+        {
+            int i = num[x + n * y];
+            A.add(i, i, 4. + 2. * c);
+            if (x > 0) A.add(i, num[x - 1 + n * y], -1. - c);
+            if (x + 1 < n) A.add(i, num[x + 1 + n * y], -1.);
+            if (y > 0) A.add(i, num[x + n * (y - 1)], -1. - c);
+            if (y + 1 < n) A.add(i, num[x + n * (y + 1)], -1.);
+        }
+    CSRMatrix Acsr(&A);
+    double *exact = new double[size];
+    double *b = new double[size];
+    double *res = new double[size];
+    for (int i = 0; i < size; i++)
+        exact[i] = 1. + i % 3;
+    Acsr.times_vector(exact, b, size);
+
+    // the orderings reduce the fill of the random numbering
+    CommonSolverSparseLU::CommonSolverSparseLUOrdering orderings[3] = {
+        CommonSolverSparseLU::CommonSolverSparseLUOrdering_Natural, CommonSolverSparseLU::CommonSolverSparseLUOrdering_AMD,
+        CommonSolverSparseLU::CommonSolverSparseLUOrdering_COLAMD};
+    int fill[3];
+    CommonSolverSparseLU solver;
+    for (int o = 0; o < 3; o++)
+    {
+        solver.set_ordering(orderings[o]);
+        for (int i = 0; i < size; i++) res[i] = b[i];
+        _assert(solver.solve(&Acsr, res));
+        fill[o] = solver.get_nnz_L() + solver.get_nnz_U();
+        for (int i = 0; i < size; i++)
+            _assert(fabs(res[i] - exact[i]) < 1e-10);
+    }
+    _assert(fill[1] < fill[0] / 2 && fill[2] < fill[0] / 2);
+
+    // the other formats are converted
+    solver.set_ordering(CommonSolverSparseLU::CommonSolverSparseLUOrdering_Auto);
+    BSRMatrix Absr(&A, 2);
+    CSCMatrix Acsc(&A);
+    Matrix *formats[3] = {&A, &Absr, &Acsc};
+    for (int f = 0; f < 3; f++)
+    {
+        for (int i = 0; i < size; i++) res[i] = b[i];
+        _assert(solver.solve(formats[f], res));
+        for (int i = 0; i < size; i++)
+            _assert(fabs(res[i] - exact[i]) < 1e-10);
+    }
+
+    // random values on the same pattern: the diagonal of the refactored
+    // matrix fails the threshold test, the factorization pivots again
+    solver.factorize(&Acsr);
+    CSRMatrix A2csr(&A);
+    for (int k = 0; k < A2csr.get_nnz(); k++)
+        A2csr.get_Ax()[k] = 2. * rand() / RAND_MAX - 1.;
+    _assert(!solver.refactor(&A2csr));
+    solver.factorize_numeric(&A2csr);
+    A2csr.times_vector(exact, b, size);
+    for (int i = 0; i < size; i++) res[i] = b[i];
+    _assert(solver.solve(res));
+    for (int i = 0; i < size; i++)
+        _assert(fabs(res[i] - exact[i]) < 1e-8);
+
+    delete[] num;
+    delete[] exact;
+    delete[] b;
+    delete[] res;
+}
+
 void test_solver_cg()
 {
     CooMatrix A(4);
@@ -90,6 +371,489 @@ void test_solver_cg()
     _assert(fabs(res[1] - 0.6) < EPS);
     _assert(fabs(res[2] - 0.6) < EPS);
     _assert(fabs(res[3] - 0.2) < EPS);
+
+    // BSR matrix, used as it is
+    BSRMatrix B(&A, 2);
+    for (int i=0; i < 4; i++) res[i] = 1.;
+    _assert(solve_linear_system_cg(&B, res, EPS, 2));
+    _assert(fabs(res[0] - 0.2) < EPS);
+    _assert(fabs(res[1] - 0.6) < EPS);
+    _assert(fabs(res[2] - 0.6) < EPS);
+    _assert(fabs(res[3] - 0.2) < EPS);
+
+    // SELL-C-sigma matrix, used as it is
+    SELLMatrix S(&A, 2, 4);
+    for (int i=0; i < 4; i++) res[i] = 1.;
+    _assert(solve_linear_system_cg(&S, res, EPS, 2));
+    _assert(fabs(res[0] - 0.2) < EPS);
+    _assert(fabs(res[1] - 0.6) < EPS);
+    _assert(fabs(res[2] - 0.6) < EPS);
+    _assert(fabs(res[3] - 0.2) < EPS);
+
+    // 64-bit indices, used as they are
+    CSRMatrix64 L(&A);
+    for (int i=0; i < 4; i++) res[i] = 1.;
+    _assert(solve_linear_system_cg(&L, res, EPS, 2));
+    _assert(fabs(res[0] - 0.2) < EPS);
+    _assert(fabs(res[1] - 0.6) < EPS);
+    _assert(fabs(res[2] - 0.6) < EPS);
+    _assert(fabs(res[3] - 0.2) < EPS);
+
+    // reverse Cuthill-McKee ordering, the solution is permuted back
+    CommonSolverCG cg;
+    cg.set_reordering(CommonSolverReordering_RCM);
+    for (int i=0; i < 4; i++) res[i] = 1.;
+    _assert(cg.solve(&A, res, EPS, 2));
+    _assert(fabs(res[0] - 0.2) < EPS);
+    _assert(fabs(res[1] - 0.6) < EPS);
+    _assert(fabs(res[2] - 0.6) < EPS);
+    _assert(fabs(res[3] - 0.2) < EPS);
+
+    // float values (exact for these entries), double iterations
+    CSRMatrixFloat F(&A);
+    for (int i=0; i < 4; i++) res[i] = 1.;
+    _assert(solve_linear_system_cg(&F, res, EPS, 2));
+    _assert(fabs(res[0] - 0.2) < EPS);
+    _assert(fabs(res[1] - 0.6) < EPS);
+    _assert(fabs(res[2] - 0.6) < EPS);
+    _assert(fabs(res[3] - 0.2) < EPS);
+
+    // reordered through a widened CSR copy
+    for (int i=0; i < 4; i++) res[i] = 1.;
+    _assert(cg.solve(&F, res, EPS, 2));
+    _assert(fabs(res[0] - 0.2) < EPS);
+    _assert(fabs(res[3] - 0.2) < EPS);
+
+    // the preconditioner works on a widened CSR copy as well
+    CommonSolverCG pcg;
+    pcg.set_preconditioner(CommonSolverPreconditioner_ILU);
+    for (int i=0; i < 4; i++) res[i] = 1.;
+    _assert(pcg.solve(&F, res, EPS, 2));
+    _assert(fabs(res[0] - 0.2) < EPS);
+    _assert(fabs(res[1] - 0.6) < EPS);
+
+    // upper triangle of the same matrix
+    CooMatrix U(4);
+    U.set_symmetric(true);
+    U.add(0, 0, -1);
+    U.add(1, 1, -1);
+    U.add(2, 2, -1);
+    U.add(3, 3, -1);
+    U.add(0, 1, 2);
+    U.add(2, 1, 2);
+    U.add(2, 3, 2);
+    for (int i=0; i < 4; i++) res[i] = 1.;
+    _assert(solve_linear_system_cg(&U, res, EPS, 2));
+    _assert(fabs(res[0] - 0.2) < EPS);
+    _assert(fabs(res[1] - 0.6) < EPS);
+    _assert(fabs(res[2] - 0.6) < EPS);
+    _assert(fabs(res[3] - 0.2) < EPS);
+
+    // the dense solver gets the full matrix
+    for (int i=0; i < 4; i++) res[i] = 1.;
+    solve_linear_system_dense_lu(&U, res);
+    _assert(fabs(res[0] - 0.2) < EPS);
+    _assert(fabs(res[3] - 0.2) < EPS);
+}
+
+void test_solver_pcg()
+{
+    // 5-point Laplacian on an n x n grid, x = 1
+    int n = 30, size = n * n;
+    CooMatrix A(size);
+    CooMatrix U(size);
+    U.set_symmetric(true);
+    for (int y = 0; y < n; y++)
+        for (int x = 0; x < n; x++)
+        {
+            int i = x + n * y;
+            A.add(i, i, 4.);
+            U.add(i, i, 4.);
+            if (x > 0) A.add(i, i - 1, -1.);
+            if (x + 1 < n) { A.add(i, i + 1, -1.); U.add(i, i + 1, -1.); }
+            if (y > 0) A.add(i, i - n, -1.);
+            if (y + 1 < n) { A.add(i, i + n, -1.); U.add(i, i + n, -1.); }
+        }
+    CSRMatrix Acsr(&A);
+    double *ones = new double[size];
+    double *b = new double[size];
+    double *res = new double[size];
+    for (int i = 0; i < size; i++) ones[i] = 1.;
+    Acsr.times_vector(ones, b, size);
+
+    CommonSolverPreconditioner types[4] = {CommonSolverPreconditioner_None, CommonSolverPreconditioner_Jacobi,
+                                           CommonSolverPreconditioner_SSOR, CommonSolverPreconditioner_ILU};
+    int iters[4];
+    // the same solver for all the solves, its work vectors are reused
+    CommonSolverCG cg;
+    for (int t = 0; t < 4; t++)
+    {
+        cg.set_preconditioner(types[t]);
+        for (int i = 0; i < size; i++) res[i] = b[i];
+        _assert(cg.solve(&Acsr, res, 1e-10, 1000));
+        iters[t] = cg.get_num_iters();
+        _assert(cg.get_residual() < 1e-10);
+        for (int i = 0; i < size; i++)
+            _assert(fabs(res[i] - 1.) < 1e-8);
+
+        // the upper triangle and the COO matrix give the same iterations
+        Matrix *other[2] = {&U, &A};
+        for (int m = 0; m < 2; m++)
+        {
+            for (int i = 0; i < size; i++) res[i] = b[i];
+            _assert(cg.solve(other[m], res, 1e-10, 1000));
+            _assert(abs(cg.get_num_iters() - iters[t]) <= 1);
+            for (int i = 0; i < size; i++)
+                _assert(fabs(res[i] - 1.) < 1e-8);
+        }
+    }
+    // the diagonal of the Laplacian is constant
+    _assert(iters[1] == iters[0]);
+    _assert(iters[2] < iters[0] && iters[3] < iters[0]);
+
+    // SSOR with over-relaxation, a BSR matrix gets a CSR copy for the
+    // preconditioner
+    BSRMatrix B(&A, 2);
+    cg.set_preconditioner(CommonSolverPreconditioner_SSOR, 1.5);
+    for (int i = 0; i < size; i++) res[i] = b[i];
+    _assert(cg.solve(&B, res, 1e-10, 1000));
+    _assert(cg.get_num_iters() < iters[2]);
+    for (int i = 0; i < size; i++)
+        _assert(fabs(res[i] - 1.) < 1e-8);
+
+    // the iteration limit
+    cg.set_preconditioner(CommonSolverPreconditioner_None);
+    for (int i = 0; i < size; i++) res[i] = b[i];
+    _assert(!cg.solve(&Acsr, res, 1e-10, 5));
+    _assert(cg.get_num_iters() == 5 && cg.get_residual() > 1e-10);
+
+    delete[] ones;
+    delete[] b;
+    delete[] res;
+}
+
+void test_solver_gmres()
+{
+    // the system of test_solver_scipy_2(), GMRES is exact after 5 iterations
+    CooMatrix A5(5);
+    A5.add(0, 0, 2);
+    A5.add(0, 1, 3);
+    A5.add(1, 0, 3);
+    A5.add(1, 2, 4);
+    A5.add(1, 4, 6);
+    A5.add(2, 1, -1);
+    A5.add(2, 2, -3);
+    A5.add(2, 3, 2);
+    A5.add(3, 2, 1);
+    A5.add(4, 1, 4);
+    A5.add(4, 2, 2);
+    A5.add(4, 4, 1);
+    double res5[5] = {8., 45., -3., 3., 19.};
+    _assert(solve_linear_system_gmres(&A5, res5));
+    for (int i = 0; i < 5; i++)
+        _assert(fabs(res5[i] - (i + 1.)) < EPS);
+
+    // upwind convection-diffusion on an n x n grid, x = 1 + i % 3
+    int n = 20, size = n * n;
+    double c = 2.;
+    CooMatrix A(size);
+    for (int y = 0; y < n; y++)
+        for (int x = 0; x < n; x++)
+        {
+            int i = x + n * y;
+            A.add(i, i, 4. + 2. * c);
+            if (x > 0) A.add(i, i - 1, -1. - c);
+            if (x + 1 < n) A.add(i, i + 1, -1.);
+            if (y > 0) A.add(i, i - n, -1. - c);
+            if (y + 1 < n) A.add(i, i + n, -1.);
+        }
+    CSRMatrix Acsr(&A);
+    int ldb = size + 1;
+    double *exact = new double[2 * ldb];
+    double *b = new double[2 * ldb];
+    double *res = new double[2 * ldb];
+    for (int i = 0; i < size; i++)
+    {
+        exact[i] = 1. + i % 3;
+        exact[ldb + i] = 1.;
+    }
+    for (int k = 0; k < 2; k++)
+    {
+        Acsr.times_vector(exact + k * ldb, b + k * ldb, size);
+        b[k * ldb + size] = -1.;
+    }
+
+    CommonSolverPreconditioner types[4] = {CommonSolverPreconditioner_None, CommonSolverPreconditioner_Jacobi,
+                                           CommonSolverPreconditioner_SSOR, CommonSolverPreconditioner_ILU};
+    int iters[4];
+    // the same solver for all the solves, its work arrays are reused
+    CommonSolverGMRES gmres;
+    for (int t = 0; t < 4; t++)
+    {
+        gmres.set_preconditioner(types[t]);
+        for (int i = 0; i < size; i++) res[i] = b[i];
+        _assert(gmres.solve(&Acsr, res, 1e-10, 1000));
+        iters[t] = gmres.get_num_iters();
+        _assert(gmres.get_residual() <= 1e-10);
+        for (int i = 0; i < size; i++)
+            _assert(fabs(res[i] - exact[i]) < 1e-8);
+    }
+    _assert(iters[3] < iters[2] && iters[2] < iters[0]);
+
+    // a short restart needs more iterations, the COO matrix is converted
+    gmres.set_restart(5);
+    for (int i = 0; i < size; i++) res[i] = b[i];
+    _assert(gmres.solve(&A, res, 1e-10, 1000));
+    _assert(gmres.get_num_iters() > iters[3]);
+    for (int i = 0; i < size; i++)
+        _assert(fabs(res[i] - exact[i]) < 1e-8);
+
+    // two right-hand sides, a BSR matrix gets a CSR copy for the
+    // preconditioner
+    BSRMatrix Absr(&A, 2);
+    gmres.set_restart(30);
+    for (int i = 0; i < 2 * ldb; i++) res[i] = b[i];
+    _assert(gmres.solve(&Absr, res, 2, ldb, 1e-10, 1000));
+    for (int k = 0; k < 2; k++)
+    {
+        for (int i = 0; i < size; i++)
+            _assert(fabs(res[k * ldb + i] - exact[k * ldb + i]) < 1e-8);
+        // the padding is not touched
+        _assert(res[k * ldb + size] == -1.);
+    }
+
+    // the iteration limit
+    gmres.set_preconditioner(CommonSolverPreconditioner_None);
+    for (int i = 0; i < size; i++) res[i] = b[i];
+    _assert(!gmres.solve(&Acsr, res, 1e-10, 3));
+    _assert(gmres.get_num_iters() == 3 && gmres.get_residual() > 1e-10);
+
+    // the larger work arrays are reused for a smaller system
+    double res5b[5] = {8., 45., -3., 3., 19.};
+    _assert(gmres.solve(&A5, res5b, 1e-12, 100));
+    for (int i = 0; i < 5; i++)
+        _assert(fabs(res5b[i] - (i + 1.)) < EPS);
+
+    delete[] exact;
+    delete[] b;
+    delete[] res;
+}
+
+void test_solver_bicgstab()
+{
+    // upwind convection-diffusion on an n x n grid, x = 1 + i % 3
+    int n = 20, size = n * n;
+    double c = 2.;
+    CooMatrix A(size);
+    for (int y = 0; y < n; y++)
+        for (int x = 0; x < n; x++)
+        {
+            int i = x + n * y;
+            A.add(i, i, 4. + 2. * c);
+            if (x > 0) A.add(i, i - 1, -1. - c);
+            if (x + 1 < n) A.add(i, i + 1, -1.);
+            if (y > 0) A.add(i, i - n, -1. - c);
+            if (y + 1 < n) A.add(i, i + n, -1.);
+        }
+    CSRMatrix Acsr(&A);
+    double *exact = new double[size];
+    double *b = new double[size];
+    double *res = new double[size];
+    for (int i = 0; i < size; i++)
+        exact[i] = 1. + i % 3;
+    Acsr.times_vector(exact, b, size);
+
+    CommonSolverPreconditioner types[4] = {CommonSolverPreconditioner_None, CommonSolverPreconditioner_Jacobi,
+                                           CommonSolverPreconditioner_SSOR, CommonSolverPreconditioner_ILU};
+    int iters[4];
+    CommonSolverBiCGSTAB bicgstab;
+    for (int t = 0; t < 4; t++)
+    {
+        bicgstab.set_preconditioner(types[t]);
+        for (int i = 0; i < size; i++) res[i] = b[i];
+        _assert(bicgstab.solve(&Acsr, res, 1e-10, 1000));
+        iters[t] = bicgstab.get_num_iters();
+        _assert(bicgstab.get_residual() <= 1e-10);
+        for (int i = 0; i < size; i++)
+            _assert(fabs(res[i] - exact[i]) < 1e-8);
+    }
+    _assert(iters[3] < iters[0]);
+
+    // the COO matrix is converted, the iteration limit
+    bicgstab.set_preconditioner(CommonSolverPreconditioner_None);
+    for (int i = 0; i < size; i++) res[i] = b[i];
+    _assert(solve_linear_system_bicgstab(&A, res, 1e-10));
+    for (int i = 0; i < size; i++)
+        _assert(fabs(res[i] - exact[i]) < 1e-8);
+    for (int i = 0; i < size; i++) res[i] = b[i];
+    _assert(!bicgstab.solve(&Acsr, res, 1e-10, 2));
+    _assert(bicgstab.get_num_iters() == 2 && bicgstab.get_residual() > 1e-10);
+
+    delete[] exact;
+    delete[] b;
+    delete[] res;
+}
+
+void test_solver_iterative_cplx()
+{
+    // Helmholtz operator with absorption on an n x n grid (complex
+    // symmetric, not hermitian), x = 1 + i % 3 + i (i % 2)
+    int n = 12, size = n * n;
+    CooMatrix A(size, true);
+    for (int y = 0; y < n; y++)
+        for (int x = 0; x < n; x++)
+        {
+            int i = x + n * y;
+            A.add(i, i, cplx(4. - 0.5, 0.5));
+            if (x > 0) A.add(i, i - 1, cplx(-1.));
+            if (x + 1 < n) A.add(i, i + 1, cplx(-1.));
+            if (y > 0) A.add(i, i - n, cplx(-1.));
+            if (y + 1 < n) A.add(i, i + n, cplx(-1.));
+        }
+    CSRMatrix Acsr(&A);
+    cplx *exact = new cplx[size];
+    cplx *b = new cplx[size];
+    cplx *res = new cplx[size];
+    for (int i = 0; i < size; i++)
+        exact[i] = cplx(1. + i % 3, i % 2);
+    Acsr.times_vector(exact, b, size);
+
+    CommonSolverPreconditioner types[4] = {CommonSolverPreconditioner_None, CommonSolverPreconditioner_Jacobi,
+                                           CommonSolverPreconditioner_SSOR, CommonSolverPreconditioner_ILU};
+    int iters[4];
+    CommonSolverCG cocg;
+    CommonSolverGMRES gmres;
+    CommonSolverBiCGSTAB bicgstab;
+    for (int t = 0; t < 4; t++)
+    {
+        cocg.set_preconditioner(types[t]);
+        for (int i = 0; i < size; i++) res[i] = b[i];
+        _assert(cocg.solve(&Acsr, res, 1e-10, 1000));
+        iters[t] = cocg.get_num_iters();
+        for (int i = 0; i < size; i++)
+            _assert(std::abs(res[i] - exact[i]) < 1e-8);
+
+        gmres.set_preconditioner(types[t]);
+        for (int i = 0; i < size; i++) res[i] = b[i];
+        _assert(gmres.solve(&Acsr, res, 1e-10, 1000));
+        _assert(gmres.get_residual() <= 1e-10);
+        for (int i = 0; i < size; i++)
+            _assert(std::abs(res[i] - exact[i]) < 1e-8);
+
+        bicgstab.set_preconditioner(types[t]);
+        for (int i = 0; i < size; i++) res[i] = b[i];
+        _assert(bicgstab.solve(&Acsr, res, 1e-10, 1000));
+        _assert(bicgstab.get_residual() <= 1e-10);
+        for (int i = 0; i < size; i++)
+            _assert(std::abs(res[i] - exact[i]) < 1e-8);
+    }
+    _assert(iters[3] < iters[0]);
+
+    // typed complex matrix, the preconditioners work on a CSRMatrix copy
+    CSRMatrixCplx Atyped(&A);
+    for (int t = 1; t < 4; t++)
+    {
+        cocg.set_preconditioner(types[t]);
+        for (int i = 0; i < size; i++) res[i] = b[i];
+        _assert(cocg.solve(&Atyped, res, 1e-10, 1000));
+        for (int i = 0; i < size; i++)
+            _assert(std::abs(res[i] - exact[i]) < 1e-8);
+    }
+    CommonSolverSparseLU lu;
+    for (int i = 0; i < size; i++) res[i] = b[i];
+    _assert(lu.solve(&Atyped, res));
+    for (int i = 0; i < size; i++)
+        _assert(std::abs(res[i] - exact[i]) < 1e-8);
+
+    // two right-hand sides from the COO matrix, the second is conj(x)
+    cplx *B = new cplx[2 * size];
+    cplx *X = new cplx[2 * size];
+    for (int i = 0; i < size; i++)
+    {
+        X[i] = exact[i];
+        X[size + i] = std::conj(exact[i]);
+    }
+    A.times_vector(X, B, size);
+    A.times_vector(X + size, B + size, size);
+    _assert(cocg.solve(&A, B, 2, size, 1e-10, 1000));
+    for (int i = 0; i < 2 * size; i++)
+        _assert(std::abs(B[i] - X[i]) < 1e-8);
+
+    // the values have to match the matrix
+    bool raised = false;
+    double *res_real = new double[size];
+    try {
+        gmres.solve(&Acsr, res_real);
+    } catch (std::exception &) {
+        raised = true;
+    }
+    _assert(raised);
+
+    delete[] exact;
+    delete[] b;
+    delete[] res;
+    delete[] B;
+    delete[] X;
+    delete[] res_real;
+}
+
+void test_solver_multiple_rhs()
+{
+    // 1D Laplacian, three right-hand sides with ldb = size + 1, the solutions
+    // are 1, i and the first one plus twice the second one
+    int size = 20, ldb = size + 1, nrhs = 3;
+    CooMatrix A(size);
+    for (int i = 0; i < size; i++)
+    {
+        A.add(i, i, 2.);
+        if (i > 0) A.add(i, i - 1, -1.);
+        if (i + 1 < size) A.add(i, i + 1, -1.);
+    }
+    CSRMatrix Acsr(&A);
+    double *X = new double[nrhs * ldb];
+    double *B = new double[nrhs * ldb];
+    for (int i = 0; i < size; i++)
+    {
+        X[i] = 1.;
+        X[ldb + i] = i;
+        X[2 * ldb + i] = 1. + 2. * i;
+    }
+    for (int k = 0; k < nrhs; k++)
+    {
+        Acsr.times_vector(X + k * ldb, B + k * ldb, size);
+        B[k * ldb + size] = -1.;
+    }
+    double *res = new double[nrhs * ldb];
+
+    CommonSolverDenseLU lu;
+    CommonSolverCG cg;
+    cg.set_preconditioner(CommonSolverPreconditioner_ILU);
+    CommonSolverSparseLib sparselib;
+    sparselib.set_tolerance(1e-14);
+    CommonSolver *solvers[3] = {&lu, &cg, &sparselib};
+    for (int s = 0; s < 3; s++)
+    {
+        for (int i = 0; i < nrhs * ldb; i++) res[i] = B[i];
+        _assert(solvers[s]->solve(&A, res, nrhs, ldb));
+        for (int k = 0; k < nrhs; k++)
+        {
+            for (int i = 0; i < size; i++)
+                _assert(fabs(res[k * ldb + i] - X[k * ldb + i]) < 1e-8);
+            // the padding is not touched
+            _assert(res[k * ldb + size] == -1.);
+        }
+    }
+
+    // CG with the tolerance and the iteration limit, on the CSR matrix
+    for (int i = 0; i < nrhs * ldb; i++) res[i] = B[i];
+    _assert(cg.solve(&Acsr, res, nrhs, ldb, 1e-10, 100));
+    _assert(cg.get_num_iters() == 1);
+    for (int i = 0; i < size; i++)
+        _assert(fabs(res[2 * ldb + i] - X[2 * ldb + i]) < 1e-8);
+
+    delete[] X;
+    delete[] B;
+    delete[] res;
 }
 
 void test_solver_scipy_1()
@@ -342,6 +1106,130 @@ void test_solver_umfpack_imag()
     _assert(fabs(res[1].imag() - (-0.25)) < EPS);
 }
 
+void test_solver_umfpack_refactor()
+{
+    CooMatrix A(5);
+    A.add(0, 0, 2);
+    A.add(0, 1, 3);
+    A.add(1, 0, 3);
+    A.add(1, 2, 4);
+    A.add(1, 4, 6);
+    A.add(2, 1, -1);
+    A.add(2, 2, -3);
+    A.add(2, 3, 2);
+    A.add(3, 2, 1);
+    A.add(4, 1, 4);
+    A.add(4, 2, 2);
+    A.add(4, 4, 1);
+    CSRMatrix Acsr(&A);
+
+    // two right-hand sides with one factorization
+    CommonSolverUmfpack solver;
+    solver.factorize(&Acsr);
+    _assert(solver.is_factorized());
+    double res[5] = {8., 45., -3., 3., 19.};
+    _assert(solver.solve(res));
+    for (int i = 0; i < 5; i++)
+        _assert(fabs(res[i] - (i + 1)) < EPS);
+    double res2[5] = {16., 90., -6., 6., 38.};
+    _assert(solver.solve(res2));
+    for (int i = 0; i < 5; i++)
+        _assert(fabs(res2[i] - 2 * (i + 1)) < EPS);
+
+    // new values on the same pattern, the symbolic analysis is reused
+    for (int k = 0; k < Acsr.get_nnz(); k++)
+        Acsr.get_Ax()[k] *= 2;
+    solver.refactor(&Acsr);
+    double res3[5] = {8., 45., -3., 3., 19.};
+    _assert(solver.solve(res3));
+    for (int i = 0; i < 5; i++)
+        _assert(fabs(res3[i] - 0.5 * (i + 1)) < EPS);
+
+    // a different pattern needs factorize()
+    A.add(3, 3, 1);
+    CSRMatrix B(&A);
+    bool failed = false;
+    try {
+        solver.refactor(&B);
+    } catch(std::exception const &ex) {
+        failed = true;
+    }
+    _assert(failed);
+
+    // the COO and BSR matrices refill the values in place, twice to reuse
+    // the work arrays
+    solver.factorize(&A);
+    for (int k = 1; k <= 2; k++)
+    {
+        CooMatrix D(5);
+        D.add(0, 0, 2 * k);
+        D.add(0, 1, 3 * k);
+        D.add(1, 0, 3 * k);
+        D.add(1, 2, 4 * k);
+        D.add(1, 4, 6 * k);
+        D.add(2, 1, -1 * k);
+        D.add(2, 2, -3 * k);
+        D.add(2, 3, 2 * k);
+        D.add(3, 2, 1 * k);
+        D.add(3, 3, 1 * k);
+        D.add(4, 1, 4 * k);
+        D.add(4, 2, 2 * k);
+        D.add(4, 4, 1 * k);
+        solver.refactor(&D);
+        double res4[5] = {8., 45., -3., 7., 19.};
+        _assert(solver.solve(res4));
+        for (int i = 0; i < 5; i++)
+            _assert(fabs(res4[i] - (double) (i + 1) / k) < EPS);
+    }
+    BSRMatrix Absr(&A, 1);
+    solver.factorize(&Absr);
+    for (int k = 0; k < Absr.get_nnzb(); k++)
+        Absr.get_Ax()[k] *= 2;
+    solver.refactor(&Absr);
+    double res5[5] = {8., 45., -3., 7., 19.};
+    _assert(solver.solve(res5));
+    for (int i = 0; i < 5; i++)
+        _assert(fabs(res5[i] - 0.5 * (i + 1)) < EPS);
+    // one more entry in the COO matrix
+    A.add(3, 0, 1);
+    failed = false;
+    try {
+        solver.refactor(&A);
+    } catch(std::exception const &ex) {
+        failed = true;
+    }
+    _assert(failed);
+
+    // complex values in the CSR format, the CSC matrix of the transpose
+    CooMatrix C(2, true);
+    C.add(0, 0, cplx(1, 1));
+    C.add(0, 1, cplx(2, 2));
+    C.add(1, 0, cplx(3, 3));
+    C.add(1, 1, cplx(4, 4));
+    CSRMatrix Ccsr(&C);
+    solver.factorize(&Ccsr);
+    cplx resc[2] = {cplx(1), cplx(2)};
+    _assert(solver.solve(resc));
+    _assert(std::abs(resc[0] - cplx(0, 0)) < EPS);
+    _assert(std::abs(resc[1] - cplx(0.25, -0.25)) < EPS);
+    solver.refactor(&Ccsr);
+    resc[0] = cplx(2);
+    resc[1] = cplx(4);
+    _assert(solver.solve(resc));
+    _assert(std::abs(resc[1] - cplx(0.5, -0.5)) < EPS);
+    solver.free_factorization();
+    _assert(!solver.is_factorized());
+
+    // several right-hand sides with one factorization
+    double rhs[10] = {8., 45., -3., 3., 19., 16., 90., -6., 6., 38.};
+    _assert(solver.solve(&Acsr, rhs, 2, 5));
+    for (int i = 0; i < 5; i++)
+    {
+        _assert(fabs(rhs[i] - 0.5 * (i + 1)) < EPS);
+        _assert(fabs(rhs[5 + i] - (i + 1)) < EPS);
+    }
+}
+
 void test_solver_sparselib_cgs()
 {
     CooMatrix A(5);
@@ -365,6 +1253,71 @@ void test_solver_sparselib_cgs()
     _assert(fabs(res[2] - 3.) < EPS);
     _assert(fabs(res[3] - 4.) < EPS);
     _assert(fabs(res[4] - 5.) < EPS);
+
+    // BSR matrix, expanded to CSC (the last block is padded)
+    BSRMatrix B(&A, 2);
+    double res2[5] = {8., 45., -3., 3., 19.};
+    solve_linear_system_sparselib_cgs(&B, res2, 1e-14);
+    for (int i=0; i < 5; i++)
+        _assert(fabs(res2[i] - (i + 1.)) < EPS);
+
+    // 64-bit indices, narrowed
+    CSRMatrix64 C(&A);
+    double res3[5] = {8., 45., -3., 3., 19.};
+    solve_linear_system_sparselib_cgs(&C, res3, 1e-14);
+    for (int i=0; i < 5; i++)
+        _assert(fabs(res3[i] - (i + 1.)) < EPS);
+
+    // float values, widened to a double CSC matrix
+    CSRMatrixFloat F(&A);
+    double res6[5] = {8., 45., -3., 3., 19.};
+    solve_linear_system_sparselib_cgs(&F, res6, 1e-14);
+    for (int i=0; i < 5; i++)
+        _assert(fabs(res6[i] - (i + 1.)) < EPS);
+
+    // typed CSC matrix, copied
+    CSCMatrixDouble G(&A);
+    double res7[5] = {8., 45., -3., 3., 19.};
+    solve_linear_system_sparselib_cgs(&G, res7, 1e-14);
+    for (int i=0; i < 5; i++)
+        _assert(fabs(res7[i] - (i + 1.)) < EPS);
+
+    // ILU factors in float, the iterations still reach the double tolerance
+    CommonSolverSparseLib solver;
+    solver.set_preconditioner(CommonSolverSparseLib::CommonSolverSparseLibPreconditioner_ILUFloat);
+    solver.set_tolerance(1e-14);
+    double res4[5] = {8., 45., -3., 3., 19.};
+    solver.solve(&A, res4);
+    for (int i=0; i < 5; i++)
+        _assert(fabs(res4[i] - (i + 1.)) < EPS);
+
+    // reordered, the matrix of the caller is not changed (A has a zero on
+    // the diagonal, the ILU(0) pivots are only safe for a nonzero diagonal)
+    CooMatrix Ad(5);
+    A.copy_into(&Ad);
+    for (int i=0; i < 5; i++)
+        Ad.add(i, i, 10.);
+    CSCMatrix D(&Ad);
+    int ap[6];
+    memcpy(ap, D.get_Ap(), sizeof(ap));
+    double res5[5] = {1., 2., 3., 4., 5.};
+    double rhs5[5];
+    D.times_vector(res5, rhs5, 5);
+    memcpy(res5, rhs5, sizeof(res5));
+    CommonSolverSparseLib rcm;
+    rcm.set_reordering(CommonSolverReordering_RCM);
+    rcm.set_tolerance(1e-14);
+    rcm.solve(&D, res5);
+    for (int i=0; i < 5; i++)
+        _assert(fabs(res5[i] - (i + 1.)) < EPS);
+    _assert(memcmp(ap, D.get_Ap(), sizeof(ap)) == 0);
+
+    // one iteration does not reach the tolerance
+    CommonSolverSparseLib one;
+    one.set_maxiter(1);
+    one.set_tolerance(1e-14);
+    double res8[5] = {8., 45., -3., 3., 19.};
+    _assert(!one.solve(&A, res8));
 }
 
 void test_solver_sparselib_ir()
@@ -392,6 +1345,87 @@ void test_solver_sparselib_ir()
     _assert(fabs(res[4] - 5.65306122448980) < EPS);
 }
 
+// every method with every preconditioner on the 5-point Laplacian on an
+// n x n grid (symmetric positive definite, so CG and IC apply)
+void test_solver_sparselib_methods()
+{
+    int n = 16, size = n * n;
+    CooMatrix L(size);
+    for (int y = 0; y < n; y++)
+        for (int x = 0; x < n; x++)
+        {
+            int i = x + n * y;
+            L.add(i, i, 4.);
+            if (x > 0) L.add(i, i - 1, -1.);
+            if (x + 1 < n) L.add(i, i + 1, -1.);
+            if (y > 0) L.add(i, i - n, -1.);
+            if (y + 1 < n) L.add(i, i + n, -1.);
+        }
+    CSRMatrix A(&L);
+    double *exact = new double[size];
+    double *b = new double[size];
+    double *x = new double[size];
+    // a solution without the symmetries of the grid
+    for (int i = 0; i < size; i++)
+        exact[i] = 1. + i % 3;
+    A.times_vector(exact, b, size);
+
+    // the spectrum of the Jacobi preconditioned Laplacian is 1 -+ cos(pi / (n + 1))
+    double c = cos(M_PI / (n + 1));
+    int iters_cg[4];
+    for (int m = 0; m < 8; m++)
+        for (int p = 0; p < 4; p++)
+        {
+            CommonSolverSparseLib::CommonSolverSparseLibSolver method = (CommonSolverSparseLib::CommonSolverSparseLibSolver) m;
+            CommonSolverSparseLib::CommonSolverSparseLibPreconditioner preconditioner = (CommonSolverSparseLib::CommonSolverSparseLibPreconditioner) p;
+            // the bounds are only known for the diagonal preconditioner
+            if (method == CommonSolverSparseLib::CommonSolverSparseLibSolver_Chebyshev &&
+                preconditioner != CommonSolverSparseLib::CommonSolverSparseLibPreconditioner_Diagonal)
+                continue;
+            CommonSolverSparseLib solver;
+            solver.set_method(method);
+            solver.set_preconditioner(preconditioner);
+            solver.set_tolerance(1e-10);
+            // Richardson with the diagonal is the Jacobi iteration
+            solver.set_maxiter(5000);
+            solver.set_restart(10);
+            solver.set_chebyshev_bounds(1 - c, 1 + c);
+            memcpy(x, b, size * sizeof(double));
+            _assert(solver.solve(&A, x));
+            _assert(solver.get_num_iters() > 0 && solver.get_residual() <= 1e-10);
+            for (int i = 0; i < size; i++)
+                _assert(fabs(x[i] - exact[i]) < 1e-6);
+            if (method == CommonSolverSparseLib::CommonSolverSparseLibSolver_ConjugateGradient)
+                iters_cg[p] = solver.get_num_iters();
+        }
+    // IC(0) needs fewer iterations than the diagonal
+    _assert(iters_cg[CommonSolverSparseLib::CommonSolverSparseLibPreconditioner_IncompleteCholesky] <
+            iters_cg[CommonSolverSparseLib::CommonSolverSparseLibPreconditioner_Diagonal]);
+
+    // no convergence within maxiter is not an error
+    CommonSolverSparseLib solver;
+    solver.set_method(CommonSolverSparseLib::CommonSolverSparseLibSolver_ConjugateGradient);
+    solver.set_preconditioner(CommonSolverSparseLib::CommonSolverSparseLibPreconditioner_Diagonal);
+    solver.set_maxiter(2);
+    memcpy(x, b, size * sizeof(double));
+    _assert(!solver.solve(&A, x));
+    _assert(solver.get_num_iters() == 2 && solver.get_residual() > 1e-8);
+
+    // Chebyshev without the bounds
+    bool raised = false;
+    solver.set_method(CommonSolverSparseLib::CommonSolverSparseLibSolver_Chebyshev);
+    try {
+        solver.solve(&A, x);
+    } catch (std::runtime_error &) {
+        raised = true;
+    }
+    _assert(raised);
+
+    delete[] exact;
+    delete[] b;
+    delete[] x;
+}
+
 void test_solver_superlu()
 {
     CooMatrix A(5);
@@ -423,11 +1457,21 @@ int main(int argc, char* argv[])
         // SparseLib++
         test_solver_sparselib_cgs();
         test_solver_sparselib_ir();
+        test_solver_sparselib_methods();
 
         // Hermes Common
         test_solver_dense_lu1();
         test_solver_dense_lu2();
+        test_solver_dense_lu3();
+        test_solver_dense_lu_cplx();
+        test_solver_sparse_lu1();
+        test_solver_sparse_lu2();
         test_solver_cg();
+        test_solver_pcg();
+        test_solver_gmres();
+        test_solver_bicgstab();
+        test_solver_iterative_cplx();
+        test_solver_multiple_rhs();
 
         // NumPy + SciPy
 #ifdef COMMON_WITH_SCIPY
@@ -440,6 +1484,7 @@ int main(int argc, char* argv[])
 #ifdef COMMON_WITH_UMFPACK
         test_solver_umfpack_real();
         test_solver_umfpack_imag();
+        test_solver_umfpack_refactor();
 #endif
 
         // SuperLU
@@ -35,146 +35,398 @@ void print_status(int status)
     }
 }
 
-bool CommonSolverUmfpack::solve(Matrix *mat, double *res)
+CommonSolverUmfpack::CommonSolverUmfpack()
 {
-    printf("UMFPACK solver\n");
+    this->size = 0;
+    this->nnz = 0;
+    this->complex = false;
+    this->transposed = false;
+    this->Ap = NULL;
+    this->Ai = NULL;
+    this->Ax = NULL;
+    this->Ax_cplx = NULL;
+    this->Ap_work = NULL;
+    this->Ai_work = NULL;
+    this->symbolic = NULL;
+    this->numeric = NULL;
+}
 
-    CSCMatrix *Acsc = NULL;
+CommonSolverUmfpack::~CommonSolverUmfpack()
+{
+    free_factorization();
+}
+
+void CommonSolverUmfpack::free_factorization()
+{
+    if (this->complex)
+    {
+        if (this->symbolic) umfpack_zi_free_symbolic(&this->symbolic);
+        if (this->numeric) umfpack_zi_free_numeric(&this->numeric);
+    }
+    else
+    {
+        if (this->symbolic) umfpack_di_free_symbolic(&this->symbolic);
+        if (this->numeric) umfpack_di_free_numeric(&this->numeric);
+    }
+    this->symbolic = NULL;
+    this->numeric = NULL;
+
+    delete[] this->Ap;
+    delete[] this->Ai;
+    delete[] this->Ax;
+    delete[] this->Ax_cplx;
+    delete[] this->Ap_work;
+    delete[] this->Ai_work;
+    this->Ap = NULL;
+    this->Ai = NULL;
+    this->Ax = NULL;
+    this->Ax_cplx = NULL;
+    this->Ap_work = NULL;
+    this->Ai_work = NULL;
+    this->size = 0;
+    this->nnz = 0;
+}
+
+// A CSR matrix is the CSC matrix of the transpose, its arrays are used as
+// they are and the transposed system is solved. The other formats are
+// converted to csc (deleted by the caller).
+static Matrix *umfpack_matrix(Matrix *mat, CSCMatrix *&csc, bool &transposed)
+{
+    csc = NULL;
+    transposed = false;
+    CSRMatrix *Acsr = dynamic_cast<CSRMatrix*>(mat);
 
     if (CooMatrix *mcoo = dynamic_cast<CooMatrix*>(mat))
-        Acsc = new CSCMatrix(mcoo);
+        csc = new CSCMatrix(mcoo);
     else if (CSCMatrix *mcsc = dynamic_cast<CSCMatrix*>(mat))
-        Acsc = mcsc;
-    else if (CSRMatrix *mcsr = dynamic_cast<CSRMatrix*>(mat))
-        Acsc = new CSCMatrix(mcsr);
+        return mcsc;
+    else if (BSRMatrix *mbsr = dynamic_cast<BSRMatrix*>(mat))
+        csc = new CSCMatrix(mbsr);
+    else if (SELLMatrix *msell = dynamic_cast<SELLMatrix*>(mat))
+        csc = new CSCMatrix(msell);
+    else if (CSRMatrix64 *m64 = dynamic_cast<CSRMatrix64*>(mat))
+        csc = new CSCMatrix(m64);     // narrowed to 32-bit indices
+    else if (Acsr && Acsr->is_symmetric())
+        // only the upper triangle is stored, UMFPACK needs the full matrix
+        csc = new CSCMatrix(Acsr);
+    else if (Acsr)
+    {
+        transposed = true;
+        return Acsr;
+    }
     else
-        _error("Matrix type not supported.");
+        csc = new CSCMatrix(mat);     // the typed matrices, fails for the others
+    return csc;
+}
 
-    int nnz = Acsc->get_nnz();
-    int size = Acsc->get_size();
+// The COO, BSR and SELL matrices write their CSC arrays into the given ones,
+// refactor() refills the values without a CSCMatrix. Returns false for the
+// other formats, for symmetric storage and if the number of entries is not nnz.
+static bool umfpack_refill(Matrix *mat, int nnz, int *&Ap, int *&Ai, double *Ax, cplx *Ax_cplx)
+{
+    CooMatrix *mcoo = dynamic_cast<CooMatrix*>(mat);
+    BSRMatrix *mbsr = dynamic_cast<BSRMatrix*>(mat);
+    SELLMatrix *msell = dynamic_cast<SELLMatrix*>(mat);
+    if ((mcoo == NULL && mbsr == NULL && msell == NULL) || mat->is_symmetric())
+        return false;
+    if ((mcoo ? mcoo->get_nnz() : mbsr ? mbsr->get_nnz() : msell->get_nnz()) != nnz)
+        return false;
+
+    // allocated by the first call, kept with the factorization
+    if (Ap == NULL)
+    {
+        Ap = new int[mat->get_size() + 1];
+        Ai = new int[nnz];
+    }
+    if (mcoo)
+    {
+        if (Ax_cplx) mcoo->get_csc(Ap, Ai, Ax_cplx);
+        else mcoo->get_csc(Ap, Ai, Ax);
+    }
+    else if (mbsr)
+    {
+        if (Ax_cplx) mbsr->get_csc(Ap, Ai, Ax_cplx);
+        else mbsr->get_csc(Ap, Ai, Ax);
+    }
+    else
+    {
+        if (Ax_cplx) msell->get_csc(Ap, Ai, Ax_cplx);
+        else msell->get_csc(Ap, Ai, Ax);
+    }
+    return true;
+}
 
-    // solve
-    umfpack_di_defaults(control_array);
+void CommonSolverUmfpack::factorize(Matrix *mat)
+{
+    free_factorization();
+
+    CSCMatrix *csc;
+    bool transposed;
+    Matrix *m = umfpack_matrix(mat, csc, transposed);
+    CSRMatrix *Acsr = transposed ? (CSRMatrix *) m : NULL;
+    CSCMatrix *Acsc = transposed ? NULL : (CSCMatrix *) m;
+
+    this->size = mat->get_size();
+    this->complex = mat->is_complex();
+    this->transposed = transposed;
+    this->nnz = Acsr ? Acsr->get_nnz() : Acsc->get_nnz();
+    int *Ap = Acsr ? Acsr->get_Ap() : Acsc->get_Ap();
+    int *Ai = Acsr ? Acsr->get_Ai() : Acsc->get_Ai();
+    this->Ap = new int[this->size + 1];
+    this->Ai = new int[this->nnz];
+    memcpy(this->Ap, Ap, (this->size + 1) * sizeof(int));
+    memcpy(this->Ai, Ai, this->nnz * sizeof(int));
+    if (this->complex)
+    {
+        this->Ax_cplx = new cplx[this->nnz];
+        memcpy(this->Ax_cplx, Acsr ? Acsr->get_Ax_cplx() : Acsc->get_Ax_cplx(), this->nnz * sizeof(cplx));
+    }
+    else
+    {
+        this->Ax = new double[this->nnz];
+        memcpy(this->Ax, Acsr ? Acsr->get_Ax() : Acsc->get_Ax(), this->nnz * sizeof(double));
+    }
+    delete csc;
 
     /* symbolic analysis */
-    void *symbolic, *numeric;
-    int status_symbolic = umfpack_di_symbolic(size, size,
-                                              Acsc->get_Ap(), Acsc->get_Ai(), NULL, &symbolic,
+    int status_symbolic;
+    if (this->complex)
+    {
+        umfpack_zi_defaults(control_array);
+        status_symbolic = umfpack_zi_symbolic(this->size, this->size,
+                                              this->Ap, this->Ai, NULL, NULL, &this->symbolic,
+                                              control_array, info_array);
+    }
+    else
+    {
+        umfpack_di_defaults(control_array);
+        status_symbolic = umfpack_di_symbolic(this->size, this->size,
+                                              this->Ap, this->Ai, NULL, &this->symbolic,
                                               control_array, info_array);
+    }
     print_status(status_symbolic);
 
+    numeric_factorization();
+}
+
+void CommonSolverUmfpack::refactor(Matrix *mat)
+{
+    if (this->symbolic == NULL)
+        _error("UMFPACK: refactor() without factorize().");
+    if (mat->get_size() != this->size || mat->is_complex() != this->complex)
+        _error("UMFPACK: refactor() with a different pattern, call factorize().");
+
+    // the values go straight into Ax (Ax_cplx), the pattern into the work
+    // arrays, which are kept for the next call
+    if (!this->transposed && umfpack_refill(mat, this->nnz, this->Ap_work, this->Ai_work, this->Ax, this->Ax_cplx))
+    {
+        if (!std::equal(this->Ap_work, this->Ap_work + this->size + 1, this->Ap) ||
+            !std::equal(this->Ai_work, this->Ai_work + this->nnz, this->Ai))
+            _error("UMFPACK: refactor() with a different pattern, call factorize().");
+        numeric_factorization();
+        return;
+    }
+
+    CSCMatrix *csc;
+    bool transposed;
+    Matrix *m = umfpack_matrix(mat, csc, transposed);
+    CSRMatrix *Acsr = transposed ? (CSRMatrix *) m : NULL;
+    CSCMatrix *Acsc = transposed ? NULL : (CSCMatrix *) m;
+    int nnz = Acsr ? Acsr->get_nnz() : Acsc->get_nnz();
+    int *Ap = Acsr ? Acsr->get_Ap() : Acsc->get_Ap();
+    int *Ai = Acsr ? Acsr->get_Ai() : Acsc->get_Ai();
+
+    if (transposed != this->transposed || nnz != this->nnz ||
+        !std::equal(Ap, Ap + this->size + 1, this->Ap) || !std::equal(Ai, Ai + nnz, this->Ai))
+    {
+        delete csc;
+        _error("UMFPACK: refactor() with a different pattern, call factorize().");
+    }
+
+    if (this->complex)
+        memcpy(this->Ax_cplx, Acsr ? Acsr->get_Ax_cplx() : Acsc->get_Ax_cplx(), nnz * sizeof(cplx));
+    else
+        memcpy(this->Ax, Acsr ? Acsr->get_Ax() : Acsc->get_Ax(), nnz * sizeof(double));
+    delete csc;
+
+    numeric_factorization();
+}
+
+void CommonSolverUmfpack::numeric_factorization()
+{
     /* LU factorization */
-    int status_numeric = umfpack_di_numeric(Acsc->get_Ap(), Acsc->get_Ai(), Acsc->get_Ax(), symbolic, &numeric,
+    int status_numeric;
+    if (this->complex)
+    {
+        if (this->numeric) umfpack_zi_free_numeric(&this->numeric);
+        // packed complex values (Az = NULL), cplx has the layout of double[2]
+        status_numeric = umfpack_zi_numeric(this->Ap, this->Ai, (double *) this->Ax_cplx, NULL, this->symbolic,
+                                            &this->numeric, control_array, info_array);
+    }
+    else
+    {
+        if (this->numeric) umfpack_di_free_numeric(&this->numeric);
+        status_numeric = umfpack_di_numeric(this->Ap, this->Ai, this->Ax, this->symbolic, &this->numeric,
                                             control_array, info_array);
+    }
+    if (status_numeric != UMFPACK_OK && this->numeric)
+    {
+        // a singular matrix still has a numeric object
+        if (this->complex)
+            umfpack_zi_free_numeric(&this->numeric);
+        else
+            umfpack_di_free_numeric(&this->numeric);
+        this->numeric = NULL;
+    }
     print_status(status_numeric);
+}
 
-    umfpack_di_free_symbolic(&symbolic);
-
-    double *x = new double[size];
+bool CommonSolverUmfpack::solve(double *res)
+{
+    return solve(res, 1, 0);
+}
 
-    /* solve system */
-    int status_solve = umfpack_di_solve(UMFPACK_A,
-                                        Acsc->get_Ap(), Acsc->get_Ai(), Acsc->get_Ax(), x, res, numeric,
-                                        control_array, info_array);
+bool CommonSolverUmfpack::solve(cplx *res)
+{
+    return solve(res, 1, 0);
+}
 
-    print_status(status_solve);
+bool CommonSolverUmfpack::solve(double *B, int nrhs, int ldb)
+{
+    if (this->numeric == NULL)
+        _error("UMFPACK: solve() without factorize().");
+    if (this->complex)
+        _error("UMFPACK: real right-hand side for a complex matrix.");
+    if (ldb == 0)
+        ldb = this->size;
 
-    umfpack_di_free_numeric(&numeric);
+    double *x = new double[this->size];
 
-    if (symbolic) umfpack_di_free_symbolic(&symbolic);
-    if (numeric) umfpack_di_free_numeric(&numeric);
+    /* solve system */
+    for (int k = 0; k < nrhs; k++)
+    {
+        double *res = B + (long) k * ldb;
+        int status_solve = umfpack_di_solve(this->transposed ? UMFPACK_At : UMFPACK_A,
+                                            this->Ap, this->Ai, this->Ax, x, res, this->numeric,
+                                            control_array, info_array);
+        if (status_solve != UMFPACK_OK)
+            delete[] x;
+        print_status(status_solve);
 
-    memcpy(res, x, size*sizeof(double));
+        memcpy(res, x, this->size*sizeof(double));
+    }
     delete[] x;
 
-    if (!dynamic_cast<CSCMatrix*>(mat))
-        delete Acsc;
+    return true;
 }
 
-bool CommonSolverUmfpack::solve(Matrix *mat, cplx *res)
+bool CommonSolverUmfpack::solve(cplx *B, int nrhs, int ldb)
 {
-    printf("UMFPACK solver - cplx\n");
-
-    CSCMatrix *Acsc = NULL;
-
-    if (CooMatrix *mcoo = dynamic_cast<CooMatrix*>(mat))
-        Acsc = new CSCMatrix(mcoo);
-    else if (CSCMatrix *mcsc = dynamic_cast<CSCMatrix*>(mat))
-        Acsc = mcsc;
-    else if (CSRMatrix *mcsr = dynamic_cast<CSRMatrix*>(mat))
-        Acsc = new CSCMatrix(mcsr);
-    else
-        _error("Matrix type not supported.");
+    if (this->numeric == NULL)
+        _error("UMFPACK: solve() without factorize().");
+    if (!this->complex)
+        _error("UMFPACK: complex right-hand side for a real matrix.");
+    if (ldb == 0)
+        ldb = this->size;
 
-    int nnz = Acsc->get_nnz();
-    int size = Acsc->get_size();
+    cplx *x = new cplx[this->size];
 
-    // complex components
-    double *Axr = new double[nnz];
-    double *Axi = new double[nnz];
-    cplx *Ax = Acsc->get_Ax_cplx();
-    for (int i = 0; i < nnz; i++)
+    /* solve system, UMFPACK_Aat is the transpose without complex conjugation */
+    for (int k = 0; k < nrhs; k++)
     {
-        Axr[i] = Ax[i].real();
-        Axi[i] = Ax[i].imag();
+        cplx *res = B + (long) k * ldb;
+        int status_solve = umfpack_zi_solve(this->transposed ? UMFPACK_Aat : UMFPACK_A,
+                                            this->Ap, this->Ai, (double *) this->Ax_cplx, NULL, (double *) x, NULL,
+                                            (double *) res, NULL, this->numeric, control_array, info_array);
+        if (status_solve != UMFPACK_OK)
+            delete[] x;
+        print_status(status_solve);
+
+        memcpy(res, x, this->size*sizeof(cplx));
     }
+    delete[] x;
 
-    umfpack_zi_defaults(control_array);
+    return true;
+}
 
-    /* symbolic analysis */
-    void *symbolic, *numeric;
-    int status_symbolic = umfpack_zi_symbolic(size, size,
-                                              Acsc->get_Ap(), Acsc->get_Ai(), NULL, NULL, &symbolic,
-                                              control_array, info_array);
-    print_status(status_symbolic);
+bool CommonSolverUmfpack::solve(Matrix *mat, double *res)
+{
+    return solve(mat, res, 1, 0);
+}
 
-    /* LU factorization */
-    int status_numeric = umfpack_zi_numeric(Acsc->get_Ap(), Acsc->get_Ai(), Axr, Axi, symbolic, &numeric,
-                                            control_array, info_array);
-    print_status(status_numeric);
+bool CommonSolverUmfpack::solve(Matrix *mat, cplx *res)
+{
+    return solve(mat, res, 1, 0);
+}
 
-    umfpack_zi_free_symbolic(&symbolic);
+// one factorization for all the right-hand sides
+bool CommonSolverUmfpack::solve(Matrix *mat, double *B, int nrhs, int ldb)
+{
+    printf("UMFPACK solver\n");
 
-    double *xr = new double[size];
-    double *xi = new double[size];
+    factorize(mat);
+    return solve(B, nrhs, ldb);
+}
 
-    double *resr = new double[size];
-    double *resi = new double[size];
+bool CommonSolverUmfpack::solve(Matrix *mat, cplx *B, int nrhs, int ldb)
+{
+    printf("UMFPACK solver - cplx\n");
 
-    for (int i = 0; i < size; i++)
-    {
-        resr[i] = res[i].real();
-        resi[i] = res[i].imag();
-    }
+    factorize(mat);
+    return solve(B, nrhs, ldb);
+}
 
-    /* solve system */
-    int status_solve = umfpack_zi_solve(UMFPACK_A,
-                                        Acsc->get_Ap(), Acsc->get_Ai(), Axr, Axi, xr, xi, resr, resi, numeric,
-                                        control_array, info_array);
+#else
+
+CommonSolverUmfpack::CommonSolverUmfpack()
+{
+    this->symbolic = NULL;
+    this->numeric = NULL;
+    this->Ap = NULL;
+    this->Ai = NULL;
+    this->Ax = NULL;
+    this->Ax_cplx = NULL;
+    this->Ap_work = NULL;
+    this->Ai_work = NULL;
+}
 
-    print_status(status_solve);
+CommonSolverUmfpack::~CommonSolverUmfpack()
+{
+}
 
-    umfpack_zi_free_numeric(&numeric);
+void CommonSolverUmfpack::factorize(Matrix *mat)
+{
+    _error("CommonSolverUmfpack::factorize(Matrix *mat) not implemented.");
+}
 
-    delete[] resr;
-    delete[] resi;
-    delete[] Axr;
-    delete[] Axi;
+void CommonSolverUmfpack::refactor(Matrix *mat)
+{
+    _error("CommonSolverUmfpack::refactor(Matrix *mat) not implemented.");
+}
 
-    if (symbolic) umfpack_di_free_symbolic(&symbolic);
-    if (numeric) umfpack_di_free_numeric(&numeric);
+void CommonSolverUmfpack::free_factorization()
+{
+}
 
-    for (int i = 0; i < Acsc->get_size(); i++)
-        res[i] = cplx(xr[i], xi[i]);
+bool CommonSolverUmfpack::solve(double *res)
+{
+    _error("CommonSolverUmfpack::solve(double *res) not implemented.");
+}
 
-    delete[] xr;
-    delete[] xi;
+bool CommonSolverUmfpack::solve(cplx *res)
+{
+    _error("CommonSolverUmfpack::solve(cplx *res) not implemented.");
+}
 
-    if (!dynamic_cast<CSCMatrix*>(mat))
-        delete Acsc;
+bool CommonSolverUmfpack::solve(double *B, int nrhs, int ldb)
+{
+    _error("CommonSolverUmfpack::solve(double *B, int nrhs, int ldb) not implemented.");
 }
 
-#else
+bool CommonSolverUmfpack::solve(cplx *B, int nrhs, int ldb)
+{
+    _error("CommonSolverUmfpack::solve(cplx *B, int nrhs, int ldb) not implemented.");
+}
 
 bool CommonSolverUmfpack::solve(Matrix *mat, double *res)
 {
@@ -185,4 +437,14 @@ bool CommonSolverUmfpack::solve(Matrix *mat, cplx *res)
 {
     _error("CommonSolverUmfpack::solve(Matrix *mat, cplx *res) not implemented.");
 }
+
+bool CommonSolverUmfpack::solve(Matrix *mat, double *B, int nrhs, int ldb)
+{
+    _error("CommonSolverUmfpack::solve(Matrix *mat, double *B, int nrhs, int ldb) not implemented.");
+}
+
+bool CommonSolverUmfpack::solve(Matrix *mat, cplx *B, int nrhs, int ldb)
+{
+    _error("CommonSolverUmfpack::solve(Matrix *mat, cplx *B, int nrhs, int ldb) not implemented.");
+}
 #endif